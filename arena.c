@@ -0,0 +1,160 @@
+/**********************************************************************
+ * Arena allocator
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Block management for the arena allocator. The allocation fast path
+ * lives in arena.h.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+/*
+ * Blocks are aligned to ARENA_ALIGNMENT, and so is their data since the
+ * header is padded to it; posix_memalign needs at least a pointer's.
+ */
+#define BLOCK_ALIGNMENT                                                 \
+    (ARENA_ALIGNMENT > sizeof(void *) ? ARENA_ALIGNMENT : sizeof(void *))
+
+static inline char *block_data(struct arena_block *b)
+{
+    return (char *)(b + 1);
+}
+
+void arena_init(struct arena *a, size_t block_size)
+{
+    if (block_size == 0) {
+        block_size = ARENA_DEFAULT_BLOCK;
+    }
+
+    a->ptr = NULL;
+    a->end = NULL;
+    a->head = NULL;
+    a->free = NULL;
+    a->block_size = block_size;
+}
+
+static void free_chain(struct arena_block *b)
+{
+    struct arena_block *prev;
+
+    while (b) {
+        prev = b->prev;
+        free(b);
+        b = prev;
+    }
+}
+
+void arena_destroy(struct arena *a)
+{
+    free_chain(a->head);
+    free_chain(a->free);
+    arena_init(a, a->block_size);
+}
+
+/*
+ * Regular sized blocks go to the free list. Oversized blocks were
+ * allocated for a single large request and are unlikely to be reused,
+ * so they go back to malloc.
+ */
+static void release_block(struct arena *a, struct arena_block *b)
+{
+    if (b->size == a->block_size) {
+        b->prev = a->free;
+        a->free = b;
+    } else {
+        free(b);
+    }
+}
+
+static void set_current(struct arena *a, struct arena_block *b, char *ptr)
+{
+    a->head = b;
+    if (b) {
+        a->ptr = ptr;
+        a->end = block_data(b) + b->size;
+    } else {
+        a->ptr = NULL;
+        a->end = NULL;
+    }
+}
+
+void arena_rewind(struct arena *a, struct arena_mark mark)
+{
+    struct arena_block *b = a->head;
+    struct arena_block *prev;
+
+    while (b != mark.block) {
+        prev = b->prev;
+        release_block(a, b);
+        b = prev;
+    }
+
+    set_current(a, b, mark.ptr);
+}
+
+void arena_reset(struct arena *a)
+{
+    struct arena_mark empty = { NULL, NULL };
+
+    arena_rewind(a, empty);
+}
+
+void *arena_alloc_slow(struct arena *a, size_t size, size_t align)
+{
+    struct arena_block *b;
+    void *mem;
+    uintptr_t p;
+    size_t need;
+
+    /* Worst case padding, the block data is only ARENA_ALIGNMENT aligned */
+    need = size + (align > ARENA_ALIGNMENT ? align - ARENA_ALIGNMENT : 0);
+    if (need < size) {
+        return NULL;
+    }
+
+    if (need <= a->block_size && a->free) {
+        b = a->free;
+        a->free = b->prev;
+    } else {
+        size_t bsize = need > a->block_size ? need : a->block_size;
+
+        if (bsize > SIZE_MAX - sizeof(*b)) {
+            return NULL;
+        }
+
+        if (posix_memalign(&mem, BLOCK_ALIGNMENT, sizeof(*b) + bsize)) {
+            return NULL;
+        }
+        b = mem;
+        b->size = bsize;
+    }
+
+    b->prev = a->head;
+    p = ((uintptr_t)block_data(b) + (align - 1)) & ~(uintptr_t)(align - 1);
+    set_current(a, b, (char *)(p + size));
+    return (void *)p;
+}
+
+void *arena_zalloc(struct arena *a, size_t size)
+{
+    void *p = arena_alloc(a, size);
+
+    if (p) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t len)
+{
+    char *p = arena_alloc_aligned(a, len + 1, 1);
+
+    if (p) {
+        memcpy(p, s, len);
+        p[len] = '\0';
+    }
+    return p;
+}
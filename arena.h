@@ -0,0 +1,125 @@
+/**********************************************************************
+ * Arena allocator
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * A bump pointer allocator for memory that shares a common lifetime,
+ * such as everything allocated while handling a single request.
+ * Allocation is a pointer increment within the current block; when the
+ * block is exhausted, a new one is chained in front of it. Individual
+ * allocations are never freed. Instead, the caller either rewinds the
+ * arena to a previously saved mark, or resets it entirely.
+ *
+ * Blocks released by a rewind or reset are kept on a free list and
+ * reused, so an arena that is reset at the end of every request stops
+ * calling malloc once it has grown to its working size. Call
+ * arena_destroy to give the memory back.
+ *
+ * Usage:
+ *      struct arena a;
+ *      arena_init(&a, 0);
+ *      p = arena_alloc(&a, len);
+ *      ...
+ *      arena_reset(&a);
+ *      ...
+ *      arena_destroy(&a);
+ *********************************************************************/
+
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cdecl.h"
+#include "compiler.h"
+
+__CDECL_BEGIN
+
+/* Alignment of memory returned by arena_alloc */
+#ifndef ARENA_ALIGNMENT
+#define ARENA_ALIGNMENT         16
+#endif
+
+/* Block size used when arena_init is passed 0 */
+#define ARENA_DEFAULT_BLOCK     (64 * 1024)
+
+struct arena_block {
+    struct arena_block *prev;
+    size_t size;                /* Usable bytes following the header */
+} __ALIGNED(ARENA_ALIGNMENT);
+
+struct arena {
+    char *ptr;                  /* Next free byte in the current block */
+    char *end;                  /* End of the current block */
+    struct arena_block *head;   /* Current block, chained to older ones */
+    struct arena_block *free;   /* Released blocks, kept for reuse */
+    size_t block_size;          /* Usable size of a regular block */
+};
+
+/* Position in an arena, as returned by arena_save */
+struct arena_mark {
+    struct arena_block *block;
+    char *ptr;
+};
+
+/* Initialize an arena. A block_size of 0 selects ARENA_DEFAULT_BLOCK */
+void arena_init(struct arena *a, size_t block_size);
+
+/* Release all memory held by the arena, including cached blocks */
+void arena_destroy(struct arena *a);
+
+/* Release every allocation, keeping the blocks for reuse */
+void arena_reset(struct arena *a);
+
+/* Release every allocation made since the mark was saved */
+void arena_rewind(struct arena *a, struct arena_mark mark);
+
+/* Out of line path, used when the current block cannot satisfy a request */
+void *arena_alloc_slow(struct arena *a, size_t size, size_t align);
+
+static inline struct arena_mark arena_save(const struct arena *a)
+{
+    struct arena_mark mark;
+
+    mark.block = a->head;
+    mark.ptr = a->ptr;
+    return mark;
+}
+
+/*
+ * Allocate size bytes aligned to align, which must be a power of 2.
+ * Returns NULL if the underlying malloc fails.
+ */
+static inline void *arena_alloc_aligned(struct arena *a, size_t size,
+                                        size_t align)
+{
+    uintptr_t cur = (uintptr_t)a->ptr;
+    size_t avail = (size_t)((uintptr_t)a->end - cur);
+    size_t pad = (size_t)(-cur & (align - 1));
+
+    /*
+     * An exact fit takes the slow path, which keeps an empty arena
+     * (ptr == end == NULL) correct without an extra test.
+     */
+    if (__LIKELY(size < avail && pad < avail - size)) {
+        a->ptr = (char *)(cur + pad + size);
+        return (void *)(cur + pad);
+    }
+
+    return arena_alloc_slow(a, size, align);
+}
+
+static inline void *arena_alloc(struct arena *a, size_t size)
+{
+    return arena_alloc_aligned(a, size, ARENA_ALIGNMENT);
+}
+
+/* Allocate zero filled memory */
+void *arena_zalloc(struct arena *a, size_t size);
+
+/* Copy len bytes of s into the arena, with a terminating NUL */
+char *arena_strndup(struct arena *a, const char *s, size_t len);
+
+__CDECL_END
+
+#endif /* !defined __ARENA_H */
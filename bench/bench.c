@@ -0,0 +1,401 @@
+/**********************************************************************
+ * Microbenchmark harness
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Timing uses the TSC on x86 CPUs where it is invariant, converted to
+ * nanoseconds with a rate measured against CLOCK_MONOTONIC at startup,
+ * and clock_gettime everywhere else. The process is pinned to a single
+ * CPU (by default the one it starts on) so that migrations do not show
+ * up in the results.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+struct bench {
+    const char *group;
+    const char *name;
+    bench_fn fn;
+};
+
+static struct bench *benches;
+static size_t nbenches;
+static size_t bench_alloc;
+
+/* Set by bench_set_bytes while a benchmark runs */
+static uint64_t cur_bytes;
+
+/* Options */
+static unsigned int opt_samples = 31;
+static double opt_batch_ns = 2e6;
+static double opt_warmup_ns = 50e6;
+static const char *opt_filter;
+static int opt_cpu = -2;            /* -2: current CPU, -1: don't pin */
+static int opt_use_tsc = 1;
+
+void bench_register(const char *group, const char *name, bench_fn fn)
+{
+    if (nbenches == bench_alloc) {
+        size_t n = bench_alloc ? bench_alloc * 2 : 64;
+        struct bench *b = realloc(benches, n * sizeof(*b));
+
+        if (b == NULL) {
+            fprintf(stderr, "bench: out of memory registering %s/%s\n",
+                    group, name);
+            return;
+        }
+        benches = b;
+        bench_alloc = n;
+    }
+
+    benches[nbenches].group = group;
+    benches[nbenches].name = name;
+    benches[nbenches].fn = fn;
+    nbenches++;
+}
+
+void bench_set_bytes(uint64_t bytes)
+{
+    cur_bytes = bytes;
+}
+
+/**********************************************************************
+ * Clocks
+ *********************************************************************/
+static double tsc_per_ns;
+
+static inline uint64_t mono_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+#ifdef HAVE_TSC
+static inline uint64_t tsc_now(void)
+{
+    unsigned int aux;
+
+    /* rdtscp waits for earlier instructions to complete */
+    return __rdtscp(&aux);
+}
+
+static int tsc_invariant(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (__get_cpuid_max(0x80000000, NULL) < 0x80000007) {
+        return 0;
+    }
+    __cpuid(0x80000007, eax, ebx, ecx, edx);
+    return (edx & (1U << 8)) != 0;
+}
+
+static void tsc_calibrate(void)
+{
+    uint64_t t0, t1, c0, c1;
+
+    t0 = mono_ns();
+    c0 = tsc_now();
+    do {
+        t1 = mono_ns();
+    } while (t1 - t0 < 20000000);
+    c1 = tsc_now();
+
+    tsc_per_ns = (double)(c1 - c0) / (double)(t1 - t0);
+}
+#endif
+
+/* Current time in nanoseconds, from the selected clock */
+static inline double now_ns(void)
+{
+#ifdef HAVE_TSC
+    if (opt_use_tsc) {
+        return (double)tsc_now() / tsc_per_ns;
+    }
+#endif
+    return (double)mono_ns();
+}
+
+static void clock_init(void)
+{
+#ifdef HAVE_TSC
+    if (opt_use_tsc && tsc_invariant()) {
+        tsc_calibrate();
+        return;
+    }
+#endif
+    opt_use_tsc = 0;
+}
+
+/**********************************************************************
+ * Running
+ *********************************************************************/
+#ifdef __linux__
+static cpu_set_t start_cpus;        /* Affinity before pinning */
+static cpu_set_t pinned_cpus;       /* Affinity while benchmarks run */
+static int pinned;
+#endif
+
+static void pin_cpu(void)
+{
+#ifdef __linux__
+    int cpu = opt_cpu;
+
+    if (cpu == -1) {
+        return;
+    }
+    if (cpu == -2) {
+        cpu = sched_getcpu();
+        if (cpu < 0) {
+            return;
+        }
+    }
+
+    if (sched_getaffinity(0, sizeof(start_cpus), &start_cpus)) {
+        return;
+    }
+    CPU_ZERO(&pinned_cpus);
+    CPU_SET(cpu, &pinned_cpus);
+    if (sched_setaffinity(0, sizeof(pinned_cpus), &pinned_cpus)) {
+        fprintf(stderr, "bench: cannot pin to CPU %d: %s\n", cpu,
+                strerror(errno));
+        return;
+    }
+    pinned = 1;
+#endif
+}
+
+void bench_unpin(void)
+{
+#ifdef __linux__
+    if (pinned) {
+        sched_setaffinity(0, sizeof(start_cpus), &start_cpus);
+    }
+#endif
+}
+
+void bench_repin(void)
+{
+#ifdef __linux__
+    if (pinned) {
+        sched_setaffinity(0, sizeof(pinned_cpus), &pinned_cpus);
+    }
+#endif
+}
+
+static double time_batch(bench_fn fn, uint64_t iters)
+{
+    double start = now_ns();
+
+    fn(iters);
+    return now_ns() - start;
+}
+
+/*
+ * Grow the batch until it takes at least the target time, scaling by the
+ * measured rate but never by more than 10x at once. This also serves as
+ * the first part of the warm up.
+ */
+static uint64_t calibrate(bench_fn fn)
+{
+    uint64_t iters = 1;
+    double elapsed;
+    double scale;
+
+    /* The first call may include one time setup, don't time it */
+    fn(1);
+
+    for (;;) {
+        elapsed = time_batch(fn, iters);
+        if (elapsed >= opt_batch_ns || iters >= (1ULL << 40)) {
+            return iters;
+        }
+
+        scale = elapsed > 0 ? opt_batch_ns * 1.2 / elapsed : 10;
+        if (scale > 10) {
+            scale = 10;
+        }
+        if (scale < 2) {
+            scale = 2;
+        }
+        iters = (uint64_t)((double)iters * scale);
+    }
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static const char *format_ns(double ns, char *buf, size_t len)
+{
+    if (ns < 1e3) {
+        snprintf(buf, len, "%.2f ns", ns);
+    } else if (ns < 1e6) {
+        snprintf(buf, len, "%.2f us", ns / 1e3);
+    } else {
+        snprintf(buf, len, "%.2f ms", ns / 1e6);
+    }
+    return buf;
+}
+
+static void run_one(const struct bench *b, double *samples)
+{
+    char name[128];
+    char med[32], p99[32], min[32];
+    uint64_t iters;
+    double warm_start;
+    unsigned int i;
+    double median;
+
+    cur_bytes = 0;
+    iters = calibrate(b->fn);
+
+    warm_start = now_ns();
+    while (now_ns() - warm_start < opt_warmup_ns) {
+        time_batch(b->fn, iters);
+    }
+
+    for (i = 0; i < opt_samples; i++) {
+        samples[i] = time_batch(b->fn, iters) / (double)iters;
+    }
+    qsort(samples, opt_samples, sizeof(samples[0]), cmp_double);
+
+    median = samples[opt_samples / 2];
+    snprintf(name, sizeof(name), "%s/%s", b->group, b->name);
+    printf("%-36s %12llu %12s %12s %12s", name, (unsigned long long)iters,
+           format_ns(median, med, sizeof(med)),
+           format_ns(samples[(opt_samples * 99 + 99) / 100 - 1], p99,
+                     sizeof(p99)),
+           format_ns(samples[0], min, sizeof(min)));
+    if (cur_bytes) {
+        printf(" %9.2f GB/s", (double)cur_bytes / median);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static int cmp_bench(const void *a, const void *b)
+{
+    const struct bench *x = a;
+    const struct bench *y = b;
+    int rc = strcmp(x->group, y->group);
+
+    return rc ? rc : strcmp(x->name, y->name);
+}
+
+static int selected(const struct bench *b)
+{
+    char name[128];
+
+    if (opt_filter == NULL) {
+        return 1;
+    }
+    snprintf(name, sizeof(name), "%s/%s", b->group, b->name);
+    return strstr(name, opt_filter) != NULL;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] [filter]\n"
+            "  -l        List benchmarks and exit\n"
+            "  -n N      Number of timed batches (default %u)\n"
+            "  -t MS     Target batch time in milliseconds (default %g)\n"
+            "  -w MS     Warm up time in milliseconds (default %g)\n"
+            "  -c CPU    Pin to CPU, or -1 to not pin (default: current)\n"
+            "  -m        Time with CLOCK_MONOTONIC instead of the TSC\n"
+            "Only benchmarks whose group/name contains filter are run.\n",
+            prog, opt_samples, opt_batch_ns / 1e6, opt_warmup_ns / 1e6);
+}
+
+int bench_main(int argc, char **argv)
+{
+    double *samples;
+    int list = 0;
+    size_t i;
+    int c;
+
+    while ((c = getopt(argc, argv, "ln:t:w:c:mh")) != -1) {
+        switch (c) {
+        case 'l':
+            list = 1;
+            break;
+        case 'n':
+            opt_samples = (unsigned int)strtoul(optarg, NULL, 0);
+            if (opt_samples == 0) {
+                opt_samples = 1;
+            }
+            break;
+        case 't':
+            opt_batch_ns = strtod(optarg, NULL) * 1e6;
+            break;
+        case 'w':
+            opt_warmup_ns = strtod(optarg, NULL) * 1e6;
+            break;
+        case 'c':
+            opt_cpu = atoi(optarg);
+            break;
+        case 'm':
+            opt_use_tsc = 0;
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (optind < argc) {
+        opt_filter = argv[optind];
+    }
+
+    qsort(benches, nbenches, sizeof(benches[0]), cmp_bench);
+
+    if (list) {
+        for (i = 0; i < nbenches; i++) {
+            if (selected(&benches[i])) {
+                printf("%s/%s\n", benches[i].group, benches[i].name);
+            }
+        }
+        return 0;
+    }
+
+    samples = malloc(opt_samples * sizeof(*samples));
+    if (samples == NULL) {
+        perror("bench");
+        return 1;
+    }
+
+    pin_cpu();
+    clock_init();
+
+    printf("%-36s %12s %12s %12s %12s\n", "benchmark", "iters", "median",
+           "p99", "min");
+    for (i = 0; i < nbenches; i++) {
+        if (selected(&benches[i])) {
+            run_one(&benches[i], samples);
+        }
+    }
+
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,79 @@
+/**********************************************************************
+ * Microbenchmark harness
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * A benchmark is a function that runs the operation under test a given
+ * number of times. The harness warms it up, calibrates the iteration
+ * count so that a batch runs for long enough to time accurately, and
+ * then times a series of batches, reporting the median, 99th
+ * percentile and minimum time per iteration.
+ *
+ * Benchmarks register themselves with the BENCH macro, so a new
+ * benchmark only needs its source file added to the build. Results
+ * that are otherwise unused must be passed to BENCH_DONT_OPTIMIZE so
+ * the compiler cannot discard the work.
+ *
+ * Usage:
+ *      BENCH(strsearch, memchr)
+ *      {
+ *          uint64_t i;
+ *
+ *          bench_set_bytes(sizeof(buf));
+ *          for (i = 0; i < iters; i++) {
+ *              BENCH_DONT_OPTIMIZE(memchr(buf, '\n', sizeof(buf)));
+ *          }
+ *      }
+ *********************************************************************/
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stdint.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+typedef void (*bench_fn)(uint64_t iters);
+
+/* Add a benchmark. Normally called through BENCH */
+void bench_register(const char *group, const char *name, bench_fn fn);
+
+/* Bytes processed per iteration, to report throughput */
+void bench_set_bytes(uint64_t bytes);
+
+/*
+ * Threads inherit the harness's pinning to one CPU. Benchmarks that
+ * start threads of their own call bench_unpin before creating them,
+ * so they can run on any CPU, and bench_repin afterwards.
+ */
+void bench_unpin(void);
+void bench_repin(void);
+
+/* Parse the command line and run the registered benchmarks */
+int bench_main(int argc, char **argv);
+
+/* Define and register a benchmark; iters is the iteration count */
+#define BENCH(group, name)                                                  \
+    static void bench_##group##_##name(uint64_t iters);                     \
+    static void bench_reg_##group##_##name(void)                            \
+        __attribute__((constructor));                                       \
+    static void bench_reg_##group##_##name(void)                            \
+    {                                                                       \
+        bench_register(#group, #name, bench_##group##_##name);              \
+    }                                                                       \
+    static void bench_##group##_##name(uint64_t iters)
+
+/* Force the value of x to be computed */
+#define BENCH_DONT_OPTIMIZE(x)                                              \
+    do {                                                                    \
+        __typeof__(x) __bench_v = (x);                                      \
+        __asm__ __volatile__("" : : "g"(__bench_v) : "memory");             \
+    } while (0)
+
+/* Force pending memory writes to be treated as observable */
+#define BENCH_CLOBBER()     __asm__ __volatile__("" : : : "memory")
+
+__CDECL_END
+
+#endif /* !defined __BENCH_H */
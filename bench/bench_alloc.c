@@ -0,0 +1,78 @@
+/**********************************************************************
+ * Allocator benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Each iteration allocates a batch of small objects and then releases
+ * them all, the way request scoped code does: arena and pool against
+ * malloc/free.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include "arena.h"
+#include "bench.h"
+#include "pool.h"
+
+#define BATCH       64
+#define OBJ_SIZE    64
+
+BENCH(alloc, arena_batch)
+{
+    static struct arena a;
+    static int init;
+    uint64_t i;
+    int j;
+
+    if (!init) {
+        arena_init(&a, 0);
+        init = 1;
+    }
+
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < BATCH; j++) {
+            BENCH_DONT_OPTIMIZE(arena_alloc(&a, OBJ_SIZE));
+        }
+        arena_reset(&a);
+    }
+}
+
+BENCH(alloc, pool_batch)
+{
+    static struct pool p;
+    static int init;
+    void *objs[BATCH];
+    uint64_t i;
+    int j;
+
+    if (!init) {
+        pool_init(&p, OBJ_SIZE, 0);
+        init = 1;
+    }
+
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < BATCH; j++) {
+            objs[j] = pool_alloc(&p);
+        }
+        BENCH_CLOBBER();
+        for (j = 0; j < BATCH; j++) {
+            pool_free(&p, objs[j]);
+        }
+    }
+}
+
+BENCH(alloc, malloc_batch)
+{
+    void *objs[BATCH];
+    uint64_t i;
+    int j;
+
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < BATCH; j++) {
+            objs[j] = malloc(OBJ_SIZE);
+        }
+        BENCH_CLOBBER();
+        for (j = 0; j < BATCH; j++) {
+            free(objs[j]);
+        }
+    }
+}
@@ -0,0 +1,167 @@
+/**********************************************************************
+ * Bitset benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Two 1 Mbit bitsets, one with 1 bit in 64 set and one with half the
+ * bits set. Counting and iteration are compared with testing one bit at
+ * a time, which is what the word and vector loops replace.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include "bench.h"
+#include "bitset.h"
+
+#define NBITS   (1024 * 1024)
+
+static struct bitset sparse;
+static struct bitset dense;
+
+static void setup(void)
+{
+    size_t i;
+
+    if (sparse.words) {
+        return;
+    }
+    bitset_init(&sparse, NBITS);
+    bitset_init(&dense, NBITS);
+    srand(1);
+    for (i = 0; i < NBITS; i++) {
+        if (rand() % 64 == 0) {
+            bitset_set(&sparse, i);
+        }
+        if (rand() % 2 == 0) {
+            bitset_set(&dense, i);
+        }
+    }
+}
+
+BENCH(bitset, count)
+{
+    uint64_t i;
+
+    setup();
+    bench_set_bytes(NBITS / 8);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(bitset_count(&dense));
+    }
+}
+
+BENCH(bitset, count_bitwise)
+{
+    uint64_t i;
+    size_t j, n;
+
+    setup();
+    bench_set_bytes(NBITS / 8);
+    for (i = 0; i < iters; i++) {
+        n = 0;
+        for (j = 0; j < NBITS; j++) {
+            n += (size_t)bitset_test(&dense, j);
+        }
+        BENCH_DONT_OPTIMIZE(n);
+    }
+}
+
+BENCH(bitset, and_count)
+{
+    uint64_t i;
+
+    setup();
+    bench_set_bytes(NBITS / 8);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(bitset_and_count(&dense, &sparse));
+    }
+}
+
+BENCH(bitset, or)
+{
+    static struct bitset dst;
+    uint64_t i;
+
+    setup();
+    if (dst.words == NULL) {
+        bitset_init(&dst, NBITS);
+    }
+    bench_set_bytes(NBITS / 8);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(bitset_or(&dst, &sparse));
+    }
+}
+
+BENCH(bitset, iterate_sparse)
+{
+    struct bitset_iter it;
+    uint64_t i;
+    size_t n;
+
+    setup();
+    bench_set_bytes(NBITS / 8);
+    for (i = 0; i < iters; i++) {
+        n = 0;
+        bitset_iter_init(&it, &sparse);
+        while (bitset_iter_next(&it) >= 0) {
+            n++;
+        }
+        BENCH_DONT_OPTIMIZE(n);
+    }
+}
+
+BENCH(bitset, iterate_sparse_next)
+{
+    uint64_t i;
+    ssize_t j;
+    size_t n;
+
+    setup();
+    bench_set_bytes(NBITS / 8);
+    for (i = 0; i < iters; i++) {
+        n = 0;
+        for (j = bitset_next_set(&sparse, 0); j >= 0;
+             j = bitset_next_set(&sparse, (size_t)j + 1)) {
+            n++;
+        }
+        BENCH_DONT_OPTIMIZE(n);
+    }
+}
+
+BENCH(bitset, iterate_sparse_bitwise)
+{
+    uint64_t i;
+    size_t j, n;
+
+    setup();
+    bench_set_bytes(NBITS / 8);
+    for (i = 0; i < iters; i++) {
+        n = 0;
+        for (j = 0; j < NBITS; j++) {
+            if (bitset_test(&sparse, j)) {
+                n++;
+            }
+        }
+        BENCH_DONT_OPTIMIZE(n);
+    }
+}
+
+BENCH(bitset, rank)
+{
+    uint64_t i;
+
+    setup();
+    bitset_rank(&dense, 0);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(bitset_rank(&dense, (i * 40503) % NBITS));
+    }
+}
+
+BENCH(bitset, select)
+{
+    uint64_t i;
+
+    setup();
+    bitset_select(&dense, 0);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(bitset_select(&dense, (i * 40503) % (NBITS / 2)));
+    }
+}
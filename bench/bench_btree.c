@@ -0,0 +1,117 @@
+/**********************************************************************
+ * B+tree benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Lookups of random keys in four million, in the B+tree and by binary
+ * search of the sorted keys, which is as compact as an index gets but
+ * takes a cache miss on almost every one of its 22 steps. A random key
+ * is also erased and put back, and a short range read from a random
+ * point. The load benchmark builds a tree of 64k keys from scratch.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include "bench.h"
+#include "btree.h"
+
+#define NKEYS   (4 * 1024 * 1024)
+#define NLOAD   65536
+#define NRANGE  100
+
+static struct btree tree;
+static uint64_t *keys;
+
+static void setup(void)
+{
+    uint64_t i;
+
+    if (keys) {
+        return;
+    }
+    keys = malloc(NKEYS * sizeof(*keys));
+    for (i = 0; i < NKEYS; i++) {
+        keys[i] = i * 2;
+    }
+    btree_init(&tree);
+    btree_load(&tree, keys, keys, NKEYS);
+}
+
+/* A random present key */
+static uint64_t key(uint64_t i)
+{
+    return keys[i * 2654435761u % NKEYS];
+}
+
+BENCH(btree, find_4m)
+{
+    uint64_t i;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(btree_find(&tree, key(i)));
+    }
+}
+
+BENCH(btree, bsearch_4m)
+{
+    uint64_t i, k;
+    size_t lo, hi, mid;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        k = key(i);
+        lo = 0;
+        hi = NKEYS;
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (keys[mid] < k) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        BENCH_DONT_OPTIMIZE(lo);
+    }
+}
+
+BENCH(btree, erase_put_4m)
+{
+    uint64_t i, k;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        k = key(i);
+        btree_erase(&tree, k);
+        btree_put(&tree, k, k);
+    }
+}
+
+BENCH(btree, range_100)
+{
+    struct btree_iter it;
+    uint64_t i, k, v, sum = 0;
+    unsigned int n;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        btree_seek(&tree, key(i), &it);
+        for (n = 0; n < NRANGE && btree_next(&it, &k, &v); n++) {
+            sum += v;
+        }
+    }
+    BENCH_DONT_OPTIMIZE(sum);
+}
+
+BENCH(btree, load_64k)
+{
+    struct btree t;
+    uint64_t i;
+
+    setup();
+    bench_set_bytes(NLOAD * 2 * sizeof(uint64_t));
+    btree_init(&t);
+    for (i = 0; i < iters; i++) {
+        btree_load(&t, keys, keys, NLOAD);
+    }
+    btree_destroy(&t);
+}
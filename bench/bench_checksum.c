@@ -0,0 +1,110 @@
+/**********************************************************************
+ * Checksum benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * CRC-32C and Adler-32 over records of several sizes, against the byte
+ * at a time table driven CRC-32C that hardware CRCs usually replace.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include "bench.h"
+#include "checksum.h"
+
+#define DATA_SIZE   (64 * 1024)
+
+static unsigned char *data;
+static uint32_t table[256];
+
+static void setup(void)
+{
+    uint32_t c;
+    size_t i;
+    int k;
+
+    if (data) {
+        return;
+    }
+    data = malloc(DATA_SIZE);
+    srand(1);
+    for (i = 0; i < DATA_SIZE; i++) {
+        data[i] = (unsigned char)rand();
+    }
+    for (i = 0; i < 256; i++) {
+        c = (uint32_t)i;
+        for (k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ 0x82f63b78U : c >> 1;
+        }
+        table[i] = c;
+    }
+}
+
+static uint32_t crc32c_table(uint32_t crc, const unsigned char *p,
+                             size_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc = (crc >> 8) ^ table[(crc ^ *p++) & 0xff];
+    }
+    return ~crc;
+}
+
+#define CHECKSUM_BENCH(len)                                         \
+    BENCH(checksum, crc32c_##len)                                   \
+    {                                                               \
+        uint64_t i;                                                 \
+                                                                    \
+        setup();                                                    \
+        bench_set_bytes(len);                                       \
+        for (i = 0; i < iters; i++) {                               \
+            BENCH_DONT_OPTIMIZE(checksum_crc32c(0, data, len));     \
+        }                                                           \
+    }                                                               \
+                                                                    \
+    BENCH(checksum, crc32c_table_##len)                             \
+    {                                                               \
+        uint64_t i;                                                 \
+                                                                    \
+        setup();                                                    \
+        bench_set_bytes(len);                                       \
+        for (i = 0; i < iters; i++) {                               \
+            BENCH_DONT_OPTIMIZE(crc32c_table(0, data, len));        \
+        }                                                           \
+    }                                                               \
+                                                                    \
+    BENCH(checksum, adler32_##len)                                  \
+    {                                                               \
+        uint64_t i;                                                 \
+                                                                    \
+        setup();                                                    \
+        bench_set_bytes(len);                                       \
+        for (i = 0; i < iters; i++) {                               \
+            BENCH_DONT_OPTIMIZE(checksum_adler32(1, data, len));    \
+        }                                                           \
+    }
+
+CHECKSUM_BENCH(64)
+CHECKSUM_BENCH(512)
+CHECKSUM_BENCH(4096)
+CHECKSUM_BENCH(65536)
+
+/* Four 16 KiB pieces checksummed separately, then combined */
+BENCH(checksum, crc32c_combine_65536)
+{
+    uint32_t crc[4];
+    uint64_t i;
+    int j;
+
+    setup();
+    bench_set_bytes(DATA_SIZE);
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < 4; j++) {
+            crc[j] = checksum_crc32c(0, data + j * (DATA_SIZE / 4),
+                                     DATA_SIZE / 4);
+        }
+        for (j = 1; j < 4; j++) {
+            crc[0] = checksum_crc32c_combine(crc[0], crc[j], DATA_SIZE / 4);
+        }
+        BENCH_DONT_OPTIMIZE(crc[0]);
+    }
+}
@@ -0,0 +1,131 @@
+/**********************************************************************
+ * Event loop benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Dispatch is measured with 1000 idle socket pairs registered and one
+ * of them made readable per iteration, against poll() over the same
+ * descriptors, whose cost grows with the number watched. Timers are
+ * started and stopped with 100000 others pending.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "bench.h"
+#include "eventloop.h"
+
+#define NSOCKS  1000
+#define NTIMERS 100000
+
+static struct eventloop *loop;
+static int socks[NSOCKS][2];
+
+static void on_read(struct eventloop *l, int fd, uint32_t events, void *arg)
+{
+    char buf[64];
+
+    (void)l;
+    (void)events;
+    (void)arg;
+    while (read(fd, buf, sizeof(buf)) > 0) {
+    }
+}
+
+static void setup(void)
+{
+    int i;
+
+    if (loop) {
+        return;
+    }
+    loop = eventloop_create();
+    for (i = 0; i < NSOCKS; i++) {
+        socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, socks[i]);
+        eventloop_add(loop, socks[i][0], EVENTLOOP_READ, on_read, NULL);
+    }
+}
+
+BENCH(eventloop, dispatch_1000)
+{
+    uint64_t i;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(write(socks[i % NSOCKS][1], "x", 1));
+        eventloop_run_once(loop, 0);
+    }
+}
+
+BENCH(eventloop, poll_1000)
+{
+    static struct pollfd fds[NSOCKS];
+    uint64_t i;
+    int j, n;
+
+    setup();
+    for (j = 0; j < NSOCKS; j++) {
+        fds[j].fd = socks[j][0];
+        fds[j].events = POLLIN;
+    }
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(write(socks[i % NSOCKS][1], "x", 1));
+        n = poll(fds, NSOCKS, 0);
+        for (j = 0; j < NSOCKS && n > 0; j++) {
+            if (fds[j].revents & POLLIN) {
+                on_read(NULL, fds[j].fd, EVENTLOOP_READ, NULL);
+                n--;
+            }
+        }
+    }
+}
+
+static void nop(struct eventloop *l, void *arg)
+{
+    (void)l;
+    (void)arg;
+}
+
+BENCH(eventloop, timer_start_stop)
+{
+    static struct eventloop_timer *timers;
+    struct eventloop_timer t;
+    uint64_t i;
+    int j;
+
+    setup();
+    if (timers == NULL) {
+        timers = malloc(NTIMERS * sizeof(*timers));
+        for (j = 0; j < NTIMERS; j++) {
+            eventloop_timer_init(&timers[j], nop, NULL);
+            eventloop_timer_start(loop, &timers[j],
+                                  3600000 + (uint64_t)j * 7919 % 3600000);
+        }
+    }
+    eventloop_timer_init(&t, nop, NULL);
+    for (i = 0; i < iters; i++) {
+        eventloop_timer_start(loop, &t, i * 40503 % 600000);
+        eventloop_timer_stop(loop, &t);
+    }
+}
+
+static void count(struct eventloop *l, void *arg)
+{
+    (void)l;
+    (*(uint64_t *)arg)++;
+}
+
+BENCH(eventloop, post)
+{
+    uint64_t i, n = 0;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        eventloop_post(loop, count, &n);
+        eventloop_run_once(loop, 0);
+    }
+    BENCH_DONT_OPTIMIZE(n);
+}
@@ -0,0 +1,110 @@
+/**********************************************************************
+ * Hash benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * hash_bytes against FNV-1a over keys of several lengths, and the bulk
+ * interface against hashing the same short keys one call at a time.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "hash.h"
+
+#define KEYS        1024
+#define DATA_SIZE   (64 * 1024)
+
+static unsigned char *data;
+static const void *keys[KEYS];
+static size_t lens[KEYS];
+static size_t keys_len;           /* Total length of the keys */
+
+static void setup(void)
+{
+    size_t i;
+
+    if (data) {
+        return;
+    }
+    data = malloc(DATA_SIZE);
+    srand(1);
+    for (i = 0; i < DATA_SIZE; i++) {
+        data[i] = (unsigned char)rand();
+    }
+    for (i = 0; i < KEYS; i++) {
+        keys[i] = data + (size_t)rand() % (DATA_SIZE - 16);
+        lens[i] = 4 + (size_t)rand() % 13;
+        keys_len += lens[i];
+    }
+}
+
+static uint64_t fnv1a(const void *key, size_t len)
+{
+    const unsigned char *p = key;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+#define HASH_BENCH(len)                                             \
+    BENCH(hash, bytes_##len)                                        \
+    {                                                               \
+        uint64_t i;                                                 \
+                                                                    \
+        setup();                                                    \
+        bench_set_bytes(len);                                       \
+        for (i = 0; i < iters; i++) {                               \
+            BENCH_DONT_OPTIMIZE(hash_bytes(data, len, i));          \
+        }                                                           \
+    }                                                               \
+                                                                    \
+    BENCH(hash, fnv1a_##len)                                        \
+    {                                                               \
+        uint64_t i;                                                 \
+                                                                    \
+        setup();                                                    \
+        bench_set_bytes(len);                                       \
+        for (i = 0; i < iters; i++) {                               \
+            BENCH_CLOBBER();                                        \
+            BENCH_DONT_OPTIMIZE(fnv1a(data, len));                  \
+        }                                                           \
+    }
+
+HASH_BENCH(8)
+HASH_BENCH(32)
+HASH_BENCH(256)
+HASH_BENCH(4096)
+
+BENCH(hash, bulk_short)
+{
+    static uint64_t out[KEYS];
+    uint64_t i;
+
+    setup();
+    bench_set_bytes(keys_len);
+    for (i = 0; i < iters; i++) {
+        hash_bulk(keys, lens, KEYS, i, out);
+        BENCH_DONT_OPTIMIZE(out[0]);
+    }
+}
+
+BENCH(hash, loop_short)
+{
+    static uint64_t out[KEYS];
+    uint64_t i;
+    size_t j;
+
+    setup();
+    bench_set_bytes(keys_len);
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < KEYS; j++) {
+            out[j] = hash_bytes(keys[j], lens[j], i);
+        }
+        BENCH_DONT_OPTIMIZE(out[0]);
+    }
+}
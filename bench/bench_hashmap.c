@@ -0,0 +1,168 @@
+/**********************************************************************
+ * Hash map benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Lookups of random present keys in a map of a million, with 64-bit
+ * keys and with 16 byte string keys, the latter against the libc hash
+ * table (hsearch_r). Building a table of 64k string keys from empty
+ * is timed for both, and the map also has a random key erased and put
+ * back, which libc's table cannot do.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <search.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "hashmap.h"
+
+#define NKEYS   (1024 * 1024)
+#define NBUILD  65536
+#define KEYLEN  16
+
+static char (*strs)[KEYLEN];
+
+/* The i'th key, scattered over the 64-bit range */
+static uint64_t key(uint64_t i)
+{
+    return i * 0x9E3779B97F4A7C15ULL;
+}
+
+/* A random one of the NKEYS keys */
+static uint64_t pick(uint64_t i)
+{
+    return i * 2654435761u % NKEYS;
+}
+
+static char (*get_strs(void))[KEYLEN]
+{
+    uint64_t i;
+
+    if (strs == NULL) {
+        strs = calloc(NKEYS, KEYLEN);
+        for (i = 0; i < NKEYS; i++) {
+            snprintf(strs[i], KEYLEN, "%015llu",
+                     (unsigned long long)(key(i) % 1000000000000000ULL));
+        }
+    }
+    return strs;
+}
+
+static struct hashmap *get_u64_map(void)
+{
+    static struct hashmap m;
+    uint64_t i, k;
+
+    if (m.key_size == 0) {
+        hashmap_init(&m, sizeof(uint64_t), sizeof(uint64_t), NULL, NULL);
+        for (i = 0; i < NKEYS; i++) {
+            k = key(i);
+            hashmap_put(&m, &k, &i);
+        }
+    }
+    return &m;
+}
+
+BENCH(hashmap, find_u64_1m)
+{
+    struct hashmap *m = get_u64_map();
+    uint64_t i, k;
+
+    for (i = 0; i < iters; i++) {
+        k = key(pick(i));
+        BENCH_DONT_OPTIMIZE(hashmap_find(m, &k));
+    }
+}
+
+BENCH(hashmap, erase_put_u64_1m)
+{
+    struct hashmap *m = get_u64_map();
+    uint64_t i, k;
+
+    for (i = 0; i < iters; i++) {
+        k = key(pick(i));
+        hashmap_erase(m, &k);
+        hashmap_put(m, &k, &i);
+    }
+}
+
+BENCH(hashmap, find_str_1m)
+{
+    static struct hashmap m;
+    char (*s)[KEYLEN] = get_strs();
+    uint64_t i;
+
+    if (m.key_size == 0) {
+        hashmap_init(&m, KEYLEN, sizeof(uint64_t), NULL, NULL);
+        for (i = 0; i < NKEYS; i++) {
+            hashmap_put(&m, s[i], &i);
+        }
+    }
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(hashmap_find(&m, s[pick(i)]));
+    }
+}
+
+BENCH(hashmap, hsearch_find_str_1m)
+{
+    static struct hsearch_data h;
+    static int init;
+    char (*s)[KEYLEN] = get_strs();
+    ENTRY e, *found;
+    uint64_t i;
+
+    if (!init) {
+        hcreate_r(NKEYS * 2, &h);
+        for (i = 0; i < NKEYS; i++) {
+            e.key = s[i];
+            e.data = NULL;
+            hsearch_r(e, ENTER, &found, &h);
+        }
+        init = 1;
+    }
+    for (i = 0; i < iters; i++) {
+        e.key = s[pick(i)];
+        hsearch_r(e, FIND, &found, &h);
+        BENCH_DONT_OPTIMIZE(found);
+    }
+}
+
+BENCH(hashmap, build_str_64k)
+{
+    char (*s)[KEYLEN] = get_strs();
+    struct hashmap m;
+    uint64_t i;
+    size_t j;
+
+    for (i = 0; i < iters; i++) {
+        hashmap_init(&m, KEYLEN, sizeof(uint64_t), NULL, NULL);
+        hashmap_reserve(&m, NBUILD);
+        for (j = 0; j < NBUILD; j++) {
+            hashmap_put(&m, s[j], &i);
+        }
+        hashmap_destroy(&m);
+    }
+}
+
+BENCH(hashmap, hsearch_build_str_64k)
+{
+    char (*s)[KEYLEN] = get_strs();
+    struct hsearch_data h;
+    ENTRY e, *found;
+    uint64_t i;
+    size_t j;
+
+    for (i = 0; i < iters; i++) {
+        memset(&h, 0, sizeof(h));
+        hcreate_r(NBUILD * 2, &h);
+        for (j = 0; j < NBUILD; j++) {
+            e.key = s[j];
+            e.data = NULL;
+            hsearch_r(e, ENTER, &found, &h);
+        }
+        hdestroy_r(&h);
+    }
+}
@@ -0,0 +1,100 @@
+/**********************************************************************
+ * Histogram benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Recording a batch of latencies into a histogram, and reading its p99,
+ * against keeping the samples and sorting them to find the p99.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include "bench.h"
+#include "histogram.h"
+
+#define SAMPLES     1000
+
+static uint64_t samples[SAMPLES];
+
+static void fill_samples(void)
+{
+    static int init;
+    uint64_t x = 88172645463325252ULL;
+    int i;
+
+    if (init) {
+        return;
+    }
+    for (i = 0; i < SAMPLES; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        samples[i] = 1000 + x % 1000000;
+    }
+    init = 1;
+}
+
+BENCH(histogram, record)
+{
+    static struct histogram h;
+    static int init;
+    uint64_t i;
+    int j;
+
+    fill_samples();
+    if (!init) {
+        histogram_init(&h, 3600000000ULL, 3);
+        init = 1;
+    }
+
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < SAMPLES; j++) {
+            histogram_record(&h, samples[j]);
+        }
+    }
+}
+
+BENCH(histogram, read_p99)
+{
+    struct histogram_snapshot s;
+    struct histogram h;
+    uint64_t i;
+    int j;
+
+    fill_samples();
+    histogram_init(&h, 3600000000ULL, 3);
+    for (j = 0; j < SAMPLES; j++) {
+        histogram_record(&h, samples[j]);
+    }
+
+    for (i = 0; i < iters; i++) {
+        if (histogram_read(&h, &s) == 0) {
+            BENCH_DONT_OPTIMIZE(histogram_percentile(&s, 99.0));
+            histogram_snapshot_destroy(&s);
+        }
+    }
+    histogram_destroy(&h);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+BENCH(histogram, sort_p99)
+{
+    static uint64_t kept[SAMPLES];
+    uint64_t i;
+    int j;
+
+    fill_samples();
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < SAMPLES; j++) {
+            kept[j] = samples[j];
+        }
+        qsort(kept, SAMPLES, sizeof(kept[0]), cmp_u64);
+        BENCH_DONT_OPTIMIZE(kept[SAMPLES * 99 / 100]);
+    }
+}
@@ -0,0 +1,194 @@
+/**********************************************************************
+ * Intrusive container benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * A FIFO of 1000 elements, with one element moved from the front to the
+ * back per iteration, on an intrusive list and on a list that allocates
+ * a node per element. The tree and heap hold 100000 elements; each
+ * iteration takes a random element out and puts it back with a new key.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include "bench.h"
+#include "list.h"
+#include "pairing_heap.h"
+#include "rbtree.h"
+
+#define NLIST   1000
+#define NTREE   100000
+
+struct item {
+    uint64_t key;               /* Tree order */
+    uint64_t deadline;          /* Heap order */
+    struct list_head link;
+    struct rb_node rb;
+    struct pairing_heap_node heap;
+};
+
+static struct item *items;
+
+static struct item *get_items(void)
+{
+    uint64_t i;
+
+    if (items == NULL) {
+        items = malloc(NTREE * sizeof(*items));
+        for (i = 0; i < NTREE; i++) {
+            items[i].key = i * 2654435761u;
+            items[i].deadline = items[i].key % 1000000;
+        }
+    }
+    return items;
+}
+
+BENCH(intrusive, list_fifo)
+{
+    struct item *it = get_items();
+    struct list_head *first;
+    LIST_HEAD(fifo);
+    uint64_t i;
+
+    for (i = 0; i < NLIST; i++) {
+        list_add_tail(&it[i].link, &fifo);
+    }
+    for (i = 0; i < iters; i++) {
+        first = fifo.next;
+        list_del(first);
+        list_add_tail(first, &fifo);
+    }
+    BENCH_DONT_OPTIMIZE(fifo.next);
+}
+
+struct node {
+    struct node *next;
+    struct item *item;
+};
+
+BENCH(intrusive, list_fifo_malloc)
+{
+    struct item *it = get_items(), *item;
+    struct node *head = NULL, **tail = &head, *n;
+    uint64_t i;
+
+    for (i = 0; i < NLIST; i++) {
+        n = malloc(sizeof(*n));
+        n->item = &it[i];
+        n->next = NULL;
+        *tail = n;
+        tail = &n->next;
+    }
+    for (i = 0; i < iters; i++) {
+        n = head;
+        head = n->next;
+        if (head == NULL) {
+            tail = &head;
+        }
+        item = n->item;
+        free(n);
+
+        n = malloc(sizeof(*n));
+        n->item = item;
+        n->next = NULL;
+        *tail = n;
+        tail = &n->next;
+    }
+    while ((n = head) != NULL) {
+        head = n->next;
+        free(n);
+    }
+}
+
+static void rb_insert_item(struct rb_root *root, struct item *item)
+{
+    struct rb_node **link = &root->node, *parent = NULL;
+
+    while (*link) {
+        parent = *link;
+        if (item->key < rb_entry(parent, struct item, rb)->key) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+        }
+    }
+    rb_link_node(&item->rb, parent, link);
+    rb_insert_color(&item->rb, root);
+}
+
+BENCH(intrusive, rbtree_reinsert_100k)
+{
+    static struct rb_root root = RB_ROOT;
+    struct item *it = get_items(), *item;
+    uint64_t i;
+
+    if (rb_empty_root(&root)) {
+        for (i = 0; i < NTREE; i++) {
+            rb_insert_item(&root, &it[i]);
+        }
+    }
+    for (i = 0; i < iters; i++) {
+        item = &it[i * 40503 % NTREE];
+        rb_erase(&item->rb, &root);
+        item->key = i * 2654435761u;
+        rb_insert_item(&root, item);
+    }
+}
+
+static int heap_less(const struct pairing_heap_node *a,
+                     const struct pairing_heap_node *b)
+{
+    return pairing_heap_entry(a, struct item, heap)->deadline <
+           pairing_heap_entry(b, struct item, heap)->deadline;
+}
+
+static struct pairing_heap *get_heap(void)
+{
+    static struct pairing_heap h;
+    struct item *it = get_items(), *item;
+    uint64_t i;
+
+    if (h.less == NULL) {
+        pairing_heap_init(&h, heap_less);
+        for (i = 0; i < NTREE; i++) {
+            pairing_heap_insert(&h, &it[i].heap);
+        }
+
+        /*
+         * The first pops after a run of inserts pair up O(n) children of
+         * the root between them; get that done before timing starts.
+         */
+        for (i = 0; i < 1000; i++) {
+            item = pairing_heap_entry(pairing_heap_pop(&h), struct item,
+                                      heap);
+            item->deadline += 1000000;
+            pairing_heap_insert(&h, &item->heap);
+        }
+    }
+    return &h;
+}
+
+BENCH(intrusive, pairing_heap_pop_push_100k)
+{
+    struct pairing_heap *h = get_heap();
+    struct item *item;
+    uint64_t i;
+
+    for (i = 0; i < iters; i++) {
+        item = pairing_heap_entry(pairing_heap_pop(h), struct item, heap);
+        item->deadline += i * 2654435761u % 1000000;
+        pairing_heap_insert(h, &item->heap);
+    }
+}
+
+BENCH(intrusive, pairing_heap_remove_100k)
+{
+    struct pairing_heap *h = get_heap();
+    struct item *it = get_items(), *item;
+    uint64_t i;
+
+    for (i = 0; i < iters; i++) {
+        item = &it[i * 40503 % NTREE];
+        pairing_heap_remove(h, &item->heap);
+        pairing_heap_insert(h, &item->heap);
+    }
+}
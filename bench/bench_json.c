@@ -0,0 +1,82 @@
+/**********************************************************************
+ * JSON tokenizer benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Tokenizes two generated documents of about 256 KiB: an API style
+ * array of small records, and a log style array of long strings.
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "json.h"
+
+#define DOC_SIZE    (256 * 1024)
+
+static char *records;
+static size_t records_len;
+static char *strings;
+static size_t strings_len;
+static struct json_token *tape;
+static size_t tape_cap;
+
+static void setup(void)
+{
+    int i;
+
+    if (records) {
+        return;
+    }
+
+    records = malloc(DOC_SIZE + 256);
+    records_len = (size_t)sprintf(records, "[");
+    for (i = 0; records_len < DOC_SIZE; i++) {
+        records_len += (size_t)sprintf(records + records_len,
+            "%s{\"id\": %d, \"name\": \"user%d\", \"score\": %d.%02d, "
+            "\"active\": %s, \"tags\": [\"a\", \"b\"], \"parent\": null}",
+            i ? ",\n " : "", i, i * 7, i % 1000, i % 100,
+            (i % 3) ? "true" : "false");
+    }
+    records_len += (size_t)sprintf(records + records_len, "]");
+
+    strings = malloc(DOC_SIZE + 256);
+    strings_len = (size_t)sprintf(strings, "[");
+    for (i = 0; strings_len < DOC_SIZE; i++) {
+        strings_len += (size_t)sprintf(strings + strings_len,
+            "%s\"%06d GET /api/v1/items?page=%d HTTP/1.1 200 \\\"Mozilla/5.0 "
+            "(X11; Linux x86_64)\\\" upstream=10.0.0.%d:8080 took %dms\"",
+            i ? ",\n " : "", i, i % 50, i % 250, i % 900);
+    }
+    strings_len += (size_t)sprintf(strings + strings_len, "]");
+
+    tape_cap = JSON_MAX_TOKENS(DOC_SIZE + 256);
+    tape = malloc(tape_cap * sizeof(*tape));
+}
+
+BENCH(json, tokenize_records)
+{
+    uint64_t i;
+
+    setup();
+    bench_set_bytes(records_len);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(json_tokenize(records, records_len, tape,
+                                          tape_cap, NULL));
+        BENCH_CLOBBER();
+    }
+}
+
+BENCH(json, tokenize_strings)
+{
+    uint64_t i;
+
+    setup();
+    bench_set_bytes(strings_len);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(json_tokenize(strings, strings_len, tape,
+                                          tape_cap, NULL));
+        BENCH_CLOBBER();
+    }
+}
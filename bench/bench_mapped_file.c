@@ -0,0 +1,135 @@
+/**********************************************************************
+ * Memory mapped file benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Counting the lines of a 16 MiB file, held in the page cache, through
+ * a mapping (opened anew each iteration, with sequential or populate
+ * advice) and with read(2) into a 64 KiB buffer or into one buffer
+ * holding the whole file. The file is created in TMPDIR (or /tmp) and
+ * unlinked at once, so only its descriptor is kept.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "mapped_file.h"
+
+#define FILE_SIZE   (16 * 1024 * 1024)
+#define CHUNK       65536
+
+static int fd = -1;
+
+static int get_fd(void)
+{
+    char path[4096], line[64];
+    const char *dir = getenv("TMPDIR");
+    size_t i, len;
+
+    if (fd >= 0) {
+        return fd;
+    }
+    snprintf(path, sizeof(path), "%s/lub-bench.XXXXXX", dir ? dir : "/tmp");
+    fd = mkstemp(path);
+    if (fd < 0) {
+        perror("bench: mkstemp");
+        exit(1);
+    }
+    unlink(path);
+    for (i = 0; i < FILE_SIZE; i += len) {
+        len = (size_t)snprintf(line, sizeof(line), "%zu,%zu,record\n",
+                               i, i * 2654435761u % 1000003);
+        if (len > FILE_SIZE - i) {
+            len = FILE_SIZE - i;
+        }
+        if (write(fd, line, len) != (ssize_t)len) {
+            perror("bench: write");
+            exit(1);
+        }
+    }
+    return fd;
+}
+
+static size_t count_lines(const char *p, size_t n)
+{
+    const char *end = p + n;
+    size_t lines = 0;
+
+    while ((p = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        lines++;
+        p++;
+    }
+    return lines;
+}
+
+static void map_lines(uint64_t iters, unsigned int flags)
+{
+    struct mapped_file mf;
+    int f = get_fd();
+    uint64_t i;
+
+    bench_set_bytes(FILE_SIZE);
+    for (i = 0; i < iters; i++) {
+        if (mapped_file_map_fd(&mf, f, flags)) {
+            perror("bench: mapped_file_map_fd");
+            exit(1);
+        }
+        BENCH_DONT_OPTIMIZE(count_lines(mf.data, mf.size));
+        mapped_file_close(&mf);
+    }
+}
+
+BENCH(mapped_file, map_sequential)
+{
+    map_lines(iters, MAPPED_FILE_SEQUENTIAL);
+}
+
+BENCH(mapped_file, map_populate)
+{
+    map_lines(iters, MAPPED_FILE_POPULATE);
+}
+
+BENCH(mapped_file, read_64k)
+{
+    static char buf[CHUNK];
+    int f = get_fd();
+    uint64_t i;
+    size_t lines;
+    off_t off;
+    ssize_t n;
+
+    bench_set_bytes(FILE_SIZE);
+    for (i = 0; i < iters; i++) {
+        lines = 0;
+        for (off = 0; (n = pread(f, buf, CHUNK, off)) > 0; off += n) {
+            lines += count_lines(buf, (size_t)n);
+        }
+        BENCH_DONT_OPTIMIZE(lines);
+    }
+}
+
+BENCH(mapped_file, read_whole)
+{
+    int f = get_fd();
+    uint64_t i;
+    size_t got;
+    ssize_t n;
+    char *buf;
+
+    bench_set_bytes(FILE_SIZE);
+    for (i = 0; i < iters; i++) {
+        buf = malloc(FILE_SIZE);
+        for (got = 0; got < FILE_SIZE; got += (size_t)n) {
+            n = pread(f, buf + got, FILE_SIZE - got, (off_t)got);
+            if (n <= 0) {
+                break;
+            }
+        }
+        BENCH_DONT_OPTIMIZE(count_lines(buf, got));
+        free(buf);
+    }
+}
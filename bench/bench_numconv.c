@@ -0,0 +1,160 @@
+/**********************************************************************
+ * Number conversion benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Parsing and formatting a batch of integers and doubles of the kind
+ * found in text protocols, with numconv and with the C library.
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "numconv.h"
+
+#define COUNT       256
+
+static uint64_t ints[COUNT];
+static double doubles[COUNT];
+static char int_text[COUNT][NUMCONV_U64_LEN + 1];
+static char double_text[COUNT][32];
+
+static void setup(void)
+{
+    static int init;
+    uint64_t x = 88172645463325252ULL;
+    int i;
+
+    if (init) {
+        return;
+    }
+    for (i = 0; i < COUNT; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        ints[i] = x >> (x % 48);
+        doubles[i] = (double)(x % 100000000) / 1000.0;
+        snprintf(int_text[i], sizeof(int_text[i]), "%llu",
+                 (unsigned long long)ints[i]);
+        snprintf(double_text[i], sizeof(double_text[i]), "%.17g",
+                 doubles[i]);
+    }
+    init = 1;
+}
+
+BENCH(numconv, parse_u64)
+{
+    uint64_t i, v;
+    int j;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < COUNT; j++) {
+            numconv_parse_u64(int_text[j], strlen(int_text[j]), &v);
+            BENCH_DONT_OPTIMIZE(v);
+        }
+    }
+}
+
+BENCH(numconv, parse_u64_strtoull)
+{
+    uint64_t i;
+    int j;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < COUNT; j++) {
+            BENCH_DONT_OPTIMIZE(strtoull(int_text[j], NULL, 10));
+        }
+    }
+}
+
+BENCH(numconv, parse_double)
+{
+    uint64_t i;
+    double v;
+    int j;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < COUNT; j++) {
+            numconv_parse_double(double_text[j], strlen(double_text[j]), &v);
+            BENCH_DONT_OPTIMIZE(v);
+        }
+    }
+}
+
+BENCH(numconv, parse_double_strtod)
+{
+    uint64_t i;
+    int j;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < COUNT; j++) {
+            BENCH_DONT_OPTIMIZE(strtod(double_text[j], NULL));
+        }
+    }
+}
+
+BENCH(numconv, format_u64)
+{
+    char buf[NUMCONV_U64_LEN];
+    uint64_t i;
+    int j;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < COUNT; j++) {
+            BENCH_DONT_OPTIMIZE(numconv_format_u64(ints[j], buf));
+            BENCH_CLOBBER();
+        }
+    }
+}
+
+BENCH(numconv, format_u64_snprintf)
+{
+    char buf[32];
+    uint64_t i;
+    int j;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < COUNT; j++) {
+            BENCH_DONT_OPTIMIZE(snprintf(buf, sizeof(buf), "%llu",
+                                         (unsigned long long)ints[j]));
+        }
+    }
+}
+
+BENCH(numconv, format_double)
+{
+    char buf[NUMCONV_DOUBLE_LEN];
+    uint64_t i;
+    int j;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < COUNT; j++) {
+            BENCH_DONT_OPTIMIZE(numconv_format_double(doubles[j], buf));
+            BENCH_CLOBBER();
+        }
+    }
+}
+
+/* %.17g round trips like numconv, though it is not the shortest */
+BENCH(numconv, format_double_snprintf)
+{
+    char buf[32];
+    uint64_t i;
+    int j;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < COUNT; j++) {
+            BENCH_DONT_OPTIMIZE(snprintf(buf, sizeof(buf), "%.17g",
+                                         doubles[j]));
+        }
+    }
+}
@@ -0,0 +1,61 @@
+/**********************************************************************
+ * outbuf benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Writes a batch of log sized records to /dev/null, either through an
+ * outbuf with one flush per batch, or with one write(2) per record.
+ *********************************************************************/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "outbuf.h"
+
+#define RECORDS     100
+
+static const char record[] =
+    "2014-01-01T00:00:00Z INFO request handled in 123us status=200\n";
+
+static int null_fd(void)
+{
+    static int fd = -1;
+
+    if (fd < 0) {
+        fd = open("/dev/null", O_WRONLY);
+    }
+    return fd;
+}
+
+BENCH(outbuf, write_flush)
+{
+    struct outbuf ob;
+    uint64_t i;
+    int j;
+
+    outbuf_init(&ob, null_fd(), 0);
+    bench_set_bytes(RECORDS * (sizeof(record) - 1));
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < RECORDS; j++) {
+            outbuf_write(&ob, record, sizeof(record) - 1);
+        }
+        outbuf_flush(&ob);
+    }
+    outbuf_destroy(&ob);
+}
+
+BENCH(outbuf, write_syscall)
+{
+    int fd = null_fd();
+    uint64_t i;
+    int j;
+
+    bench_set_bytes(RECORDS * (sizeof(record) - 1));
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < RECORDS; j++) {
+            BENCH_DONT_OPTIMIZE(write(fd, record, sizeof(record) - 1));
+        }
+    }
+}
@@ -0,0 +1,246 @@
+/**********************************************************************
+ * Queue benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * The SPSC ring and the MPMC queue against a ring guarded by a pthread
+ * mutex, with condition variables to wait on. The local benchmarks
+ * enqueue and dequeue one element on the same thread, which is the
+ * bare cost of an operation. The others pass elements from a producer
+ * thread to the benchmark thread, timed per element: the SPSC ring
+ * spins (yielding) while full or empty, the others sleep.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include "bench.h"
+#include "mpmc_queue.h"
+#include "spsc_ring.h"
+
+#define QSIZE   1024
+#define BURST   32
+
+/* The pthread baseline: a ring under one lock */
+struct lock_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    size_t head;
+    size_t tail;
+    uint64_t buf[QSIZE];
+};
+
+static struct lock_queue lq = {
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    0, 0, { 0 },
+};
+
+static void lock_queue_push(struct lock_queue *q, uint64_t v)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->head - q->tail == QSIZE) {
+        pthread_cond_wait(&q->not_full, &q->lock);
+    }
+    q->buf[q->head++ % QSIZE] = v;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static uint64_t lock_queue_pop(struct lock_queue *q)
+{
+    uint64_t v;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->head == q->tail) {
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    }
+    v = q->buf[q->tail++ % QSIZE];
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return v;
+}
+
+static struct spsc_ring *get_ring(void)
+{
+    static struct spsc_ring r;
+
+    if (r.buf == NULL) {
+        spsc_ring_init(&r, QSIZE, sizeof(uint64_t));
+    }
+    return &r;
+}
+
+static struct mpmc_queue *get_queue(void)
+{
+    static struct mpmc_queue q;
+
+    if (q.cells == NULL) {
+        mpmc_queue_init(&q, QSIZE, sizeof(uint64_t));
+    }
+    return &q;
+}
+
+/* Start fn(&n) on a thread free to run on any CPU */
+static pthread_t start_producer(void *(*fn)(void *), uint64_t *n)
+{
+    pthread_t t;
+
+    bench_unpin();
+    pthread_create(&t, NULL, fn, n);
+    bench_repin();
+    return t;
+}
+
+BENCH(queue, spsc_local)
+{
+    struct spsc_ring *r = get_ring();
+    uint64_t i, v;
+
+    for (i = 0; i < iters; i++) {
+        spsc_ring_enqueue(r, &i);
+        spsc_ring_dequeue(r, &v);
+        BENCH_DONT_OPTIMIZE(v);
+    }
+}
+
+BENCH(queue, mpmc_local)
+{
+    struct mpmc_queue *q = get_queue();
+    uint64_t i, v;
+
+    for (i = 0; i < iters; i++) {
+        mpmc_queue_try_enqueue(q, &i);
+        mpmc_queue_try_dequeue(q, &v);
+        BENCH_DONT_OPTIMIZE(v);
+    }
+}
+
+BENCH(queue, mutex_local)
+{
+    uint64_t i;
+
+    for (i = 0; i < iters; i++) {
+        lock_queue_push(&lq, i);
+        BENCH_DONT_OPTIMIZE(lock_queue_pop(&lq));
+    }
+}
+
+static void *spsc_producer(void *arg)
+{
+    struct spsc_ring *r = get_ring();
+    uint64_t i, n = *(uint64_t *)arg;
+
+    for (i = 0; i < n; i++) {
+        while (!spsc_ring_enqueue(r, &i)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+BENCH(queue, spsc_threads)
+{
+    struct spsc_ring *r = get_ring();
+    uint64_t i, v, sum = 0;
+    pthread_t t = start_producer(spsc_producer, &iters);
+
+    for (i = 0; i < iters; i++) {
+        while (!spsc_ring_dequeue(r, &v)) {
+            sched_yield();
+        }
+        sum += v;
+    }
+    pthread_join(t, NULL);
+    BENCH_DONT_OPTIMIZE(sum);
+}
+
+static void *spsc_burst_producer(void *arg)
+{
+    struct spsc_ring *r = get_ring();
+    uint64_t i, j, n = *(uint64_t *)arg, buf[BURST];
+    size_t k, done;
+
+    for (i = 0; i < n; i += k) {
+        k = n - i < BURST ? (size_t)(n - i) : BURST;
+        for (j = 0; j < k; j++) {
+            buf[j] = i + j;
+        }
+        for (done = 0; done < k;) {
+            done += spsc_ring_enqueue_burst(r, buf + done, k - done);
+            if (done < k) {
+                sched_yield();
+            }
+        }
+    }
+    return NULL;
+}
+
+BENCH(queue, spsc_threads_burst)
+{
+    struct spsc_ring *r = get_ring();
+    uint64_t i, buf[BURST], sum = 0;
+    pthread_t t = start_producer(spsc_burst_producer, &iters);
+    size_t j, k;
+
+    for (i = 0; i < iters; i += k) {
+        while ((k = spsc_ring_dequeue_burst(r, buf, BURST)) == 0) {
+            sched_yield();
+        }
+        for (j = 0; j < k; j++) {
+            sum += buf[j];
+        }
+    }
+    pthread_join(t, NULL);
+    BENCH_DONT_OPTIMIZE(sum);
+}
+
+static void *mpmc_producer(void *arg)
+{
+    struct mpmc_queue *q = get_queue();
+    uint64_t i, n = *(uint64_t *)arg;
+
+    for (i = 0; i < n; i++) {
+        mpmc_queue_enqueue_wait(q, &i);
+    }
+    return NULL;
+}
+
+BENCH(queue, mpmc_threads)
+{
+    struct mpmc_queue *q = get_queue();
+    uint64_t i, v, sum = 0;
+    pthread_t t = start_producer(mpmc_producer, &iters);
+
+    for (i = 0; i < iters; i++) {
+        mpmc_queue_dequeue_wait(q, &v);
+        sum += v;
+    }
+    pthread_join(t, NULL);
+    BENCH_DONT_OPTIMIZE(sum);
+}
+
+static void *mutex_producer(void *arg)
+{
+    uint64_t i, n = *(uint64_t *)arg;
+
+    for (i = 0; i < n; i++) {
+        lock_queue_push(&lq, i);
+    }
+    return NULL;
+}
+
+BENCH(queue, mutex_threads)
+{
+    uint64_t i, sum = 0;
+    pthread_t t = start_producer(mutex_producer, &iters);
+
+    for (i = 0; i < iters; i++) {
+        sum += lock_queue_pop(&lq);
+    }
+    pthread_join(t, NULL);
+    BENCH_DONT_OPTIMIZE(sum);
+}
@@ -0,0 +1,165 @@
+/**********************************************************************
+ * Roaring bitmap benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Two sets of values below 2^24, one with about 1 value in 8 and one
+ * with about 1 in 256, as a frequent and a rare term of an index might
+ * have. Intersection is compared with merging the sorted arrays of the
+ * values, which is what the sets would otherwise be kept as.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include "bench.h"
+#include "roaring.h"
+
+#define RANGE   (1U << 24)
+
+static struct roaring frequent;
+static struct roaring rare;
+static uint32_t *frequent_array;
+static uint32_t *rare_array;
+static size_t frequent_n;
+static size_t rare_n;
+
+static void setup(void)
+{
+    uint32_t v;
+
+    if (frequent_array) {
+        return;
+    }
+    frequent_array = malloc(RANGE / 4 * sizeof(uint32_t));
+    rare_array = malloc(RANGE / 64 * sizeof(uint32_t));
+    srand(1);
+    for (v = 0; v < RANGE; v++) {
+        if (rand() % 8 == 0) {
+            frequent_array[frequent_n++] = v;
+        }
+        if (rand() % 256 == 0) {
+            rare_array[rare_n++] = v;
+        }
+    }
+    roaring_init(&frequent);
+    roaring_init(&rare);
+    roaring_add_many(&frequent, frequent_array, frequent_n);
+    roaring_add_many(&rare, rare_array, rare_n);
+}
+
+BENCH(roaring, and)
+{
+    struct roaring dst;
+    uint64_t i;
+
+    setup();
+    roaring_init(&dst);
+    for (i = 0; i < iters; i++) {
+        roaring_and(&dst, &frequent, &rare);
+        BENCH_DONT_OPTIMIZE(dst.size);
+    }
+    roaring_destroy(&dst);
+}
+
+BENCH(roaring, and_cardinality)
+{
+    uint64_t i;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(roaring_and_cardinality(&frequent, &rare));
+    }
+}
+
+BENCH(roaring, and_sorted_arrays)
+{
+    static uint32_t *out;
+    size_t a, b, n;
+    uint64_t i;
+
+    setup();
+    if (out == NULL) {
+        out = malloc(rare_n * sizeof(*out));
+    }
+    for (i = 0; i < iters; i++) {
+        a = b = n = 0;
+        while (a < frequent_n && b < rare_n) {
+            if (frequent_array[a] < rare_array[b]) {
+                a++;
+            } else if (frequent_array[a] > rare_array[b]) {
+                b++;
+            } else {
+                out[n++] = frequent_array[a];
+                a++;
+                b++;
+            }
+        }
+        BENCH_DONT_OPTIMIZE(out[n / 2]);
+    }
+}
+
+BENCH(roaring, or)
+{
+    struct roaring dst;
+    uint64_t i;
+
+    setup();
+    roaring_init(&dst);
+    for (i = 0; i < iters; i++) {
+        roaring_or(&dst, &frequent, &rare);
+        BENCH_DONT_OPTIMIZE(dst.size);
+    }
+    roaring_destroy(&dst);
+}
+
+BENCH(roaring, add_many)
+{
+    struct roaring r;
+    uint64_t i;
+
+    setup();
+    bench_set_bytes(rare_n * sizeof(uint32_t));
+    for (i = 0; i < iters; i++) {
+        roaring_init(&r);
+        roaring_add_many(&r, rare_array, rare_n);
+        BENCH_DONT_OPTIMIZE(r.size);
+        roaring_destroy(&r);
+    }
+}
+
+BENCH(roaring, serialize)
+{
+    static void *buf;
+    size_t len;
+    uint64_t i;
+
+    setup();
+    len = roaring_serialized_size(&frequent);
+    if (buf == NULL) {
+        buf = malloc(len);
+    }
+    bench_set_bytes(len);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(roaring_serialize(&frequent, buf));
+    }
+}
+
+BENCH(roaring, deserialize)
+{
+    static void *buf;
+    struct roaring r;
+    size_t len;
+    uint64_t i;
+
+    setup();
+    len = roaring_serialized_size(&frequent);
+    if (buf == NULL) {
+        buf = malloc(len);
+        roaring_serialize(&frequent, buf);
+    }
+    bench_set_bytes(len);
+    roaring_init(&r);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(roaring_deserialize(&r, buf, len));
+    }
+    roaring_destroy(&r);
+}
@@ -0,0 +1,139 @@
+/**********************************************************************
+ * strsearch benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Compares the strsearch kernels with the closest libc equivalents, on
+ * a buffer of text where the bytes searched for only occur at the end.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "strsearch.h"
+
+#define TEXT_SIZE   (64 * 1024)
+
+static char *text;
+
+static char *get_text(void)
+{
+    static const char needle[] = "needle|\t";
+    size_t i;
+
+    if (text) {
+        return text;
+    }
+
+    /* Lowercase words, with a newline every 64 bytes or so */
+    text = malloc(TEXT_SIZE);
+    srand(1);
+    for (i = 0; i < TEXT_SIZE; i++) {
+        text[i] = (rand() % 6 == 0) ? ' ' : (char)('a' + rand() % 26);
+        if (i % 64 == 63) {
+            text[i] = '\n';
+        }
+    }
+    memcpy(text + TEXT_SIZE - sizeof(needle) + 1, needle, sizeof(needle) - 1);
+    return text;
+}
+
+BENCH(strsearch, memchr2_lub)
+{
+    char *t = get_text();
+    uint64_t i;
+
+    bench_set_bytes(TEXT_SIZE);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(strsearch_memchr2(t, '|', '\t', TEXT_SIZE));
+    }
+}
+
+/* The usual libc substitute: one memchr per byte, take the earliest */
+BENCH(strsearch, memchr2_libc)
+{
+    char *t = get_text();
+    char *a, *b;
+    uint64_t i;
+
+    bench_set_bytes(TEXT_SIZE);
+    for (i = 0; i < iters; i++) {
+        a = memchr(t, '|', TEXT_SIZE);
+        b = memchr(t, '\t', a ? (size_t)(a - t) : TEXT_SIZE);
+        BENCH_DONT_OPTIMIZE(b ? b : a);
+    }
+}
+
+BENCH(strsearch, memchr3_lub)
+{
+    char *t = get_text();
+    uint64_t i;
+
+    bench_set_bytes(TEXT_SIZE);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(strsearch_memchr3(t, '|', '\t', '\r', TEXT_SIZE));
+    }
+}
+
+BENCH(strsearch, memchr_libc)
+{
+    char *t = get_text();
+    uint64_t i;
+
+    bench_set_bytes(TEXT_SIZE);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(memchr(t, '|', TEXT_SIZE));
+    }
+}
+
+BENCH(strsearch, memmem_lub)
+{
+    char *t = get_text();
+    uint64_t i;
+
+    bench_set_bytes(TEXT_SIZE);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(strsearch_memmem(t, TEXT_SIZE, "needle", 6));
+    }
+}
+
+BENCH(strsearch, memmem_libc)
+{
+    char *t = get_text();
+    uint64_t i;
+
+    bench_set_bytes(TEXT_SIZE);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(memmem(t, TEXT_SIZE, "needle", 6));
+    }
+}
+
+BENCH(strsearch, count_lines_lub)
+{
+    char *t = get_text();
+    uint64_t i;
+
+    bench_set_bytes(TEXT_SIZE);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(strsearch_count_lines(t, TEXT_SIZE));
+    }
+}
+
+BENCH(strsearch, count_lines_libc)
+{
+    char *t = get_text();
+    char *p, *end = t + TEXT_SIZE;
+    size_t n;
+    uint64_t i;
+
+    bench_set_bytes(TEXT_SIZE);
+    for (i = 0; i < iters; i++) {
+        n = 0;
+        for (p = t; (p = memchr(p, '\n', (size_t)(end - p))) != NULL; p++) {
+            n++;
+        }
+        BENCH_DONT_OPTIMIZE(n);
+    }
+}
@@ -0,0 +1,182 @@
+/**********************************************************************
+ * Thread pool benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Running a batch of 16 small tasks and waiting for them, on the pool
+ * and with a pthread created and joined per task. A sum over 4M words
+ * is split with threadpool_parallel_for, against one pthread per CPU
+ * each summing a fixed slice, and a plain loop on one thread.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "bench.h"
+#include "threadpool.h"
+
+#define NTASKS  16
+#define NWORDS  (4 * 1024 * 1024)
+
+static struct threadpool *pool;
+static uint64_t *words;
+
+static struct threadpool *get_pool(void)
+{
+    if (pool == NULL) {
+        bench_unpin();
+        pool = threadpool_create(0);
+        bench_repin();
+    }
+    return pool;
+}
+
+static uint64_t *get_words(void)
+{
+    uint64_t i;
+
+    if (words == NULL) {
+        words = malloc(NWORDS * sizeof(*words));
+        for (i = 0; i < NWORDS; i++) {
+            words[i] = i * 2654435761u;
+        }
+    }
+    return words;
+}
+
+static void task(void *arg)
+{
+    __atomic_fetch_add((uint64_t *)arg, 1, __ATOMIC_RELAXED);
+}
+
+static void *thread_task(void *arg)
+{
+    task(arg);
+    return NULL;
+}
+
+BENCH(threadpool, submit_wait_16)
+{
+    struct threadpool *tp = get_pool();
+    uint64_t i, done = 0;
+    int j;
+
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < NTASKS; j++) {
+            threadpool_submit(tp, task, &done);
+        }
+        threadpool_wait(tp);
+    }
+    BENCH_DONT_OPTIMIZE(done);
+}
+
+BENCH(threadpool, pthread_create_16)
+{
+    pthread_t threads[NTASKS];
+    uint64_t i, done = 0;
+    int j;
+
+    bench_unpin();
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < NTASKS; j++) {
+            pthread_create(&threads[j], NULL, thread_task, &done);
+        }
+        for (j = 0; j < NTASKS; j++) {
+            pthread_join(threads[j], NULL);
+        }
+    }
+    bench_repin();
+    BENCH_DONT_OPTIMIZE(done);
+}
+
+struct sum {
+    const uint64_t *words;
+    size_t begin;
+    size_t end;
+    uint64_t total;             /* Updated atomically by range tasks */
+};
+
+static uint64_t sum_words(const uint64_t *w, size_t begin, size_t end)
+{
+    uint64_t total = 0;
+
+    for (; begin < end; begin++) {
+        total += w[begin];
+    }
+    return total;
+}
+
+static void sum_range(size_t begin, size_t end, void *arg)
+{
+    struct sum *s = arg;
+
+    __atomic_fetch_add(&s->total, sum_words(s->words, begin, end),
+                       __ATOMIC_RELAXED);
+}
+
+static void *sum_slice(void *arg)
+{
+    struct sum *s = arg;
+
+    s->total = sum_words(s->words, s->begin, s->end);
+    return NULL;
+}
+
+BENCH(threadpool, parallel_for_4m)
+{
+    struct threadpool *tp = get_pool();
+    struct sum s;
+    uint64_t i;
+
+    bench_set_bytes(NWORDS * sizeof(uint64_t));
+    s.words = get_words();
+    for (i = 0; i < iters; i++) {
+        s.total = 0;
+        threadpool_parallel_for(tp, 0, NWORDS, 0, sum_range, &s);
+        BENCH_DONT_OPTIMIZE(s.total);
+    }
+}
+
+BENCH(threadpool, pthread_split_4m)
+{
+    struct sum slices[64];
+    pthread_t threads[64];
+    uint64_t i, total;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t n, j;
+
+    bench_set_bytes(NWORDS * sizeof(uint64_t));
+    n = ncpu < 1 ? 1 : ncpu > 64 ? 64 : (size_t)ncpu;
+    for (j = 0; j < n; j++) {
+        slices[j].words = get_words();
+        slices[j].begin = NWORDS * j / n;
+        slices[j].end = NWORDS * (j + 1) / n;
+    }
+
+    bench_unpin();
+    for (i = 0; i < iters; i++) {
+        for (j = 0; j < n; j++) {
+            pthread_create(&threads[j], NULL, sum_slice, &slices[j]);
+        }
+        total = 0;
+        for (j = 0; j < n; j++) {
+            pthread_join(threads[j], NULL);
+            total += slices[j].total;
+        }
+        BENCH_DONT_OPTIMIZE(total);
+    }
+    bench_repin();
+}
+
+BENCH(threadpool, serial_4m)
+{
+    const uint64_t *w = get_words();
+    uint64_t i;
+
+    bench_set_bytes(NWORDS * sizeof(uint64_t));
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(sum_words(w, 0, NWORDS));
+    }
+}
@@ -0,0 +1,145 @@
+/**********************************************************************
+ * Timing wheel benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * A random one of a million pending timers is moved to a new time, as
+ * an idle timer is on every request, in the wheel and in a binary heap
+ * that keeps each timer's index so it can be sifted. The expiry
+ * benchmark moves the wheel on a tick at a time through a million
+ * timers that add themselves again when they fire.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include "bench.h"
+#include "timer_wheel.h"
+
+#define NTIMERS 1000000
+
+static struct timer_wheel wheel;
+static struct timer_wheel_node *nodes;
+
+static uint64_t delay(uint64_t i)
+{
+    return 1 + i * 2654435761u % 3600000;
+}
+
+static void refire(struct timer_wheel_node *t, void *arg)
+{
+    (void)arg;
+    timer_wheel_add(&wheel, t, wheel.tick + delay((uint64_t)(t - nodes)));
+}
+
+static void setup(void)
+{
+    uint64_t i;
+
+    if (nodes) {
+        return;
+    }
+    timer_wheel_init(&wheel, 0);
+    nodes = malloc(NTIMERS * sizeof(*nodes));
+    for (i = 0; i < NTIMERS; i++) {
+        timer_wheel_node_init(&nodes[i], refire, NULL);
+        timer_wheel_add(&wheel, &nodes[i], delay(i));
+    }
+}
+
+BENCH(timer_wheel, reschedule_1m)
+{
+    uint64_t i;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        timer_wheel_add(&wheel, &nodes[i * 40503 % NTIMERS],
+                        wheel.tick + delay(i));
+    }
+}
+
+BENCH(timer_wheel, advance_1m)
+{
+    uint64_t i;
+    size_t n = 0;
+
+    setup();
+    for (i = 0; i < iters; i++) {
+        n += timer_wheel_advance(&wheel, wheel.tick);
+    }
+    BENCH_DONT_OPTIMIZE(n);
+}
+
+/* Binary heap baseline */
+struct heap_timer {
+    uint64_t expires;
+    size_t index;
+};
+
+static struct heap_timer **heap;
+static size_t heap_len;
+
+static void heap_set(size_t i, struct heap_timer *t)
+{
+    heap[i] = t;
+    t->index = i;
+}
+
+static void heap_up(size_t i)
+{
+    struct heap_timer *t = heap[i];
+
+    while (i > 0 && heap[(i - 1) / 2]->expires > t->expires) {
+        heap_set(i, heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    heap_set(i, t);
+}
+
+static void heap_down(size_t i)
+{
+    struct heap_timer *t = heap[i];
+    size_t c;
+
+    while ((c = 2 * i + 1) < heap_len) {
+        if (c + 1 < heap_len && heap[c + 1]->expires < heap[c]->expires) {
+            c++;
+        }
+        if (heap[c]->expires >= t->expires) {
+            break;
+        }
+        heap_set(i, heap[c]);
+        i = c;
+    }
+    heap_set(i, t);
+}
+
+static void heap_add(struct heap_timer *t)
+{
+    heap[heap_len] = t;
+    heap_up(heap_len++);
+}
+
+static void heap_update(struct heap_timer *t, uint64_t expires)
+{
+    t->expires = expires;
+    heap_up(t->index);
+    heap_down(t->index);
+}
+
+BENCH(timer_wheel, heap_reschedule_1m)
+{
+    static struct heap_timer *timers;
+    uint64_t i;
+
+    if (timers == NULL) {
+        timers = malloc(NTIMERS * sizeof(*timers));
+        heap = malloc(NTIMERS * sizeof(*heap));
+        for (i = 0; i < NTIMERS; i++) {
+            timers[i].expires = delay(i);
+            heap_add(&timers[i]);
+        }
+    }
+    for (i = 0; i < iters; i++) {
+        heap_update(&timers[i * 40503 % NTIMERS],
+                    heap[0]->expires + delay(i));
+    }
+}
@@ -0,0 +1,34 @@
+/**********************************************************************
+ * trace benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Cost of recording a begin/end pair, with tracing on and switched off
+ * at run time.
+ *********************************************************************/
+
+#include "bench.h"
+#include "trace.h"
+
+BENCH(trace, begin_end)
+{
+    uint64_t i;
+
+    trace_set_enabled(1);
+    for (i = 0; i < iters; i++) {
+        TRACE_BEGIN("bench");
+        TRACE_END("bench");
+    }
+}
+
+BENCH(trace, begin_end_disabled)
+{
+    uint64_t i;
+
+    trace_set_enabled(0);
+    for (i = 0; i < iters; i++) {
+        TRACE_BEGIN("bench");
+        TRACE_END("bench");
+    }
+    trace_set_enabled(1);
+}
@@ -0,0 +1,107 @@
+/**********************************************************************
+ * io_uring benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Random 4 KiB reads from a 16 MiB file, which stays in the page cache,
+ * so the cost measured is that of the system calls and not the disk.
+ * One pread per block is compared with batches of 64 requests through
+ * io_uring and through the thread pool backend.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "bench.h"
+#include "uring.h"
+
+#define FILE_SIZE   (16 << 20)
+#define BLOCK       4096
+#define BATCH       64
+
+static int fd = -1;
+static char bufs[BATCH][BLOCK];
+
+static void setup(void)
+{
+    char path[] = "/tmp/bench_uring.XXXXXX";
+    static char block[BLOCK];
+    int i;
+
+    if (fd >= 0) {
+        return;
+    }
+    fd = mkstemp(path);
+    unlink(path);
+    for (i = 0; i < FILE_SIZE / BLOCK; i++) {
+        block[0] = (char)i;
+        BENCH_DONT_OPTIMIZE(write(fd, block, BLOCK));
+    }
+}
+
+static uint64_t offset(uint64_t i)
+{
+    return (i * 40503 % (FILE_SIZE / BLOCK)) * BLOCK;
+}
+
+BENCH(uring, pread)
+{
+    uint64_t i;
+
+    setup();
+    bench_set_bytes(BLOCK);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(pread(fd, bufs[i % BATCH], BLOCK,
+                                  (off_t)offset(i)));
+    }
+}
+
+static void done(struct uring *u, int res, void *buf, unsigned int flags,
+                 void *arg)
+{
+    (void)u;
+    (void)buf;
+    (void)flags;
+    *(int *)arg += res;
+}
+
+static void batched(struct uring *u, uint64_t iters)
+{
+    uint64_t i;
+    int total = 0;
+
+    bench_set_bytes(BLOCK);
+    for (i = 0; i < iters; i++) {
+        uring_read(u, fd, bufs[i % BATCH], BLOCK, offset(i), done, &total);
+        if (i % BATCH == BATCH - 1) {
+            uring_wait(u, BATCH);
+        }
+    }
+    while (uring_pending(u) > 0) {
+        uring_wait(u, 1);
+    }
+    BENCH_DONT_OPTIMIZE(total);
+}
+
+BENCH(uring, read_batched)
+{
+    static struct uring *u;
+
+    setup();
+    if (u == NULL) {
+        u = uring_create(BATCH, 0);
+    }
+    batched(u, iters);
+}
+
+BENCH(uring, read_batched_threads)
+{
+    static struct uring *u;
+
+    setup();
+    if (u == NULL) {
+        u = uring_create(BATCH, URING_THREADS);
+    }
+    batched(u, iters);
+}
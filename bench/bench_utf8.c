@@ -0,0 +1,176 @@
+/**********************************************************************
+ * utf8 benchmarks
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Validates and transcodes two 64 KiB texts: plain ASCII, and a mix of
+ * ASCII, Greek, CJK and emoji. The vector validator is compared with a
+ * straightforward decoder that looks at a character at a time.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "utf8.h"
+
+#define TEXT_SIZE   (64 * 1024)
+
+static char *ascii;
+static char *mixed;
+static size_t mixed_len;
+
+static void make_texts(void)
+{
+    static const char *const words[] = {
+        "hello ", "world ", "\xce\xb1\xce\xb2\xce\xb3 ", "\xe4\xb8\xad\xe6\x96\x87 ",
+        "\xf0\x9f\x98\x80 ", "caf\xc3\xa9 ", "data\n",
+    };
+    size_t i, n;
+
+    if (ascii) {
+        return;
+    }
+
+    ascii = malloc(TEXT_SIZE);
+    mixed = malloc(TEXT_SIZE);
+    srand(1);
+    for (i = 0; i < TEXT_SIZE; i++) {
+        ascii[i] = (rand() % 6 == 0) ? ' ' : (char)('a' + rand() % 26);
+    }
+    for (mixed_len = 0;;) {
+        const char *w = words[rand() % 7];
+
+        n = strlen(w);
+        if (mixed_len + n > TEXT_SIZE) {
+            break;
+        }
+        memcpy(mixed + mixed_len, w, n);
+        mixed_len += n;
+    }
+}
+
+/* One character at a time, as a hand written validator would */
+static int validate_simple(const unsigned char *s, size_t len)
+{
+    size_t i = 0, n, j;
+    unsigned char c;
+
+    while (i < len) {
+        c = s[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+        if (c >= 0xc2 && c <= 0xdf) {
+            n = 1;
+        } else if (c >= 0xe0 && c <= 0xef) {
+            n = 2;
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            n = 3;
+        } else {
+            return 0;
+        }
+        if (len - i <= n) {
+            return 0;
+        }
+        if ((c == 0xe0 && s[i + 1] < 0xa0) || (c == 0xed && s[i + 1] > 0x9f) ||
+            (c == 0xf0 && s[i + 1] < 0x90) || (c == 0xf4 && s[i + 1] > 0x8f)) {
+            return 0;
+        }
+        for (j = 1; j <= n; j++) {
+            if ((s[i + j] & 0xc0) != 0x80) {
+                return 0;
+            }
+        }
+        i += n + 1;
+    }
+    return 1;
+}
+
+BENCH(utf8, validate_ascii)
+{
+    uint64_t i;
+
+    make_texts();
+    bench_set_bytes(TEXT_SIZE);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(utf8_validate(ascii, TEXT_SIZE));
+    }
+}
+
+BENCH(utf8, validate_ascii_simple)
+{
+    uint64_t i;
+
+    make_texts();
+    bench_set_bytes(TEXT_SIZE);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(validate_simple((unsigned char *)ascii,
+                                            TEXT_SIZE));
+    }
+}
+
+BENCH(utf8, validate_mixed)
+{
+    uint64_t i;
+
+    make_texts();
+    bench_set_bytes(mixed_len);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(utf8_validate(mixed, mixed_len));
+    }
+}
+
+BENCH(utf8, validate_mixed_simple)
+{
+    uint64_t i;
+
+    make_texts();
+    bench_set_bytes(mixed_len);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(validate_simple((unsigned char *)mixed,
+                                            mixed_len));
+    }
+}
+
+BENCH(utf8, to_utf16_ascii)
+{
+    static uint16_t out[TEXT_SIZE];
+    uint64_t i;
+
+    make_texts();
+    bench_set_bytes(TEXT_SIZE);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(utf8_to_utf16(ascii, TEXT_SIZE, out));
+        BENCH_CLOBBER();
+    }
+}
+
+BENCH(utf8, to_utf16_mixed)
+{
+    static uint16_t out[TEXT_SIZE];
+    uint64_t i;
+
+    make_texts();
+    bench_set_bytes(mixed_len);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(utf8_to_utf16(mixed, mixed_len, out));
+        BENCH_CLOBBER();
+    }
+}
+
+BENCH(utf8, from_utf16_mixed)
+{
+    static uint16_t in[TEXT_SIZE];
+    static char out[3 * TEXT_SIZE];
+    uint64_t i;
+    ssize_t n;
+
+    make_texts();
+    n = utf8_to_utf16(mixed, mixed_len, in);
+    bench_set_bytes(mixed_len);
+    for (i = 0; i < iters; i++) {
+        BENCH_DONT_OPTIMIZE(utf16_to_utf8(in, (size_t)n, out));
+        BENCH_CLOBBER();
+    }
+}
@@ -0,0 +1,15 @@
+/**********************************************************************
+ * Microbenchmark runner
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Runs every benchmark linked into the program. Kept separate from the
+ * harness so that C++ programs can supply their own main.
+ *********************************************************************/
+
+#include "bench.h"
+
+int main(int argc, char **argv)
+{
+    return bench_main(argc, argv);
+}
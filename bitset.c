@@ -0,0 +1,554 @@
+/**********************************************************************
+ * Dynamic bitset
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * The vector population counts use the nibble lookup of W. Mula, N.
+ * Kurz and D. Lemire, "Faster Population Counts Using AVX2 Instructions"
+ * (2018): a byte shuffle looks up the count of each half byte, and the
+ * byte counts are summed into 64-bit lanes with a sum of absolute
+ * differences against zero.
+ *
+ * Selecting a bit within a word is done without a loop over its bits,
+ * after S. Vigna, "Broadword Implementation of Rank/Select Queries"
+ * (2008): a multiply turns the bit count of each byte into a running
+ * count, and a parallel compare of those against k finds the byte that
+ * holds the bit, leaving at most seven bits to step over.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "bitset.h"
+#include "compiler.h"
+#include "cpu_features.h"
+
+#if defined(__x86_64__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Words covered by each rank sample */
+#define RANK_WORDS  8
+
+/**********************************************************************
+ * Single words
+ *********************************************************************/
+static inline unsigned popcount64(uint64_t w)
+{
+#if defined(HAVE_X86) && !defined(__POPCNT__)
+    /* Without the instruction, the builtin is a call into libgcc */
+    w = w - ((w >> 1) & 0x5555555555555555ULL);
+    w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+    w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (unsigned)((w * 0x0101010101010101ULL) >> 56);
+#else
+    return (unsigned)__builtin_popcountll(w);
+#endif
+}
+
+/* Position of the set bit of w with rank k, which must be below its count */
+static inline unsigned select64(uint64_t w, unsigned k)
+{
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    uint64_t s, x;
+    unsigned shift;
+
+    /* Byte i of s is the number of set bits in bytes 0 to i of w */
+    s = w - ((w >> 1) & 0x5555555555555555ULL);
+    s = (s & 0x3333333333333333ULL) + ((s >> 2) & 0x3333333333333333ULL);
+    s = ((s + (s >> 4)) & 0x0f0f0f0f0f0f0f0fULL) * ones;
+
+    /*
+     * The high bit of each byte of x is set if the running count is at
+     * most k, which is true of the bytes before the one holding the bit.
+     */
+    x = ((k * ones) | highs) - s;
+    shift = (unsigned)((((x & highs) >> 7) * ones) >> 56) * 8;
+
+    k -= (unsigned)(((s << 8) >> shift) & 0xff);
+    x = (w >> shift) & 0xff;
+    while (k-- > 0) {
+        x &= x - 1;
+    }
+    return shift + (unsigned)__builtin_ctzll(x);
+}
+
+/**********************************************************************
+ * Kernels
+ *
+ * Each bulk operation returns 1 if any bit of its result is set. The
+ * vector versions leave the last few words to the scalar ones.
+ *********************************************************************/
+#define AND(a, b)       ((a) & (b))
+#define OR(a, b)        ((a) | (b))
+#define XOR(a, b)       ((a) ^ (b))
+#define ANDNOT(a, b)    ((a) & ~(b))
+
+#define SCALAR_OP(name, OP)                                             \
+    static int name##_scalar(uint64_t *dst, const uint64_t *src,        \
+                             size_t n)                                  \
+    {                                                                   \
+        uint64_t any = 0;                                               \
+        size_t i;                                                       \
+                                                                        \
+        for (i = 0; i < n; i++) {                                       \
+            dst[i] = OP(dst[i], src[i]);                                \
+            any |= dst[i];                                              \
+        }                                                               \
+        return any != 0;                                                \
+    }
+
+SCALAR_OP(op_and, AND)
+SCALAR_OP(op_or, OR)
+SCALAR_OP(op_xor, XOR)
+SCALAR_OP(op_andnot, ANDNOT)
+
+static size_t count_scalar(const uint64_t *w, size_t n)
+{
+    size_t i, total = 0;
+
+    for (i = 0; i < n; i++) {
+        total += popcount64(w[i]);
+    }
+    return total;
+}
+
+static size_t and_count_scalar(const uint64_t *a, const uint64_t *b,
+                               size_t n)
+{
+    size_t i, total = 0;
+
+    for (i = 0; i < n; i++) {
+        total += popcount64(a[i] & b[i]);
+    }
+    return total;
+}
+
+#if defined(HAVE_X86)
+#define AVX2    __attribute__((target("avx2,popcnt")))
+#define POPCNT  __attribute__((target("popcnt")))
+
+#define SSE2_ANDNOT(a, b)   _mm_andnot_si128(b, a)
+#define AVX2_ANDNOT(a, b)   _mm256_andnot_si256(b, a)
+
+#define SSE2_OP(name, VOP)                                              \
+    static int name##_sse2(uint64_t *dst, const uint64_t *src,          \
+                           size_t n)                                    \
+    {                                                                   \
+        __m128i any = _mm_setzero_si128(), v;                           \
+        size_t i = 0;                                                   \
+                                                                        \
+        for (; i + 2 <= n; i += 2) {                                    \
+            v = VOP(_mm_loadu_si128((const __m128i *)(dst + i)),        \
+                    _mm_loadu_si128((const __m128i *)(src + i)));       \
+            _mm_storeu_si128((__m128i *)(dst + i), v);                  \
+            any = _mm_or_si128(any, v);                                 \
+        }                                                               \
+        any = _mm_cmpeq_epi8(any, _mm_setzero_si128());                 \
+        return (_mm_movemask_epi8(any) != 0xffff) |                     \
+               name##_scalar(dst + i, src + i, n - i);                  \
+    }
+
+#define AVX2_OP(name, VOP)                                              \
+    static AVX2 int name##_avx2(uint64_t *dst, const uint64_t *src,     \
+                                size_t n)                               \
+    {                                                                   \
+        __m256i any = _mm256_setzero_si256(), v;                        \
+        size_t i = 0;                                                   \
+                                                                        \
+        for (; i + 4 <= n; i += 4) {                                    \
+            v = VOP(_mm256_loadu_si256((const __m256i *)(dst + i)),     \
+                    _mm256_loadu_si256((const __m256i *)(src + i)));    \
+            _mm256_storeu_si256((__m256i *)(dst + i), v);               \
+            any = _mm256_or_si256(any, v);                              \
+        }                                                               \
+        return (_mm256_testz_si256(any, any) == 0) |                    \
+               name##_scalar(dst + i, src + i, n - i);                  \
+    }
+
+SSE2_OP(op_and, _mm_and_si128)
+SSE2_OP(op_or, _mm_or_si128)
+SSE2_OP(op_xor, _mm_xor_si128)
+SSE2_OP(op_andnot, SSE2_ANDNOT)
+
+AVX2_OP(op_and, _mm256_and_si256)
+AVX2_OP(op_or, _mm256_or_si256)
+AVX2_OP(op_xor, _mm256_xor_si256)
+AVX2_OP(op_andnot, AVX2_ANDNOT)
+
+/* Bit counts of v, in four 64-bit lanes */
+static AVX2 __ALWAYS_INLINE __m256i popcount_avx2(__m256i v)
+{
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                            1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3,
+                                            1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i lo, hi;
+
+    lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low));
+    hi = _mm256_shuffle_epi8(lookup,
+                             _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+static AVX2 __ALWAYS_INLINE size_t hsum_avx2(__m256i v)
+{
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v),
+                              _mm256_extracti128_si256(v, 1));
+
+    return (size_t)(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+}
+
+static AVX2 size_t count_avx2(const uint64_t *w, size_t n)
+{
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0, rest = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        total = _mm256_add_epi64(total, popcount_avx2(
+                    _mm256_loadu_si256((const __m256i *)(w + i))));
+    }
+    for (; i < n; i++) {
+        rest += (size_t)__builtin_popcountll(w[i]);
+    }
+    return hsum_avx2(total) + rest;
+}
+
+static AVX2 size_t and_count_avx2(const uint64_t *a, const uint64_t *b,
+                                  size_t n)
+{
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0, rest = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        total = _mm256_add_epi64(total, popcount_avx2(_mm256_and_si256(
+                    _mm256_loadu_si256((const __m256i *)(a + i)),
+                    _mm256_loadu_si256((const __m256i *)(b + i)))));
+    }
+    for (; i < n; i++) {
+        rest += (size_t)__builtin_popcountll(a[i] & b[i]);
+    }
+    return hsum_avx2(total) + rest;
+}
+
+/* Independent sums, as popcnt has a latency of three cycles */
+static POPCNT size_t count_popcnt(const uint64_t *w, size_t n)
+{
+    size_t i = 0, t0 = 0, t1 = 0, t2 = 0, t3 = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        t0 += (size_t)__builtin_popcountll(w[i]);
+        t1 += (size_t)__builtin_popcountll(w[i + 1]);
+        t2 += (size_t)__builtin_popcountll(w[i + 2]);
+        t3 += (size_t)__builtin_popcountll(w[i + 3]);
+    }
+    for (; i < n; i++) {
+        t0 += (size_t)__builtin_popcountll(w[i]);
+    }
+    return t0 + t1 + t2 + t3;
+}
+
+static POPCNT size_t and_count_popcnt(const uint64_t *a, const uint64_t *b,
+                                      size_t n)
+{
+    size_t i = 0, t0 = 0, t1 = 0, t2 = 0, t3 = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        t0 += (size_t)__builtin_popcountll(a[i] & b[i]);
+        t1 += (size_t)__builtin_popcountll(a[i + 1] & b[i + 1]);
+        t2 += (size_t)__builtin_popcountll(a[i + 2] & b[i + 2]);
+        t3 += (size_t)__builtin_popcountll(a[i + 3] & b[i + 3]);
+    }
+    for (; i < n; i++) {
+        t0 += (size_t)__builtin_popcountll(a[i] & b[i]);
+    }
+    return t0 + t1 + t2 + t3;
+}
+#endif /* HAVE_X86 */
+
+#if defined(HAVE_NEON)
+#define NEON_ANDNOT(a, b)   vbicq_u64(a, b)
+
+#define NEON_OP(name, VOP)                                              \
+    static int name##_neon(uint64_t *dst, const uint64_t *src,          \
+                           size_t n)                                    \
+    {                                                                   \
+        uint64x2_t any = vdupq_n_u64(0), v;                             \
+        size_t i = 0;                                                   \
+                                                                        \
+        for (; i + 2 <= n; i += 2) {                                    \
+            v = VOP(vld1q_u64(dst + i), vld1q_u64(src + i));            \
+            vst1q_u64(dst + i, v);                                      \
+            any = vorrq_u64(any, v);                                    \
+        }                                                               \
+        return (vmaxvq_u32(vreinterpretq_u32_u64(any)) != 0) |          \
+               name##_scalar(dst + i, src + i, n - i);                  \
+    }
+
+NEON_OP(op_and, vandq_u64)
+NEON_OP(op_or, vorrq_u64)
+NEON_OP(op_xor, veorq_u64)
+NEON_OP(op_andnot, NEON_ANDNOT)
+
+static inline uint64x2_t popcount_neon(uint64x2_t v)
+{
+    return vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(
+               vcntq_u8(vreinterpretq_u8_u64(v)))));
+}
+
+static size_t count_neon(const uint64_t *w, size_t n)
+{
+    uint64x2_t total = vdupq_n_u64(0);
+    size_t i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        total = vaddq_u64(total, popcount_neon(vld1q_u64(w + i)));
+    }
+    return (size_t)vaddvq_u64(total) + count_scalar(w + i, n - i);
+}
+
+static size_t and_count_neon(const uint64_t *a, const uint64_t *b,
+                             size_t n)
+{
+    uint64x2_t total = vdupq_n_u64(0);
+    size_t i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        total = vaddq_u64(total, popcount_neon(
+                    vandq_u64(vld1q_u64(a + i), vld1q_u64(b + i))));
+    }
+    return (size_t)vaddvq_u64(total) + and_count_scalar(a + i, b + i, n - i);
+}
+#endif /* HAVE_NEON */
+
+/**********************************************************************
+ * Dispatch
+ *********************************************************************/
+#if defined(HAVE_X86)
+#define OP_VARIANTS(fn)                                                 \
+    __CPU_VARIANT(CPU_FEATURE_AVX2, fn##_avx2),                         \
+    __CPU_VARIANT(CPU_FEATURE_SSE2, fn##_sse2),                         \
+    __CPU_VARIANT(0, fn##_scalar)
+#define COUNT_VARIANTS(fn)                                              \
+    __CPU_VARIANT(CPU_FEATURE_AVX2 | CPU_FEATURE_POPCNT, fn##_avx2),    \
+    __CPU_VARIANT(CPU_FEATURE_POPCNT, fn##_popcnt),                     \
+    __CPU_VARIANT(0, fn##_scalar)
+#elif defined(HAVE_NEON)
+#define OP_VARIANTS(fn)                                                 \
+    __CPU_VARIANT(CPU_FEATURE_NEON, fn##_neon),                         \
+    __CPU_VARIANT(0, fn##_scalar)
+#define COUNT_VARIANTS(fn)  OP_VARIANTS(fn)
+#else
+#define OP_VARIANTS(fn)                                                 \
+    __CPU_VARIANT(0, fn##_scalar)
+#define COUNT_VARIANTS(fn)  OP_VARIANTS(fn)
+#endif
+
+#define DISPATCH_OP(name, fn)                                           \
+    __CPU_DISPATCH(int, name,                                           \
+                   (uint64_t *dst, const uint64_t *src, size_t n),      \
+                   (dst, src, n), OP_VARIANTS(fn))
+
+DISPATCH_OP(bitset_words_and, op_and)
+DISPATCH_OP(bitset_words_or, op_or)
+DISPATCH_OP(bitset_words_xor, op_xor)
+DISPATCH_OP(bitset_words_andnot, op_andnot)
+
+__CPU_DISPATCH(size_t, bitset_words_count, (const uint64_t *w, size_t n),
+               (w, n), COUNT_VARIANTS(count))
+
+__CPU_DISPATCH(size_t, bitset_words_and_count,
+               (const uint64_t *a, const uint64_t *b, size_t n),
+               (a, b, n), COUNT_VARIANTS(and_count))
+
+const char *bitset_impl(void)
+{
+    const char *name = __CPU_SELECTED(bitset_words_count)->name;
+
+    /* Variants are named <function>_<impl> */
+    return strrchr(name, '_') + 1;
+}
+
+/**********************************************************************
+ * Bitsets
+ *********************************************************************/
+int bitset_init(struct bitset *b, size_t nbits)
+{
+    b->words = NULL;
+    b->nbits = 0;
+    b->ranks = NULL;
+    b->ranks_valid = 0;
+    return bitset_resize(b, nbits);
+}
+
+void bitset_destroy(struct bitset *b)
+{
+    /* The rank samples share the allocation */
+    free(b->words);
+    b->words = NULL;
+    b->ranks = NULL;
+}
+
+int bitset_resize(struct bitset *b, size_t nbits)
+{
+    size_t n = (nbits + 63) / 64, old = bitset_words(b);
+    uint64_t *mem;
+
+    mem = calloc(n + n / RANK_WORDS + 1, sizeof(*mem));
+    if (mem == NULL) {
+        return -1;
+    }
+    if (b->words != NULL) {
+        memcpy(mem, b->words, (n < old ? n : old) * sizeof(*mem));
+        free(b->words);
+    }
+    if (nbits < b->nbits && nbits % 64 != 0) {
+        mem[n - 1] &= (1ULL << (nbits % 64)) - 1;
+    }
+
+    b->words = mem;
+    b->nbits = nbits;
+    b->ranks = mem + n;
+    b->ranks_valid = 0;
+    return 0;
+}
+
+void bitset_fill(struct bitset *b, int value)
+{
+    size_t n = bitset_words(b);
+
+    memset(b->words, value ? 0xff : 0, n * sizeof(*b->words));
+    if (value && b->nbits % 64 != 0) {
+        b->words[n - 1] = (1ULL << (b->nbits % 64)) - 1;
+    }
+    b->ranks_valid = 0;
+}
+
+size_t bitset_count(const struct bitset *b)
+{
+    return bitset_words_count(b->words, bitset_words(b));
+}
+
+ssize_t bitset_next_set(const struct bitset *b, size_t from)
+{
+    size_t i = from / 64, n = bitset_words(b);
+    uint64_t w;
+
+    if (from >= b->nbits) {
+        return -1;
+    }
+    w = b->words[i] & (~0ULL << (from % 64));
+    while (w == 0) {
+        if (++i == n) {
+            return -1;
+        }
+        w = b->words[i];
+    }
+    return (ssize_t)(i * 64 + (size_t)__builtin_ctzll(w));
+}
+
+ssize_t bitset_next_clear(const struct bitset *b, size_t from)
+{
+    size_t i = from / 64, n = bitset_words(b), pos;
+    uint64_t w;
+
+    if (from >= b->nbits) {
+        return -1;
+    }
+    w = ~b->words[i] & (~0ULL << (from % 64));
+    while (w == 0) {
+        if (++i == n) {
+            return -1;
+        }
+        w = ~b->words[i];
+    }
+
+    /* The unused bits of the last word are clear, but not part of it */
+    pos = i * 64 + (size_t)__builtin_ctzll(w);
+    return pos < b->nbits ? (ssize_t)pos : -1;
+}
+
+/* ranks[j] is the number of bits set in words [0, j * RANK_WORDS) */
+static void build_ranks(struct bitset *b)
+{
+    size_t n = bitset_words(b), j, total = 0;
+
+    for (j = 0; j < n / RANK_WORDS; j++) {
+        b->ranks[j] = total;
+        total += bitset_words_count(b->words + j * RANK_WORDS, RANK_WORDS);
+    }
+    b->ranks[j] = total;
+    b->ranks_valid = 1;
+}
+
+size_t bitset_rank(struct bitset *b, size_t i)
+{
+    size_t w = i / 64, j, r;
+
+    if (!b->ranks_valid) {
+        build_ranks(b);
+    }
+
+    r = b->ranks[w / RANK_WORDS];
+    for (j = w - w % RANK_WORDS; j < w; j++) {
+        r += popcount64(b->words[j]);
+    }
+    if (i % 64 != 0) {
+        r += popcount64(b->words[w] & ((1ULL << (i % 64)) - 1));
+    }
+    return r;
+}
+
+ssize_t bitset_select(struct bitset *b, size_t k)
+{
+    size_t n = bitset_words(b), lo = 0, len = n / RANK_WORDS + 1, half, w;
+    unsigned c;
+
+    if (!b->ranks_valid) {
+        build_ranks(b);
+    }
+
+    /*
+     * Find the last sample at or below k, as the bit is in the words
+     * after it. The search has no branches that depend on the data, so
+     * that it does not mispredict half of them.
+     */
+    while (len > 1) {
+        half = len / 2;
+        lo = b->ranks[lo + half] <= k ? lo + half : lo;
+        len -= half;
+    }
+
+    k -= b->ranks[lo];
+    for (w = lo * RANK_WORDS; w < n; w++) {
+        c = popcount64(b->words[w]);
+        if (k < c) {
+            return (ssize_t)(w * 64 + select64(b->words[w], (unsigned)k));
+        }
+        k -= c;
+    }
+    return -1;
+}
+
+#define BITSET_OP(name)                                                 \
+    int bitset_##name(struct bitset *dst, const struct bitset *src)     \
+    {                                                                   \
+        dst->ranks_valid = 0;                                           \
+        return bitset_words_##name(dst->words, src->words,              \
+                                   bitset_words(dst));                  \
+    }
+
+BITSET_OP(and)
+BITSET_OP(or)
+BITSET_OP(xor)
+BITSET_OP(andnot)
+
+size_t bitset_and_count(const struct bitset *a, const struct bitset *b)
+{
+    return bitset_words_and_count(a->words, b->words, bitset_words(a));
+}
@@ -0,0 +1,248 @@
+/**********************************************************************
+ * Dynamic bitset
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * A fixed number of bits, resizable, stored as an array of 64-bit words
+ * with bit i in bit i % 64 of word i / 64. Single bits are set, cleared
+ * and tested inline. Everything that looks at many bits works a word
+ * or a vector at a time: the bulk operations and population counts use
+ * AVX2 or SSE2 on x86 and NEON on AArch64, picked at startup, and the
+ * searches skip over whole words that cannot match.
+ *
+ * The bulk operations are also available on plain word arrays, for
+ * bitmaps that live somewhere other than a struct bitset.
+ *
+ * bitset_rank and bitset_select use a sampled index of the number of
+ * set bits before every 512th bit. It is rebuilt by the first rank or
+ * select after a change, which takes about as long as bitset_count, and
+ * then answers each query with one lookup and a few popcounts (plus a
+ * binary search, for select).
+ *
+ * Usage:
+ *      struct bitset b;
+ *      struct bitset_iter it;
+ *      ssize_t i;
+ *
+ *      bitset_init(&b, 1000);
+ *      bitset_set(&b, 42);
+ *      bitset_iter_init(&it, &b);
+ *      while ((i = bitset_iter_next(&it)) >= 0) {
+ *          ...
+ *      }
+ *      bitset_destroy(&b);
+ *
+ * C++ code can use lub::bitset, defined at the end of this file.
+ *********************************************************************/
+
+#ifndef __BITSET_H
+#define __BITSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+struct bitset {
+    uint64_t *words;
+    size_t nbits;
+    uint64_t *ranks;            /* Set bits before each 512 bit block */
+    int ranks_valid;
+};
+
+/*
+ * Initialize a bitset of nbits bits, all clear. Returns 0, or -1 with
+ * errno set to ENOMEM.
+ */
+int bitset_init(struct bitset *b, size_t nbits);
+
+/* Release the memory held by the bitset */
+void bitset_destroy(struct bitset *b);
+
+/*
+ * Change the number of bits, keeping the values of those below both the
+ * old and new sizes, and clearing any new ones. Returns 0, or -1 with
+ * errno set to ENOMEM, leaving the bitset unchanged.
+ */
+int bitset_resize(struct bitset *b, size_t nbits);
+
+static inline size_t bitset_size(const struct bitset *b)
+{
+    return b->nbits;
+}
+
+/* Words in use, the last of which has its bits from nbits onwards clear */
+static inline size_t bitset_words(const struct bitset *b)
+{
+    return (b->nbits + 63) / 64;
+}
+
+/* i must be less than the size */
+static inline int bitset_test(const struct bitset *b, size_t i)
+{
+    return (int)((b->words[i / 64] >> (i % 64)) & 1);
+}
+
+static inline void bitset_set(struct bitset *b, size_t i)
+{
+    b->words[i / 64] |= 1ULL << (i % 64);
+    b->ranks_valid = 0;
+}
+
+static inline void bitset_clear(struct bitset *b, size_t i)
+{
+    b->words[i / 64] &= ~(1ULL << (i % 64));
+    b->ranks_valid = 0;
+}
+
+/* Set every bit if value is nonzero, or clear every bit if it is 0 */
+void bitset_fill(struct bitset *b, int value);
+
+/* Number of set bits */
+size_t bitset_count(const struct bitset *b);
+
+/*
+ * Index of the first set (or clear) bit at or after from, or -1 if there
+ * is none.
+ */
+ssize_t bitset_next_set(const struct bitset *b, size_t from);
+ssize_t bitset_next_clear(const struct bitset *b, size_t from);
+
+/*
+ * Iteration over the set bits. This is faster than bitset_next_set in a
+ * loop, as the word being looked at is kept rather than read again for
+ * every bit. The bitset must not be resized while it is iterated over.
+ */
+struct bitset_iter {
+    const uint64_t *words;
+    size_t nwords;
+    size_t i;                   /* Index of the current word */
+    uint64_t w;                 /* Its bits not yet returned */
+};
+
+static inline void bitset_iter_init(struct bitset_iter *it,
+                                    const struct bitset *b)
+{
+    it->words = b->words;
+    it->nwords = bitset_words(b);
+    it->i = 0;
+    it->w = it->nwords > 0 ? b->words[0] : 0;
+}
+
+/* Index of the next set bit, or -1 after the last */
+static inline ssize_t bitset_iter_next(struct bitset_iter *it)
+{
+    size_t bit;
+
+    while (it->w == 0) {
+        if (it->i + 1 >= it->nwords) {
+            return -1;
+        }
+        it->w = it->words[++it->i];
+    }
+    bit = it->i * 64 + (size_t)__builtin_ctzll(it->w);
+    it->w &= it->w - 1;
+    return (ssize_t)bit;
+}
+
+/* Number of set bits before bit i, for i up to the size */
+size_t bitset_rank(struct bitset *b, size_t i);
+
+/* Index of the set bit with rank k (counting from 0), or -1 if k >= count */
+ssize_t bitset_select(struct bitset *b, size_t k);
+
+/*
+ * dst = dst op src, for two bitsets of the same size. Each returns 1 if
+ * any bit of the result is set, and 0 if none is.
+ */
+int bitset_and(struct bitset *dst, const struct bitset *src);
+int bitset_or(struct bitset *dst, const struct bitset *src);
+int bitset_xor(struct bitset *dst, const struct bitset *src);
+int bitset_andnot(struct bitset *dst, const struct bitset *src);
+
+/* Number of bits set in both a and b, which must have the same size */
+size_t bitset_and_count(const struct bitset *a, const struct bitset *b);
+
+/* The same operations, on arrays of n words */
+int bitset_words_and(uint64_t *dst, const uint64_t *src, size_t n);
+int bitset_words_or(uint64_t *dst, const uint64_t *src, size_t n);
+int bitset_words_xor(uint64_t *dst, const uint64_t *src, size_t n);
+int bitset_words_andnot(uint64_t *dst, const uint64_t *src, size_t n);
+size_t bitset_words_count(const uint64_t *w, size_t n);
+size_t bitset_words_and_count(const uint64_t *a, const uint64_t *b,
+                              size_t n);
+
+/* Name of the kernel in use, e.g. "avx2" */
+const char *bitset_impl(void);
+
+__CDECL_END
+
+#ifdef __cplusplus
+#include <new>
+
+namespace lub {
+
+class bitset {
+    struct ::bitset b;
+
+public:
+    explicit bitset(size_t nbits = 0)
+    {
+        if (bitset_init(&b, nbits)) {
+            throw std::bad_alloc();
+        }
+    }
+
+    ~bitset() { bitset_destroy(&b); }
+
+    bitset(const bitset &) = delete;
+    bitset &operator=(const bitset &) = delete;
+
+    size_t size() const { return bitset_size(&b); }
+
+    void resize(size_t nbits)
+    {
+        if (bitset_resize(&b, nbits)) {
+            throw std::bad_alloc();
+        }
+    }
+
+    bool test(size_t i) const { return bitset_test(&b, i) != 0; }
+    void set(size_t i) { bitset_set(&b, i); }
+    void reset(size_t i) { bitset_clear(&b, i); }
+    void fill(bool value) { bitset_fill(&b, value); }
+
+    size_t count() const { return bitset_count(&b); }
+    size_t rank(size_t i) { return bitset_rank(&b, i); }
+    ssize_t select(size_t k) { return bitset_select(&b, k); }
+    ssize_t next_set(size_t from) const { return bitset_next_set(&b, from); }
+
+    ssize_t next_clear(size_t from) const
+    {
+        return bitset_next_clear(&b, from);
+    }
+
+    bitset &operator&=(const bitset &o) { bitset_and(&b, &o.b); return *this; }
+    bitset &operator|=(const bitset &o) { bitset_or(&b, &o.b); return *this; }
+    bitset &operator^=(const bitset &o) { bitset_xor(&b, &o.b); return *this; }
+
+    /* Call fn(i) for every set bit i, in increasing order */
+    template <typename F>
+    void for_each(F fn) const
+    {
+        struct bitset_iter it;
+        ssize_t i;
+
+        bitset_iter_init(&it, &b);
+        while ((i = bitset_iter_next(&it)) >= 0) {
+            fn((size_t)i);
+        }
+    }
+};
+
+} /* namespace lub */
+#endif /* __cplusplus */
+
+#endif /* !defined __BITSET_H */
@@ -0,0 +1,840 @@
+/**********************************************************************
+ * B+tree of 64-bit keys
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Inner nodes hold up to NODE_KEYS separators and one more child than
+ * separators. Separator i is the largest key under child i, and the
+ * keys under the last child are greater than every separator, so the
+ * child to follow for a key is the number of separators less than it,
+ * and the slot for a key in a leaf is the number of keys less than it.
+ * Unused key slots hold UINT64_MAX, which is never less than anything,
+ * so both counts can be taken over the whole key array at once.
+ *
+ * A full node is split in two on insertion, and the middle separator
+ * goes up; a node that falls below MIN_KEYS keys on erasure takes keys
+ * from a neighbour, or is merged with it if both would fit in one node.
+ * Insertion at the far end of the last leaf splits it unevenly, leaving
+ * it full, so keys added in ascending order pack the leaves as
+ * btree_load would. Every node but the root therefore holds at least
+ * MIN_KEYS keys, except the last leaf after such an append, which may
+ * hold as few as one until more keys arrive or erasure merges it.
+ *********************************************************************/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "btree.h"
+#include "compiler.h"
+#include "cpu_features.h"
+
+#if defined(__x86_64__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Keys per node, a multiple of 4 up to 64 */
+#ifndef BTREE_NODE_KEYS
+#define BTREE_NODE_KEYS     16
+#endif
+
+#if BTREE_NODE_KEYS % 4 || BTREE_NODE_KEYS > 64
+#error "BTREE_NODE_KEYS must be a multiple of 4 no greater than 64"
+#endif
+
+#define NODE_KEYS       BTREE_NODE_KEYS
+#define MIN_KEYS        (NODE_KEYS / 2)
+
+/* Key of unused slots */
+#define PAD             UINT64_MAX
+
+/* With nodes at least half full, 2^64 keys need fewer levels than this */
+#define MAX_HEIGHT      32
+
+struct btree_leaf {
+    uint64_t keys[NODE_KEYS];
+    uint64_t values[NODE_KEYS];
+    struct btree_leaf *next;
+    unsigned int count;
+} __CACHELINE_ALIGNED;
+
+struct btree_inner {
+    uint64_t keys[NODE_KEYS];
+    void *children[NODE_KEYS + 1];
+    unsigned int count;             /* Keys, one less than children */
+} __CACHELINE_ALIGNED;
+
+/* The nodes passed on the way down, from the leaf (0) up to the root */
+struct path {
+    void *nodes[MAX_HEIGHT];
+    unsigned int slots[MAX_HEIGHT]; /* Child followed, or slot in leaf */
+};
+
+/**********************************************************************
+ * In-node search
+ *********************************************************************/
+static inline unsigned int count_less_scalar(const uint64_t *keys,
+                                             uint64_t key)
+{
+    unsigned int i, n = 0;
+
+    for (i = 0; i < NODE_KEYS; i++) {
+        n += keys[i] < key;
+    }
+    return n;
+}
+
+#if defined(HAVE_X86)
+#define AVX2    __attribute__((target("avx2,popcnt")))
+#define SSE42   __attribute__((target("sse4.2,popcnt")))
+
+/*
+ * There are only signed 64-bit compares, so both sides have their top
+ * bits flipped first, which orders them as unsigned values.
+ */
+static AVX2 __ALWAYS_INLINE unsigned int count_less_avx2(const uint64_t *keys,
+                                                         uint64_t key)
+{
+    const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+    __m256i k = _mm256_xor_si256(_mm256_set1_epi64x((long long)key), bias);
+    __m256i v;
+    uint64_t mask = 0;
+    unsigned int i;
+
+    for (i = 0; i < NODE_KEYS; i += 4) {
+        v = _mm256_xor_si256(_mm256_load_si256((const __m256i *)(keys + i)),
+                             bias);
+        mask |= (uint64_t)_mm256_movemask_pd(
+                    _mm256_castsi256_pd(_mm256_cmpgt_epi64(k, v))) << i;
+    }
+    return (unsigned int)__builtin_popcountll(mask);
+}
+
+static SSE42 __ALWAYS_INLINE unsigned int
+count_less_sse42(const uint64_t *keys, uint64_t key)
+{
+    const __m128i bias = _mm_set1_epi64x(INT64_MIN);
+    __m128i k = _mm_xor_si128(_mm_set1_epi64x((long long)key), bias);
+    __m128i v;
+    uint64_t mask = 0;
+    unsigned int i;
+
+    for (i = 0; i < NODE_KEYS; i += 2) {
+        v = _mm_xor_si128(_mm_load_si128((const __m128i *)(keys + i)), bias);
+        mask |= (uint64_t)_mm_movemask_pd(
+                    _mm_castsi128_pd(_mm_cmpgt_epi64(k, v))) << i;
+    }
+    return (unsigned int)__builtin_popcountll(mask);
+}
+#endif /* HAVE_X86 */
+
+#if defined(HAVE_NEON)
+/* Each matching lane is all ones, so subtracting it counts one */
+static inline unsigned int count_less_neon(const uint64_t *keys,
+                                           uint64_t key)
+{
+    uint64x2_t k = vdupq_n_u64(key), n = vdupq_n_u64(0);
+    unsigned int i;
+
+    for (i = 0; i < NODE_KEYS; i += 2) {
+        n = vsubq_u64(n, vcltq_u64(vld1q_u64(keys + i), k));
+    }
+    return (unsigned int)(vgetq_lane_u64(n, 0) + vgetq_lane_u64(n, 1));
+}
+#endif /* HAVE_NEON */
+
+/*
+ * Walk down from the root, which must exist, to the leaf where key is
+ * or would be, recording the way in path. Returns the slot in the leaf.
+ */
+#define DESCEND(name, ATTR, count_less)                                 \
+    static ATTR unsigned int name(const struct btree *t, uint64_t key,  \
+                                  struct path *path)                    \
+    {                                                                   \
+        const struct btree_inner *inner;                                \
+        void *node = t->root;                                           \
+        unsigned int level, slot;                                       \
+                                                                        \
+        for (level = t->height; level > 0; level--) {                   \
+            inner = (const struct btree_inner *)node;                   \
+            slot = count_less(inner->keys, key);                        \
+            path->nodes[level] = node;                                  \
+            path->slots[level] = slot;                                  \
+            node = inner->children[slot];                               \
+        }                                                               \
+        slot = count_less(((const struct btree_leaf *)node)->keys, key); \
+        path->nodes[0] = node;                                          \
+        path->slots[0] = slot;                                          \
+        return slot;                                                    \
+    }
+
+DESCEND(descend_scalar, , count_less_scalar)
+
+#if defined(HAVE_X86)
+DESCEND(descend_avx2, AVX2, count_less_avx2)
+DESCEND(descend_sse42, SSE42, count_less_sse42)
+
+#define DESCEND_VARIANTS                                                \
+    __CPU_VARIANT(CPU_FEATURE_AVX2 | CPU_FEATURE_POPCNT, descend_avx2), \
+    __CPU_VARIANT(CPU_FEATURE_SSE4_2 | CPU_FEATURE_POPCNT, descend_sse42), \
+    __CPU_VARIANT(0, descend_scalar)
+#elif defined(HAVE_NEON)
+DESCEND(descend_neon, , count_less_neon)
+
+#define DESCEND_VARIANTS                                                \
+    __CPU_VARIANT(CPU_FEATURE_NEON, descend_neon),                      \
+    __CPU_VARIANT(0, descend_scalar)
+#else
+#define DESCEND_VARIANTS                                                \
+    __CPU_VARIANT(0, descend_scalar)
+#endif
+
+__CPU_DISPATCH_STATIC(unsigned int, descend,
+                      (const struct btree *t, uint64_t key,
+                       struct path *path),
+                      (t, key, path), DESCEND_VARIANTS)
+
+const char *btree_impl(void)
+{
+    const char *name = __CPU_SELECTED(descend)->name;
+
+    /* Variants are named <function>_<impl> */
+    return strrchr(name, '_') + 1;
+}
+
+/**********************************************************************
+ * Nodes
+ *********************************************************************/
+static void *node_alloc(size_t size)
+{
+    uint64_t *keys;
+    void *node;
+
+    if (posix_memalign(&node, __CACHELINE_SIZE, size)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* Both kinds of node start with their keys */
+    keys = (uint64_t *)node;
+    memset(keys, 0xff, NODE_KEYS * sizeof(*keys));
+    return node;
+}
+
+static struct btree_leaf *leaf_alloc(void)
+{
+    struct btree_leaf *leaf = node_alloc(sizeof(*leaf));
+
+    if (leaf) {
+        leaf->next = NULL;
+        leaf->count = 0;
+    }
+    return leaf;
+}
+
+static struct btree_inner *inner_alloc(void)
+{
+    struct btree_inner *inner = node_alloc(sizeof(*inner));
+
+    if (inner) {
+        inner->count = 0;
+    }
+    return inner;
+}
+
+static void free_subtree(void *node, unsigned int height)
+{
+    struct btree_inner *inner = node;
+    unsigned int i;
+
+    if (height > 0) {
+        for (i = 0; i <= inner->count; i++) {
+            free_subtree(inner->children[i], height - 1);
+        }
+    }
+    free(node);
+}
+
+/* Insert key, with a value of 0, at pos in a leaf with room */
+static void leaf_insert(struct btree_leaf *leaf, unsigned int pos,
+                        uint64_t key)
+{
+    unsigned int n = leaf->count - pos;
+
+    memmove(leaf->keys + pos + 1, leaf->keys + pos, n * sizeof(uint64_t));
+    memmove(leaf->values + pos + 1, leaf->values + pos,
+            n * sizeof(uint64_t));
+    leaf->keys[pos] = key;
+    leaf->values[pos] = 0;
+    leaf->count++;
+}
+
+/* Move the n entries from pos on to the start of the empty leaf to */
+static void leaf_move(struct btree_leaf *leaf, unsigned int pos,
+                      struct btree_leaf *to)
+{
+    unsigned int n = leaf->count - pos;
+
+    memcpy(to->keys, leaf->keys + pos, n * sizeof(uint64_t));
+    memcpy(to->values, leaf->values + pos, n * sizeof(uint64_t));
+    memset(leaf->keys + pos, 0xff, n * sizeof(uint64_t));
+    to->count = n;
+    leaf->count = pos;
+}
+
+/*
+ * Split a full leaf, moving its upper entries to the new leaf right,
+ * and insert key at pos. Returns a pointer to the key's value.
+ */
+static uint64_t *leaf_split(struct btree_leaf *leaf, struct btree_leaf *right,
+                            unsigned int pos, uint64_t key)
+{
+    unsigned int half = (NODE_KEYS + 1) / 2;
+    uint64_t *value;
+
+    if (pos == NODE_KEYS && leaf->next == NULL) {
+        /* Appending to the whole tree: leave this leaf full */
+        half = NODE_KEYS;
+    }
+    if (pos < half) {
+        leaf_move(leaf, half - 1, right);
+        leaf_insert(leaf, pos, key);
+        value = &leaf->values[pos];
+    } else {
+        leaf_move(leaf, half, right);
+        leaf_insert(right, pos - half, key);
+        value = &right->values[pos - half];
+    }
+    right->next = leaf->next;
+    leaf->next = right;
+    return value;
+}
+
+/* Insert sep and, after it, child at slot s of an inner node with room */
+static void inner_insert(struct btree_inner *inner, unsigned int s,
+                         uint64_t sep, void *child)
+{
+    unsigned int n = inner->count - s;
+
+    memmove(inner->keys + s + 1, inner->keys + s, n * sizeof(uint64_t));
+    memmove(inner->children + s + 2, inner->children + s + 1,
+            n * sizeof(void *));
+    inner->keys[s] = sep;
+    inner->children[s + 1] = child;
+    inner->count++;
+}
+
+/*
+ * Split a full inner node while inserting sep and child at slot s,
+ * moving the upper half to the new node right. Returns the separator
+ * for the parent, which belongs to neither half.
+ */
+static uint64_t inner_split(struct btree_inner *inner,
+                            struct btree_inner *right, unsigned int s,
+                            uint64_t sep, void *child)
+{
+    uint64_t keys[NODE_KEYS + 1];
+    void *children[NODE_KEYS + 2];
+    unsigned int half = (NODE_KEYS + 1) / 2, n = NODE_KEYS;
+
+    memcpy(keys, inner->keys, s * sizeof(uint64_t));
+    keys[s] = sep;
+    memcpy(keys + s + 1, inner->keys + s, (n - s) * sizeof(uint64_t));
+    memcpy(children, inner->children, (s + 1) * sizeof(void *));
+    children[s + 1] = child;
+    memcpy(children + s + 2, inner->children + s + 1,
+           (n - s) * sizeof(void *));
+
+    memcpy(inner->keys, keys, half * sizeof(uint64_t));
+    memset(inner->keys + half, 0xff, (n - half) * sizeof(uint64_t));
+    memcpy(inner->children, children, (half + 1) * sizeof(void *));
+    inner->count = half;
+
+    memcpy(right->keys, keys + half + 1, (n - half) * sizeof(uint64_t));
+    memcpy(right->children, children + half + 1,
+           (n - half + 1) * sizeof(void *));
+    right->count = n - half;
+    return keys[half];
+}
+
+/* Remove separator s and the child after it from an inner node */
+static void inner_remove(struct btree_inner *inner, unsigned int s)
+{
+    unsigned int n = inner->count - s - 1;
+
+    memmove(inner->keys + s, inner->keys + s + 1, n * sizeof(uint64_t));
+    memmove(inner->children + s + 1, inner->children + s + 2,
+            n * sizeof(void *));
+    inner->count--;
+    inner->keys[inner->count] = PAD;
+}
+
+/*
+ * Hand the separator and new node from a split at the top of path up,
+ * splitting full nodes on the way with the spare nodes allocated for
+ * them, and the last spare for a new root if the root splits.
+ */
+static void grow(struct btree *t, const struct path *path, uint64_t sep,
+                 void *child, struct btree_inner **spare)
+{
+    struct btree_inner *inner, *right, *root;
+    unsigned int level;
+
+    for (level = 1; level <= t->height; level++) {
+        inner = path->nodes[level];
+        if (inner->count < NODE_KEYS) {
+            inner_insert(inner, path->slots[level], sep, child);
+            return;
+        }
+        right = *spare++;
+        sep = inner_split(inner, right, path->slots[level], sep, child);
+        child = right;
+    }
+    root = *spare;
+    root->keys[0] = sep;
+    root->children[0] = t->root;
+    root->children[1] = child;
+    root->count = 1;
+    t->root = root;
+    t->height++;
+}
+
+/*
+ * Even out leaves left and right, which are children s and s + 1 of
+ * parent, or merge them if they fit in one. Returns 1 if merged.
+ */
+static int leaf_rebalance(struct btree_inner *parent, unsigned int s,
+                          struct btree_leaf *left, struct btree_leaf *right)
+{
+    unsigned int n;
+
+    if (left->count + right->count <= NODE_KEYS) {
+        memcpy(left->keys + left->count, right->keys,
+               right->count * sizeof(uint64_t));
+        memcpy(left->values + left->count, right->values,
+               right->count * sizeof(uint64_t));
+        left->count += right->count;
+        left->next = right->next;
+        free(right);
+        inner_remove(parent, s);
+        return 1;
+    }
+
+    if (left->count < right->count) {
+        n = (right->count - left->count) / 2;
+        memcpy(left->keys + left->count, right->keys, n * sizeof(uint64_t));
+        memcpy(left->values + left->count, right->values,
+               n * sizeof(uint64_t));
+        left->count += n;
+        right->count -= n;
+        memmove(right->keys, right->keys + n,
+                right->count * sizeof(uint64_t));
+        memmove(right->values, right->values + n,
+                right->count * sizeof(uint64_t));
+        memset(right->keys + right->count, 0xff, n * sizeof(uint64_t));
+    } else {
+        n = (left->count - right->count) / 2;
+        memmove(right->keys + n, right->keys,
+                right->count * sizeof(uint64_t));
+        memmove(right->values + n, right->values,
+                right->count * sizeof(uint64_t));
+        left->count -= n;
+        right->count += n;
+        memcpy(right->keys, left->keys + left->count, n * sizeof(uint64_t));
+        memcpy(right->values, left->values + left->count,
+               n * sizeof(uint64_t));
+        memset(left->keys + left->count, 0xff, n * sizeof(uint64_t));
+    }
+    parent->keys[s] = left->keys[left->count - 1];
+    return 0;
+}
+
+/* As leaf_rebalance, for inner nodes, rotating through separator s */
+static int inner_rebalance(struct btree_inner *parent, unsigned int s,
+                           struct btree_inner *left,
+                           struct btree_inner *right)
+{
+    unsigned int n;
+
+    if (left->count + 1 + right->count <= NODE_KEYS) {
+        left->keys[left->count] = parent->keys[s];
+        memcpy(left->keys + left->count + 1, right->keys,
+               right->count * sizeof(uint64_t));
+        memcpy(left->children + left->count + 1, right->children,
+               (right->count + 1) * sizeof(void *));
+        left->count += right->count + 1;
+        free(right);
+        inner_remove(parent, s);
+        return 1;
+    }
+
+    if (left->count < right->count) {
+        /* The first n children of right move to the end of left */
+        n = (right->count - left->count) / 2;
+        left->keys[left->count] = parent->keys[s];
+        memcpy(left->keys + left->count + 1, right->keys,
+               (n - 1) * sizeof(uint64_t));
+        memcpy(left->children + left->count + 1, right->children,
+               n * sizeof(void *));
+        parent->keys[s] = right->keys[n - 1];
+        left->count += n;
+        right->count -= n;
+        memmove(right->keys, right->keys + n,
+                right->count * sizeof(uint64_t));
+        memmove(right->children, right->children + n,
+                (right->count + 1) * sizeof(void *));
+        memset(right->keys + right->count, 0xff, n * sizeof(uint64_t));
+    } else {
+        /* The last n children of left move to the start of right */
+        n = (left->count - right->count) / 2;
+        memmove(right->keys + n, right->keys,
+                right->count * sizeof(uint64_t));
+        memmove(right->children + n, right->children,
+                (right->count + 1) * sizeof(void *));
+        right->keys[n - 1] = parent->keys[s];
+        memcpy(right->keys, left->keys + left->count - n + 1,
+               (n - 1) * sizeof(uint64_t));
+        memcpy(right->children, left->children + left->count - n + 1,
+               n * sizeof(void *));
+        parent->keys[s] = left->keys[left->count - n];
+        left->count -= n;
+        right->count += n;
+        memset(left->keys + left->count, 0xff, n * sizeof(uint64_t));
+    }
+    return 0;
+}
+
+/* Fix up the node at level of path, which has fallen below MIN_KEYS */
+static void shrink(struct btree *t, const struct path *path,
+                   unsigned int level)
+{
+    struct btree_inner *parent;
+    unsigned int s;
+    int merged;
+
+    for (;;) {
+        /* Pair the node with the sibling after it, or before if last */
+        parent = path->nodes[level + 1];
+        s = path->slots[level + 1];
+        if (s == parent->count) {
+            s--;
+        }
+        if (level == 0) {
+            merged = leaf_rebalance(parent, s, parent->children[s],
+                                    parent->children[s + 1]);
+        } else {
+            merged = inner_rebalance(parent, s, parent->children[s],
+                                     parent->children[s + 1]);
+        }
+        if (!merged) {
+            return;
+        }
+
+        /* The parent has lost a separator */
+        level++;
+        if (level == t->height) {
+            if (parent->count == 0) {
+                t->root = parent->children[0];
+                t->height--;
+                free(parent);
+            }
+            return;
+        }
+        if (parent->count >= MIN_KEYS) {
+            return;
+        }
+    }
+}
+
+/**********************************************************************
+ * Trees
+ *********************************************************************/
+void btree_init(struct btree *t)
+{
+    t->root = NULL;
+    t->height = 0;
+    t->size = 0;
+}
+
+void btree_destroy(struct btree *t)
+{
+    if (t->root) {
+        free_subtree(t->root, t->height);
+    }
+    t->root = NULL;
+}
+
+void btree_clear(struct btree *t)
+{
+    btree_destroy(t);
+    btree_init(t);
+}
+
+uint64_t *btree_find(const struct btree *t, uint64_t key)
+{
+    struct btree_leaf *leaf;
+    struct path path;
+    unsigned int pos;
+
+    if (t->root == NULL) {
+        return NULL;
+    }
+    pos = descend(t, key, &path);
+    leaf = path.nodes[0];
+    if (pos < leaf->count && leaf->keys[pos] == key) {
+        return &leaf->values[pos];
+    }
+    return NULL;
+}
+
+uint64_t *btree_insert(struct btree *t, uint64_t key, int *inserted)
+{
+    struct btree_inner *spare[MAX_HEIGHT];
+    struct btree_leaf *leaf, *right;
+    struct path path;
+    unsigned int pos, level, nspare, i;
+    uint64_t *value;
+
+    if (t->root == NULL) {
+        if ((t->root = leaf_alloc()) == NULL) {
+            return NULL;
+        }
+        t->height = 0;
+    }
+    pos = descend(t, key, &path);
+    leaf = path.nodes[0];
+    if (pos < leaf->count && leaf->keys[pos] == key) {
+        if (inserted) {
+            *inserted = 0;
+        }
+        return &leaf->values[pos];
+    }
+
+    if (leaf->count < NODE_KEYS) {
+        leaf_insert(leaf, pos, key);
+        value = &leaf->values[pos];
+    } else {
+        /*
+         * Allocate every node the split will need before changing
+         * anything: one per full inner node above the leaf, and a new
+         * root if they are full all the way up.
+         */
+        for (level = 1; level <= t->height; level++) {
+            if (((struct btree_inner *)path.nodes[level])->count <
+                NODE_KEYS) {
+                break;
+            }
+        }
+        nspare = level - 1 + (level > t->height);
+        right = leaf_alloc();
+        for (i = 0; right != NULL && i < nspare; i++) {
+            if ((spare[i] = inner_alloc()) == NULL) {
+                break;
+            }
+        }
+        if (right == NULL || i < nspare) {
+            free(right);
+            while (i-- > 0) {
+                free(spare[i]);
+            }
+            return NULL;
+        }
+        value = leaf_split(leaf, right, pos, key);
+        grow(t, &path, leaf->keys[leaf->count - 1], right, spare);
+    }
+    t->size++;
+    if (inserted) {
+        *inserted = 1;
+    }
+    return value;
+}
+
+int btree_put(struct btree *t, uint64_t key, uint64_t value)
+{
+    uint64_t *v = btree_insert(t, key, NULL);
+
+    if (v == NULL) {
+        return -1;
+    }
+    *v = value;
+    return 0;
+}
+
+int btree_erase(struct btree *t, uint64_t key)
+{
+    struct btree_leaf *leaf;
+    struct path path;
+    unsigned int pos, n;
+
+    if (t->root == NULL) {
+        return 0;
+    }
+    pos = descend(t, key, &path);
+    leaf = path.nodes[0];
+    if (pos >= leaf->count || leaf->keys[pos] != key) {
+        return 0;
+    }
+
+    n = leaf->count - pos - 1;
+    memmove(leaf->keys + pos, leaf->keys + pos + 1, n * sizeof(uint64_t));
+    memmove(leaf->values + pos, leaf->values + pos + 1,
+            n * sizeof(uint64_t));
+    leaf->count--;
+    leaf->keys[leaf->count] = PAD;
+    t->size--;
+
+    if (t->height == 0) {
+        if (leaf->count == 0) {
+            free(leaf);
+            t->root = NULL;
+        }
+    } else if (leaf->count < MIN_KEYS) {
+        shrink(t, &path, 0);
+    }
+    return 1;
+}
+
+int btree_load(struct btree *t, const uint64_t *keys, const uint64_t *values,
+               size_t n)
+{
+    struct btree_leaf *leaf, *prev = NULL;
+    struct btree_inner *inner;
+    void **nodes = NULL;
+    uint64_t *maxes = NULL;
+    size_t i, j = 0, c, count, per, extra, next;
+    unsigned int k, height = 0;
+
+    btree_clear(t);
+    for (i = 1; i < n; i++) {
+        if (keys[i] <= keys[i - 1]) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    /*
+     * Spread the keys evenly over as few leaves as will hold them, so
+     * every leaf is at least half full, then build each level of inner
+     * nodes over the one below in the same way.
+     */
+    count = (n + NODE_KEYS - 1) / NODE_KEYS;
+    nodes = malloc(count * sizeof(*nodes));
+    maxes = malloc(count * sizeof(*maxes));
+    if (nodes == NULL || maxes == NULL) {
+        goto error_leaves;
+    }
+    per = n / count;
+    extra = n % count;
+    for (i = j = 0; j < count; j++) {
+        if ((leaf = leaf_alloc()) == NULL) {
+            goto error_leaves;
+        }
+        leaf->count = (unsigned int)(per + (j < extra));
+        memcpy(leaf->keys, keys + i, leaf->count * sizeof(uint64_t));
+        if (values) {
+            memcpy(leaf->values, values + i,
+                   leaf->count * sizeof(uint64_t));
+        } else {
+            memset(leaf->values, 0, leaf->count * sizeof(uint64_t));
+        }
+        i += leaf->count;
+        if (prev) {
+            prev->next = leaf;
+        }
+        prev = leaf;
+        nodes[j] = leaf;
+        maxes[j] = keys[i - 1];
+    }
+
+    while (count > 1) {
+        next = (count + NODE_KEYS) / (NODE_KEYS + 1);
+        per = count / next;
+        extra = count % next;
+
+        /* Each new node is stored over children already taken */
+        for (c = j = 0; j < next; j++) {
+            if ((inner = inner_alloc()) == NULL) {
+                for (i = 0; i < j; i++) {
+                    free_subtree(nodes[i], height + 1);
+                }
+                for (i = c; i < count; i++) {
+                    free_subtree(nodes[i], height);
+                }
+                goto error;
+            }
+            inner->count = (unsigned int)(per + (j < extra) - 1);
+            for (k = 0; k <= inner->count; k++, c++) {
+                inner->children[k] = nodes[c];
+                if (k < inner->count) {
+                    inner->keys[k] = maxes[c];
+                }
+            }
+            nodes[j] = inner;
+            maxes[j] = maxes[c - 1];
+        }
+        count = next;
+        height++;
+    }
+
+    t->root = nodes[0];
+    t->height = height;
+    t->size = n;
+    free(nodes);
+    free(maxes);
+    return 0;
+
+error_leaves:
+    if (nodes) {
+        for (i = 0; i < j; i++) {
+            free(nodes[i]);
+        }
+    }
+error:
+    free(nodes);
+    free(maxes);
+    errno = ENOMEM;
+    return -1;
+}
+
+void btree_seek(const struct btree *t, uint64_t key, struct btree_iter *it)
+{
+    struct path path;
+
+    it->leaf = NULL;
+    it->pos = 0;
+    if (t->root == NULL) {
+        return;
+    }
+    it->pos = descend(t, key, &path);
+    it->leaf = path.nodes[0];
+    if (it->pos == it->leaf->count) {
+        it->leaf = it->leaf->next;
+        it->pos = 0;
+    }
+}
+
+int btree_next(struct btree_iter *it, uint64_t *key, uint64_t *value)
+{
+    const struct btree_leaf *leaf = it->leaf;
+
+    if (leaf == NULL) {
+        return 0;
+    }
+    if (key) {
+        *key = leaf->keys[it->pos];
+    }
+    if (value) {
+        *value = leaf->values[it->pos];
+    }
+    if (++it->pos == leaf->count) {
+        it->leaf = leaf->next;
+        it->pos = 0;
+    }
+    return 1;
+}
@@ -0,0 +1,122 @@
+/**********************************************************************
+ * B+tree of 64-bit keys
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * An ordered map from uint64_t keys to uint64_t values, for in-memory
+ * indexes of tens of millions of keys. A red-black tree or skip list
+ * spends two or three pointers per key and takes a cache miss at every
+ * level of a tree some 25 levels deep; here nodes are whole, aligned
+ * cache lines holding 16 keys each, so a lookup in 50 million keys
+ * visits six or seven nodes. A full leaf takes 20 bytes per key, value
+ * included, against 40 or more for a node per key.
+ *
+ * The keys of a node sit together in its first two cache lines, padded
+ * out with UINT64_MAX, and the position of a key within a node is found
+ * by comparing it against all 16 at once with SIMD compares (AVX2 or
+ * SSE4.2 on x86, picked at run time, and NEON on ARM) and counting the
+ * smaller ones, with no branches to mispredict.
+ *
+ * btree_load builds a tree from sorted input bottom up, in linear time,
+ * with every node as full as it can be, which is much faster than
+ * inserting the keys one by one and gives a smaller tree. Leaves are
+ * chained in key order, so a range is read by seeking to its start and
+ * walking forward.
+ *
+ * Pointers returned by btree_find and iterators are invalidated by any
+ * change to the tree. A tree is not thread safe.
+ *
+ * Usage:
+ *      struct btree t;
+ *      struct btree_iter it;
+ *
+ *      btree_init(&t);
+ *      btree_put(&t, key, value);
+ *      if ((v = btree_find(&t, key)) != NULL) {
+ *          ...
+ *      }
+ *      for (btree_seek(&t, lo, &it); btree_next(&it, &k, &v) && k <= hi;) {
+ *          ...
+ *      }
+ *      btree_destroy(&t);
+ *********************************************************************/
+
+#ifndef __BTREE_H
+#define __BTREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+struct btree_leaf;
+
+struct btree {
+    void *root;                 /* NULL if the tree is empty */
+    unsigned int height;        /* Levels of inner nodes above the leaves */
+    size_t size;
+};
+
+/* A position in the tree, for walking the keys in order */
+struct btree_iter {
+    const struct btree_leaf *leaf;
+    unsigned int pos;
+};
+
+void btree_init(struct btree *t);
+
+/* Free every node. The tree can be used again after btree_init */
+void btree_destroy(struct btree *t);
+
+/* Remove every key */
+void btree_clear(struct btree *t);
+
+static inline size_t btree_size(const struct btree *t)
+{
+    return t->size;
+}
+
+/*
+ * A pointer to the value of key, which stays valid until the tree is
+ * next changed, or NULL if key is not present.
+ */
+uint64_t *btree_find(const struct btree *t, uint64_t key);
+
+/*
+ * Find key, inserting it with a value of 0 if not present, and set
+ * *inserted (if not NULL) to whether it was. Returns a pointer to the
+ * value, or NULL if out of memory.
+ */
+uint64_t *btree_insert(struct btree *t, uint64_t key, int *inserted);
+
+/* Insert or overwrite key's value. Returns 0, or -1 if out of memory */
+int btree_put(struct btree *t, uint64_t key, uint64_t value);
+
+/* Remove key. Returns 1 if it was present, 0 otherwise */
+int btree_erase(struct btree *t, uint64_t key);
+
+/*
+ * Replace the contents of the tree with n keys, which must be strictly
+ * increasing, and their values (or zeros, if values is NULL). Returns
+ * 0, or -1 with errno set to EINVAL if the keys are out of order, or to
+ * ENOMEM, leaving the tree empty.
+ */
+int btree_load(struct btree *t, const uint64_t *keys, const uint64_t *values,
+               size_t n);
+
+/* Position it at the first key not less than key */
+void btree_seek(const struct btree *t, uint64_t key, struct btree_iter *it);
+
+/*
+ * Store the key and value at it (either may be NULL) and move on,
+ * returning 1, or return 0 if there are no more keys.
+ */
+int btree_next(struct btree_iter *it, uint64_t *key, uint64_t *value);
+
+/* Name of the in-node search in use, e.g. "avx2" */
+const char *btree_impl(void);
+
+__CDECL_END
+
+#endif /* !defined __BTREE_H */
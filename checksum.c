@@ -0,0 +1,515 @@
+/**********************************************************************
+ * CRC-32C and Adler-32 checksums
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * The crc32 instruction has a latency of three cycles but can start one
+ * every cycle, so long buffers are split into three equal streams that
+ * are run side by side. The CRC of the whole is the CRC of the first
+ * stream shifted over the length of the other two, plus that of the
+ * second shifted over the third, plus the third (all starting from
+ * zero, apart from the first). Shifting a CRC over n bytes multiplies
+ * it by x^(8n) modulo the polynomial; one carry-less multiply by a
+ * constant and one crc32 instruction to reduce the product do that.
+ *
+ * The Adler-32 kernels keep the two sums in vector lanes. Each block
+ * of bytes adds its plain sum to A, and its sum weighted by distance
+ * from the end of the block to B, with a multiply-add. B also gains A
+ * times the block length for every block, which is accounted for by
+ * summing A before each block into a third vector. The sums are only
+ * reduced modulo 65521 every NMAX bytes, the most that can be added up
+ * without overflowing 32 bits.
+ *********************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+#include "checksum.h"
+#include "compiler.h"
+#include "cpu_features.h"
+
+#if defined(__x86_64__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define HAVE_ARM 1
+#include <arm_acle.h>
+#include <arm_neon.h>
+#endif
+
+/* CRC-32C polynomial, bit reflected */
+#define POLY        0x82f63b78U
+
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+/**********************************************************************
+ * CRC-32C: slicing-by-8
+ *********************************************************************/
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+static void crc_table_init(void)
+{
+    uint32_t c;
+    int i, k;
+
+    for (i = 0; i < 256; i++) {
+        c = (uint32_t)i;
+        for (k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ POLY : c >> 1;
+        }
+        crc_table[0][i] = c;
+    }
+
+    /* crc_table[k][i] is the CRC of byte i followed by k zero bytes */
+    for (i = 0; i < 256; i++) {
+        for (k = 1; k < 8; k++) {
+            c = crc_table[k - 1][i];
+            crc_table[k][i] = (c >> 8) ^ crc_table[0][c & 0xff];
+        }
+    }
+}
+
+static uint32_t crc32c_scalar(uint32_t crc, const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+    uint64_t v;
+
+    pthread_once(&crc_table_once, crc_table_init);
+
+    crc = ~crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        v = read64(p) ^ crc;
+        crc = crc_table[7][v & 0xff] ^
+              crc_table[6][(v >> 8) & 0xff] ^
+              crc_table[5][(v >> 16) & 0xff] ^
+              crc_table[4][(v >> 24) & 0xff] ^
+              crc_table[3][(v >> 32) & 0xff] ^
+              crc_table[2][(v >> 40) & 0xff] ^
+              crc_table[1][(v >> 48) & 0xff] ^
+              crc_table[0][v >> 56];
+    }
+    for (; len > 0; p++, len--) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p) & 0xff];
+    }
+    return ~crc;
+}
+
+/**********************************************************************
+ * CRC-32C: hardware
+ *
+ * Inputs of at least three times LONG bytes are run as three streams of
+ * LONG bytes, then inputs of at least three times SHORT as three streams
+ * of SHORT, and what is left as one stream. The K_ constants shift a CRC
+ * over the given number of bytes, and are x^(8n - 33) modulo POLY: the
+ * product of two 32-bit reflected values comes out one bit along, and
+ * the crc32 instruction multiplies by x^32 as it reduces.
+ *********************************************************************/
+#define LONG            4096
+#define SHORT           256
+
+#define K_LONG          0x82f89c77U
+#define K_LONG2         0x54a86326U     /* Over 2 * LONG */
+#define K_SHORT         0xb9e02b86U
+#define K_SHORT2        0xdd7e3b0cU     /* Over 2 * SHORT */
+
+#if defined(HAVE_X86)
+#define SSE42   __attribute__((target("sse4.2")))
+#define PCLMUL  __attribute__((target("sse4.2,pclmul")))
+
+static SSE42 __ALWAYS_INLINE uint32_t crc_sse42(uint32_t crc,
+                                                const unsigned char *p,
+                                                size_t len)
+{
+    uint64_t c = crc;
+
+    for (; len >= 8; p += 8, len -= 8) {
+        c = _mm_crc32_u64(c, read64(p));
+    }
+    crc = (uint32_t)c;
+    for (; len > 0; p++, len--) {
+        crc = _mm_crc32_u8(crc, *p);
+    }
+    return crc;
+}
+
+/* Three streams of n bytes from p */
+static PCLMUL __ALWAYS_INLINE uint32_t crc3_pclmul(uint32_t crc,
+                                                  const unsigned char *p,
+                                                  size_t n, uint32_t k,
+                                                  uint32_t k2)
+{
+    const unsigned char *end = p + n;
+    uint64_t a = crc, b = 0, c = 0;
+    __m128i v;
+
+    do {
+        a = _mm_crc32_u64(a, read64(p));
+        b = _mm_crc32_u64(b, read64(p + n));
+        c = _mm_crc32_u64(c, read64(p + 2 * n));
+        p += 8;
+    } while (p < end);
+
+    v = _mm_xor_si128(
+            _mm_clmulepi64_si128(_mm_cvtsi64_si128((int64_t)a),
+                                 _mm_cvtsi32_si128((int)k2), 0x00),
+            _mm_clmulepi64_si128(_mm_cvtsi64_si128((int64_t)b),
+                                 _mm_cvtsi32_si128((int)k), 0x00));
+    return (uint32_t)(c ^ _mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(v)));
+}
+
+static PCLMUL uint32_t crc32c_pclmul(uint32_t crc, const void *buf,
+                                     size_t len)
+{
+    const unsigned char *p = buf;
+
+    crc = ~crc;
+    for (; len >= 3 * LONG; p += 3 * LONG, len -= 3 * LONG) {
+        crc = crc3_pclmul(crc, p, LONG, K_LONG, K_LONG2);
+    }
+    for (; len >= 3 * SHORT; p += 3 * SHORT, len -= 3 * SHORT) {
+        crc = crc3_pclmul(crc, p, SHORT, K_SHORT, K_SHORT2);
+    }
+    return ~crc_sse42(crc, p, len);
+}
+
+static SSE42 uint32_t crc32c_sse42(uint32_t crc, const void *buf, size_t len)
+{
+    return ~crc_sse42(~crc, buf, len);
+}
+#endif /* HAVE_X86 */
+
+#if defined(HAVE_ARM)
+#define CRC     __attribute__((target("+crc")))
+#define PMULL   __attribute__((target("+crc+crypto")))
+
+static CRC __ALWAYS_INLINE uint32_t crc_arm(uint32_t crc,
+                                            const unsigned char *p,
+                                            size_t len)
+{
+    for (; len >= 8; p += 8, len -= 8) {
+        crc = __crc32cd(crc, read64(p));
+    }
+    for (; len > 0; p++, len--) {
+        crc = __crc32cb(crc, *p);
+    }
+    return crc;
+}
+
+static PMULL __ALWAYS_INLINE uint32_t crc3_pmull(uint32_t crc,
+                                                 const unsigned char *p,
+                                                 size_t n, uint32_t k,
+                                                 uint32_t k2)
+{
+    const unsigned char *end = p + n;
+    uint32_t a = crc, b = 0, c = 0;
+    uint64_t v;
+
+    do {
+        a = __crc32cd(a, read64(p));
+        b = __crc32cd(b, read64(p + n));
+        c = __crc32cd(c, read64(p + 2 * n));
+        p += 8;
+    } while (p < end);
+
+    v = (uint64_t)vmull_p64((poly64_t)a, (poly64_t)k2) ^
+        (uint64_t)vmull_p64((poly64_t)b, (poly64_t)k);
+    return c ^ __crc32cd(0, v);
+}
+
+static PMULL uint32_t crc32c_pmull(uint32_t crc, const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+
+    crc = ~crc;
+    for (; len >= 3 * LONG; p += 3 * LONG, len -= 3 * LONG) {
+        crc = crc3_pmull(crc, p, LONG, K_LONG, K_LONG2);
+    }
+    for (; len >= 3 * SHORT; p += 3 * SHORT, len -= 3 * SHORT) {
+        crc = crc3_pmull(crc, p, SHORT, K_SHORT, K_SHORT2);
+    }
+    return ~crc_arm(crc, p, len);
+}
+
+static CRC uint32_t crc32c_armcrc(uint32_t crc, const void *buf, size_t len)
+{
+    return ~crc_arm(~crc, buf, len);
+}
+#endif /* HAVE_ARM */
+
+/**********************************************************************
+ * CRC-32C: combining
+ *
+ * As in zlib, polynomials modulo POLY are 32-bit reflected values, with
+ * x^0 in the top bit.
+ *********************************************************************/
+/* x^(2^n) modulo POLY */
+static const uint32_t x2n_table[32] = {
+    0x40000000, 0x20000000, 0x08000000, 0x00800000,
+    0x00008000, 0x82f63b78, 0x6ea2d55c, 0x18b8ea18,
+    0x510ac59a, 0xb82be955, 0xb8fdb1e7, 0x88e56f72,
+    0x74c360a4, 0xe4172b16, 0x0d65762a, 0x35d73a62,
+    0x28461564, 0xbf455269, 0xe2ea32dc, 0xfe7740e6,
+    0xf946610b, 0x3c204f8f, 0x538586e3, 0x59726915,
+    0x734d5309, 0xbc1ac763, 0x7d0722cc, 0xd289cabe,
+    0xe94ca9bc, 0x05b74f3f, 0xa51e1f42, 0x40000000,
+};
+
+/* a * b modulo POLY */
+static uint32_t multmodp(uint32_t a, uint32_t b)
+{
+    uint32_t m = 1U << 31, p = 0;
+
+    for (; m != 0; m >>= 1) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        b = (b & 1) ? (b >> 1) ^ POLY : b >> 1;
+    }
+    return p;
+}
+
+uint32_t checksum_crc32c_combine(uint32_t crc1, uint32_t crc2,
+                                 size_t len2)
+{
+    /* x^(8 * len2), starting from x^8 = x^(2^3) */
+    uint32_t p = 1U << 31;
+    int k = 3;
+
+    for (; len2 != 0; len2 >>= 1, k++) {
+        if (len2 & 1) {
+            p = multmodp(x2n_table[k & 31], p);
+        }
+    }
+    return multmodp(p, crc1) ^ crc2;
+}
+
+/**********************************************************************
+ * Adler-32
+ *********************************************************************/
+#define BASE        65521U
+#define NMAX        5552
+
+static uint32_t adler32_scalar(uint32_t adler, const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    size_t n;
+
+    while (len > 0) {
+        n = len < NMAX ? len : NMAX;
+        len -= n;
+        for (; n > 0; n--) {
+            a += *p++;
+            b += a;
+        }
+        a %= BASE;
+        b %= BASE;
+    }
+    return (b << 16) | a;
+}
+
+/* Finish with the scalar loop, which reduces the sums */
+static inline uint32_t adler_tail(uint32_t a, uint32_t b,
+                                  const unsigned char *p, size_t len)
+{
+    return adler32_scalar((b << 16) | a, p, len);
+}
+
+#if defined(HAVE_X86)
+#define SSSE3   __attribute__((target("ssse3")))
+#define AVX2    __attribute__((target("avx2")))
+
+static SSSE3 inline uint32_t hsum_sse2(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4e));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xb1));
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+static SSSE3 uint32_t adler32_ssse3(uint32_t adler, const void *buf,
+                                    size_t len)
+{
+    const unsigned char *p = buf;
+    const __m128i weights = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9,
+                                          8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    __m128i sa, sb, prev, v;
+    size_t n;
+
+    while (len >= 16) {
+        n = (len < NMAX ? len : NMAX) & ~(size_t)15;
+        len -= n;
+        b += a * (uint32_t)n;
+        sa = zero;
+        sb = zero;
+        prev = zero;
+        for (; n > 0; n -= 16, p += 16) {
+            v = _mm_loadu_si128((const __m128i *)p);
+            prev = _mm_add_epi32(prev, sa);
+            sa = _mm_add_epi32(sa, _mm_sad_epu8(v, zero));
+            sb = _mm_add_epi32(sb, _mm_madd_epi16(
+                                       _mm_maddubs_epi16(v, weights), ones));
+        }
+        sb = _mm_add_epi32(sb, _mm_slli_epi32(prev, 4));
+        a = (a + hsum_sse2(sa)) % BASE;
+        b = (b + hsum_sse2(sb)) % BASE;
+    }
+    return adler_tail(a, b, p, len);
+}
+
+static AVX2 uint32_t adler32_avx2(uint32_t adler, const void *buf,
+                                  size_t len)
+{
+    const unsigned char *p = buf;
+    const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+                                             24, 23, 22, 21, 20, 19, 18, 17,
+                                             16, 15, 14, 13, 12, 11, 10, 9,
+                                             8, 7, 6, 5, 4, 3, 2, 1);
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    __m256i sa, sb, prev, v;
+    size_t n;
+
+    while (len >= 32) {
+        n = (len < NMAX ? len : NMAX) & ~(size_t)31;
+        len -= n;
+        b += a * (uint32_t)n;
+        sa = zero;
+        sb = zero;
+        prev = zero;
+        for (; n > 0; n -= 32, p += 32) {
+            v = _mm256_loadu_si256((const __m256i *)p);
+            prev = _mm256_add_epi32(prev, sa);
+            sa = _mm256_add_epi32(sa, _mm256_sad_epu8(v, zero));
+            sb = _mm256_add_epi32(sb, _mm256_madd_epi16(
+                                          _mm256_maddubs_epi16(v, weights),
+                                          ones));
+        }
+        sb = _mm256_add_epi32(sb, _mm256_slli_epi32(prev, 5));
+        a = (a + hsum_sse2(_mm_add_epi32(_mm256_castsi256_si128(sa),
+                                         _mm256_extracti128_si256(sa, 1))))
+            % BASE;
+        b = (b + hsum_sse2(_mm_add_epi32(_mm256_castsi256_si128(sb),
+                                         _mm256_extracti128_si256(sb, 1))))
+            % BASE;
+    }
+    return adler_tail(a, b, p, len);
+}
+#endif /* HAVE_X86 */
+
+#if defined(HAVE_ARM)
+static uint32_t adler32_neon(uint32_t adler, const void *buf, size_t len)
+{
+    static const uint8_t w[16] = {
+        16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1,
+    };
+    const unsigned char *p = buf;
+    const uint8x16_t weights = vld1q_u8(w);
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    uint32x4_t sa, sb, prev;
+    uint16x8_t t;
+    uint8x16_t v;
+    size_t n;
+
+    while (len >= 16) {
+        n = (len < NMAX ? len : NMAX) & ~(size_t)15;
+        len -= n;
+        b += a * (uint32_t)n;
+        sa = vdupq_n_u32(0);
+        sb = vdupq_n_u32(0);
+        prev = vdupq_n_u32(0);
+        for (; n > 0; n -= 16, p += 16) {
+            v = vld1q_u8(p);
+            prev = vaddq_u32(prev, sa);
+            sa = vpadalq_u16(sa, vpaddlq_u8(v));
+            t = vmull_u8(vget_low_u8(v), vget_low_u8(weights));
+            t = vmlal_u8(t, vget_high_u8(v), vget_high_u8(weights));
+            sb = vpadalq_u16(sb, t);
+        }
+        sb = vaddq_u32(sb, vshlq_n_u32(prev, 4));
+        a = (a + vaddvq_u32(sa)) % BASE;
+        b = (b + vaddvq_u32(sb)) % BASE;
+    }
+    return adler_tail(a, b, p, len);
+}
+#endif /* HAVE_ARM */
+
+uint32_t checksum_adler32_combine(uint32_t adler1, uint32_t adler2,
+                                  size_t len2)
+{
+    uint64_t rem = len2 % BASE;
+    uint64_t a1 = adler1 & 0xffff, b1 = adler1 >> 16;
+    uint64_t a2 = adler2 & 0xffff, b2 = adler2 >> 16;
+    uint64_t a, b;
+
+    /*
+     * Both sums of A include the initial 1, and the B of the second
+     * piece counts it len2 times where it should count A's sum instead.
+     */
+    a = (a1 + a2 + BASE - 1) % BASE;
+    b = (b1 + b2 + rem * a1 + BASE - rem) % BASE;
+    return (uint32_t)((b << 16) | a);
+}
+
+/**********************************************************************
+ * Dispatch
+ *********************************************************************/
+#if defined(HAVE_X86)
+#define CRC_VARIANTS                                                    \
+    __CPU_VARIANT(CPU_FEATURE_SSE4_2 | CPU_FEATURE_PCLMULQDQ,           \
+                  crc32c_pclmul),                                       \
+    __CPU_VARIANT(CPU_FEATURE_SSE4_2, crc32c_sse42),                    \
+    __CPU_VARIANT(0, crc32c_scalar)
+#define ADLER_VARIANTS                                                  \
+    __CPU_VARIANT(CPU_FEATURE_AVX2, adler32_avx2),                      \
+    __CPU_VARIANT(CPU_FEATURE_SSSE3, adler32_ssse3),                    \
+    __CPU_VARIANT(0, adler32_scalar)
+#elif defined(HAVE_ARM)
+#define CRC_VARIANTS                                                    \
+    __CPU_VARIANT(CPU_FEATURE_ARM_CRC32 | CPU_FEATURE_ARM_PMULL,        \
+                  crc32c_pmull),                                        \
+    __CPU_VARIANT(CPU_FEATURE_ARM_CRC32, crc32c_armcrc),                \
+    __CPU_VARIANT(0, crc32c_scalar)
+#define ADLER_VARIANTS                                                  \
+    __CPU_VARIANT(CPU_FEATURE_NEON, adler32_neon),                      \
+    __CPU_VARIANT(0, adler32_scalar)
+#else
+#define CRC_VARIANTS                                                    \
+    __CPU_VARIANT(0, crc32c_scalar)
+#define ADLER_VARIANTS                                                  \
+    __CPU_VARIANT(0, adler32_scalar)
+#endif
+
+__CPU_DISPATCH(uint32_t, checksum_crc32c,
+               (uint32_t crc, const void *buf, size_t len),
+               (crc, buf, len), CRC_VARIANTS)
+
+__CPU_DISPATCH(uint32_t, checksum_adler32,
+               (uint32_t adler, const void *buf, size_t len),
+               (adler, buf, len), ADLER_VARIANTS)
+
+/* Variants are named <function>_<impl> */
+const char *checksum_crc32c_impl(void)
+{
+    return strrchr(__CPU_SELECTED(checksum_crc32c)->name, '_') + 1;
+}
+
+const char *checksum_adler32_impl(void)
+{
+    return strrchr(__CPU_SELECTED(checksum_adler32)->name, '_') + 1;
+}
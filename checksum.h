@@ -0,0 +1,62 @@
+/**********************************************************************
+ * CRC-32C and Adler-32 checksums
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * checksum_crc32c computes the CRC-32C (Castagnoli) used by iSCSI,
+ * SCTP, ext4 and most storage formats, with the usual bit reflection and
+ * final complement, so the CRC of "123456789" is 0xe3069283. On x86 it
+ * uses the SSE4.2 crc32 instruction, running three independent streams
+ * to cover its latency and merging them with a PCLMULQDQ multiply, and
+ * on AArch64 the CRC32 and PMULL instructions in the same way. Other
+ * CPUs fall back to slicing-by-8 tables.
+ *
+ * checksum_adler32 computes the zlib Adler-32, with SSSE3, AVX2 or NEON
+ * kernels where available. It is cheaper than a CRC without hardware
+ * support, but much weaker on short inputs.
+ *
+ * Both functions continue from a previous value, so a buffer may be
+ * checksummed in pieces. The combine functions give the checksum of
+ * two pieces joined together from their separate checksums and the
+ * length of the second, which lets pieces be checksummed in parallel:
+ *
+ *      crc1 = checksum_crc32c(0, a, alen);     (on one thread)
+ *      crc2 = checksum_crc32c(0, b, blen);     (on another)
+ *      crc = checksum_crc32c_combine(crc1, crc2, blen);
+ *
+ * gives the same result as checksum_crc32c(crc1, b, blen).
+ *********************************************************************/
+
+#ifndef __CHECKSUM_H
+#define __CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+/* CRC-32C of buf[0..len), following data whose CRC was crc. Start with 0 */
+uint32_t checksum_crc32c(uint32_t crc, const void *buf, size_t len);
+
+/* CRC-32C of A followed by B, given that of A, that of B and B's length */
+uint32_t checksum_crc32c_combine(uint32_t crc1, uint32_t crc2,
+                                 size_t len2);
+
+/* Adler-32 of no data, to start from */
+#define CHECKSUM_ADLER32_INIT   1
+
+/* Adler-32 of buf[0..len), following data whose Adler-32 was adler */
+uint32_t checksum_adler32(uint32_t adler, const void *buf, size_t len);
+
+/* Adler-32 of A followed by B, given that of A, that of B and B's length */
+uint32_t checksum_adler32_combine(uint32_t adler1, uint32_t adler2,
+                                  size_t len2);
+
+/* Names of the kernels in use, e.g. "pclmul" and "avx2" */
+const char *checksum_crc32c_impl(void);
+const char *checksum_adler32_impl(void);
+
+__CDECL_END
+
+#endif /* !defined __CHECKSUM_H */
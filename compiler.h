@@ -0,0 +1,42 @@
+/**********************************************************************
+ * Compiler helpers
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Small wrappers around GCC/Clang extensions that the other snippets
+ * use on their hot paths. Compilers that do not understand them get
+ * harmless fallbacks, so the snippets still build, just without the
+ * hints.
+ *********************************************************************/
+
+#ifndef __COMPILER_H
+#define __COMPILER_H
+
+#include <stddef.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define __LIKELY(x)         __builtin_expect(!!(x), 1)
+#define __UNLIKELY(x)       __builtin_expect(!!(x), 0)
+#define __ALWAYS_INLINE     inline __attribute__((always_inline))
+#define __NOINLINE          __attribute__((noinline))
+#define __ALIGNED(n)        __attribute__((aligned(n)))
+#else
+#define __LIKELY(x)         (x)
+#define __UNLIKELY(x)       (x)
+#define __ALWAYS_INLINE     inline
+#define __NOINLINE
+#define __ALIGNED(n)
+#endif
+
+/* Assume 64 byte cache lines unless told otherwise */
+#ifndef __CACHELINE_SIZE
+#define __CACHELINE_SIZE    64
+#endif
+
+#define __CACHELINE_ALIGNED __ALIGNED(__CACHELINE_SIZE)
+
+/* The structure of the given type that ptr points to the member of */
+#define __CONTAINER_OF(ptr, type, member)                               \
+    ((type *)(void *)((char *)(ptr) - offsetof(type, member)))
+
+#endif /* !defined __COMPILER_H */
@@ -0,0 +1,308 @@
+/**********************************************************************
+ * Runtime CPU feature detection and dispatch
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * cpu_features() returns a bitmask of CPU_FEATURE_* flags describing
+ * the instruction set extensions that are usable on the running CPU.
+ * On x86, this is read with CPUID, and the AVX and AVX-512 flags are
+ * only set if the OS saves the wider registers (checked with XGETBV).
+ * On ARM, it comes from the kernel's hwcaps via getauxval.
+ *
+ * __CPU_DISPATCH defines an exported function which forwards to the
+ * best of several implementations, picked once at startup. Each
+ * implementation is listed with __CPU_VARIANT along with the features
+ * it needs, best first, and the list must end with a variant needing
+ * no features at all. With glibc on ELF targets the choice is made by
+ * the dynamic linker using an ifunc, and calls go straight to the
+ * chosen variant. Elsewhere a function pointer is used, set by a
+ * constructor (or by the first call, if that happens earlier).
+ *
+ * Usage:
+ *      static size_t count_avx2(const void *s, size_t n);
+ *      static size_t count_sse2(const void *s, size_t n);
+ *      static size_t count_scalar(const void *s, size_t n);
+ *
+ *      __CPU_DISPATCH(size_t, count, (const void *s, size_t n), (s, n),
+ *          __CPU_VARIANT(CPU_FEATURE_AVX2, count_avx2),
+ *          __CPU_VARIANT(CPU_FEATURE_SSE2, count_sse2),
+ *          __CPU_VARIANT(0, count_scalar))
+ *
+ * __CPU_DISPATCH_STATIC does the same for a function local to the file.
+ * Functions returning void are dispatched with __CPU_DISPATCH_VOID and
+ * __CPU_DISPATCH_STATIC_VOID, which take no return type.
+ *********************************************************************/
+
+#ifndef __CPU_FEATURES_H
+#define __CPU_FEATURES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cdecl.h"
+#include "compiler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#endif
+
+__CDECL_BEGIN
+
+/* x86 */
+#define CPU_FEATURE_SSE2            (1ULL << 0)
+#define CPU_FEATURE_SSSE3           (1ULL << 1)
+#define CPU_FEATURE_SSE4_1          (1ULL << 2)
+#define CPU_FEATURE_SSE4_2          (1ULL << 3)
+#define CPU_FEATURE_POPCNT          (1ULL << 4)
+#define CPU_FEATURE_PCLMULQDQ       (1ULL << 5)
+#define CPU_FEATURE_AVX             (1ULL << 6)
+#define CPU_FEATURE_AVX2            (1ULL << 7)
+#define CPU_FEATURE_BMI1            (1ULL << 8)
+#define CPU_FEATURE_BMI2            (1ULL << 9)
+#define CPU_FEATURE_AVX512F         (1ULL << 10)
+#define CPU_FEATURE_AVX512BW        (1ULL << 11)
+#define CPU_FEATURE_AVX512VL        (1ULL << 12)
+#define CPU_FEATURE_AVX512VPOPCNTDQ (1ULL << 13)
+#define CPU_FEATURE_VPCLMULQDQ      (1ULL << 14)
+
+/* ARM */
+#define CPU_FEATURE_NEON            (1ULL << 32)
+#define CPU_FEATURE_ARM_CRC32       (1ULL << 33)
+#define CPU_FEATURE_ARM_PMULL       (1ULL << 34)
+
+/* Always set once detection has run, so the result is never 0 */
+#define CPU_FEATURE_DETECTED        (1ULL << 63)
+
+/*
+ * ifunc resolvers run while the dynamic linker is still relocating the
+ * program, before sanitizer runtimes are set up, so the resolver and
+ * everything it calls must not be instrumented.
+ */
+#if defined(__has_attribute)
+#if __has_attribute(no_sanitize)
+#define __CPU_RESOLVER  __attribute__((no_sanitize("address", "undefined")))
+#endif
+#endif
+#ifndef __CPU_RESOLVER
+#define __CPU_RESOLVER
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline __CPU_RESOLVER uint64_t __cpu_xgetbv(void)
+{
+    uint32_t eax, edx;
+
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+}
+#endif
+
+#if defined(__aarch64__) && defined(__linux__)
+/*
+ * Decode the kernel's AT_HWCAP bits. glibc passes them to AArch64 ifunc
+ * resolvers as their first argument, since getauxval may not have been
+ * relocated yet when a resolver runs.
+ */
+static inline __CPU_RESOLVER uint64_t __cpu_features_hwcap(uint64_t hwcap)
+{
+    uint64_t f = CPU_FEATURE_DETECTED;
+
+    if (hwcap & (1UL << 1)) f |= CPU_FEATURE_NEON;      /* HWCAP_ASIMD */
+    if (hwcap & (1UL << 4)) f |= CPU_FEATURE_ARM_PMULL; /* HWCAP_PMULL */
+    if (hwcap & (1UL << 7)) f |= CPU_FEATURE_ARM_CRC32; /* HWCAP_CRC32 */
+    return f;
+}
+#endif
+
+/*
+ * Query the CPU. On x86 this makes no calls that need relocation, so it
+ * is safe to use from an ifunc resolver; on AArch64 it calls getauxval,
+ * and resolvers use __cpu_features_hwcap instead.
+ */
+static inline __CPU_RESOLVER uint64_t __cpu_features_detect(void)
+{
+    uint64_t f = CPU_FEATURE_DETECTED;
+
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int max_leaf;
+    uint64_t xcr0 = 0;
+
+    max_leaf = __get_cpuid_max(0, NULL);
+    if (max_leaf < 1) {
+        return f;
+    }
+
+    __cpuid(1, eax, ebx, ecx, edx);
+    if (edx & (1U << 26)) f |= CPU_FEATURE_SSE2;
+    if (ecx & (1U << 9))  f |= CPU_FEATURE_SSSE3;
+    if (ecx & (1U << 19)) f |= CPU_FEATURE_SSE4_1;
+    if (ecx & (1U << 20)) f |= CPU_FEATURE_SSE4_2;
+    if (ecx & (1U << 23)) f |= CPU_FEATURE_POPCNT;
+    if (ecx & (1U << 1))  f |= CPU_FEATURE_PCLMULQDQ;
+
+    /* The OS must save the YMM (and ZMM) state for AVX to be usable */
+    if (ecx & (1U << 27)) {
+        xcr0 = __cpu_xgetbv();
+    }
+    if ((ecx & (1U << 28)) && (xcr0 & 0x06) == 0x06) {
+        f |= CPU_FEATURE_AVX;
+    }
+
+    if (max_leaf >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        if (ebx & (1U << 3)) f |= CPU_FEATURE_BMI1;
+        if (ebx & (1U << 8)) f |= CPU_FEATURE_BMI2;
+
+        if (f & CPU_FEATURE_AVX) {
+            if (ebx & (1U << 5))  f |= CPU_FEATURE_AVX2;
+            if (ecx & (1U << 10)) f |= CPU_FEATURE_VPCLMULQDQ;
+        }
+
+        if ((xcr0 & 0xE6) == 0xE6) {
+            if (ebx & (1U << 16)) f |= CPU_FEATURE_AVX512F;
+            if (ebx & (1U << 30)) f |= CPU_FEATURE_AVX512BW;
+            if (ebx & (1U << 31)) f |= CPU_FEATURE_AVX512VL;
+            if (ecx & (1U << 14)) f |= CPU_FEATURE_AVX512VPOPCNTDQ;
+        }
+    }
+#elif defined(__aarch64__) && defined(__linux__)
+    f = __cpu_features_hwcap(getauxval(AT_HWCAP));
+#elif defined(__ARM_NEON)
+    f |= CPU_FEATURE_NEON;
+#endif
+
+    return f;
+}
+
+/* Features of the running CPU, detected on the first call */
+static inline uint64_t cpu_features(void)
+{
+    static uint64_t features;
+    uint64_t f = __atomic_load_n(&features, __ATOMIC_RELAXED);
+
+    if (__UNLIKELY(f == 0)) {
+        f = __cpu_features_detect();
+        __atomic_store_n(&features, f, __ATOMIC_RELAXED);
+    }
+    return f;
+}
+
+/* Returns nonzero if all the features in mask are available */
+static inline int cpu_has(uint64_t mask)
+{
+    return (cpu_features() & mask) == mask;
+}
+
+/**********************************************************************
+ * Dispatch
+ *********************************************************************/
+struct cpu_variant {
+    uint64_t features;          /* Required CPU_FEATURE_* flags */
+    void (*fn)(void);           /* Implementation, cast to a common type */
+    const char *name;
+};
+
+#define __CPU_VARIANT(features, fn) \
+    { (features), (void (*)(void))(fn), #fn }
+
+/* Pick the first variant whose features are all available */
+static inline __CPU_RESOLVER const struct cpu_variant *
+__cpu_select(const struct cpu_variant *v, size_t n, uint64_t features)
+{
+    size_t i;
+
+    for (i = 0; i < n - 1; i++) {
+        if ((v[i].features & features) == v[i].features) {
+            break;
+        }
+    }
+    return &v[i];
+}
+
+#define __CPU_NVARIANTS(name) \
+    (sizeof(name##__variants) / sizeof(name##__variants[0]))
+
+/* The variant of a dispatched function that is in use */
+#define __CPU_SELECTED(name) \
+    __cpu_select(name##__variants, __CPU_NVARIANTS(name), cpu_features())
+
+#if !defined(CPU_DISPATCH_NO_IFUNC) && defined(__ELF__) && \
+    defined(__GLIBC__) && defined(__has_attribute)
+#if __has_attribute(ifunc)
+#define __CPU_DISPATCH_IFUNC 1
+#endif
+#endif
+
+#ifdef __CPU_DISPATCH_IFUNC
+
+/* AArch64 resolvers are passed AT_HWCAP by glibc */
+#if defined(__aarch64__) && defined(__linux__)
+#define __CPU_RESOLVER_PARAMS       (uint64_t hwcap)
+#define __CPU_RESOLVER_FEATURES     __cpu_features_hwcap(hwcap)
+#else
+#define __CPU_RESOLVER_PARAMS       (void)
+#define __CPU_RESOLVER_FEATURES     __cpu_features_detect()
+#endif
+
+/* ret_kw is return, or nothing for a void function */
+#define __CPU_DISPATCH_DEFINE(storage, ret, ret_kw, name, params, args, ...) \
+    typedef ret (*name##__fn_t) params;                                     \
+    static const struct cpu_variant name##__variants[] = { __VA_ARGS__ };   \
+    static __CPU_RESOLVER name##__fn_t name##__resolve                      \
+        __CPU_RESOLVER_PARAMS                                               \
+    {                                                                       \
+        return (name##__fn_t)__cpu_select(name##__variants,                 \
+                                          __CPU_NVARIANTS(name),            \
+                                          __CPU_RESOLVER_FEATURES)->fn;     \
+    }                                                                       \
+    storage ret name params __attribute__((ifunc(#name "__resolve")));
+
+#else /* !defined __CPU_DISPATCH_IFUNC */
+
+#define __CPU_DISPATCH_DEFINE(storage, ret, ret_kw, name, params, args, ...) \
+    typedef ret (*name##__fn_t) params;                                     \
+    static const struct cpu_variant name##__variants[] = { __VA_ARGS__ };   \
+    static ret name##__first params;                                        \
+    static name##__fn_t name##__ptr = name##__first;                        \
+    static void name##__resolve(void)                                       \
+    {                                                                       \
+        __atomic_store_n(&name##__ptr,                                      \
+                         (name##__fn_t)__CPU_SELECTED(name)->fn,            \
+                         __ATOMIC_RELAXED);                                 \
+    }                                                                       \
+    static void name##__init(void) __attribute__((constructor));            \
+    static void name##__init(void)                                          \
+    {                                                                       \
+        name##__resolve();                                                  \
+    }                                                                       \
+    static ret name##__first params                                         \
+    {                                                                       \
+        name##__resolve();                                                  \
+        ret_kw name##__ptr args;                                            \
+    }                                                                       \
+    storage ret name params                                                 \
+    {                                                                       \
+        ret_kw __atomic_load_n(&name##__ptr, __ATOMIC_RELAXED) args;        \
+    }
+
+#endif /* defined __CPU_DISPATCH_IFUNC */
+
+/* Define an exported, or a file local, dispatched function */
+#define __CPU_DISPATCH(ret, name, params, args, ...) \
+    __CPU_DISPATCH_DEFINE(, ret, return, name, params, args, __VA_ARGS__)
+
+#define __CPU_DISPATCH_STATIC(ret, name, params, args, ...) \
+    __CPU_DISPATCH_DEFINE(static, ret, return, name, params, args, __VA_ARGS__)
+
+/* The same, for functions returning void */
+#define __CPU_DISPATCH_VOID(name, params, args, ...) \
+    __CPU_DISPATCH_DEFINE(, void, , name, params, args, __VA_ARGS__)
+
+#define __CPU_DISPATCH_STATIC_VOID(name, params, args, ...) \
+    __CPU_DISPATCH_DEFINE(static, void, , name, params, args, __VA_ARGS__)
+
+__CDECL_END
+
+#endif /* !defined __CPU_FEATURES_H */
@@ -0,0 +1,375 @@
+/**********************************************************************
+ * Event loop
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Each epoll registration carries the descriptor and a generation
+ * number, bumped whenever the descriptor is removed. An event collected
+ * for a descriptor that is removed (and perhaps reused) by an earlier
+ * callback in the same batch no longer matches, and is dropped.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "compiler.h"
+#include "eventloop.h"
+
+/* Events collected by one epoll_wait */
+#define MAX_EVENTS      256
+
+/* epoll data of the wakeup eventfd, which no descriptor can have */
+#define WAKEUP          UINT64_MAX
+
+#define EVENT_MASK      (EVENTLOOP_READ | EVENTLOOP_WRITE |              \
+                         EVENTLOOP_ERROR | EVENTLOOP_HUP)
+
+struct handler {
+    eventloop_io_fn fn;
+    void *arg;
+    uint32_t gen;
+    int active;
+};
+
+struct post {
+    struct post *next;
+    eventloop_fn fn;
+    void *arg;
+};
+
+struct eventloop {
+    int epfd;
+    int wakefd;
+    int stopped;
+    uint64_t start;             /* Monotonic time of creation, in ms */
+    uint64_t now;               /* Monotonic time of the last wait */
+
+    struct handler *handlers;   /* Indexed by descriptor */
+    size_t nhandlers;
+
+    struct timer_wheel wheel;   /* Ticks are milliseconds since start */
+
+    /* Functions posted from other threads, and whether a wakeup is due */
+    pthread_mutex_t lock;
+    struct post *posted;
+    struct post **posted_tail;
+    int wakeup_pending;
+
+    struct epoll_event events[MAX_EVENTS];
+};
+
+static uint64_t monotonic_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/**********************************************************************
+ * Timers
+ *********************************************************************/
+static void fire(struct timer_wheel_node *node, void *arg)
+{
+    struct eventloop_timer *t = (struct eventloop_timer *)node;
+
+    t->fn(arg, t->arg);
+}
+
+void eventloop_timer_start(struct eventloop *loop, struct eventloop_timer *t,
+                           uint64_t ms)
+{
+    uint64_t expires = loop->now - loop->start + ms;
+
+    if (expires < ms) {
+        expires = UINT64_MAX;
+    }
+    t->node.fn = fire;
+    t->node.arg = loop;
+    timer_wheel_add(&loop->wheel, &t->node, expires);
+}
+
+void eventloop_timer_stop(struct eventloop *loop, struct eventloop_timer *t)
+{
+    timer_wheel_cancel(&loop->wheel, &t->node);
+}
+
+/**********************************************************************
+ * Posting and waking
+ *********************************************************************/
+static void wakeup(struct eventloop *loop)
+{
+    uint64_t one = 1;
+
+    /* EAGAIN means the counter is full, which wakes the loop just as well */
+    while (write(loop->wakefd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+int eventloop_post(struct eventloop *loop, eventloop_fn fn, void *arg)
+{
+    struct post *p = malloc(sizeof(*p));
+    int need_wakeup;
+
+    if (p == NULL) {
+        return -1;
+    }
+    p->next = NULL;
+    p->fn = fn;
+    p->arg = arg;
+
+    pthread_mutex_lock(&loop->lock);
+    *loop->posted_tail = p;
+    loop->posted_tail = &p->next;
+    need_wakeup = !loop->wakeup_pending;
+    loop->wakeup_pending = 1;
+    pthread_mutex_unlock(&loop->lock);
+
+    if (need_wakeup) {
+        wakeup(loop);
+    }
+    return 0;
+}
+
+void eventloop_stop(struct eventloop *loop)
+{
+    __atomic_store_n(&loop->stopped, 1, __ATOMIC_RELEASE);
+    wakeup(loop);
+}
+
+/* Clear the eventfd, then run everything posted so far, in order */
+static void run_posted(struct eventloop *loop)
+{
+    struct post *p, *next;
+    uint64_t count;
+
+    /* EAGAIN means it was cleared already, by an earlier wakeup */
+    while (read(loop->wakefd, &count, sizeof(count)) < 0 && errno == EINTR) {
+    }
+
+    pthread_mutex_lock(&loop->lock);
+    p = loop->posted;
+    loop->posted = NULL;
+    loop->posted_tail = &loop->posted;
+    loop->wakeup_pending = 0;
+    pthread_mutex_unlock(&loop->lock);
+
+    for (; p != NULL; p = next) {
+        next = p->next;
+        p->fn(loop, p->arg);
+        free(p);
+    }
+}
+
+/**********************************************************************
+ * Loop
+ *********************************************************************/
+struct eventloop *eventloop_create(void)
+{
+    struct eventloop *loop = calloc(1, sizeof(*loop));
+    struct epoll_event ev;
+
+    if (loop == NULL) {
+        return NULL;
+    }
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    loop->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->epfd < 0 || loop->wakefd < 0) {
+        goto error;
+    }
+
+    /* Level triggered, so a wakeup is never lost between reads */
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = WAKEUP;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wakefd, &ev)) {
+        goto error;
+    }
+
+    pthread_mutex_init(&loop->lock, NULL);
+    loop->posted_tail = &loop->posted;
+    loop->start = loop->now = monotonic_ms();
+    timer_wheel_init(&loop->wheel, 0);
+    return loop;
+
+error:
+    {
+        int err = errno;
+
+        if (loop->epfd >= 0) {
+            close(loop->epfd);
+        }
+        if (loop->wakefd >= 0) {
+            close(loop->wakefd);
+        }
+        free(loop);
+        errno = err;
+    }
+    return NULL;
+}
+
+void eventloop_destroy(struct eventloop *loop)
+{
+    if (loop == NULL) {
+        return;
+    }
+    run_posted(loop);
+    pthread_mutex_destroy(&loop->lock);
+    close(loop->epfd);
+    close(loop->wakefd);
+    free(loop->handlers);
+    free(loop);
+}
+
+int eventloop_add(struct eventloop *loop, int fd, uint32_t events,
+                  eventloop_io_fn fn, void *arg)
+{
+    struct epoll_event ev;
+    struct handler *h;
+    size_t n;
+
+    if (fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    if ((size_t)fd >= loop->nhandlers) {
+        for (n = loop->nhandlers ? loop->nhandlers : 64; n <= (size_t)fd;) {
+            n *= 2;
+        }
+        h = realloc(loop->handlers, n * sizeof(*h));
+        if (h == NULL) {
+            return -1;
+        }
+        memset(h + loop->nhandlers, 0, (n - loop->nhandlers) * sizeof(*h));
+        loop->handlers = h;
+        loop->nhandlers = n;
+    }
+
+    h = &loop->handlers[fd];
+    if (h->active) {
+        errno = EEXIST;
+        return -1;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (events & EVENT_MASK) | EPOLLET;
+    ev.data.u64 = (uint64_t)h->gen << 32 | (uint32_t)fd;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev)) {
+        return -1;
+    }
+    h->fn = fn;
+    h->arg = arg;
+    h->active = 1;
+    return 0;
+}
+
+static struct handler *lookup(struct eventloop *loop, int fd)
+{
+    if (fd < 0 || (size_t)fd >= loop->nhandlers ||
+        !loop->handlers[fd].active) {
+        errno = ENOENT;
+        return NULL;
+    }
+    return &loop->handlers[fd];
+}
+
+int eventloop_modify(struct eventloop *loop, int fd, uint32_t events)
+{
+    struct handler *h = lookup(loop, fd);
+    struct epoll_event ev;
+
+    if (h == NULL) {
+        return -1;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (events & EVENT_MASK) | EPOLLET;
+    ev.data.u64 = (uint64_t)h->gen << 32 | (uint32_t)fd;
+    return epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+int eventloop_remove(struct eventloop *loop, int fd)
+{
+    struct handler *h = lookup(loop, fd);
+
+    if (h == NULL) {
+        return -1;
+    }
+    h->active = 0;
+    h->gen++;
+    return epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+uint64_t eventloop_now(const struct eventloop *loop)
+{
+    return loop->now;
+}
+
+int eventloop_run_once(struct eventloop *loop, int timeout_ms)
+{
+    struct epoll_event *ev;
+    struct handler *h;
+    uint64_t next, now;
+    int i, n, fd, count = 0;
+
+    /* Sleep no later than the next slot the wheel has to look at */
+    loop->now = monotonic_ms();
+    next = timer_wheel_next(&loop->wheel);
+    if (next != UINT64_MAX) {
+        now = loop->now - loop->start;
+        next = next > now ? next - now : 0;
+        if (timeout_ms < 0 || next < (uint64_t)timeout_ms) {
+            timeout_ms = next > INT_MAX ? INT_MAX : (int)next;
+        }
+    }
+
+    n = epoll_wait(loop->epfd, loop->events, MAX_EVENTS, timeout_ms);
+    if (n < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+        n = 0;
+    }
+    loop->now = monotonic_ms();
+
+    for (i = 0; i < n; i++) {
+        ev = &loop->events[i];
+        if (__UNLIKELY(ev->data.u64 == WAKEUP)) {
+            run_posted(loop);
+            continue;
+        }
+        fd = (int)(uint32_t)ev->data.u64;
+        if ((size_t)fd >= loop->nhandlers) {
+            continue;
+        }
+        h = &loop->handlers[fd];
+        if (!h->active || h->gen != (uint32_t)(ev->data.u64 >> 32)) {
+            continue;
+        }
+        h->fn(loop, fd, ev->events & EVENT_MASK, h->arg);
+        count++;
+    }
+
+    timer_wheel_advance(&loop->wheel, loop->now - loop->start);
+    return count;
+}
+
+int eventloop_run(struct eventloop *loop)
+{
+    int rc = 0;
+
+    while (!__atomic_load_n(&loop->stopped, __ATOMIC_ACQUIRE)) {
+        if (eventloop_run_once(loop, -1) < 0) {
+            rc = -1;
+            break;
+        }
+    }
+    __atomic_store_n(&loop->stopped, 0, __ATOMIC_RELAXED);
+    return rc;
+}
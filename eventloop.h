@@ -0,0 +1,308 @@
+/**********************************************************************
+ * Event loop
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * A single threaded loop around epoll. File descriptors are registered
+ * edge triggered, so a callback is only called again once new data (or
+ * room) arrives, and must read or write until it gets EAGAIN. Handlers
+ * are kept in a table indexed by descriptor, so dispatching an event
+ * costs the same whether 10 or 100000 descriptors are registered.
+ *
+ * Timers are embedded in the caller's own structures and kept in a
+ * timer_wheel (see timer_wheel.h) with a tick of a millisecond, so that
+ * starting and stopping a timer is a list insert or removal, however
+ * many timers are pending.
+ *
+ * Other threads can hand work to the loop with eventloop_post, and stop
+ * it with eventloop_stop; both wake it through an eventfd. Everything
+ * else must be called from the thread running the loop.
+ *
+ * Usage:
+ *      static void on_read(struct eventloop *loop, int fd,
+ *                          uint32_t events, void *arg)
+ *      {
+ *          while ((n = read(fd, buf, sizeof(buf))) > 0) {
+ *              ...
+ *          }
+ *      }
+ *
+ *      loop = eventloop_create();
+ *      eventloop_add(loop, sock, EVENTLOOP_READ, on_read, conn);
+ *      eventloop_timer_init(&conn->idle, on_idle, conn);
+ *      eventloop_timer_start(loop, &conn->idle, 30000);
+ *      eventloop_run(loop);
+ *
+ * C++ code can use lub::eventloop, defined at the end of this file,
+ * which accepts lambdas.
+ *********************************************************************/
+
+#ifndef __EVENTLOOP_H
+#define __EVENTLOOP_H
+
+#include <stdint.h>
+#include "cdecl.h"
+#include "timer_wheel.h"
+
+__CDECL_BEGIN
+
+struct eventloop;
+
+/* Events, with the values of the matching EPOLL* flags */
+#define EVENTLOOP_READ      0x001
+#define EVENTLOOP_WRITE     0x004
+#define EVENTLOOP_ERROR     0x008   /* Always reported, need not be asked */
+#define EVENTLOOP_HUP       0x010   /* Always reported, need not be asked */
+
+typedef void (*eventloop_io_fn)(struct eventloop *loop, int fd,
+                                uint32_t events, void *arg);
+typedef void (*eventloop_fn)(struct eventloop *loop, void *arg);
+
+/*
+ * A timer, to be embedded in the structure it times out. Its fields are
+ * private to the loop.
+ */
+struct eventloop_timer {
+    struct timer_wheel_node node;   /* Must come first */
+    eventloop_fn fn;
+    void *arg;
+};
+
+/* Returns NULL with errno set on failure */
+struct eventloop *eventloop_create(void);
+
+/*
+ * Free the loop. Functions posted but not yet run are run first, so that
+ * whatever they were given can be released. Registered descriptors are
+ * not closed.
+ */
+void eventloop_destroy(struct eventloop *loop);
+
+/*
+ * Call fn(loop, fd, events, arg) whenever fd becomes ready for any of
+ * events. Returns 0, or -1 with errno set, e.g. to EEXIST if fd is
+ * already registered.
+ */
+int eventloop_add(struct eventloop *loop, int fd, uint32_t events,
+                  eventloop_io_fn fn, void *arg);
+
+/* Change the events fd is watched for. Returns 0, or -1 with errno set */
+int eventloop_modify(struct eventloop *loop, int fd, uint32_t events);
+
+/*
+ * Stop watching fd. This must be done before it is closed; events
+ * already collected for it are dropped. Returns 0, or -1 with errno set.
+ */
+int eventloop_remove(struct eventloop *loop, int fd);
+
+/*
+ * Run until eventloop_stop is called. Returns 0, or -1 with errno set if
+ * waiting for events fails.
+ */
+int eventloop_run(struct eventloop *loop);
+
+/*
+ * Wait up to timeout_ms milliseconds (-1 to wait for the next timer or
+ * event) for events, and dispatch them and any timers that are due.
+ * Returns the number of descriptor events, or -1 with errno set.
+ */
+int eventloop_run_once(struct eventloop *loop, int timeout_ms);
+
+/* Make eventloop_run return. May be called from any thread */
+void eventloop_stop(struct eventloop *loop);
+
+/*
+ * Call fn(loop, arg) from the loop thread, soon. May be called from any
+ * thread. Returns 0, or -1 with errno set to ENOMEM.
+ */
+int eventloop_post(struct eventloop *loop, eventloop_fn fn, void *arg);
+
+/* Milliseconds on the monotonic clock, as of the last wait */
+uint64_t eventloop_now(const struct eventloop *loop);
+
+static inline void eventloop_timer_init(struct eventloop_timer *t,
+                                        eventloop_fn fn, void *arg)
+{
+    timer_wheel_node_init(&t->node, NULL, NULL);
+    t->fn = fn;
+    t->arg = arg;
+}
+
+/*
+ * Call the timer's function once, ms milliseconds from eventloop_now.
+ * A pending timer is moved to the new time.
+ */
+void eventloop_timer_start(struct eventloop *loop, struct eventloop_timer *t,
+                           uint64_t ms);
+
+/* Stop the timer if it is pending */
+void eventloop_timer_stop(struct eventloop *loop, struct eventloop_timer *t);
+
+static inline int eventloop_timer_pending(const struct eventloop_timer *t)
+{
+    return timer_wheel_pending(&t->node);
+}
+
+__CDECL_END
+
+#ifdef __cplusplus
+#include <cerrno>
+#include <functional>
+#include <new>
+#include <system_error>
+#include <unordered_map>
+
+namespace lub {
+
+/*
+ * Lambda friendly wrapper for struct eventloop. As with the C functions,
+ * only post and stop may be called from other threads, and exceptions
+ * must not escape from the callbacks.
+ */
+class eventloop {
+public:
+    typedef std::function<void(uint32_t events)> io_handler;
+
+private:
+    struct ::eventloop *loop;
+    std::unordered_map<int, io_handler *> handlers;
+
+    static void check(int rc, const char *what)
+    {
+        if (rc < 0) {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+    }
+
+    static void call_io(struct ::eventloop *, int, uint32_t events,
+                        void *arg) noexcept
+    {
+        (*static_cast<io_handler *>(arg))(events);
+    }
+
+    static void call(struct ::eventloop *, void *arg) noexcept
+    {
+        std::function<void()> *fn = static_cast<std::function<void()> *>(arg);
+
+        (*fn)();
+        delete fn;
+    }
+
+    static void free_handler(struct ::eventloop *, void *arg) noexcept
+    {
+        delete static_cast<io_handler *>(arg);
+    }
+
+public:
+    eventloop() : loop(eventloop_create())
+    {
+        if (loop == nullptr) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "eventloop_create");
+        }
+    }
+
+    ~eventloop()
+    {
+        eventloop_destroy(loop);
+        for (auto &h : handlers) {
+            delete h.second;
+        }
+    }
+
+    eventloop(const eventloop &) = delete;
+    eventloop &operator=(const eventloop &) = delete;
+
+    void add(int fd, uint32_t events, io_handler fn)
+    {
+        io_handler *h = new io_handler(std::move(fn));
+        int rc = eventloop_add(loop, fd, events, call_io, h);
+
+        if (rc < 0) {
+            delete h;
+            check(rc, "eventloop_add");
+        }
+        handlers[fd] = h;
+    }
+
+    void modify(int fd, uint32_t events)
+    {
+        check(eventloop_modify(loop, fd, events), "eventloop_modify");
+    }
+
+    /*
+     * The handler may be the one running, so it is freed from the loop
+     * once the current callback has returned.
+     */
+    void remove(int fd)
+    {
+        auto it = handlers.find(fd);
+
+        if (it == handlers.end()) {
+            check(eventloop_remove(loop, fd), "eventloop_remove");
+            return;
+        }
+        if (eventloop_post(loop, free_handler, it->second)) {
+            throw std::bad_alloc();
+        }
+        handlers.erase(it);
+        check(eventloop_remove(loop, fd), "eventloop_remove");
+    }
+
+    void post(std::function<void()> fn)
+    {
+        std::function<void()> *p = new std::function<void()>(std::move(fn));
+
+        if (eventloop_post(loop, call, p)) {
+            delete p;
+            throw std::bad_alloc();
+        }
+    }
+
+    void run() { check(eventloop_run(loop), "eventloop_run"); }
+
+    int run_once(int timeout_ms = -1)
+    {
+        int rc = eventloop_run_once(loop, timeout_ms);
+
+        check(rc, "eventloop_run_once");
+        return rc;
+    }
+
+    void stop() { eventloop_stop(loop); }
+    uint64_t now() const { return eventloop_now(loop); }
+    struct ::eventloop *get() { return loop; }
+
+    /* A timer calling a lambda; stopped when destroyed */
+    class timer {
+        struct eventloop_timer t;
+        struct ::eventloop *loop;
+        std::function<void()> fn;
+
+        static void fire(struct ::eventloop *, void *arg) noexcept
+        {
+            static_cast<timer *>(arg)->fn();
+        }
+
+    public:
+        timer(eventloop &l, std::function<void()> f)
+            : loop(l.get()), fn(std::move(f))
+        {
+            eventloop_timer_init(&t, fire, this);
+        }
+
+        ~timer() { stop(); }
+
+        timer(const timer &) = delete;
+        timer &operator=(const timer &) = delete;
+
+        void start(uint64_t ms) { eventloop_timer_start(loop, &t, ms); }
+        void stop() { eventloop_timer_stop(loop, &t); }
+        bool pending() const { return eventloop_timer_pending(&t) != 0; }
+    };
+};
+
+} /* namespace lub */
+#endif /* __cplusplus */
+
+#endif /* !defined __EVENTLOOP_H */
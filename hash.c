@@ -0,0 +1,253 @@
+/**********************************************************************
+ * Fast 64-bit hashing
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Keys longer than 16 bytes are consumed in blocks of 48 bytes, as long
+ * as more than 48 remain, then in steps of 16 as long as more than 16
+ * remain. The last 16 bytes of the key are always read as the final two
+ * words, even if that means reading some bytes twice. The streaming
+ * interface has to make the same choices without knowing where the
+ * input ends, so it holds back the last bytes it has seen until more
+ * arrive, and keeps the 16 bytes before them for the final words.
+ *********************************************************************/
+
+#include <string.h>
+#include "hash.h"
+
+#define BLOCK   48
+
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint64_t read32(const unsigned char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+/* First and last words of a key of up to 16 bytes */
+static __ALWAYS_INLINE void short_words(const unsigned char *p, size_t len,
+                                        uint64_t *a, uint64_t *b)
+{
+    size_t mid;
+
+    if (len >= 4) {
+        /* Two overlapping 4 byte reads from each end */
+        mid = (len >> 3) << 2;
+        *a = (read32(p) << 32) | read32(p + mid);
+        *b = (read32(p + len - 4) << 32) | read32(p + len - 4 - mid);
+    } else if (len > 0) {
+        *a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) |
+             p[len - 1];
+        *b = 0;
+    } else {
+        *a = 0;
+        *b = 0;
+    }
+}
+
+static __ALWAYS_INLINE void block(const unsigned char *p, uint64_t *seed,
+                                  uint64_t *see1, uint64_t *see2)
+{
+    *seed = __hash_mix(read64(p) ^ __HASH_S1, read64(p + 8) ^ *seed);
+    *see1 = __hash_mix(read64(p + 16) ^ __HASH_S2, read64(p + 24) ^ *see1);
+    *see2 = __hash_mix(read64(p + 32) ^ __HASH_S3, read64(p + 40) ^ *see2);
+}
+
+/* The last 1 to 48 bytes of a key longer than 16, ending at p + len */
+static __ALWAYS_INLINE uint64_t tail(const unsigned char *p, size_t len,
+                                     uint64_t seed, uint64_t total)
+{
+    while (len > 16) {
+        seed = __hash_mix(read64(p) ^ __HASH_S1, read64(p + 8) ^ seed);
+        p += 16;
+        len -= 16;
+    }
+    return __hash_finish(read64(p + len - 16), read64(p + len - 8), seed,
+                         total);
+}
+
+/* Hash with a seed that has already been mixed */
+static __ALWAYS_INLINE uint64_t hash_mixed(const unsigned char *p, size_t len,
+                                           uint64_t seed)
+{
+    uint64_t a, b, see1, see2;
+    size_t i = len;
+
+    if (__LIKELY(len <= 16)) {
+        short_words(p, len, &a, &b);
+        return __hash_finish(a, b, seed, len);
+    }
+
+    if (i > BLOCK) {
+        see1 = seed;
+        see2 = seed;
+        do {
+            block(p, &seed, &see1, &see2);
+            p += BLOCK;
+            i -= BLOCK;
+        } while (i > BLOCK);
+        seed ^= see1 ^ see2;
+    }
+    return tail(p, i, seed, len);
+}
+
+uint64_t hash_bytes(const void *key, size_t len, uint64_t seed)
+{
+    return hash_mixed(key, len, __hash_seed(seed));
+}
+
+/**********************************************************************
+ * Bulk
+ *********************************************************************/
+/* Four keys of up to 16 bytes, with no dependencies between them */
+static __ALWAYS_INLINE void short4(const unsigned char *const p[4],
+                                   const size_t len[4], uint64_t seed,
+                                   uint64_t *out)
+{
+    uint64_t a[4], b[4];
+    int j;
+
+    for (j = 0; j < 4; j++) {
+        short_words(p[j], len[j], &a[j], &b[j]);
+    }
+    for (j = 0; j < 4; j++) {
+        out[j] = __hash_finish(a[j], b[j], seed, len[j]);
+    }
+}
+
+void hash_bulk(const void *const *keys, const size_t *lens, size_t n,
+               uint64_t seed, uint64_t *out)
+{
+    const unsigned char *p[4];
+    size_t i = 0;
+    int j;
+
+    seed = __hash_seed(seed);
+    for (; i + 4 <= n; i += 4) {
+        if ((lens[i] | lens[i + 1] | lens[i + 2] | lens[i + 3]) <= 16) {
+            for (j = 0; j < 4; j++) {
+                p[j] = keys[i + j];
+            }
+            short4(p, lens + i, seed, out + i);
+            continue;
+        }
+        for (j = 0; j < 4; j++) {
+            out[i + j] = hash_mixed(keys[i + j], lens[i + j], seed);
+        }
+    }
+    for (; i < n; i++) {
+        out[i] = hash_mixed(keys[i], lens[i], seed);
+    }
+}
+
+void hash_bulk_fixed(const void *keys, size_t key_size, size_t n,
+                     uint64_t seed, uint64_t *out)
+{
+    const unsigned char *k = keys;
+    const unsigned char *p[4];
+    size_t len[4] = { key_size, key_size, key_size, key_size };
+    size_t i = 0;
+    int j;
+
+    seed = __hash_seed(seed);
+    if (key_size <= 16) {
+        for (; i + 4 <= n; i += 4) {
+            for (j = 0; j < 4; j++) {
+                p[j] = k + (i + (size_t)j) * key_size;
+            }
+            short4(p, len, seed, out + i);
+        }
+    }
+    for (; i < n; i++) {
+        out[i] = hash_mixed(k + i * key_size, key_size, seed);
+    }
+}
+
+/**********************************************************************
+ * Streaming
+ *
+ * Pending bytes are kept at buf + 16, and the 16 bytes before them at
+ * buf. A block is only hashed once a byte after it has arrived, since
+ * the last bytes of the input are hashed differently.
+ *********************************************************************/
+#define PENDING(h)  ((h)->buf + 16)
+
+void hash_init(struct hash_state *h, uint64_t seed)
+{
+    h->seed = __hash_seed(seed);
+    h->see1 = h->seed;
+    h->see2 = h->seed;
+    h->len = 0;
+    h->pending = 0;
+}
+
+void hash_update(struct hash_state *h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    size_t n;
+
+    h->len += len;
+
+    /* Fill up the pending block, and hash it if more input follows */
+    if (h->pending > 0) {
+        n = BLOCK - h->pending;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(PENDING(h) + h->pending, p, n);
+        h->pending += n;
+        p += n;
+        len -= n;
+        if (len == 0) {
+            return;
+        }
+
+        block(PENDING(h), &h->seed, &h->see1, &h->see2);
+        memcpy(h->buf, PENDING(h) + BLOCK - 16, 16);
+        h->pending = 0;
+    }
+
+    /* Whole blocks are hashed straight from the input */
+    if (len > BLOCK) {
+        do {
+            block(p, &h->seed, &h->see1, &h->see2);
+            p += BLOCK;
+            len -= BLOCK;
+        } while (len > BLOCK);
+        memcpy(h->buf, p - 16, 16);
+    }
+
+    memcpy(PENDING(h), p, len);
+    h->pending = len;
+}
+
+uint64_t hash_final(const struct hash_state *h)
+{
+    uint64_t a, b, seed = h->seed;
+
+    if (h->len <= 16) {
+        short_words(PENDING(h), h->pending, &a, &b);
+        return __hash_finish(a, b, seed, h->len);
+    }
+
+    /* Blocks were hashed if the input did not fit in the tail */
+    if (h->len > BLOCK) {
+        seed ^= h->see1 ^ h->see2;
+    }
+    return tail(PENDING(h), h->pending, seed, h->len);
+}
@@ -0,0 +1,125 @@
+/**********************************************************************
+ * Fast 64-bit hashing
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * A non-cryptographic hash for hash tables, sharding and checksums of
+ * data that is not under an attacker's control. The algorithm is Wang
+ * Yi's wyhash (final version 4), which is built on the 64x64->128-bit
+ * multiply: keys up to 16 bytes take two multiplies after the seed has
+ * been mixed, and longer keys are consumed 48 bytes at a time in three
+ * independent multiply chains. With its default secret, as here, the
+ * results match the reference implementation's test vectors.
+ *
+ * Results depend only on the bytes hashed and the seed. Input is read
+ * as little endian words and the 128-bit product is computed exactly
+ * where the compiler has no 128-bit integers, so every platform gives
+ * the same value, and values may be stored or sent between machines.
+ *
+ * Three interfaces give the same results for the same bytes:
+ *      hash_bytes      One buffer at a time
+ *      hash_update     A buffer delivered in pieces, via struct hash_state
+ *      hash_bulk       Many keys at once, overlapping their multiplies
+ *
+ * hash_u64 hashes the 8 byte little endian encoding of an integer key,
+ * inline, and agrees with hash_bytes on that encoding.
+ *********************************************************************/
+
+#ifndef __HASH_H
+#define __HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cdecl.h"
+#include "compiler.h"
+
+__CDECL_BEGIN
+
+/* The reference implementation's default secret */
+#define __HASH_S0   0x2d358dccaa6c78a5ULL
+#define __HASH_S1   0x8bb84b93962eacc9ULL
+#define __HASH_S2   0x4b33a62ed433d4a3ULL
+#define __HASH_S3   0x4d5a2da51de1aa47ULL
+
+/* Full 128-bit product of *a and *b, low half in *a and high in *b */
+static __ALWAYS_INLINE void __hash_mum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)*a * *b;
+
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, la = (uint32_t)*a;
+    uint64_t hb = *b >> 32, lb = (uint32_t)*b;
+    uint64_t hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+    uint64_t mid = (ll >> 32) + (uint32_t)hl + (uint32_t)lh;
+
+    *a = (mid << 32) | (uint32_t)ll;
+    *b = hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+#endif
+}
+
+static __ALWAYS_INLINE uint64_t __hash_mix(uint64_t a, uint64_t b)
+{
+    __hash_mum(&a, &b);
+    return a ^ b;
+}
+
+/* The seed is mixed once, then shared by every key hashed with it */
+static __ALWAYS_INLINE uint64_t __hash_seed(uint64_t seed)
+{
+    return seed ^ __hash_mix(seed ^ __HASH_S0, __HASH_S1);
+}
+
+/* Final mix of the last two words a and b of a len byte key */
+static __ALWAYS_INLINE uint64_t __hash_finish(uint64_t a, uint64_t b,
+                                              uint64_t seed, uint64_t len)
+{
+    a ^= __HASH_S1;
+    b ^= seed;
+    __hash_mum(&a, &b);
+    return __hash_mix(a ^ __HASH_S0 ^ len, b ^ __HASH_S1);
+}
+
+/* Hash of the 8 byte little endian encoding of v */
+static inline uint64_t hash_u64(uint64_t v, uint64_t seed)
+{
+    uint64_t lo = (uint32_t)v, hi = v >> 32;
+
+    return __hash_finish((lo << 32) | hi, (hi << 32) | lo,
+                         __hash_seed(seed), 8);
+}
+
+uint64_t hash_bytes(const void *key, size_t len, uint64_t seed);
+
+/*
+ * Hash n keys, storing the hash of keys[i], of lens[i] bytes, in out[i].
+ * Short keys are hashed four at a time so that their multiplies overlap.
+ */
+void hash_bulk(const void *const *keys, const size_t *lens, size_t n,
+               uint64_t seed, uint64_t *out);
+
+/* Hash n keys of key_size bytes each, stored back to back in keys */
+void hash_bulk_fixed(const void *keys, size_t key_size, size_t n,
+                     uint64_t seed, uint64_t *out);
+
+/* Streaming state. The buffer holds the 16 bytes before the pending ones */
+struct hash_state {
+    uint64_t seed;
+    uint64_t see1;
+    uint64_t see2;
+    uint64_t len;               /* Bytes hashed so far */
+    size_t pending;
+    unsigned char buf[16 + 48];
+};
+
+void hash_init(struct hash_state *h, uint64_t seed);
+void hash_update(struct hash_state *h, const void *data, size_t len);
+
+/* Hash of everything passed to hash_update. h may be updated further */
+uint64_t hash_final(const struct hash_state *h);
+
+__CDECL_END
+
+#endif /* !defined __HASH_H */
@@ -0,0 +1,434 @@
+/**********************************************************************
+ * Open addressing hash map
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * The control byte array has GROUP_WIDTH extra bytes at the end, which
+ * mirror the first GROUP_WIDTH bytes, so that a group can be loaded
+ * starting at any slot without wrapping. Probing visits one group after
+ * another in a triangular sequence, which covers every group since the
+ * number of groups is a power of 2.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "compiler.h"
+#include "hash.h"
+#include "hashmap.h"
+
+#define CTRL_EMPTY      0x80
+#define CTRL_DELETED    0xFE
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+#define GROUP_WIDTH     16
+#define BITMASK_SHIFT   0
+
+typedef uint32_t bitmask_t;
+
+static inline bitmask_t group_match(const uint8_t *ctrl, uint8_t h2)
+{
+    __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+
+    return (bitmask_t)_mm_movemask_epi8(
+                        _mm_cmpeq_epi8(g, _mm_set1_epi8((char)h2)));
+}
+
+static inline bitmask_t group_match_empty(const uint8_t *ctrl)
+{
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+/* Empty and deleted are the only control bytes with the top bit set */
+static inline bitmask_t group_match_free(const uint8_t *ctrl)
+{
+    return (bitmask_t)_mm_movemask_epi8(
+                        _mm_loadu_si128((const __m128i *)ctrl));
+}
+
+#else /* !defined __SSE2__ */
+
+/*
+ * Portable fallback, treating 8 control bytes as a 64-bit word. Each
+ * match sets the top bit of the matching byte. group_match may report
+ * false positives, which are weeded out by the key comparison.
+ */
+#define GROUP_WIDTH     8
+#define BITMASK_SHIFT   3
+
+#define LSBS            0x0101010101010101ULL
+#define MSBS            0x8080808080808080ULL
+
+typedef uint64_t bitmask_t;
+
+static inline uint64_t group_load(const uint8_t *ctrl)
+{
+    uint64_t g;
+
+    memcpy(&g, ctrl, sizeof(g));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    g = __builtin_bswap64(g);
+#endif
+    return g;
+}
+
+static inline bitmask_t group_match(const uint8_t *ctrl, uint8_t h2)
+{
+    uint64_t x = group_load(ctrl) ^ (LSBS * h2);
+
+    return (x - LSBS) & ~x & MSBS;
+}
+
+static inline bitmask_t group_match_empty(const uint8_t *ctrl)
+{
+    uint64_t g = group_load(ctrl);
+
+    return g & (~g << 6) & MSBS;
+}
+
+static inline bitmask_t group_match_free(const uint8_t *ctrl)
+{
+    return group_load(ctrl) & MSBS;
+}
+
+#endif /* defined __SSE2__ */
+
+static inline unsigned int bitmask_first(bitmask_t mask)
+{
+    return (unsigned int)__builtin_ctzll(mask) >> BITMASK_SHIFT;
+}
+
+/* Used for maps that have never had anything inserted */
+static const uint8_t empty_group[GROUP_WIDTH] __ALIGNED(16) = {
+    CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY,
+    CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY,
+#if GROUP_WIDTH == 16
+    CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY,
+    CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY, CTRL_EMPTY,
+#endif
+};
+
+static inline size_t capacity(const struct hashmap *m)
+{
+    return m->ctrl == empty_group ? 0 : m->mask + 1;
+}
+
+/* Maximum load factor is 7/8 */
+static inline size_t max_load(size_t cap)
+{
+    return cap - cap / 8;
+}
+
+static inline char *slot_at(const struct hashmap *m, size_t i)
+{
+    return m->slots + i * m->slot_size;
+}
+
+static inline uint64_t hash_key(const struct hashmap *m, const void *key)
+{
+    return m->hash ? m->hash(key, m->key_size) :
+                     hash_bytes(key, m->key_size, 0);
+}
+
+static inline int key_equal(const struct hashmap *m, const void *a,
+                            const void *b)
+{
+    return m->cmp ? m->cmp(a, b, m->key_size) == 0 :
+                    memcmp(a, b, m->key_size) == 0;
+}
+
+static inline void set_ctrl(struct hashmap *m, size_t i, uint8_t c)
+{
+    m->ctrl[i] = c;
+    if (i < GROUP_WIDTH) {
+        m->ctrl[m->mask + 1 + i] = c;
+    }
+}
+
+/* Largest power of 2 dividing n, capped at 16 */
+static size_t natural_align(size_t n)
+{
+    size_t a = 1;
+
+    while (a < 16 && (n & a) == 0) {
+        a <<= 1;
+    }
+    return n ? a : 1;
+}
+
+void hashmap_init(struct hashmap *m, size_t key_size, size_t value_size,
+                  hashmap_hash_fn hash, hashmap_cmp_fn cmp)
+{
+    size_t kalign = natural_align(key_size);
+    size_t valign = natural_align(value_size);
+    size_t align = kalign > valign ? kalign : valign;
+
+    m->ctrl = (uint8_t *)empty_group;
+    m->slots = NULL;
+    m->mask = 0;
+    m->size = 0;
+    m->growth_left = 0;
+    m->key_size = key_size;
+    m->value_size = value_size;
+    m->value_offset = (key_size + valign - 1) & ~(valign - 1);
+    m->slot_size = (m->value_offset + value_size + align - 1) & ~(align - 1);
+    m->hash = hash;
+    m->cmp = cmp;
+}
+
+void hashmap_destroy(struct hashmap *m)
+{
+    if (capacity(m)) {
+        free(m->slots);
+    }
+    hashmap_init(m, m->key_size, m->value_size, m->hash, m->cmp);
+}
+
+void hashmap_clear(struct hashmap *m)
+{
+    size_t cap = capacity(m);
+
+    if (cap) {
+        memset(m->ctrl, CTRL_EMPTY, cap + GROUP_WIDTH);
+        m->growth_left = max_load(cap);
+    }
+    m->size = 0;
+}
+
+/* Find the first empty or deleted slot in the probe sequence for hash */
+static size_t find_free(const struct hashmap *m, uint64_t hash)
+{
+    size_t pos = (size_t)(hash >> 7) & m->mask;
+    size_t stride = 0;
+    bitmask_t free_mask;
+
+    for (;;) {
+        free_mask = group_match_free(m->ctrl + pos);
+        if (free_mask) {
+            return (pos + bitmask_first(free_mask)) & m->mask;
+        }
+        stride += GROUP_WIDTH;
+        pos = (pos + stride) & m->mask;
+    }
+}
+
+static int resize(struct hashmap *m, size_t new_cap)
+{
+    struct hashmap old = *m;
+    size_t old_cap = capacity(m);
+    size_t slot_bytes = new_cap * m->slot_size;
+    char *mem;
+    size_t i;
+
+    /* Slot array followed by the control bytes */
+    mem = malloc(slot_bytes + new_cap + GROUP_WIDTH);
+    if (mem == NULL) {
+        return -1;
+    }
+
+    m->slots = mem;
+    m->ctrl = (uint8_t *)mem + slot_bytes;
+    m->mask = new_cap - 1;
+    memset(m->ctrl, CTRL_EMPTY, new_cap + GROUP_WIDTH);
+    m->growth_left = max_load(new_cap) - m->size;
+
+    for (i = 0; i < old_cap; i++) {
+        const char *src;
+        uint64_t hash;
+        size_t dst;
+
+        if (old.ctrl[i] & 0x80) {
+            continue;
+        }
+
+        src = slot_at(&old, i);
+        hash = hash_key(m, src);
+        dst = find_free(m, hash);
+        set_ctrl(m, dst, (uint8_t)(hash & 0x7F));
+        memcpy(slot_at(m, dst), src, m->slot_size);
+    }
+
+    if (old_cap) {
+        free(old.slots);
+    }
+    return 0;
+}
+
+int hashmap_reserve(struct hashmap *m, size_t n)
+{
+    size_t cap = GROUP_WIDTH;
+
+    while (max_load(cap) < n) {
+        cap <<= 1;
+        if (cap == 0) {
+            return -1;
+        }
+    }
+
+    if (cap <= capacity(m)) {
+        return 0;
+    }
+    return resize(m, cap);
+}
+
+static void *find_slot(const struct hashmap *m, const void *key,
+                       uint64_t hash)
+{
+    uint8_t h2 = (uint8_t)(hash & 0x7F);
+    size_t pos = (size_t)(hash >> 7) & m->mask;
+    size_t stride = 0;
+    const uint8_t *group;
+    bitmask_t match;
+    char *slot;
+
+    for (;;) {
+        group = m->ctrl + pos;
+        for (match = group_match(group, h2); match; match &= match - 1) {
+            slot = slot_at(m, (pos + bitmask_first(match)) & m->mask);
+            if (__LIKELY(key_equal(m, slot, key))) {
+                return slot;
+            }
+        }
+
+        if (__LIKELY(group_match_empty(group))) {
+            return NULL;
+        }
+
+        stride += GROUP_WIDTH;
+        pos = (pos + stride) & m->mask;
+    }
+}
+
+void *hashmap_find(const struct hashmap *m, const void *key)
+{
+    char *slot = find_slot(m, key, hash_key(m, key));
+
+    return slot ? slot + m->value_offset : NULL;
+}
+
+void *hashmap_insert(struct hashmap *m, const void *key, int *inserted)
+{
+    uint64_t hash = hash_key(m, key);
+    char *slot = find_slot(m, key, hash);
+    size_t i;
+
+    if (slot) {
+        if (inserted) {
+            *inserted = 0;
+        }
+        return slot + m->value_offset;
+    }
+
+    i = find_free(m, hash);
+    if (__UNLIKELY(m->growth_left == 0 && m->ctrl[i] != CTRL_DELETED)) {
+        size_t cap = capacity(m);
+
+        /*
+         * If at least half of the load is tombstones, rehashing at the
+         * same size is enough to make room.
+         */
+        if (cap == 0) {
+            cap = GROUP_WIDTH;
+        } else if (m->size > max_load(cap) / 2) {
+            cap <<= 1;
+        }
+
+        if (resize(m, cap)) {
+            return NULL;
+        }
+        i = find_free(m, hash);
+    }
+
+    if (m->ctrl[i] == CTRL_EMPTY) {
+        m->growth_left--;
+    }
+    set_ctrl(m, i, (uint8_t)(hash & 0x7F));
+    m->size++;
+
+    slot = slot_at(m, i);
+    memcpy(slot, key, m->key_size);
+    if (inserted) {
+        *inserted = 1;
+    }
+    return slot + m->value_offset;
+}
+
+int hashmap_put(struct hashmap *m, const void *key, const void *value)
+{
+    void *v = hashmap_insert(m, key, NULL);
+
+    if (v == NULL) {
+        return -1;
+    }
+    memcpy(v, value, m->value_size);
+    return 0;
+}
+
+int hashmap_erase(struct hashmap *m, const void *key)
+{
+    char *slot = find_slot(m, key, hash_key(m, key));
+    size_t i;
+
+    if (slot == NULL) {
+        return 0;
+    }
+
+    i = (size_t)(slot - m->slots) / m->slot_size;
+
+    /*
+     * The slot can go back to empty only if no probe sequence could have
+     * passed over it, i.e. there was never a full group's worth of
+     * occupied slots around it. Otherwise leave a tombstone.
+     */
+    {
+        size_t before = (i - GROUP_WIDTH) & m->mask;
+        bitmask_t empty_after = group_match_empty(m->ctrl + i);
+        bitmask_t empty_before = group_match_empty(m->ctrl + before);
+        unsigned int run = GROUP_WIDTH;
+
+        if (empty_before && empty_after) {
+            unsigned int lead = (unsigned int)__builtin_clzll(empty_before);
+
+            /* Leading zeros count from bit 63, convert to group slots */
+            lead = (lead - (64 - GROUP_WIDTH * (1 << BITMASK_SHIFT))) >>
+                   BITMASK_SHIFT;
+            run = lead + bitmask_first(empty_after);
+        }
+
+        if (run < GROUP_WIDTH) {
+            set_ctrl(m, i, CTRL_EMPTY);
+            m->growth_left++;
+        } else {
+            set_ctrl(m, i, CTRL_DELETED);
+        }
+    }
+
+    m->size--;
+    return 1;
+}
+
+int hashmap_next(const struct hashmap *m, size_t *iter,
+                 void **key, void **value)
+{
+    size_t cap = capacity(m);
+    size_t i;
+
+    for (i = *iter; i < cap; i++) {
+        if (!(m->ctrl[i] & 0x80)) {
+            char *slot = slot_at(m, i);
+
+            if (key) {
+                *key = slot;
+            }
+            if (value) {
+                *value = slot + m->value_offset;
+            }
+            *iter = i + 1;
+            return 1;
+        }
+    }
+
+    *iter = cap;
+    return 0;
+}
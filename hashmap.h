@@ -0,0 +1,206 @@
+/**********************************************************************
+ * Open addressing hash map
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * A hash map in the style of Abseil's Swiss tables. Each slot has a
+ * control byte which is either empty, deleted, or holds the low 7 bits
+ * of the key's hash. Lookups compare a whole group of control bytes at
+ * once (16 with SSE2, 8 with the portable fallback), so only slots
+ * whose hash bits match ever have their keys compared.
+ *
+ * Keys and values are fixed size byte blobs, whose sizes are set at
+ * init time. Keys and values are copied into the map, and the pointers
+ * returned by the lookup functions remain valid until the next insert
+ * or erase.
+ *
+ * Usage:
+ *      struct hashmap m;
+ *      hashmap_init(&m, sizeof(uint64_t), sizeof(struct foo), NULL, NULL);
+ *      v = hashmap_insert(&m, &key, &inserted);
+ *      ...
+ *      v = hashmap_find(&m, &key);
+ *      ...
+ *      hashmap_destroy(&m);
+ *
+ * C++ code can use lub::hashmap<K, V>, defined at the end of this file.
+ *********************************************************************/
+
+#ifndef __HASHMAP_H
+#define __HASHMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+/* Hash function, called with the key and the configured key size */
+typedef uint64_t (*hashmap_hash_fn)(const void *key, size_t len);
+
+/* Key comparison, returns 0 if the keys are equal (memcmp will do) */
+typedef int (*hashmap_cmp_fn)(const void *a, const void *b, size_t len);
+
+struct hashmap {
+    uint8_t *ctrl;              /* Control bytes, followed by clones */
+    char *slots;                /* Key, then value, for each slot */
+    size_t mask;                /* Capacity - 1, capacity is a power of 2 */
+    size_t size;                /* Number of live entries */
+    size_t growth_left;         /* Inserts into empty slots before resize */
+    size_t key_size;
+    size_t value_size;
+    size_t value_offset;        /* Offset of the value within a slot */
+    size_t slot_size;
+    hashmap_hash_fn hash;
+    hashmap_cmp_fn cmp;
+};
+
+/*
+ * Initialize an empty map. hash and cmp may be NULL, in which case the
+ * key is hashed and compared as a sequence of bytes. value_size may be
+ * 0 to use the map as a set. No memory is allocated until the first
+ * insert.
+ */
+void hashmap_init(struct hashmap *m, size_t key_size, size_t value_size,
+                  hashmap_hash_fn hash, hashmap_cmp_fn cmp);
+
+/* Release all memory held by the map */
+void hashmap_destroy(struct hashmap *m);
+
+/* Remove all entries, keeping the allocated capacity */
+void hashmap_clear(struct hashmap *m);
+
+/* Make room for at least n entries. Returns 0, or -1 if out of memory */
+int hashmap_reserve(struct hashmap *m, size_t n);
+
+/* Return a pointer to the value for key, or NULL if it is not present */
+void *hashmap_find(const struct hashmap *m, const void *key);
+
+/*
+ * Find key, inserting it if not present. Returns a pointer to the value,
+ * which is uninitialized if the key was inserted, or NULL if out of
+ * memory. *inserted, if not NULL, is set to 1 if the key was inserted.
+ */
+void *hashmap_insert(struct hashmap *m, const void *key, int *inserted);
+
+/* Insert or overwrite key's value. Returns 0, or -1 if out of memory */
+int hashmap_put(struct hashmap *m, const void *key, const void *value);
+
+/* Remove key. Returns 1 if it was present, 0 otherwise */
+int hashmap_erase(struct hashmap *m, const void *key);
+
+/*
+ * Iterate over all entries. Set *iter to 0 before the first call. Each
+ * call stores the next entry in *key and *value (either may be NULL)
+ * and returns 1, or returns 0 when there are no more entries. The map
+ * must not be modified while iterating, except by erasing the current
+ * entry.
+ */
+int hashmap_next(const struct hashmap *m, size_t *iter,
+                 void **key, void **value);
+
+static inline size_t hashmap_size(const struct hashmap *m)
+{
+    return m->size;
+}
+
+__CDECL_END
+
+#ifdef __cplusplus
+#include <new>
+#include <type_traits>
+
+namespace lub {
+
+/*
+ * Typed wrapper for struct hashmap. Keys and values are copied as raw
+ * bytes, so both must be trivially copyable, and keys must not contain
+ * padding (or must have it zeroed).
+ */
+template <typename K, typename V>
+class hashmap {
+    static_assert(std::is_trivially_copyable<K>::value,
+                  "hashmap keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<V>::value,
+                  "hashmap values must be trivially copyable");
+
+    struct ::hashmap m;
+
+public:
+    hashmap(hashmap_hash_fn hash = nullptr, hashmap_cmp_fn cmp = nullptr)
+    {
+        hashmap_init(&m, sizeof(K), sizeof(V), hash, cmp);
+    }
+
+    ~hashmap() { hashmap_destroy(&m); }
+
+    hashmap(const hashmap &) = delete;
+    hashmap &operator=(const hashmap &) = delete;
+
+    size_t size() const { return hashmap_size(&m); }
+    bool empty() const { return size() == 0; }
+    void clear() { hashmap_clear(&m); }
+
+    void reserve(size_t n)
+    {
+        if (hashmap_reserve(&m, n)) {
+            throw std::bad_alloc();
+        }
+    }
+
+    V *find(const K &key) { return static_cast<V *>(hashmap_find(&m, &key)); }
+
+    const V *find(const K &key) const
+    {
+        return static_cast<const V *>(hashmap_find(&m, &key));
+    }
+
+    bool contains(const K &key) const { return find(key) != nullptr; }
+
+    /* Returns true if the key was inserted, false if it was overwritten */
+    bool put(const K &key, const V &value)
+    {
+        int inserted;
+        V *v = static_cast<V *>(hashmap_insert(&m, &key, &inserted));
+
+        if (v == nullptr) {
+            throw std::bad_alloc();
+        }
+        *v = value;
+        return inserted != 0;
+    }
+
+    /* Value initializes missing entries, like std::unordered_map */
+    V &operator[](const K &key)
+    {
+        int inserted;
+        V *v = static_cast<V *>(hashmap_insert(&m, &key, &inserted));
+
+        if (v == nullptr) {
+            throw std::bad_alloc();
+        }
+        if (inserted) {
+            new (v) V();
+        }
+        return *v;
+    }
+
+    bool erase(const K &key) { return hashmap_erase(&m, &key) != 0; }
+
+    /* Call fn(key, value) for every entry */
+    template <typename F>
+    void for_each(F fn)
+    {
+        size_t iter = 0;
+        void *k, *v;
+
+        while (hashmap_next(&m, &iter, &k, &v)) {
+            fn(*static_cast<const K *>(k), *static_cast<V *>(v));
+        }
+    }
+};
+
+} /* namespace lub */
+#endif /* __cplusplus */
+
+#endif /* !defined __HASHMAP_H */
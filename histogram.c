@@ -0,0 +1,447 @@
+/**********************************************************************
+ * Latency histograms
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Counter i belongs to bucket (i >> half_bits) - 1, except that the
+ * first 2 * 2^half_bits counters all belong to bucket 0, which has unit
+ * width. Within bucket b the counters cover values from
+ * 2^half_bits << b upwards in steps of 2^b, so each bucket only uses
+ * its upper half of sub-buckets; the lower half would repeat the
+ * previous bucket at a coarser resolution.
+ *
+ * The encoding is the magic "LUBH", the varints half_bits and highest,
+ * and then one varint per counter up to the last non-zero one. A zero
+ * varint stands for a run of empty counters, with the run length in the
+ * varint that follows it.
+ *********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "histogram.h"
+
+#define MAGIC           "LUBH"
+#define MAGIC_LEN       4
+
+/* Limits from 1 and 5 significant digits */
+#define MIN_HALF_BITS   1
+#define MAX_HALF_BITS   17
+
+__thread unsigned int __histogram_slot;
+static unsigned int next_slot;
+
+/* Work out the number of counters needed to cover 0 to highest */
+static void layout_init(struct histogram_layout *l, uint64_t highest,
+                        unsigned int half_bits)
+{
+    uint64_t limit = 2ULL << half_bits;
+    size_t buckets = 1;
+
+    while (limit <= highest) {
+        buckets++;
+        if (limit > UINT64_MAX / 2) {
+            break;
+        }
+        limit <<= 1;
+    }
+
+    l->highest = highest;
+    l->half_bits = half_bits;
+    l->counts_len = (buckets + 1) << half_bits;
+}
+
+static int layout_equal(const struct histogram_layout *a,
+                        const struct histogram_layout *b)
+{
+    return a->highest == b->highest && a->half_bits == b->half_bits;
+}
+
+/* Smallest value counted by counter i, and the width of its bucket */
+static uint64_t index_value(const struct histogram_layout *l, size_t i,
+                            uint64_t *width)
+{
+    size_t half = (size_t)1 << l->half_bits;
+    size_t bucket = i >> l->half_bits;
+    uint64_t sub = (uint64_t)((i & (half - 1)) + half);
+
+    if (bucket == 0) {
+        sub -= half;
+    } else {
+        bucket--;
+    }
+
+    *width = 1ULL << bucket;
+    return sub << bucket;
+}
+
+int histogram_init(struct histogram *h, uint64_t highest, int sigfigs)
+{
+    uint64_t single_unit = 2;
+    unsigned int bits = 0;
+    int i;
+
+    if (sigfigs < 1 || sigfigs > 5 || highest < 2) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Values below 2 * 10^sigfigs must be counted exactly */
+    for (i = 0; i < sigfigs; i++) {
+        single_unit *= 10;
+    }
+    while ((1ULL << bits) < single_unit) {
+        bits++;
+    }
+
+    memset(h, 0, sizeof(*h));
+    layout_init(&h->layout, highest, bits - 1);
+    return 0;
+}
+
+void histogram_destroy(struct histogram *h)
+{
+    int i;
+
+    for (i = 0; i < HISTOGRAM_SHARDS; i++) {
+        free(h->shards[i]);
+        h->shards[i] = NULL;
+    }
+}
+
+void histogram_reset(struct histogram *h)
+{
+    uint64_t *counts;
+    size_t j;
+    int i;
+
+    for (i = 0; i < HISTOGRAM_SHARDS; i++) {
+        counts = __atomic_load_n(&h->shards[i], __ATOMIC_ACQUIRE);
+        if (counts == NULL) {
+            continue;
+        }
+        for (j = 0; j < h->layout.counts_len; j++) {
+            __atomic_store_n(&counts[j], 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+unsigned int __histogram_slot_assign(void)
+{
+    unsigned int n = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED);
+
+    __histogram_slot = n % HISTOGRAM_SHARDS + 1;
+    return __histogram_slot;
+}
+
+uint64_t *__histogram_shard_alloc(struct histogram *h, unsigned int slot)
+{
+    size_t size = h->layout.counts_len * sizeof(uint64_t);
+    uint64_t *expected = NULL;
+    void *counts;
+
+    /* Cache line aligned, so that shards never share a line */
+    if (posix_memalign(&counts, __CACHELINE_SIZE, size)) {
+        return NULL;
+    }
+    memset(counts, 0, size);
+
+    if (!__atomic_compare_exchange_n(&h->shards[slot], &expected,
+                                     (uint64_t *)counts, 0, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_ACQUIRE)) {
+        /* Another thread sharing the slot got there first */
+        free(counts);
+        return expected;
+    }
+    return counts;
+}
+
+int histogram_read(const struct histogram *h, struct histogram_snapshot *s)
+{
+    const uint64_t *counts;
+    uint64_t total = 0;
+    size_t j;
+    int i;
+
+    s->layout = h->layout;
+    s->counts = calloc(h->layout.counts_len, sizeof(uint64_t));
+    if (s->counts == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < HISTOGRAM_SHARDS; i++) {
+        counts = __atomic_load_n(&h->shards[i], __ATOMIC_ACQUIRE);
+        if (counts == NULL) {
+            continue;
+        }
+        for (j = 0; j < h->layout.counts_len; j++) {
+            s->counts[j] += __atomic_load_n(&counts[j], __ATOMIC_RELAXED);
+        }
+    }
+
+    for (j = 0; j < h->layout.counts_len; j++) {
+        total += s->counts[j];
+    }
+    s->total = total;
+    return 0;
+}
+
+void histogram_snapshot_destroy(struct histogram_snapshot *s)
+{
+    free(s->counts);
+    s->counts = NULL;
+}
+
+int histogram_snapshot_merge(struct histogram_snapshot *dst,
+                             const struct histogram_snapshot *src)
+{
+    size_t i;
+
+    if (!layout_equal(&dst->layout, &src->layout)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < dst->layout.counts_len; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    return 0;
+}
+
+/**********************************************************************
+ * Queries
+ *********************************************************************/
+uint64_t histogram_percentile(const struct histogram_snapshot *s,
+                              double percentile)
+{
+    uint64_t target, seen = 0, width, value;
+    double want;
+    size_t i;
+
+    if (s->total == 0) {
+        return 0;
+    }
+
+    if (percentile < 0) {
+        percentile = 0;
+    } else if (percentile > 100) {
+        percentile = 100;
+    }
+
+    /* Rank of the value, rounded up, and at least the first value */
+    want = percentile / 100 * (double)s->total;
+    target = (uint64_t)want;
+    if ((double)target < want) {
+        target++;
+    }
+    if (target == 0) {
+        target = 1;
+    }
+
+    for (i = 0; i < s->layout.counts_len; i++) {
+        seen += s->counts[i];
+        if (seen >= target) {
+            break;
+        }
+    }
+    if (i == s->layout.counts_len) {
+        i--;
+    }
+
+    value = index_value(&s->layout, i, &width);
+    return value + width - 1;
+}
+
+uint64_t histogram_min(const struct histogram_snapshot *s)
+{
+    uint64_t width;
+    size_t i;
+
+    for (i = 0; i < s->layout.counts_len; i++) {
+        if (s->counts[i]) {
+            return index_value(&s->layout, i, &width);
+        }
+    }
+    return 0;
+}
+
+uint64_t histogram_max(const struct histogram_snapshot *s)
+{
+    uint64_t width, value;
+    size_t i;
+
+    for (i = s->layout.counts_len; i > 0; i--) {
+        if (s->counts[i - 1]) {
+            value = index_value(&s->layout, i - 1, &width);
+            return value + width - 1;
+        }
+    }
+    return 0;
+}
+
+double histogram_mean(const struct histogram_snapshot *s)
+{
+    uint64_t width, value;
+    double sum = 0;
+    size_t i;
+
+    if (s->total == 0) {
+        return 0;
+    }
+
+    /* Each value is taken to be in the middle of its counter's range */
+    for (i = 0; i < s->layout.counts_len; i++) {
+        if (s->counts[i]) {
+            value = index_value(&s->layout, i, &width);
+            sum += (double)(value + width / 2) * (double)s->counts[i];
+        }
+    }
+    return sum / (double)s->total;
+}
+
+/**********************************************************************
+ * Serialization
+ *********************************************************************/
+static size_t put_varint(unsigned char *buf, size_t len, size_t pos,
+                         uint64_t v)
+{
+    do {
+        unsigned char c = (unsigned char)(v & 0x7f);
+
+        v >>= 7;
+        if (v) {
+            c |= 0x80;
+        }
+        if (pos < len) {
+            buf[pos] = c;
+        }
+        pos++;
+    } while (v);
+
+    return pos;
+}
+
+/* Returns 0, or -1 if the varint is truncated or too long */
+static int get_varint(const unsigned char *buf, size_t len, size_t *pos,
+                      uint64_t *v)
+{
+    uint64_t r = 0;
+    unsigned int shift = 0;
+    unsigned char c;
+
+    do {
+        if (*pos >= len || shift > 63) {
+            return -1;
+        }
+        c = buf[(*pos)++];
+        if (shift == 63 && (c & 0x7e)) {
+            return -1;
+        }
+        r |= (uint64_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    *v = r;
+    return 0;
+}
+
+size_t histogram_encode(const struct histogram_snapshot *s, void *buf,
+                        size_t len)
+{
+    unsigned char *out = buf;
+    size_t end, i, run;
+    size_t pos = 0;
+
+    for (i = 0; i < MAGIC_LEN; i++, pos++) {
+        if (pos < len) {
+            out[pos] = (unsigned char)MAGIC[i];
+        }
+    }
+    pos = put_varint(out, len, pos, s->layout.half_bits);
+    pos = put_varint(out, len, pos, s->layout.highest);
+
+    /* Trailing empty counters are left out */
+    end = s->layout.counts_len;
+    while (end > 0 && s->counts[end - 1] == 0) {
+        end--;
+    }
+
+    for (i = 0; i < end; i++) {
+        if (s->counts[i]) {
+            pos = put_varint(out, len, pos, s->counts[i]);
+            continue;
+        }
+
+        for (run = 1; s->counts[i + run] == 0; run++) {
+            /* The run ends before the last non-zero counter */
+        }
+        pos = put_varint(out, len, pos, 0);
+        pos = put_varint(out, len, pos, run);
+        i += run - 1;
+    }
+
+    return pos;
+}
+
+/* Fill in the counters of s from the rest of the encoding */
+static int decode_counts(struct histogram_snapshot *s,
+                         const unsigned char *in, size_t len, size_t pos)
+{
+    size_t i = 0;
+    uint64_t v;
+
+    while (pos < len) {
+        if (get_varint(in, len, &pos, &v)) {
+            return -1;
+        }
+        if (v == 0) {
+            if (get_varint(in, len, &pos, &v) || v == 0 ||
+                v > s->layout.counts_len - i) {
+                return -1;
+            }
+            i += (size_t)v;
+            continue;
+        }
+        if (i >= s->layout.counts_len) {
+            return -1;
+        }
+        s->counts[i++] = v;
+        s->total += v;
+    }
+    return 0;
+}
+
+int histogram_decode(struct histogram_snapshot *s, const void *buf,
+                     size_t len)
+{
+    const unsigned char *in = buf;
+    uint64_t half_bits, highest;
+    size_t pos = MAGIC_LEN;
+
+    s->counts = NULL;
+    if (len < MAGIC_LEN || memcmp(in, MAGIC, MAGIC_LEN) ||
+        get_varint(in, len, &pos, &half_bits) ||
+        get_varint(in, len, &pos, &highest) ||
+        half_bits < MIN_HALF_BITS || half_bits > MAX_HALF_BITS ||
+        highest < 2) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    layout_init(&s->layout, highest, (unsigned int)half_bits);
+    s->counts = calloc(s->layout.counts_len, sizeof(uint64_t));
+    if (s->counts == NULL) {
+        return -1;
+    }
+    s->total = 0;
+
+    if (decode_counts(s, in, len, pos)) {
+        histogram_snapshot_destroy(s);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,269 @@
+/**********************************************************************
+ * Latency histograms
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Log-linear histograms after Gil Tene's HdrHistogram. Values are
+ * counted in buckets whose width doubles every power of 2, each split
+ * into enough linear sub-buckets that any value is reported to within
+ * the requested number of significant decimal digits. Finding a
+ * value's bucket takes a count-leading-zeros and a couple of shifts, and
+ * the memory used depends only on the range and precision, not on the
+ * number of values recorded.
+ *
+ * Recording is spread over HISTOGRAM_SHARDS count arrays, each used by
+ * the threads assigned to it in turn as they first record, so threads
+ * do not contend for the same cache lines. Shards are allocated the
+ * first time they are used. Reading merges all shards into a snapshot,
+ * which answers percentile queries and can be serialized compactly.
+ *
+ * Values are unsigned integers in whatever unit the caller picks, for
+ * example nanoseconds. The smallest distinguishable value is 1, and
+ * values above the highest trackable value are counted as that value.
+ *
+ * Usage:
+ *      struct histogram h;
+ *      struct histogram_snapshot s;
+ *
+ *      histogram_init(&h, 3600000000ULL, 3);   (1us to 1 hour, 3 digits)
+ *      histogram_record(&h, elapsed_us);
+ *      ...
+ *      histogram_read(&h, &s);
+ *      p99 = histogram_percentile(&s, 99.0);
+ *      histogram_snapshot_destroy(&s);
+ *********************************************************************/
+
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cdecl.h"
+#include "compiler.h"
+
+__CDECL_BEGIN
+
+/* Number of count arrays that recording threads are spread over */
+#ifndef HISTOGRAM_SHARDS
+#define HISTOGRAM_SHARDS    16
+#endif
+
+struct histogram_layout {
+    uint64_t highest;           /* Highest trackable value */
+    unsigned int half_bits;     /* log2 of half the sub-buckets per bucket */
+    size_t counts_len;
+};
+
+struct histogram {
+    struct histogram_layout layout;
+    uint64_t *shards[HISTOGRAM_SHARDS];
+};
+
+struct histogram_snapshot {
+    struct histogram_layout layout;
+    uint64_t *counts;
+    uint64_t total;             /* Number of values recorded */
+};
+
+/*
+ * Initialize a histogram for values from 1 to highest, kept to sigfigs
+ * significant digits (1 to 5). Returns 0, or -1 with errno set to EINVAL
+ * if the parameters are out of range.
+ */
+int histogram_init(struct histogram *h, uint64_t highest, int sigfigs);
+
+/* Release all memory. No thread may be recording */
+void histogram_destroy(struct histogram *h);
+
+/* Zero all counts. Values recorded concurrently may or may not be kept */
+void histogram_reset(struct histogram *h);
+
+/* Index of the counter for value v */
+static __ALWAYS_INLINE size_t
+__histogram_index(const struct histogram_layout *l, uint64_t v)
+{
+    unsigned int half_bits = l->half_bits;
+    uint64_t mask = (2ULL << half_bits) - 1;
+    unsigned int bucket;
+
+    if (__UNLIKELY(v > l->highest)) {
+        v = l->highest;
+    }
+
+    /* Buckets above the first one drop one bit of precision each */
+    bucket = 63 - (unsigned int)__builtin_clzll(v | mask) - half_bits;
+    return ((size_t)bucket << half_bits) + (size_t)(v >> bucket);
+}
+
+/* Calling thread's shard, 1 based so that 0 means not yet assigned */
+extern __thread unsigned int __histogram_slot;
+
+unsigned int __histogram_slot_assign(void);
+uint64_t *__histogram_shard_alloc(struct histogram *h, unsigned int slot);
+
+/* Record n occurrences of value v. Drops them if out of memory */
+static inline void histogram_record_n(struct histogram *h, uint64_t v,
+                                      uint64_t n)
+{
+    unsigned int slot = __histogram_slot;
+    uint64_t *counts;
+
+    if (__UNLIKELY(slot == 0)) {
+        slot = __histogram_slot_assign();
+    }
+    counts = __atomic_load_n(&h->shards[slot - 1], __ATOMIC_ACQUIRE);
+    if (__UNLIKELY(counts == NULL)) {
+        counts = __histogram_shard_alloc(h, slot - 1);
+        if (counts == NULL) {
+            return;
+        }
+    }
+
+    /* Shards may be shared by threads, and are read concurrently */
+    __atomic_fetch_add(&counts[__histogram_index(&h->layout, v)], n,
+                       __ATOMIC_RELAXED);
+}
+
+static inline void histogram_record(struct histogram *h, uint64_t v)
+{
+    histogram_record_n(h, v, 1);
+}
+
+/*
+ * Merge the shards of h into s, which must not be initialized. Returns
+ * 0, or -1 with errno set if out of memory. Values recorded while this
+ * runs may or may not be included.
+ */
+int histogram_read(const struct histogram *h, struct histogram_snapshot *s);
+
+void histogram_snapshot_destroy(struct histogram_snapshot *s);
+
+/*
+ * Add the counts of src to dst. Both must have been created with the
+ * same parameters. Returns 0, or -1 with errno set to EINVAL.
+ */
+int histogram_snapshot_merge(struct histogram_snapshot *dst,
+                             const struct histogram_snapshot *src);
+
+/*
+ * Value at or below which the given percentage (0 to 100) of values
+ * fall, reported as the highest value equivalent to it at the
+ * histogram's precision. Returns 0 if the snapshot is empty.
+ */
+uint64_t histogram_percentile(const struct histogram_snapshot *s,
+                              double percentile);
+
+/* Smallest and largest values recorded, at the histogram's precision */
+uint64_t histogram_min(const struct histogram_snapshot *s);
+uint64_t histogram_max(const struct histogram_snapshot *s);
+double histogram_mean(const struct histogram_snapshot *s);
+
+/*
+ * Serialize s into buf, run length encoding empty counters and storing
+ * the rest as varints. Returns the size of the encoding; if this is
+ * more than len, nothing useful was written and the call should be
+ * repeated with a larger buffer.
+ */
+size_t histogram_encode(const struct histogram_snapshot *s, void *buf,
+                        size_t len);
+
+/*
+ * Initialize s from an encoding made by histogram_encode. Returns 0, or
+ * -1 with errno set to EINVAL if the data is malformed, or ENOMEM.
+ */
+int histogram_decode(struct histogram_snapshot *s, const void *buf,
+                     size_t len);
+
+__CDECL_END
+
+#ifdef __cplusplus
+#include <cerrno>
+#include <system_error>
+#include <vector>
+
+namespace lub {
+
+class histogram_snapshot {
+    struct ::histogram_snapshot s;
+
+    friend class histogram;
+    histogram_snapshot() { s.counts = nullptr; }
+
+public:
+    histogram_snapshot(const void *buf, size_t len)
+    {
+        if (histogram_decode(&s, buf, len)) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "histogram_decode");
+        }
+    }
+
+    ~histogram_snapshot() { histogram_snapshot_destroy(&s); }
+
+    histogram_snapshot(const histogram_snapshot &) = delete;
+    histogram_snapshot &operator=(const histogram_snapshot &) = delete;
+
+    histogram_snapshot(histogram_snapshot &&o) noexcept : s(o.s)
+    {
+        o.s.counts = nullptr;
+    }
+
+    uint64_t count() const { return s.total; }
+    uint64_t percentile(double p) const { return histogram_percentile(&s, p); }
+    uint64_t min() const { return histogram_min(&s); }
+    uint64_t max() const { return histogram_max(&s); }
+    double mean() const { return histogram_mean(&s); }
+
+    void merge(const histogram_snapshot &o)
+    {
+        if (histogram_snapshot_merge(&s, &o.s)) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "histogram_snapshot_merge");
+        }
+    }
+
+    std::vector<unsigned char> encode() const
+    {
+        std::vector<unsigned char> buf(histogram_encode(&s, nullptr, 0));
+
+        histogram_encode(&s, buf.data(), buf.size());
+        return buf;
+    }
+};
+
+class histogram {
+    struct ::histogram h;
+
+public:
+    histogram(uint64_t highest, int sigfigs)
+    {
+        if (histogram_init(&h, highest, sigfigs)) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "histogram_init");
+        }
+    }
+
+    ~histogram() { histogram_destroy(&h); }
+
+    histogram(const histogram &) = delete;
+    histogram &operator=(const histogram &) = delete;
+
+    void record(uint64_t v, uint64_t n = 1) { histogram_record_n(&h, v, n); }
+    void reset() { histogram_reset(&h); }
+
+    histogram_snapshot read() const
+    {
+        histogram_snapshot snap;
+
+        if (histogram_read(&h, &snap.s)) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "histogram_read");
+        }
+        return snap;
+    }
+};
+
+} /* namespace lub */
+#endif /* __cplusplus */
+
+#endif /* !defined __HISTOGRAM_H */
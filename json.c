@@ -0,0 +1,781 @@
+/**********************************************************************
+ * JSON tokenizer
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Stage 1 classifies each 64 byte block into bitmaps with bit i set for
+ * byte i. Quotes preceded by an odd number of backslashes are escaped;
+ * the rest toggle between inside and outside a string, which a prefix
+ * XOR of the quote bitmap turns into a mask of the string contents. Each
+ * of these carries a bit of state over to the next block.
+ *
+ * A byte is structural if it is an operator, the first byte of a
+ * number or literal, or a quote, provided it is not inside a string.
+ * Both quotes of a string are structural, so that stage 2 finds the end
+ * of a string at the next structural byte after its start.
+ *
+ * Stage 2 is a state machine driven by the structural bytes. Open
+ * containers are kept in a stack threaded through their tape entries:
+ * until a container is closed, its next field holds the index of the
+ * container around it.
+ *********************************************************************/
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include "compiler.h"
+#include "cpu_features.h"
+#include "json.h"
+#include "utf8.h"
+
+#if defined(__x86_64__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define BLOCK       64
+#define CHUNK       64          /* Blocks classified at a time */
+#define NONE        SIZE_MAX
+
+struct block {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;                /* { } [ ] : , */
+    uint64_t ws;                /* Space, tab, newline, carriage return */
+    uint64_t ctrl;              /* Below 0x20 */
+};
+
+/**********************************************************************
+ * Stage 1: classification
+ *********************************************************************/
+static void classify_scalar(const unsigned char *p, size_t n,
+                            struct block *b)
+{
+    uint64_t quote, backslash, op, ws, ctrl, bit;
+    size_t i;
+
+    for (; n > 0; n--, p += BLOCK, b++) {
+        quote = backslash = op = ws = ctrl = 0;
+        for (i = 0; i < BLOCK; i++) {
+            bit = 1ULL << i;
+            switch (p[i]) {
+            case '"':
+                quote |= bit;
+                break;
+            case '\\':
+                backslash |= bit;
+                break;
+            case '{': case '}': case '[': case ']': case ':': case ',':
+                op |= bit;
+                break;
+            case ' ': case '\t': case '\n': case '\r':
+                ws |= bit;
+                break;
+            }
+            if (p[i] < 0x20) {
+                ctrl |= bit;
+            }
+        }
+        b->quote = quote;
+        b->backslash = backslash;
+        b->op = op;
+        b->ws = ws;
+        b->ctrl = ctrl;
+    }
+}
+
+/* Combine the masks of the four 16 byte vectors of a block */
+#define JOIN16(i) \
+    ((uint64_t)m0[i] | (uint64_t)m1[i] << 16 | \
+     (uint64_t)m2[i] << 32 | (uint64_t)m3[i] << 48)
+
+#ifdef HAVE_X86
+/*
+ * OR-ing in 0x20 maps [ and ] onto { and }, and nothing else onto
+ * either; , and : have to be compared as they are. The masks are
+ * collected in m, indexed like the fields of struct block, so that they
+ * stay in registers until the block is stored.
+ */
+static inline void classify16_sse2(const unsigned char *p, uint32_t m[5])
+{
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    __m128i lc = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    __m128i op, ws;
+
+    op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(lc, _mm_set1_epi8('{')),
+                                   _mm_cmpeq_epi8(lc, _mm_set1_epi8('}'))),
+                      _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(',')),
+                                   _mm_cmpeq_epi8(x, _mm_set1_epi8(':'))));
+    ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+                                   _mm_cmpeq_epi8(x, _mm_set1_epi8('\t'))),
+                      _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')),
+                                   _mm_cmpeq_epi8(x, _mm_set1_epi8('\r'))));
+
+    m[0] = (uint32_t)_mm_movemask_epi8(
+                _mm_cmpeq_epi8(x, _mm_set1_epi8('"')));
+    m[1] = (uint32_t)_mm_movemask_epi8(
+                _mm_cmpeq_epi8(x, _mm_set1_epi8('\\')));
+    m[2] = (uint32_t)_mm_movemask_epi8(op);
+    m[3] = (uint32_t)_mm_movemask_epi8(ws);
+    m[4] = (uint32_t)_mm_movemask_epi8(
+                _mm_cmpeq_epi8(_mm_max_epu8(x, _mm_set1_epi8(0x1f)),
+                               _mm_set1_epi8(0x1f)));
+}
+
+static void classify_sse2(const unsigned char *p, size_t n, struct block *b)
+{
+    uint32_t m0[5], m1[5], m2[5], m3[5];
+
+    for (; n > 0; n--, p += BLOCK, b++) {
+        classify16_sse2(p, m0);
+        classify16_sse2(p + 16, m1);
+        classify16_sse2(p + 32, m2);
+        classify16_sse2(p + 48, m3);
+        b->quote = JOIN16(0);
+        b->backslash = JOIN16(1);
+        b->op = JOIN16(2);
+        b->ws = JOIN16(3);
+        b->ctrl = JOIN16(4);
+    }
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+static AVX2 inline void classify32_avx2(const unsigned char *p,
+                                        uint32_t m[5])
+{
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    __m256i lc = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    __m256i op, ws;
+
+    op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(lc, _mm256_set1_epi8('{')),
+                            _mm256_cmpeq_epi8(lc, _mm256_set1_epi8('}'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(',')),
+                            _mm256_cmpeq_epi8(x, _mm256_set1_epi8(':'))));
+    ws = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+                            _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')),
+                            _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\r'))));
+
+    m[0] = (uint32_t)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')));
+    m[1] = (uint32_t)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\')));
+    m[2] = (uint32_t)_mm256_movemask_epi8(op);
+    m[3] = (uint32_t)_mm256_movemask_epi8(ws);
+    m[4] = (uint32_t)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(_mm256_max_epu8(x, _mm256_set1_epi8(0x1f)),
+                                  _mm256_set1_epi8(0x1f)));
+}
+
+static AVX2 void classify_avx2(const unsigned char *p, size_t n,
+                               struct block *b)
+{
+    uint32_t lo[5], hi[5];
+
+#define JOIN32(i)   ((uint64_t)lo[i] | (uint64_t)hi[i] << 32)
+
+    for (; n > 0; n--, p += BLOCK, b++) {
+        classify32_avx2(p, lo);
+        classify32_avx2(p + 32, hi);
+        b->quote = JOIN32(0);
+        b->backslash = JOIN32(1);
+        b->op = JOIN32(2);
+        b->ws = JOIN32(3);
+        b->ctrl = JOIN32(4);
+    }
+}
+#endif /* HAVE_X86 */
+
+#ifdef HAVE_NEON
+/* Bitmask of a compare result, by weighting each lane and adding pairs */
+static inline uint32_t neon_movemask(uint8x16_t m)
+{
+    static const uint8_t weights[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+    };
+    uint8x16_t t = vandq_u8(m, vld1q_u8(weights));
+
+    t = vpaddq_u8(t, t);
+    t = vpaddq_u8(t, t);
+    t = vpaddq_u8(t, t);
+    return vgetq_lane_u16(vreinterpretq_u16_u8(t), 0);
+}
+
+static inline void classify16_neon(const unsigned char *p, uint32_t m[5])
+{
+    uint8x16_t x = vld1q_u8(p);
+    uint8x16_t lc = vorrq_u8(x, vdupq_n_u8(0x20));
+    uint8x16_t op, ws;
+
+    op = vorrq_u8(vorrq_u8(vceqq_u8(lc, vdupq_n_u8('{')),
+                           vceqq_u8(lc, vdupq_n_u8('}'))),
+                  vorrq_u8(vceqq_u8(x, vdupq_n_u8(',')),
+                           vceqq_u8(x, vdupq_n_u8(':'))));
+    ws = vorrq_u8(vorrq_u8(vceqq_u8(x, vdupq_n_u8(' ')),
+                           vceqq_u8(x, vdupq_n_u8('\t'))),
+                  vorrq_u8(vceqq_u8(x, vdupq_n_u8('\n')),
+                           vceqq_u8(x, vdupq_n_u8('\r'))));
+
+    m[0] = neon_movemask(vceqq_u8(x, vdupq_n_u8('"')));
+    m[1] = neon_movemask(vceqq_u8(x, vdupq_n_u8('\\')));
+    m[2] = neon_movemask(op);
+    m[3] = neon_movemask(ws);
+    m[4] = neon_movemask(vcltq_u8(x, vdupq_n_u8(0x20)));
+}
+
+static void classify_neon(const unsigned char *p, size_t n, struct block *b)
+{
+    uint32_t m0[5], m1[5], m2[5], m3[5];
+
+    for (; n > 0; n--, p += BLOCK, b++) {
+        classify16_neon(p, m0);
+        classify16_neon(p + 16, m1);
+        classify16_neon(p + 32, m2);
+        classify16_neon(p + 48, m3);
+        b->quote = JOIN16(0);
+        b->backslash = JOIN16(1);
+        b->op = JOIN16(2);
+        b->ws = JOIN16(3);
+        b->ctrl = JOIN16(4);
+    }
+}
+#endif /* HAVE_NEON */
+
+#if defined(HAVE_X86)
+#define VARIANTS(fn)                                \
+    __CPU_VARIANT(CPU_FEATURE_AVX2, fn##_avx2),     \
+    __CPU_VARIANT(CPU_FEATURE_SSE2, fn##_sse2),     \
+    __CPU_VARIANT(0, fn##_scalar)
+#elif defined(HAVE_NEON)
+#define VARIANTS(fn)                                \
+    __CPU_VARIANT(CPU_FEATURE_NEON, fn##_neon),     \
+    __CPU_VARIANT(0, fn##_scalar)
+#else
+#define VARIANTS(fn)                                \
+    __CPU_VARIANT(0, fn##_scalar)
+#endif
+
+__CPU_DISPATCH_STATIC_VOID(classify,
+                           (const unsigned char *p, size_t n, struct block *b),
+                           (p, n, b), VARIANTS(classify))
+
+/**********************************************************************
+ * Stage 1: strings and structural bytes
+ *********************************************************************/
+/*
+ * Bytes escaped by a backslash. A run of backslashes escapes the byte
+ * after it if it has odd length, which is when it starts and ends on
+ * bits of different parity. Adding the start of each run to the run
+ * carries out of its end, so the parity of the carry's position shows
+ * whether the run starting there had odd length.
+ */
+static inline uint64_t find_escaped(uint64_t backslash, uint64_t *carry)
+{
+    const uint64_t even = 0x5555555555555555ULL;
+    uint64_t follows, odd_starts, sum, invert;
+
+    backslash &= ~*carry;
+    follows = (backslash << 1) | *carry;
+    odd_starts = backslash & ~even & ~follows;
+    *carry = __builtin_add_overflow(odd_starts, backslash, &sum);
+    invert = sum << 1;
+    return (even ^ invert) & follows;
+}
+
+/* Bit i is the XOR of bits 0 to i */
+static inline uint64_t prefix_xor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/**********************************************************************
+ * Stage 2: tokens
+ *********************************************************************/
+enum state {
+    S_VALUE,                    /* At the start, or after , in an array or : */
+    S_VALUE_OR_CLOSE,           /* After [ */
+    S_KEY,                      /* After , in an object */
+    S_KEY_OR_CLOSE,             /* After { */
+    S_COLON,                    /* After a key */
+    S_COMMA_OR_CLOSE,           /* After a value in a container */
+    S_DONE,                     /* After the top level value */
+};
+
+struct tokenizer {
+    const unsigned char *s;
+    size_t len;
+    struct json_token *tape;
+    size_t cap;
+    size_t n;                   /* Tokens on the tape */
+    size_t parent;              /* Innermost open container */
+    size_t string;              /* Open string token, or NONE */
+    int string_is_key;
+    enum state state;
+
+    /* Carried from one block to the next */
+    uint64_t escaped;
+    uint64_t in_string;
+    uint64_t scalar;
+
+    size_t err_offset;
+    int err;
+};
+
+static __NOINLINE int fail(struct tokenizer *t, size_t offset, int err)
+{
+    t->err_offset = offset;
+    t->err = err;
+    return -1;
+}
+
+static inline int is_delimiter(unsigned char c)
+{
+    switch (c) {
+    case '{': case '}': case '[': case ']': case ':': case ',': case '"':
+    case ' ': case '\t': case '\n': case '\r':
+        return 1;
+    }
+    return 0;
+}
+
+static inline size_t digits(const unsigned char *p, size_t i, size_t avail)
+{
+    while (i < avail && p[i] >= '0' && p[i] <= '9') {
+        i++;
+    }
+    return i;
+}
+
+/* Length of the number at p, or 0 if it is malformed */
+static size_t number_len(const unsigned char *p, size_t avail)
+{
+    size_t i = 0, j;
+
+    if (p[i] == '-') {
+        i++;
+    }
+    if (i < avail && p[i] == '0') {
+        i++;
+    } else if (i < avail && p[i] >= '1' && p[i] <= '9') {
+        i = digits(p, i + 1, avail);
+    } else {
+        return 0;
+    }
+
+    if (i < avail && p[i] == '.') {
+        j = digits(p, i + 1, avail);
+        if (j == i + 1) {
+            return 0;
+        }
+        i = j;
+    }
+
+    if (i < avail && (p[i] == 'e' || p[i] == 'E')) {
+        i++;
+        if (i < avail && (p[i] == '+' || p[i] == '-')) {
+            i++;
+        }
+        j = digits(p, i, avail);
+        if (j == i) {
+            return 0;
+        }
+        i = j;
+    }
+    return i;
+}
+
+/* Length and type of the number or literal at p, or 0 if malformed */
+static size_t scalar_len(const unsigned char *p, size_t avail,
+                         uint32_t *type)
+{
+    size_t n;
+
+    switch (p[0]) {
+    case 't':
+        n = (avail >= 4 && memcmp(p, "true", 4) == 0) ? 4 : 0;
+        *type = JSON_TRUE;
+        break;
+    case 'f':
+        n = (avail >= 5 && memcmp(p, "false", 5) == 0) ? 5 : 0;
+        *type = JSON_FALSE;
+        break;
+    case 'n':
+        n = (avail >= 4 && memcmp(p, "null", 4) == 0) ? 4 : 0;
+        *type = JSON_NULL;
+        break;
+    default:
+        n = number_len(p, avail);
+        *type = JSON_NUMBER;
+        break;
+    }
+
+    if (n == 0 || (n < avail && !is_delimiter(p[n]))) {
+        return 0;
+    }
+    return n;
+}
+
+static enum state after_value(const struct tokenizer *t)
+{
+    return t->parent == NONE ? S_DONE : S_COMMA_OR_CLOSE;
+}
+
+/* Append a token, counting it as a member or element of its parent */
+static __ALWAYS_INLINE struct json_token *
+push(struct tokenizer *t, uint32_t type, size_t start, size_t len, int is_key)
+{
+    struct json_token *tok;
+
+    if (t->n == t->cap) {
+        return NULL;
+    }
+    if (t->parent != NONE &&
+        (is_key || t->tape[t->parent].type == JSON_ARRAY)) {
+        t->tape[t->parent].size++;
+    }
+
+    tok = &t->tape[t->n++];
+    tok->type = type;
+    tok->size = 0;
+    tok->start = start;
+    tok->len = len;
+    tok->next = t->n;
+    return tok;
+}
+
+static __ALWAYS_INLINE int
+open_container(struct tokenizer *t, size_t i, uint32_t type)
+{
+    struct json_token *tok;
+
+    if (t->state != S_VALUE && t->state != S_VALUE_OR_CLOSE) {
+        return fail(t, i, EINVAL);
+    }
+    tok = push(t, type, i, 0, 0);
+    if (tok == NULL) {
+        return fail(t, i, ENOBUFS);
+    }
+
+    tok->next = t->parent;
+    t->parent = t->n - 1;
+    t->state = (type == JSON_OBJECT) ? S_KEY_OR_CLOSE : S_VALUE_OR_CLOSE;
+    return 0;
+}
+
+static __ALWAYS_INLINE int
+close_container(struct tokenizer *t, size_t i, uint32_t type)
+{
+    enum state empty = (type == JSON_OBJECT) ? S_KEY_OR_CLOSE
+                                             : S_VALUE_OR_CLOSE;
+    struct json_token *tok;
+
+    if (t->parent == NONE || t->tape[t->parent].type != type ||
+        (t->state != S_COMMA_OR_CLOSE && t->state != empty)) {
+        return fail(t, i, EINVAL);
+    }
+
+    tok = &t->tape[t->parent];
+    tok->len = i + 1 - tok->start;
+    t->parent = tok->next;
+    tok->next = t->n;
+    t->state = after_value(t);
+    return 0;
+}
+
+static __ALWAYS_INLINE int open_string(struct tokenizer *t, size_t i)
+{
+    switch (t->state) {
+    case S_KEY:
+    case S_KEY_OR_CLOSE:
+        t->string_is_key = 1;
+        break;
+    case S_VALUE:
+    case S_VALUE_OR_CLOSE:
+        t->string_is_key = 0;
+        break;
+    default:
+        return fail(t, i, EINVAL);
+    }
+
+    if (push(t, JSON_STRING, i + 1, 0, t->string_is_key) == NULL) {
+        return fail(t, i, ENOBUFS);
+    }
+    t->string = t->n - 1;
+    return 0;
+}
+
+static __ALWAYS_INLINE int scalar(struct tokenizer *t, size_t i)
+{
+    uint32_t type;
+    size_t n;
+
+    if (t->state != S_VALUE && t->state != S_VALUE_OR_CLOSE) {
+        return fail(t, i, EINVAL);
+    }
+    n = scalar_len(t->s + i, t->len - i, &type);
+    if (n == 0) {
+        return fail(t, i, EINVAL);
+    }
+    if (push(t, type, i, n, 0) == NULL) {
+        return fail(t, i, ENOBUFS);
+    }
+    t->state = after_value(t);
+    return 0;
+}
+
+/* Handle the structural byte at offset i */
+static __ALWAYS_INLINE int step(struct tokenizer *t, size_t i)
+{
+    struct json_token *tok;
+
+    /* The next structural byte after an opening quote closes it */
+    if (t->string != NONE) {
+        tok = &t->tape[t->string];
+        tok->len = i - tok->start;
+        t->string = NONE;
+        t->state = t->string_is_key ? S_COLON : after_value(t);
+        return 0;
+    }
+
+    switch (t->s[i]) {
+    case '{':
+        return open_container(t, i, JSON_OBJECT);
+    case '[':
+        return open_container(t, i, JSON_ARRAY);
+    case '}':
+        return close_container(t, i, JSON_OBJECT);
+    case ']':
+        return close_container(t, i, JSON_ARRAY);
+    case '"':
+        return open_string(t, i);
+    case ',':
+        if (t->state != S_COMMA_OR_CLOSE) {
+            return fail(t, i, EINVAL);
+        }
+        t->state = (t->tape[t->parent].type == JSON_OBJECT) ? S_KEY : S_VALUE;
+        return 0;
+    case ':':
+        if (t->state != S_COLON) {
+            return fail(t, i, EINVAL);
+        }
+        t->state = S_VALUE;
+        return 0;
+    default:
+        return scalar(t, i);
+    }
+}
+
+/* Find the structural bytes of the block at offset base and step them */
+static int walk_block(struct tokenizer *t, const struct block *b, size_t base)
+{
+    uint64_t escaped, quote, in_string, tail, scalar, nonquote, follows;
+    uint64_t structural, bad;
+
+    escaped = find_escaped(b->backslash, &t->escaped);
+    quote = b->quote & ~escaped;
+
+    /* From the opening quote up to, but not including, the closing one */
+    in_string = prefix_xor(quote) ^ t->in_string;
+    t->in_string = (uint64_t)((int64_t)in_string >> 63);
+    tail = in_string ^ quote;
+
+    /* Start of each run of bytes that are not operators or whitespace */
+    scalar = ~(b->op | b->ws);
+    nonquote = scalar & ~quote;
+    follows = (nonquote << 1) | t->scalar;
+    t->scalar = nonquote >> 63;
+
+    bad = b->ctrl & in_string;
+    structural = ((b->op | (scalar & ~follows)) & ~tail) | quote;
+    if (__UNLIKELY(bad)) {
+        /* Only an error if the parse gets that far */
+        structural &= (bad & -bad) - 1;
+    }
+
+    while (structural) {
+        if (step(t, base + (size_t)__builtin_ctzll(structural))) {
+            return -1;
+        }
+        structural &= structural - 1;
+    }
+
+    if (__UNLIKELY(bad)) {
+        return fail(t, base + (size_t)__builtin_ctzll(bad), EINVAL);
+    }
+    return 0;
+}
+
+static int walk(struct tokenizer *t)
+{
+    struct block blocks[CHUNK];
+    unsigned char last[BLOCK];
+    size_t off = 0;
+    size_t n, k;
+
+    while (t->len - off >= BLOCK) {
+        n = (t->len - off) / BLOCK;
+        if (n > CHUNK) {
+            n = CHUNK;
+        }
+        classify(t->s + off, n, blocks);
+        for (k = 0; k < n; k++, off += BLOCK) {
+            if (walk_block(t, &blocks[k], off)) {
+                return -1;
+            }
+        }
+    }
+
+    /* Padding the last block with whitespace leaves its meaning alone */
+    if (off < t->len) {
+        memset(last, ' ', BLOCK);
+        memcpy(last, t->s + off, t->len - off);
+        classify(last, 1, blocks);
+        if (walk_block(t, &blocks[0], off)) {
+            return -1;
+        }
+    }
+
+    if (t->string != NONE || t->state != S_DONE) {
+        return fail(t, t->len, EINVAL);
+    }
+    return 0;
+}
+
+ssize_t json_tokenize(const char *s, size_t len, struct json_token *tape,
+                      size_t cap, size_t *err_offset)
+{
+    struct tokenizer t;
+
+    memset(&t, 0, sizeof(t));
+    t.s = (const unsigned char *)s;
+    t.len = len;
+    t.tape = tape;
+    t.cap = cap;
+    t.parent = NONE;
+    t.string = NONE;
+    t.state = S_VALUE;
+
+    if (walk(&t)) {
+        if (err_offset) {
+            *err_offset = t.err_offset;
+        }
+        errno = t.err;
+        return -1;
+    }
+    return (ssize_t)t.n;
+}
+
+/**********************************************************************
+ * Strings
+ *********************************************************************/
+/* Parse the 4 hex digits of a \u escape, returning -1 if malformed */
+static int hex4(const unsigned char *p, const unsigned char *end,
+                uint32_t *v)
+{
+    uint32_t r = 0;
+    unsigned char c;
+    int i;
+
+    if (end - p < 4) {
+        return -1;
+    }
+    for (i = 0; i < 4; i++) {
+        c = p[i];
+        if (c >= '0' && c <= '9') {
+            r = (r << 4) | (uint32_t)(c - '0');
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            r = (r << 4) | (uint32_t)((c | 0x20) - 'a' + 10);
+        } else {
+            return -1;
+        }
+    }
+    *v = r;
+    return 0;
+}
+
+/* Decode the escape after a backslash at p, returning the bytes used */
+static size_t unescape_one(const unsigned char *p, const unsigned char *end,
+                           unsigned char **out)
+{
+    static const char plain[] = "\"\"\\\\//b\bf\fn\nr\rt\t";
+    uint32_t cp, lo;
+    const char *e;
+    ssize_t n;
+
+    if (p == end) {
+        return 0;
+    }
+    if (*p != 'u') {
+        for (e = plain; *e; e += 2) {
+            if (*p == (unsigned char)e[0]) {
+                *(*out)++ = (unsigned char)e[1];
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    if (hex4(p + 1, end, &cp)) {
+        return 0;
+    }
+    if (cp >= 0xd800 && cp <= 0xdbff) {
+        /* A high surrogate must be followed by an escaped low one */
+        if (end - p < 11 || p[5] != '\\' || p[6] != 'u' ||
+            hex4(p + 7, end, &lo) || lo < 0xdc00 || lo > 0xdfff) {
+            return 0;
+        }
+        cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+        n = utf32_to_utf8(&cp, 1, (char *)*out);
+        *out += n;
+        return 11;
+    }
+
+    /* Fails on a lone low surrogate */
+    n = utf32_to_utf8(&cp, 1, (char *)*out);
+    if (n < 0) {
+        return 0;
+    }
+    *out += n;
+    return 5;
+}
+
+ssize_t json_unescape(const char *s, const struct json_token *t, char *out)
+{
+    const unsigned char *p = (const unsigned char *)s + t->start;
+    const unsigned char *end = p + t->len;
+    unsigned char *o = (unsigned char *)out;
+    const unsigned char *bs;
+    size_t n;
+
+    while (p < end) {
+        bs = memchr(p, '\\', (size_t)(end - p));
+        if (bs == NULL) {
+            bs = end;
+        }
+        memcpy(o, p, (size_t)(bs - p));
+        o += bs - p;
+        if (bs == end) {
+            break;
+        }
+
+        n = unescape_one(bs + 1, end, &o);
+        if (n == 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        p = bs + 1 + n;
+    }
+    return o - (unsigned char *)out;
+}
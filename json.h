@@ -0,0 +1,90 @@
+/**********************************************************************
+ * JSON tokenizer
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Splits a JSON document into a flat array of tokens, the tape, in the
+ * order they appear. The caller provides the tape, and nothing is
+ * allocated. The whole document is checked against the JSON grammar,
+ * apart from the escapes in strings, which are left for json_unescape
+ * to decode. Numbers are not converted either: tokens point back into
+ * the input, which must be kept around while they are used, and
+ * numconv.h can parse a number token.
+ *
+ * The input is processed in two stages, after simdjson (G. Langdale and
+ * D. Lemire, "Parsing Gigabytes of JSON per Second", 2019). The first
+ * uses SIMD compares to build bitmaps of the quotes, operators and
+ * whitespace in each 64 byte block, and from them works out which
+ * characters are inside strings and which start a token. The second
+ * walks the set bits of those bitmaps, so it only looks at the bytes
+ * where something happens. Both stages run over a few KiB at a time.
+ *
+ * Containers record the tape index just past their last descendant, so
+ * a value can be skipped without looking at its contents. Object
+ * members appear as a string token for the key followed by the value.
+ *
+ * The input is not checked to be valid UTF-8; see utf8_validate.
+ *
+ * Usage:
+ *      struct json_token tape[256];
+ *      size_t err;
+ *
+ *      n = json_tokenize(buf, len, tape, 256, &err);
+ *      for (i = 1; i < tape[0].next; i = tape[i + 1].next) {
+ *          (tape[i] is a key of the top level object, tape[i + 1] its value)
+ *      }
+ *********************************************************************/
+
+#ifndef __JSON_H
+#define __JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+enum json_type {
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_NULL,
+};
+
+struct json_token {
+    uint32_t type;      /* enum json_type */
+    uint32_t size;      /* Members of an object, elements of an array */
+    size_t start;       /* Offset in the input; after the quote of a string */
+    size_t len;         /* Including brackets; excluding quotes */
+    size_t next;        /* Tape index after this value and its contents */
+};
+
+/* Tokens that a document of len bytes can need at most */
+#define JSON_MAX_TOKENS(len)    (((len) + 1) / 2)
+
+/*
+ * Tokenize the document s[0..len), which must be a single value with
+ * optional whitespace around it. Returns the number of tokens written
+ * to tape, or -1 with errno set to EINVAL if the document is malformed,
+ * or to ENOBUFS if it needs more than cap tokens. On failure, the offset
+ * of the byte where the problem was found is stored in *err_offset
+ * unless it is NULL.
+ */
+ssize_t json_tokenize(const char *s, size_t len, struct json_token *tape,
+                      size_t cap, size_t *err_offset);
+
+/*
+ * Decode the escapes in the contents of a string token, writing UTF-8
+ * to out, which needs room for t->len bytes. Returns the length of the
+ * result, or -1 with errno set to EINVAL if an escape is malformed or a
+ * string contains an unpaired surrogate.
+ */
+ssize_t json_unescape(const char *s, const struct json_token *t, char *out);
+
+__CDECL_END
+
+#endif /* !defined __JSON_H */
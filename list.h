@@ -0,0 +1,205 @@
+/**********************************************************************
+ * Intrusive doubly linked list
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * A circular doubly linked list in the style of the Linux kernel's
+ * list.h. A struct list_head is embedded in each element, so putting an
+ * element on a list needs no allocation, and going from the link to the
+ * element is a subtraction rather than another pointer to follow. An
+ * element can be on as many lists at once as it has links.
+ *
+ * The head of a list is a struct list_head of its own, pointing at
+ * itself when the list is empty, so that insertion and removal never
+ * have a special case for the ends.
+ *
+ * The iteration macros use __typeof__, which GCC and Clang accept in C
+ * and C++ alike.
+ *
+ * Usage:
+ *      struct conn {
+ *          struct list_head link;
+ *          ...
+ *      };
+ *
+ *      LIST_HEAD(conns);
+ *      list_add_tail(&conn->link, &conns);
+ *      list_for_each_entry(c, &conns, link) {
+ *          ...
+ *      }
+ *      list_del(&conn->link);
+ *********************************************************************/
+
+#ifndef __LIST_H
+#define __LIST_H
+
+#include <stddef.h>
+#include "cdecl.h"
+#include "compiler.h"
+
+__CDECL_BEGIN
+
+struct list_head {
+    struct list_head *next;
+    struct list_head *prev;
+};
+
+#define LIST_HEAD_INIT(name)    { &(name), &(name) }
+#define LIST_HEAD(name)         struct list_head name = LIST_HEAD_INIT(name)
+
+/* The element containing the link ptr */
+#define list_entry(ptr, type, member)   __CONTAINER_OF(ptr, type, member)
+
+/* The first and last elements of a list, which must not be empty */
+#define list_first_entry(head, type, member)                            \
+    list_entry((head)->next, type, member)
+#define list_last_entry(head, type, member)                             \
+    list_entry((head)->prev, type, member)
+
+static inline void list_init(struct list_head *head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static inline int list_empty(const struct list_head *head)
+{
+    return head->next == head;
+}
+
+/* Whether the list holds exactly one element */
+static inline int list_is_singular(const struct list_head *head)
+{
+    return head->next != head && head->next == head->prev;
+}
+
+static inline void __list_add(struct list_head *entry,
+                              struct list_head *prev, struct list_head *next)
+{
+    next->prev = entry;
+    entry->next = next;
+    entry->prev = prev;
+    prev->next = entry;
+}
+
+/* Insert entry after head, as at the front of a stack */
+static inline void list_add(struct list_head *entry, struct list_head *head)
+{
+    __list_add(entry, head, head->next);
+}
+
+/* Insert entry before head, as at the back of a queue */
+static inline void list_add_tail(struct list_head *entry,
+                                 struct list_head *head)
+{
+    __list_add(entry, head->prev, head);
+}
+
+/*
+ * Take entry off its list. Its links are left pointing at its old
+ * neighbours; use list_del_init to be able to test it with list_empty.
+ */
+static inline void list_del(struct list_head *entry)
+{
+    entry->next->prev = entry->prev;
+    entry->prev->next = entry->next;
+}
+
+static inline void list_del_init(struct list_head *entry)
+{
+    list_del(entry);
+    list_init(entry);
+}
+
+/* Put entry in the place of old, which is left as it was */
+static inline void list_replace(struct list_head *old, struct list_head *entry)
+{
+    entry->next = old->next;
+    entry->next->prev = entry;
+    entry->prev = old->prev;
+    entry->prev->next = entry;
+}
+
+/* Move entry from its list to the front, or the back, of head */
+static inline void list_move(struct list_head *entry, struct list_head *head)
+{
+    list_del(entry);
+    list_add(entry, head);
+}
+
+static inline void list_move_tail(struct list_head *entry,
+                                  struct list_head *head)
+{
+    list_del(entry);
+    list_add_tail(entry, head);
+}
+
+static inline void __list_splice(const struct list_head *list,
+                                 struct list_head *prev,
+                                 struct list_head *next)
+{
+    struct list_head *first = list->next;
+    struct list_head *last = list->prev;
+
+    first->prev = prev;
+    prev->next = first;
+    last->next = next;
+    next->prev = last;
+}
+
+/*
+ * Join the elements of list onto the front, or the back, of head, and
+ * leave list empty.
+ */
+static inline void list_splice_init(struct list_head *list,
+                                    struct list_head *head)
+{
+    if (!list_empty(list)) {
+        __list_splice(list, head, head->next);
+        list_init(list);
+    }
+}
+
+static inline void list_splice_tail_init(struct list_head *list,
+                                         struct list_head *head)
+{
+    if (!list_empty(list)) {
+        __list_splice(list, head->prev, head);
+        list_init(list);
+    }
+}
+
+/* Iterate over the links of a list */
+#define list_for_each(pos, head)                                        \
+    for ((pos) = (head)->next; (pos) != (head); (pos) = (pos)->next)
+
+/* Iterate over the links, allowing pos to be removed */
+#define list_for_each_safe(pos, n, head)                                \
+    for ((pos) = (head)->next, (n) = (pos)->next; (pos) != (head);      \
+         (pos) = (n), (n) = (pos)->next)
+
+/* Iterate over the elements of a list, front to back or back to front */
+#define list_for_each_entry(pos, head, member)                          \
+    for ((pos) = list_entry((head)->next, __typeof__(*(pos)), member);  \
+         &(pos)->member != (head);                                      \
+         (pos) = list_entry((pos)->member.next, __typeof__(*(pos)),     \
+                            member))
+
+#define list_for_each_entry_reverse(pos, head, member)                  \
+    for ((pos) = list_entry((head)->prev, __typeof__(*(pos)), member);  \
+         &(pos)->member != (head);                                      \
+         (pos) = list_entry((pos)->member.prev, __typeof__(*(pos)),     \
+                            member))
+
+/* Iterate over the elements, allowing pos to be removed */
+#define list_for_each_entry_safe(pos, n, head, member)                  \
+    for ((pos) = list_entry((head)->next, __typeof__(*(pos)), member),  \
+         (n) = list_entry((pos)->member.next, __typeof__(*(pos)),       \
+                          member);                                      \
+         &(pos)->member != (head);                                      \
+         (pos) = (n),                                                   \
+         (n) = list_entry((n)->member.next, __typeof__(*(n)), member))
+
+__CDECL_END
+
+#endif /* !defined __LIST_H */
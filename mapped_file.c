@@ -0,0 +1,142 @@
+/**********************************************************************
+ * Read only memory mapped file
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mapped_file.h"
+
+static int advise(void *addr, size_t len, unsigned int flags)
+{
+    int rc = 0;
+
+    if (flags & MAPPED_FILE_SEQUENTIAL) {
+        rc |= madvise(addr, len, MADV_SEQUENTIAL);
+    }
+    if (flags & MAPPED_FILE_RANDOM) {
+        rc |= madvise(addr, len, MADV_RANDOM);
+    }
+    if (flags & MAPPED_FILE_HUGEPAGE) {
+#ifdef MADV_HUGEPAGE
+        rc |= madvise(addr, len, MADV_HUGEPAGE);
+#else
+        errno = EINVAL;
+        rc = -1;
+#endif
+    }
+    if (flags & MAPPED_FILE_WILLNEED) {
+        rc |= madvise(addr, len, MADV_WILLNEED);
+    }
+    if (flags & MAPPED_FILE_DONTNEED) {
+        rc |= madvise(addr, len, MADV_DONTNEED);
+    }
+
+    return rc ? -1 : 0;
+}
+
+int mapped_file_map_fd(struct mapped_file *mf, int fd, unsigned int flags)
+{
+    struct stat st;
+    int mflags = MAP_PRIVATE;
+    void *addr;
+
+    mf->data = NULL;
+    mf->size = 0;
+
+    if (fstat(fd, &st)) {
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        errno = S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+        return -1;
+    }
+    if ((uint64_t)st.st_size > SIZE_MAX) {
+        errno = EFBIG;
+        return -1;
+    }
+    if (st.st_size == 0) {
+        return 0;
+    }
+
+#ifdef MAP_POPULATE
+    if (flags & MAPPED_FILE_POPULATE) {
+        mflags |= MAP_POPULATE;
+    }
+#endif
+
+    addr = mmap(NULL, (size_t)st.st_size, PROT_READ, mflags, fd, 0);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
+
+    /* Advice is only a hint, don't fail the open because of it */
+    advise(addr, (size_t)st.st_size, flags);
+
+    mf->data = addr;
+    mf->size = (size_t)st.st_size;
+    return 0;
+}
+
+int mapped_file_open(struct mapped_file *mf, const char *path,
+                     unsigned int flags)
+{
+    int fd;
+    int rc;
+    int err;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        mf->data = NULL;
+        mf->size = 0;
+        return -1;
+    }
+
+    /* The mapping stays valid after the descriptor is closed */
+    rc = mapped_file_map_fd(mf, fd, flags);
+    err = errno;
+    close(fd);
+    errno = err;
+    return rc;
+}
+
+void mapped_file_close(struct mapped_file *mf)
+{
+    if (mf->data) {
+        munmap((void *)mf->data, mf->size);
+    }
+    mf->data = NULL;
+    mf->size = 0;
+}
+
+int mapped_file_advise(const struct mapped_file *mf, size_t offset,
+                       size_t len, unsigned int flags)
+{
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start, end;
+
+    if (offset > mf->size) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (len > mf->size - offset) {
+        len = mf->size - offset;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    start = (uintptr_t)mf->data + offset;
+    end = start + len;
+    start &= ~(page - 1);
+    end = (end + page - 1) & ~(page - 1);
+
+    return advise((void *)start, end - start, flags);
+}
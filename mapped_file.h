@@ -0,0 +1,117 @@
+/**********************************************************************
+ * Read only memory mapped file
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Maps a whole file read only, and exposes it as a pointer and length,
+ * avoiding the copy (and the heap buffer) of reading it in. The caller
+ * chooses how the kernel should treat the mapping by passing a set of
+ * MAPPED_FILE_* flags, which are applied with madvise(2). Advice is only
+ * a hint, so flags that the kernel does not support for the file (such
+ * as huge pages on most filesystems) are silently ignored by
+ * mapped_file_open. mapped_file_advise reports such failures.
+ *
+ * Usage:
+ *      struct mapped_file mf;
+ *      if (mapped_file_open(&mf, path, MAPPED_FILE_SEQUENTIAL) == 0) {
+ *          scan(mf.data, mf.size);
+ *          mapped_file_close(&mf);
+ *      }
+ *********************************************************************/
+
+#ifndef __MAPPED_FILE_H
+#define __MAPPED_FILE_H
+
+#include <stddef.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+/* Access pattern and prefetch flags */
+#define MAPPED_FILE_NORMAL      0x00    /* No advice */
+#define MAPPED_FILE_SEQUENTIAL  0x01    /* Aggressive readahead */
+#define MAPPED_FILE_RANDOM      0x02    /* No readahead */
+#define MAPPED_FILE_WILLNEED    0x04    /* Start reading in the range now */
+#define MAPPED_FILE_HUGEPAGE    0x08    /* Back with huge pages if possible */
+#define MAPPED_FILE_DONTNEED    0x10    /* Range will not be needed again */
+#define MAPPED_FILE_POPULATE    0x20    /* Fault in the whole file at open */
+
+struct mapped_file {
+    const char *data;           /* NULL for an empty file */
+    size_t size;
+};
+
+/*
+ * Map the file at path. flags is a combination of MAPPED_FILE_* flags.
+ * Returns 0 on success, or -1 with errno set on failure.
+ */
+int mapped_file_open(struct mapped_file *mf, const char *path,
+                     unsigned int flags);
+
+/* Same as mapped_file_open, for an already open file descriptor */
+int mapped_file_map_fd(struct mapped_file *mf, int fd, unsigned int flags);
+
+/* Unmap the file */
+void mapped_file_close(struct mapped_file *mf);
+
+/*
+ * Apply MAPPED_FILE_* advice to the byte range [offset, offset + len),
+ * which is widened to page boundaries. Returns 0 on success, or -1 with
+ * errno set on failure.
+ */
+int mapped_file_advise(const struct mapped_file *mf, size_t offset,
+                       size_t len, unsigned int flags);
+
+/* Ask the kernel to start reading in a range that will be needed soon */
+static inline int mapped_file_prefetch(const struct mapped_file *mf,
+                                       size_t offset, size_t len)
+{
+    return mapped_file_advise(mf, offset, len, MAPPED_FILE_WILLNEED);
+}
+
+__CDECL_END
+
+#ifdef __cplusplus
+#include <cerrno>
+#include <system_error>
+
+namespace lub {
+
+/* RAII wrapper for struct mapped_file, usable as a range of chars */
+class mapped_file {
+    struct ::mapped_file mf;
+
+public:
+    explicit mapped_file(const char *path,
+                         unsigned int flags = MAPPED_FILE_NORMAL)
+    {
+        if (mapped_file_open(&mf, path, flags)) {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+    }
+
+    ~mapped_file() { mapped_file_close(&mf); }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    const char *data() const { return mf.data; }
+    size_t size() const { return mf.size; }
+    bool empty() const { return mf.size == 0; }
+    const char *begin() const { return mf.data; }
+    const char *end() const { return mf.data + mf.size; }
+    char operator[](size_t i) const { return mf.data[i]; }
+
+    void advise(size_t offset, size_t len, unsigned int flags) const
+    {
+        if (mapped_file_advise(&mf, offset, len, flags)) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "madvise");
+        }
+    }
+};
+
+} /* namespace lub */
+#endif /* __cplusplus */
+
+#endif /* !defined __MAPPED_FILE_H */
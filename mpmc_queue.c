@@ -0,0 +1,176 @@
+/**********************************************************************
+ * Bounded multi producer, multi consumer queue
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Setup and the blocking paths. A thread that finds the queue empty (or
+ * full) spins for a while, then registers itself as a waiter, samples
+ * the futex word, retries once more, and only then sleeps. The other
+ * side bumps the futex word and wakes a sleeper whenever it sees a
+ * registered waiter after changing the queue.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdlib.h>
+#include "mpmc_queue.h"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* Number of failed attempts before going to sleep */
+#define SPIN_COUNT      128
+
+static void futex_wait(uint32_t *futex, uint32_t val)
+{
+#ifdef __linux__
+    syscall(SYS_futex, futex, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#else
+    (void)futex;
+    (void)val;
+    sched_yield();
+#endif
+}
+
+static void futex_wake(uint32_t *futex, int count)
+{
+#ifdef __linux__
+    syscall(SYS_futex, futex, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+#else
+    (void)futex;
+    (void)count;
+#endif
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+int mpmc_queue_init(struct mpmc_queue *q, size_t count, size_t elem_size)
+{
+    size_t cap = 2;
+    size_t i;
+
+    if (count > ((size_t)-1 >> 2) || elem_size == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    while (cap < count) {
+        cap <<= 1;
+    }
+
+    memset(q, 0, sizeof(*q));
+    q->elem_size = elem_size;
+    q->cell_size = (sizeof(size_t) + elem_size + sizeof(size_t) - 1) &
+                   ~(sizeof(size_t) - 1);
+    if (cap > (size_t)-1 / q->cell_size) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    q->cells = malloc(cap * q->cell_size);
+    if (q->cells == NULL) {
+        return -1;
+    }
+    q->mask = cap - 1;
+
+    for (i = 0; i < cap; i++) {
+        *__mpmc_queue_seq(q, i) = i;
+    }
+    return 0;
+}
+
+void mpmc_queue_destroy(struct mpmc_queue *q)
+{
+    free(q->cells);
+    q->cells = NULL;
+}
+
+void __mpmc_queue_wake(uint32_t *futex)
+{
+    __atomic_fetch_add(futex, 1, __ATOMIC_RELEASE);
+    futex_wake(futex, 1);
+}
+
+void mpmc_queue_close(struct mpmc_queue *q)
+{
+    __atomic_store_n(&q->closed, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&q->not_empty, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&q->not_full, 1, __ATOMIC_RELEASE);
+    futex_wake(&q->not_empty, INT_MAX);
+    futex_wake(&q->not_full, INT_MAX);
+}
+
+typedef int (*try_fn)(struct mpmc_queue *q, void *obj);
+
+static int wait_for(struct mpmc_queue *q, try_fn fn, void *obj,
+                    uint32_t *waiting, uint32_t *futex)
+{
+    unsigned int spin;
+    uint32_t val;
+
+    for (;;) {
+        for (spin = 0; spin < SPIN_COUNT; spin++) {
+            if (fn(q, obj)) {
+                return 1;
+            }
+            if (__atomic_load_n(&q->closed, __ATOMIC_ACQUIRE)) {
+                /* Let consumers drain what is left */
+                return fn(q, obj);
+            }
+            cpu_relax();
+        }
+
+        __atomic_fetch_add(waiting, 1, __ATOMIC_SEQ_CST);
+        val = __atomic_load_n(futex, __ATOMIC_ACQUIRE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        if (fn(q, obj)) {
+            __atomic_fetch_sub(waiting, 1, __ATOMIC_RELAXED);
+            return 1;
+        }
+        if (!__atomic_load_n(&q->closed, __ATOMIC_ACQUIRE)) {
+            futex_wait(futex, val);
+        }
+        __atomic_fetch_sub(waiting, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static int try_enqueue(struct mpmc_queue *q, void *obj)
+{
+    if (__atomic_load_n(&q->closed, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    return mpmc_queue_try_enqueue(q, obj);
+}
+
+static int try_dequeue(struct mpmc_queue *q, void *obj)
+{
+    return mpmc_queue_try_dequeue(q, obj);
+}
+
+int mpmc_queue_enqueue_wait(struct mpmc_queue *q, const void *obj)
+{
+    if (__atomic_load_n(&q->closed, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    return wait_for(q, try_enqueue, (void *)obj, &q->producers_waiting,
+                    &q->not_full);
+}
+
+int mpmc_queue_dequeue_wait(struct mpmc_queue *q, void *obj)
+{
+    return wait_for(q, try_dequeue, obj, &q->consumers_waiting,
+                    &q->not_empty);
+}
@@ -0,0 +1,159 @@
+/**********************************************************************
+ * Bounded multi producer, multi consumer queue
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Dmitry Vyukov's bounded MPMC queue. Every cell carries a sequence
+ * number which tells a producer whether the cell is free for position
+ * pos (seq == pos), and a consumer whether it has been filled
+ * (seq == pos + 1). Producers and consumers claim positions with a CAS
+ * on their own index, each on its own cache line, and never take a lock.
+ *
+ * The try functions never block. The wait functions spin briefly, then
+ * sleep on a futex until the queue changes state, so idle consumers do
+ * not burn CPU. A queue that is used with the wait functions should be
+ * closed with mpmc_queue_close to release any sleeping threads.
+ *
+ * Usage:
+ *      struct mpmc_queue q;
+ *      mpmc_queue_init(&q, 4096, sizeof(struct work *));
+ *      Producers:  mpmc_queue_enqueue_wait(&q, &w);
+ *      Consumers:  while (mpmc_queue_dequeue_wait(&q, &w)) { ... }
+ *      Shutdown:   mpmc_queue_close(&q);
+ *********************************************************************/
+
+#ifndef __MPMC_QUEUE_H
+#define __MPMC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "cdecl.h"
+#include "compiler.h"
+
+__CDECL_BEGIN
+
+struct mpmc_queue {
+    /* Read only after init */
+    char *cells;                /* Sequence number, then element */
+    size_t mask;
+    size_t elem_size;
+    size_t cell_size;
+
+    size_t enqueue_pos __CACHELINE_ALIGNED;
+    size_t dequeue_pos __CACHELINE_ALIGNED;
+
+    /* Futex words, bumped whenever a sleeper may need waking */
+    uint32_t not_empty __CACHELINE_ALIGNED;
+    uint32_t not_full;
+    uint32_t consumers_waiting;
+    uint32_t producers_waiting;
+    uint32_t closed;
+};
+
+/*
+ * Initialize a queue holding at least count elements of elem_size bytes.
+ * count is rounded up to a power of 2, and must be at least 2. Returns 0
+ * on success, or -1 with errno set on failure.
+ */
+int mpmc_queue_init(struct mpmc_queue *q, size_t count, size_t elem_size);
+
+void mpmc_queue_destroy(struct mpmc_queue *q);
+
+/*
+ * Close the queue. Further enqueues fail, and waiting consumers return
+ * 0 once the remaining elements have been drained.
+ */
+void mpmc_queue_close(struct mpmc_queue *q);
+
+/*
+ * Blocking variants. Return 1 once the element has been moved, or 0 if
+ * the queue has been closed (and, for dequeue, is empty).
+ */
+int mpmc_queue_enqueue_wait(struct mpmc_queue *q, const void *obj);
+int mpmc_queue_dequeue_wait(struct mpmc_queue *q, void *obj);
+
+/* Wake up sleepers after a state change. Internal to the inline paths */
+void __mpmc_queue_wake(uint32_t *futex);
+
+static inline size_t *__mpmc_queue_seq(const struct mpmc_queue *q,
+                                       size_t pos)
+{
+    return (size_t *)(q->cells + (pos & q->mask) * q->cell_size);
+}
+
+/*
+ * The full fence orders the sequence number store above against the
+ * load of the waiter count, pairing with the fence in the wait path.
+ * Without it, a sleeper could miss the element we just published.
+ */
+static inline void __mpmc_queue_notify(uint32_t *waiting, uint32_t *futex)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__UNLIKELY(__atomic_load_n(waiting, __ATOMIC_RELAXED))) {
+        __mpmc_queue_wake(futex);
+    }
+}
+
+/* Returns 1 if the element was enqueued, 0 if the queue is full */
+static inline int mpmc_queue_try_enqueue(struct mpmc_queue *q,
+                                         const void *obj)
+{
+    size_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+    size_t *seq;
+    intptr_t dif;
+
+    for (;;) {
+        seq = __mpmc_queue_seq(q, pos);
+        dif = (intptr_t)(__atomic_load_n(seq, __ATOMIC_ACQUIRE) - pos);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1,
+                                            1, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    memcpy(seq + 1, obj, q->elem_size);
+    __atomic_store_n(seq, pos + 1, __ATOMIC_RELEASE);
+    __mpmc_queue_notify(&q->consumers_waiting, &q->not_empty);
+    return 1;
+}
+
+/* Returns 1 if an element was dequeued, 0 if the queue is empty */
+static inline int mpmc_queue_try_dequeue(struct mpmc_queue *q, void *obj)
+{
+    size_t pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+    size_t *seq;
+    intptr_t dif;
+
+    for (;;) {
+        seq = __mpmc_queue_seq(q, pos);
+        dif = (intptr_t)(__atomic_load_n(seq, __ATOMIC_ACQUIRE) - (pos + 1));
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->dequeue_pos, &pos, pos + 1,
+                                            1, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    memcpy(obj, seq + 1, q->elem_size);
+    __atomic_store_n(seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    __mpmc_queue_notify(&q->producers_waiting, &q->not_full);
+    return 1;
+}
+
+__CDECL_END
+
+#endif /* !defined __MPMC_QUEUE_H */
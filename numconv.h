@@ -0,0 +1,77 @@
+/**********************************************************************
+ * Number parsing and formatting
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Conversions between numbers and their decimal text, for protocol
+ * handlers that would otherwise spend their time in strtod and
+ * snprintf. Nothing here depends on the locale, input is given as a
+ * pointer and a length and need not be NUL terminated, and output is
+ * written without a terminating NUL.
+ *
+ * Integers are parsed eight digits at a time with SWAR arithmetic.
+ * Doubles are parsed with the Eisel-Lemire algorithm (D. Lemire,
+ * "Number Parsing at a Gigabyte per Second", 2021), which is exact for
+ * up to 19 significant digits; the rare longer inputs that it cannot
+ * round on its own fall back to strtod_l in the C locale. Doubles are
+ * formatted with Ryu (U. Adams, "Ryu: Fast Float-to-String Conversion",
+ * PLDI 2018), which gives the shortest digits that parse back to the
+ * same value.
+ *
+ * The parse functions return the number of bytes consumed, which may be
+ * less than len if the number is followed by something else. They
+ * return 0 with errno set to EINVAL if s does not start with a number,
+ * or to ERANGE if an integer does not fit. No leading whitespace is
+ * skipped, and there is no support for other bases.
+ *
+ * Usage:
+ *      uint64_t id;
+ *      char buf[NUMCONV_DOUBLE_LEN];
+ *
+ *      n = numconv_parse_u64(field, field_len, &id);
+ *      len = numconv_format_double(value, buf);
+ *********************************************************************/
+
+#ifndef __NUMCONV_H
+#define __NUMCONV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+/* Largest output of the format functions */
+#define NUMCONV_U64_LEN     20
+#define NUMCONV_I64_LEN     20
+#define NUMCONV_DOUBLE_LEN  25
+
+/* Parse decimal digits, with no sign */
+size_t numconv_parse_u64(const char *s, size_t len, uint64_t *v);
+
+/* Parse decimal digits with an optional leading + or - */
+size_t numconv_parse_i64(const char *s, size_t len, int64_t *v);
+
+/*
+ * Parse a decimal floating point number, with an optional sign,
+ * fraction and exponent, or inf, infinity or nan in any case. The
+ * result is correctly rounded; values out of range become infinity or
+ * zero, as with strtod.
+ */
+size_t numconv_parse_double(const char *s, size_t len, double *v);
+
+/* Write v to buf and return the number of bytes written */
+size_t numconv_format_u64(uint64_t v, char *buf);
+size_t numconv_format_i64(int64_t v, char *buf);
+
+/*
+ * Write the shortest representation of v that parses back to v. As in
+ * JavaScript, numbers from 1e-6 up to 1e21 are written in plain decimal
+ * notation and the rest with an exponent, e.g. 0.001, 1234.5, 1e+21 and
+ * 1.5e-7. Infinities and NaN are written as inf, -inf and nan.
+ */
+size_t numconv_format_double(double v, char *buf);
+
+__CDECL_END
+
+#endif /* !defined __NUMCONV_H */
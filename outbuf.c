@@ -0,0 +1,302 @@
+/**********************************************************************
+ * Buffered output with vectored flush
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Copied data lives in pages. The part of the current page between seg
+ * and ptr has not been queued yet; it is turned into an iovec when the
+ * page fills up, when caller memory is appended after it, or on flush.
+ * Pages referenced by queued iovecs sit on the used list until a flush
+ * completes, after which they are recycled.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "outbuf.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+struct outbuf_page {
+    struct outbuf_page *next;
+    char data[];
+};
+
+static void free_pages(struct outbuf_page *p)
+{
+    struct outbuf_page *next;
+
+    while (p) {
+        next = p->next;
+        free(p);
+        p = next;
+    }
+}
+
+void outbuf_init(struct outbuf *ob, int fd, size_t page_size)
+{
+    memset(ob, 0, sizeof(*ob));
+    ob->fd = fd;
+    ob->page_size = page_size ? page_size : OUTBUF_DEFAULT_PAGE;
+}
+
+void outbuf_destroy(struct outbuf *ob)
+{
+    free(ob->cur);
+    free_pages(ob->used);
+    free_pages(ob->free);
+    free(ob->iov);
+    outbuf_init(ob, ob->fd, ob->page_size);
+}
+
+/* Add an iovec to the queue, merging it with the last one if adjacent */
+static int queue_iov(struct outbuf *ob, const void *base, size_t len)
+{
+    struct iovec *last;
+
+    if (len == 0) {
+        return 0;
+    }
+
+    if (ob->iovcnt > ob->iovfirst) {
+        last = &ob->iov[ob->iovcnt - 1];
+        if ((const char *)last->iov_base + last->iov_len == base) {
+            last->iov_len += len;
+            ob->queued += len;
+            return 0;
+        }
+    }
+
+    if (ob->iovcnt == ob->iovmax) {
+        int n = ob->iovmax ? ob->iovmax * 2 : 64;
+        struct iovec *iov = realloc(ob->iov, (size_t)n * sizeof(*iov));
+
+        if (iov == NULL) {
+            return -1;
+        }
+        ob->iov = iov;
+        ob->iovmax = n;
+    }
+
+    ob->iov[ob->iovcnt].iov_base = (void *)base;
+    ob->iov[ob->iovcnt].iov_len = len;
+    ob->iovcnt++;
+    ob->queued += len;
+    return 0;
+}
+
+/* Queue the unqueued part of the current page */
+static int queue_segment(struct outbuf *ob)
+{
+    if (queue_iov(ob, ob->seg, (size_t)(ob->ptr - ob->seg))) {
+        return -1;
+    }
+    ob->seg = ob->ptr;
+    return 0;
+}
+
+/* Retire the current page and start a new one */
+static int next_page(struct outbuf *ob)
+{
+    struct outbuf_page *p;
+
+    if (queue_segment(ob)) {
+        return -1;
+    }
+
+    p = ob->free;
+    if (p) {
+        ob->free = p->next;
+    } else {
+        p = malloc(sizeof(*p) + ob->page_size);
+        if (p == NULL) {
+            return -1;
+        }
+    }
+
+    if (ob->cur) {
+        ob->cur->next = ob->used;
+        ob->used = ob->cur;
+    }
+
+    ob->cur = p;
+    ob->ptr = p->data;
+    ob->seg = p->data;
+    ob->end = p->data + ob->page_size;
+    return 0;
+}
+
+/* Everything has been written, recycle the pages */
+static void reset_queue(struct outbuf *ob)
+{
+    struct outbuf_page *p, *next;
+
+    for (p = ob->used; p; p = next) {
+        next = p->next;
+        p->next = ob->free;
+        ob->free = p;
+    }
+    ob->used = NULL;
+
+    if (ob->cur) {
+        ob->ptr = ob->cur->data;
+        ob->seg = ob->cur->data;
+    }
+
+    ob->iovcnt = 0;
+    ob->iovfirst = 0;
+    ob->queued = 0;
+}
+
+int outbuf_flush(struct outbuf *ob)
+{
+    struct iovec *iov;
+    ssize_t n;
+    int cnt;
+
+    if (queue_segment(ob)) {
+        return -1;
+    }
+
+    while (ob->iovfirst < ob->iovcnt) {
+        iov = &ob->iov[ob->iovfirst];
+        cnt = ob->iovcnt - ob->iovfirst;
+        if (cnt > IOV_MAX) {
+            cnt = IOV_MAX;
+        }
+
+        n = writev(ob->fd, iov, cnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        ob->queued -= (size_t)n;
+
+        /* Skip over what was written, which may end mid iovec */
+        while (n > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            ob->iovfirst++;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+
+    reset_queue(ob);
+    return 0;
+}
+
+/* Flush if over the threshold. A descriptor that is not ready is fine */
+static int maybe_flush(struct outbuf *ob)
+{
+    if (outbuf_pending(ob) < OUTBUF_FLUSH_THRESHOLD) {
+        return 0;
+    }
+    if (outbuf_flush(ob) && errno != EAGAIN && errno != EWOULDBLOCK) {
+        return -1;
+    }
+    return 0;
+}
+
+int outbuf_write_slow(struct outbuf *ob, const void *buf, size_t len)
+{
+    const char *p = buf;
+    size_t n;
+
+    while (len) {
+        if (ob->ptr == ob->end && next_page(ob)) {
+            return -1;
+        }
+
+        n = (size_t)(ob->end - ob->ptr);
+        if (n > len) {
+            n = len;
+        }
+        memcpy(ob->ptr, p, n);
+        ob->ptr += n;
+        p += n;
+        len -= n;
+    }
+
+    return maybe_flush(ob);
+}
+
+int outbuf_printf(struct outbuf *ob, const char *fmt, ...)
+{
+    va_list ap;
+    size_t avail = (size_t)(ob->end - ob->ptr);
+    char *tmp;
+    int n;
+    int rc;
+
+    va_start(ap, fmt);
+    n = vsnprintf(ob->ptr, avail, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return -1;
+    }
+
+    /* vsnprintf needs room for the NUL, which we don't keep */
+    if ((size_t)n < avail) {
+        ob->ptr += n;
+        return 0;
+    }
+
+    if ((size_t)n < ob->page_size) {
+        if (next_page(ob)) {
+            return -1;
+        }
+        va_start(ap, fmt);
+        vsnprintf(ob->ptr, ob->page_size, fmt, ap);
+        va_end(ap);
+        ob->ptr += n;
+        return maybe_flush(ob);
+    }
+
+    /* Too big for a page, format it separately and copy it in */
+    tmp = malloc((size_t)n + 1);
+    if (tmp == NULL) {
+        return -1;
+    }
+    va_start(ap, fmt);
+    vsnprintf(tmp, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    rc = outbuf_write(ob, tmp, (size_t)n);
+    free(tmp);
+    return rc;
+}
+
+int outbuf_append(struct outbuf *ob, const void *buf, size_t len)
+{
+    if (queue_segment(ob) || queue_iov(ob, buf, len)) {
+        return -1;
+    }
+    return maybe_flush(ob);
+}
+
+int outbuf_appendv(struct outbuf *ob, const struct iovec *iov, int iovcnt)
+{
+    int i;
+
+    if (queue_segment(ob)) {
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        if (queue_iov(ob, iov[i].iov_base, iov[i].iov_len)) {
+            return -1;
+        }
+    }
+    return maybe_flush(ob);
+}
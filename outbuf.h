@@ -0,0 +1,126 @@
+/**********************************************************************
+ * Buffered output with vectored flush
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Collects output for a file descriptor and writes it out with as few
+ * writev(2) calls as possible. Small writes are copied into fixed size
+ * pages; a full page is queued as one iovec and a fresh page is started.
+ * Large buffers that the caller can keep alive until the next flush can
+ * be queued without copying using outbuf_append and outbuf_appendv.
+ *
+ * Output is flushed automatically once the queued data reaches the
+ * flush threshold, and explicitly by outbuf_flush. If the descriptor is
+ * non-blocking and the kernel cannot take all the data, outbuf_flush
+ * fails with EAGAIN and keeps the rest queued for the next call; the
+ * automatic flushes treat this as success.
+ *
+ * All functions returning int return 0 on success, or -1 with errno set.
+ *
+ * Usage:
+ *      struct outbuf ob;
+ *      outbuf_init(&ob, fd, 0);
+ *      outbuf_write(&ob, hdr, hdrlen);
+ *      outbuf_append(&ob, body, bodylen);  (body stays valid until flush)
+ *      outbuf_flush(&ob);
+ *      outbuf_destroy(&ob);
+ *********************************************************************/
+
+#ifndef __OUTBUF_H
+#define __OUTBUF_H
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/uio.h>
+#include "cdecl.h"
+#include "compiler.h"
+
+__CDECL_BEGIN
+
+/* Page size used when outbuf_init is passed 0 */
+#define OUTBUF_DEFAULT_PAGE     (16 * 1024)
+
+/* Queued bytes that trigger an automatic flush */
+#ifndef OUTBUF_FLUSH_THRESHOLD
+#define OUTBUF_FLUSH_THRESHOLD  (256 * 1024)
+#endif
+
+struct outbuf_page;
+
+struct outbuf {
+    char *ptr;                  /* Next free byte in the current page */
+    char *end;                  /* End of the current page */
+    char *seg;                  /* Start of data not yet queued */
+    struct outbuf_page *cur;    /* Page being filled */
+    struct outbuf_page *used;   /* Full pages referenced by queued data */
+    struct outbuf_page *free;   /* Pages ready for reuse */
+    struct iovec *iov;          /* Queued data */
+    int iovcnt;
+    int iovfirst;               /* First iovec not yet written */
+    int iovmax;                 /* Allocated size of iov */
+    size_t queued;              /* Bytes queued and not yet written */
+    size_t page_size;
+    int fd;
+};
+
+/* Initialize a buffer for fd. page_size 0 selects OUTBUF_DEFAULT_PAGE */
+void outbuf_init(struct outbuf *ob, int fd, size_t page_size);
+
+/* Release all memory. Does not flush */
+void outbuf_destroy(struct outbuf *ob);
+
+/* Write out everything queued so far */
+int outbuf_flush(struct outbuf *ob);
+
+/* Number of bytes not yet written to the descriptor */
+static inline size_t outbuf_pending(const struct outbuf *ob)
+{
+    return ob->queued + (size_t)(ob->ptr - ob->seg);
+}
+
+/* Out of line copy path, for when the current page is full */
+int outbuf_write_slow(struct outbuf *ob, const void *buf, size_t len);
+
+/* Copy len bytes into the buffer */
+static inline int outbuf_write(struct outbuf *ob, const void *buf, size_t len)
+{
+    if (__LIKELY(len <= (size_t)(ob->end - ob->ptr))) {
+        memcpy(ob->ptr, buf, len);
+        ob->ptr += len;
+        return 0;
+    }
+    return outbuf_write_slow(ob, buf, len);
+}
+
+static inline int outbuf_putc(struct outbuf *ob, char c)
+{
+    if (__LIKELY(ob->ptr < ob->end)) {
+        *ob->ptr++ = c;
+        return 0;
+    }
+    return outbuf_write_slow(ob, &c, 1);
+}
+
+static inline int outbuf_puts(struct outbuf *ob, const char *s)
+{
+    return outbuf_write(ob, s, strlen(s));
+}
+
+/* Format into the buffer, like printf */
+int outbuf_printf(struct outbuf *ob, const char *fmt, ...)
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+/*
+ * Queue caller owned memory without copying it. The memory must stay
+ * valid and unchanged until outbuf_pending returns 0, which is always
+ * the case after a successful outbuf_flush.
+ */
+int outbuf_append(struct outbuf *ob, const void *buf, size_t len);
+int outbuf_appendv(struct outbuf *ob, const struct iovec *iov, int iovcnt);
+
+__CDECL_END
+
+#endif /* !defined __OUTBUF_H */
@@ -0,0 +1,145 @@
+/**********************************************************************
+ * Intrusive pairing heap
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Each node keeps its first child and its siblings in a doubly linked
+ * list, where prev of the first child points at the parent, so a node
+ * can be cut out of the tree in O(1). Popping uses the standard two
+ * pass pairing: the children of the old root are linked in pairs from
+ * left to right, then the pairs are linked from right to left.
+ *********************************************************************/
+
+#include "pairing_heap.h"
+
+/*
+ * Join two trees, making the one with the greater root the first child
+ * of the other. The next and prev of the result are left for the
+ * caller to set.
+ */
+static struct pairing_heap_node *join(struct pairing_heap *h,
+                                      struct pairing_heap_node *a,
+                                      struct pairing_heap_node *b)
+{
+    struct pairing_heap_node *t;
+
+    if (h->less(b, a)) {
+        t = a;
+        a = b;
+        b = t;
+    }
+    b->next = a->child;
+    if (b->next) {
+        b->next->prev = b;
+    }
+    b->prev = a;
+    a->child = b;
+    return a;
+}
+
+/* Link a list of siblings into one tree */
+static struct pairing_heap_node *merge_pairs(struct pairing_heap *h,
+                                             struct pairing_heap_node *first)
+{
+    struct pairing_heap_node *pairs = NULL, *a, *b, *rest;
+
+    /* Link in pairs, stacking the results in reverse through next */
+    while ((a = first) != NULL) {
+        b = a->next;
+        rest = NULL;
+        if (b) {
+            rest = b->next;
+            a = join(h, a, b);
+        }
+        a->next = pairs;
+        pairs = a;
+        first = rest;
+    }
+    if (pairs == NULL) {
+        return NULL;
+    }
+
+    /* Then fold them together from the last pair back to the first */
+    a = pairs;
+    pairs = a->next;
+    while ((b = pairs) != NULL) {
+        pairs = b->next;
+        a = join(h, a, b);
+    }
+    a->next = a->prev = NULL;
+    return a;
+}
+
+/* Make node, a tree of its own, part of the heap */
+static void meld(struct pairing_heap *h, struct pairing_heap_node *node)
+{
+    node->next = node->prev = NULL;
+    if (h->root) {
+        node = join(h, h->root, node);
+        node->next = node->prev = NULL;
+    }
+    h->root = node;
+}
+
+/* Cut the subtree at node, which is not the root, out of the tree */
+static void cut(struct pairing_heap_node *node)
+{
+    if (node->prev->child == node) {
+        node->prev->child = node->next;
+    } else {
+        node->prev->next = node->next;
+    }
+    if (node->next) {
+        node->next->prev = node->prev;
+    }
+}
+
+void pairing_heap_insert(struct pairing_heap *h,
+                         struct pairing_heap_node *node)
+{
+    node->child = NULL;
+    meld(h, node);
+}
+
+struct pairing_heap_node *pairing_heap_pop(struct pairing_heap *h)
+{
+    struct pairing_heap_node *root = h->root;
+
+    if (root) {
+        h->root = merge_pairs(h, root->child);
+    }
+    return root;
+}
+
+void pairing_heap_remove(struct pairing_heap *h,
+                         struct pairing_heap_node *node)
+{
+    struct pairing_heap_node *sub;
+
+    if (node == h->root) {
+        pairing_heap_pop(h);
+        return;
+    }
+    cut(node);
+    sub = merge_pairs(h, node->child);
+    if (sub) {
+        meld(h, sub);
+    }
+}
+
+void pairing_heap_decrease(struct pairing_heap *h,
+                           struct pairing_heap_node *node)
+{
+    if (node != h->root) {
+        cut(node);
+        meld(h, node);
+    }
+}
+
+void pairing_heap_merge(struct pairing_heap *h, struct pairing_heap *other)
+{
+    if (other->root) {
+        meld(h, other->root);
+        other->root = NULL;
+    }
+}
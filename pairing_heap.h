@@ -0,0 +1,100 @@
+/**********************************************************************
+ * Intrusive pairing heap
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * A min-heap, after Fredman, Sedgewick, Sleator and Tarjan, "The
+ * Pairing Heap: A New Form of Self-Adjusting Heap" (1986), with a
+ * struct pairing_heap_node embedded in each element. Insertion, finding
+ * the minimum, merging two heaps and decreasing a key are O(1); taking
+ * the minimum (or any other node) out is O(log n) amortized. Unlike an
+ * array based binary heap it never allocates or moves elements, and
+ * any element can be removed or have its key lowered in place, which
+ * suits schedulers and Dijkstra style searches.
+ *
+ * Elements are ordered by a less function given at initialization. A
+ * node's key must not change while it is in the heap, except through
+ * pairing_heap_decrease.
+ *
+ * Usage:
+ *      static int task_less(const struct pairing_heap_node *a,
+ *                           const struct pairing_heap_node *b)
+ *      {
+ *          return pairing_heap_entry(a, struct task, node)->deadline <
+ *                 pairing_heap_entry(b, struct task, node)->deadline;
+ *      }
+ *
+ *      pairing_heap_init(&h, task_less);
+ *      pairing_heap_insert(&h, &task->node);
+ *      while ((n = pairing_heap_pop(&h)) != NULL) {
+ *          t = pairing_heap_entry(n, struct task, node);
+ *          ...
+ *      }
+ *********************************************************************/
+
+#ifndef __PAIRING_HEAP_H
+#define __PAIRING_HEAP_H
+
+#include <stddef.h>
+#include "cdecl.h"
+#include "compiler.h"
+
+__CDECL_BEGIN
+
+struct pairing_heap_node {
+    struct pairing_heap_node *child;    /* First child */
+    struct pairing_heap_node *next;     /* Next sibling */
+    struct pairing_heap_node *prev;     /* Previous sibling, or parent */
+};
+
+typedef int (*pairing_heap_less_fn)(const struct pairing_heap_node *a,
+                                    const struct pairing_heap_node *b);
+
+struct pairing_heap {
+    struct pairing_heap_node *root;
+    pairing_heap_less_fn less;
+};
+
+/* The element containing the node ptr */
+#define pairing_heap_entry(ptr, type, member)                           \
+    __CONTAINER_OF(ptr, type, member)
+
+static inline void pairing_heap_init(struct pairing_heap *h,
+                                     pairing_heap_less_fn less)
+{
+    h->root = NULL;
+    h->less = less;
+}
+
+static inline int pairing_heap_empty(const struct pairing_heap *h)
+{
+    return h->root == NULL;
+}
+
+/* The minimum node, or NULL if the heap is empty */
+static inline struct pairing_heap_node *
+pairing_heap_first(const struct pairing_heap *h)
+{
+    return h->root;
+}
+
+void pairing_heap_insert(struct pairing_heap *h,
+                         struct pairing_heap_node *node);
+
+/* Take out and return the minimum node, or NULL if the heap is empty */
+struct pairing_heap_node *pairing_heap_pop(struct pairing_heap *h);
+
+/* Take node, which must be in the heap, out */
+void pairing_heap_remove(struct pairing_heap *h,
+                         struct pairing_heap_node *node);
+
+/* Move node up after its key has been lowered */
+void pairing_heap_decrease(struct pairing_heap *h,
+                           struct pairing_heap_node *node);
+
+/* Move every node of other, which has the same ordering, into h */
+void pairing_heap_merge(struct pairing_heap *h, struct pairing_heap *other);
+
+__CDECL_END
+
+#endif /* !defined __PAIRING_HEAP_H */
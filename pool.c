@@ -0,0 +1,329 @@
+/**********************************************************************
+ * Fixed size object pool
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Magazine and depot layer, after Bonwick and Adams, "Magazines and
+ * Vmem", USENIX 2001. Each thread cache holds a loaded and a previous
+ * magazine; the depot holds lists of non-empty and empty magazines.
+ *********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compiler.h"
+#include "pool.h"
+
+struct pool_cache {
+    struct pool_magazine *loaded;
+    struct pool_magazine *previous;
+    struct pool *pool;
+    struct pool_cache *next;
+    struct pool_cache **pprev;
+};
+
+static inline size_t round_up(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+static struct pool_magazine *magazine_new(void)
+{
+    struct pool_magazine *m = malloc(sizeof(*m));
+
+    if (m) {
+        m->next = NULL;
+        m->count = 0;
+    }
+    return m;
+}
+
+static void magazine_free_chain(struct pool_magazine *m)
+{
+    struct pool_magazine *next;
+
+    while (m) {
+        next = m->next;
+        free(m);
+        m = next;
+    }
+}
+
+/* Depot lock must be held */
+static void depot_put(struct pool *p, struct pool_magazine *m)
+{
+    struct pool_magazine **list = m->count ? &p->full : &p->empty;
+
+    m->next = *list;
+    *list = m;
+}
+
+static void cache_release(void *arg)
+{
+    struct pool_cache *c = arg;
+    struct pool *p = c->pool;
+
+    pthread_mutex_lock(&p->lock);
+    depot_put(p, c->loaded);
+    depot_put(p, c->previous);
+    *c->pprev = c->next;
+    if (c->next) {
+        c->next->pprev = c->pprev;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    free(c);
+}
+
+int pool_init(struct pool *p, size_t obj_size, size_t align)
+{
+    int rc;
+
+    if (align == 0) {
+        align = sizeof(void *);
+    }
+    if (align & (align - 1)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Free objects are linked through their first word on the loose list */
+    if (obj_size < sizeof(void *)) {
+        obj_size = sizeof(void *);
+    }
+    obj_size = round_up(obj_size, align);
+    if (obj_size > POOL_SLAB_SIZE / 2) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(p, 0, sizeof(*p));
+    p->obj_size = obj_size;
+    p->align = align;
+
+    rc = pthread_key_create(&p->key, cache_release);
+    if (rc) {
+        errno = rc;
+        return -1;
+    }
+
+    rc = pthread_mutex_init(&p->lock, NULL);
+    if (rc) {
+        pthread_key_delete(p->key);
+        errno = rc;
+        return -1;
+    }
+
+    return 0;
+}
+
+void pool_destroy(struct pool *p)
+{
+    struct pool_cache *c, *next;
+    void *slab, *next_slab;
+
+    pthread_key_delete(p->key);
+
+    for (c = p->caches; c; c = next) {
+        next = c->next;
+        free(c->loaded);
+        free(c->previous);
+        free(c);
+    }
+
+    magazine_free_chain(p->full);
+    magazine_free_chain(p->empty);
+
+    for (slab = p->slabs; slab; slab = next_slab) {
+        next_slab = *(void **)slab;
+        free(slab);
+    }
+
+    pthread_mutex_destroy(&p->lock);
+    memset(p, 0, sizeof(*p));
+}
+
+static struct pool_cache *cache_create(struct pool *p)
+{
+    struct pool_cache *c;
+
+    c = malloc(sizeof(*c));
+    if (c == NULL) {
+        return NULL;
+    }
+
+    c->loaded = magazine_new();
+    c->previous = magazine_new();
+    if (c->loaded == NULL || c->previous == NULL ||
+        pthread_setspecific(p->key, c)) {
+        free(c->loaded);
+        free(c->previous);
+        free(c);
+        return NULL;
+    }
+
+    c->pool = p;
+    pthread_mutex_lock(&p->lock);
+    c->next = p->caches;
+    c->pprev = &p->caches;
+    if (c->next) {
+        c->next->pprev = &c->next;
+    }
+    p->caches = c;
+    pthread_mutex_unlock(&p->lock);
+
+    return c;
+}
+
+static inline struct pool_cache *cache_get(struct pool *p)
+{
+    struct pool_cache *c = pthread_getspecific(p->key);
+
+    if (__UNLIKELY(c == NULL)) {
+        c = cache_create(p);
+    }
+    return c;
+}
+
+/* Depot lock must be held. Returns 0 if a new slab could not be allocated */
+static int slab_refill(struct pool *p, struct pool_magazine *m)
+{
+    void *obj;
+
+    while (m->count < POOL_MAGAZINE_SIZE && p->loose) {
+        obj = p->loose;
+        p->loose = *(void **)obj;
+        m->objs[m->count++] = obj;
+    }
+
+    while (m->count < POOL_MAGAZINE_SIZE) {
+        if ((size_t)(p->slab_end - p->slab_ptr) < p->obj_size) {
+            size_t align = p->align > sizeof(void *) ? p->align :
+                                                       sizeof(void *);
+            void *slab;
+
+            if (posix_memalign(&slab, align, POOL_SLAB_SIZE)) {
+                break;
+            }
+            *(void **)slab = p->slabs;
+            p->slabs = slab;
+            p->slab_ptr = (char *)slab + round_up(sizeof(void *), align);
+            p->slab_end = (char *)slab + POOL_SLAB_SIZE;
+        }
+
+        m->objs[m->count++] = p->slab_ptr;
+        p->slab_ptr += p->obj_size;
+    }
+
+    return m->count != 0;
+}
+
+static __NOINLINE void *alloc_slow(struct pool *p, struct pool_cache *c)
+{
+    struct pool_magazine *m;
+
+    pthread_mutex_lock(&p->lock);
+    m = p->full;
+    if (m) {
+        /* Swap our empty loaded magazine for a full one from the depot */
+        p->full = m->next;
+        depot_put(p, c->loaded);
+        c->loaded = m;
+    } else if (!slab_refill(p, c->loaded)) {
+        pthread_mutex_unlock(&p->lock);
+        return NULL;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    m = c->loaded;
+    return m->objs[--m->count];
+}
+
+void *pool_alloc(struct pool *p)
+{
+    struct pool_cache *c = cache_get(p);
+    struct pool_magazine *m;
+
+    if (__UNLIKELY(c == NULL)) {
+        return NULL;
+    }
+
+    m = c->loaded;
+    if (__LIKELY(m->count)) {
+        return m->objs[--m->count];
+    }
+
+    m = c->previous;
+    if (m->count) {
+        c->previous = c->loaded;
+        c->loaded = m;
+        return m->objs[--m->count];
+    }
+
+    return alloc_slow(p, c);
+}
+
+static __NOINLINE void free_slow(struct pool *p, struct pool_cache *c,
+                                 void *obj)
+{
+    struct pool_magazine *m;
+
+    pthread_mutex_lock(&p->lock);
+    m = p->empty;
+    if (m) {
+        p->empty = m->next;
+    } else {
+        pthread_mutex_unlock(&p->lock);
+        m = magazine_new();
+        pthread_mutex_lock(&p->lock);
+    }
+
+    if (m == NULL) {
+        /* No memory for a magazine, keep the object on the loose list */
+        *(void **)obj = p->loose;
+        p->loose = obj;
+    } else {
+        /* Hand our full loaded magazine to the depot */
+        depot_put(p, c->loaded);
+        c->loaded = m;
+        m->objs[m->count++] = obj;
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pool_free(struct pool *p, void *obj)
+{
+    struct pool_cache *c;
+    struct pool_magazine *m;
+
+    if (obj == NULL) {
+        return;
+    }
+
+    c = cache_get(p);
+    if (__UNLIKELY(c == NULL)) {
+        pthread_mutex_lock(&p->lock);
+        *(void **)obj = p->loose;
+        p->loose = obj;
+        pthread_mutex_unlock(&p->lock);
+        return;
+    }
+
+    m = c->loaded;
+    if (__LIKELY(m->count < POOL_MAGAZINE_SIZE)) {
+        m->objs[m->count++] = obj;
+        return;
+    }
+
+    m = c->previous;
+    if (m->count < POOL_MAGAZINE_SIZE) {
+        c->previous = c->loaded;
+        c->loaded = m;
+        m->objs[m->count++] = obj;
+        return;
+    }
+
+    free_slow(p, c, obj);
+}
@@ -0,0 +1,85 @@
+/**********************************************************************
+ * Fixed size object pool
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Hands out fixed size objects carved from large slabs. Each thread
+ * keeps a small cache of two magazines (arrays of free objects) per
+ * pool, and allocations and frees are served from these without any
+ * locking. Only when both magazines are exhausted (or full) does the
+ * thread go to the shared depot, exchanging a whole magazine at a time
+ * under the depot lock.
+ *
+ * Memory is returned to the system only by pool_destroy, which must
+ * not be called while other threads are still using the pool.
+ *
+ * Usage:
+ *      struct pool p;
+ *      pool_init(&p, sizeof(struct conn), 0);
+ *      c = pool_alloc(&p);
+ *      ...
+ *      pool_free(&p, c);
+ *********************************************************************/
+
+#ifndef __POOL_H
+#define __POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+/* Number of objects held by a single magazine */
+#ifndef POOL_MAGAZINE_SIZE
+#define POOL_MAGAZINE_SIZE      64
+#endif
+
+/* Size of the slabs that objects are carved from */
+#ifndef POOL_SLAB_SIZE
+#define POOL_SLAB_SIZE          (256 * 1024)
+#endif
+
+struct pool_magazine {
+    struct pool_magazine *next;
+    unsigned int count;
+    void *objs[POOL_MAGAZINE_SIZE];
+};
+
+struct pool_cache;
+
+struct pool {
+    size_t obj_size;            /* Object stride, including padding */
+    size_t align;
+    pthread_key_t key;          /* Per thread struct pool_cache */
+
+    /* Everything below is protected by the depot lock */
+    pthread_mutex_t lock;
+    struct pool_magazine *full; /* Magazines with at least one object */
+    struct pool_magazine *empty;
+    void *loose;                /* Freed objects that had no magazine */
+    char *slab_ptr;             /* Unused part of the newest slab */
+    char *slab_end;
+    void *slabs;                /* All slabs, chained through word 0 */
+    struct pool_cache *caches;  /* All thread caches */
+};
+
+/*
+ * Initialize a pool of objects of the given size. align must be a power
+ * of 2, or 0 for pointer alignment. Returns 0 on success, or -1 with
+ * errno set on failure.
+ */
+int pool_init(struct pool *p, size_t obj_size, size_t align);
+
+/* Release all memory held by the pool */
+void pool_destroy(struct pool *p);
+
+/* Allocate an object, or return NULL if out of memory */
+void *pool_alloc(struct pool *p);
+
+/* Return an object allocated from the same pool, by any thread */
+void pool_free(struct pool *p, void *obj);
+
+__CDECL_END
+
+#endif /* !defined __POOL_H */
@@ -0,0 +1,305 @@
+/**********************************************************************
+ * Intrusive red-black tree
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * The insertion and deletion fixups follow Cormen et al., Introduction
+ * to Algorithms, with NULL children standing in for the black leaves.
+ * Since a missing child has no parent pointer of its own, deletion
+ * carries the parent of the node it is fixing up alongside it.
+ *********************************************************************/
+
+#include "rbtree.h"
+
+#define RB_RED      0
+#define RB_BLACK    1
+
+static inline int is_black(const struct rb_node *node)
+{
+    return node == NULL || (node->parent_color & RB_BLACK);
+}
+
+static inline int color(const struct rb_node *node)
+{
+    return (int)(node->parent_color & RB_BLACK);
+}
+
+static inline void set_color(struct rb_node *node, int c)
+{
+    node->parent_color = (node->parent_color & ~(uintptr_t)RB_BLACK) |
+                         (uintptr_t)c;
+}
+
+static inline void set_parent(struct rb_node *node, struct rb_node *parent)
+{
+    node->parent_color = (uintptr_t)parent |
+                         (node->parent_color & RB_BLACK);
+}
+
+/* Make node the child of parent that old was, or the root */
+static inline void change_child(struct rb_node *old, struct rb_node *node,
+                                struct rb_node *parent, struct rb_root *root)
+{
+    if (parent == NULL) {
+        root->node = node;
+    } else if (parent->left == old) {
+        parent->left = node;
+    } else {
+        parent->right = node;
+    }
+}
+
+static void rotate_left(struct rb_node *x, struct rb_root *root)
+{
+    struct rb_node *y = x->right;
+
+    x->right = y->left;
+    if (y->left) {
+        set_parent(y->left, x);
+    }
+    set_parent(y, rb_parent(x));
+    change_child(x, y, rb_parent(x), root);
+    y->left = x;
+    set_parent(x, y);
+}
+
+static void rotate_right(struct rb_node *x, struct rb_root *root)
+{
+    struct rb_node *y = x->left;
+
+    x->left = y->right;
+    if (y->right) {
+        set_parent(y->right, x);
+    }
+    set_parent(y, rb_parent(x));
+    change_child(x, y, rb_parent(x), root);
+    y->right = x;
+    set_parent(x, y);
+}
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root)
+{
+    struct rb_node *parent, *gparent, *uncle;
+
+    while ((parent = rb_parent(node)) != NULL && !is_black(parent)) {
+        /* A red node is never the root, so the grandparent exists */
+        gparent = rb_parent(parent);
+        if (parent == gparent->left) {
+            uncle = gparent->right;
+            if (!is_black(uncle)) {
+                set_color(parent, RB_BLACK);
+                set_color(uncle, RB_BLACK);
+                set_color(gparent, RB_RED);
+                node = gparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rotate_left(parent, root);
+                node = parent;
+                parent = rb_parent(node);
+            }
+            set_color(parent, RB_BLACK);
+            set_color(gparent, RB_RED);
+            rotate_right(gparent, root);
+        } else {
+            uncle = gparent->left;
+            if (!is_black(uncle)) {
+                set_color(parent, RB_BLACK);
+                set_color(uncle, RB_BLACK);
+                set_color(gparent, RB_RED);
+                node = gparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rotate_right(parent, root);
+                node = parent;
+                parent = rb_parent(node);
+            }
+            set_color(parent, RB_BLACK);
+            set_color(gparent, RB_RED);
+            rotate_left(gparent, root);
+        }
+    }
+    set_color(root->node, RB_BLACK);
+}
+
+/*
+ * Restore the black heights after a black node was taken out from under
+ * parent, leaving node (perhaps NULL) one black short.
+ */
+static void erase_color(struct rb_node *node, struct rb_node *parent,
+                        struct rb_root *root)
+{
+    struct rb_node *sibling;
+
+    while (node != root->node && is_black(node)) {
+        /* The short side has a black height of at least one to match */
+        if (node == parent->left) {
+            sibling = parent->right;
+            if (!is_black(sibling)) {
+                set_color(sibling, RB_BLACK);
+                set_color(parent, RB_RED);
+                rotate_left(parent, root);
+                sibling = parent->right;
+            }
+            if (is_black(sibling->left) && is_black(sibling->right)) {
+                set_color(sibling, RB_RED);
+                node = parent;
+                parent = rb_parent(node);
+                continue;
+            }
+            if (is_black(sibling->right)) {
+                set_color(sibling->left, RB_BLACK);
+                set_color(sibling, RB_RED);
+                rotate_right(sibling, root);
+                sibling = parent->right;
+            }
+            set_color(sibling, color(parent));
+            set_color(parent, RB_BLACK);
+            set_color(sibling->right, RB_BLACK);
+            rotate_left(parent, root);
+        } else {
+            sibling = parent->left;
+            if (!is_black(sibling)) {
+                set_color(sibling, RB_BLACK);
+                set_color(parent, RB_RED);
+                rotate_right(parent, root);
+                sibling = parent->left;
+            }
+            if (is_black(sibling->left) && is_black(sibling->right)) {
+                set_color(sibling, RB_RED);
+                node = parent;
+                parent = rb_parent(node);
+                continue;
+            }
+            if (is_black(sibling->left)) {
+                set_color(sibling->right, RB_BLACK);
+                set_color(sibling, RB_RED);
+                rotate_left(sibling, root);
+                sibling = parent->left;
+            }
+            set_color(sibling, color(parent));
+            set_color(parent, RB_BLACK);
+            set_color(sibling->left, RB_BLACK);
+            rotate_right(parent, root);
+        }
+        node = root->node;
+        break;
+    }
+    if (node) {
+        set_color(node, RB_BLACK);
+    }
+}
+
+void rb_erase(struct rb_node *node, struct rb_root *root)
+{
+    struct rb_node *child, *parent, *succ;
+    int removed;
+
+    if (node->left == NULL || node->right == NULL) {
+        child = node->left ? node->left : node->right;
+        parent = rb_parent(node);
+        removed = color(node);
+        if (child) {
+            set_parent(child, parent);
+        }
+        change_child(node, child, parent, root);
+    } else {
+        /* Move the successor, which has no left child, into its place */
+        succ = node->right;
+        while (succ->left) {
+            succ = succ->left;
+        }
+        removed = color(succ);
+        child = succ->right;
+        if (rb_parent(succ) == node) {
+            parent = succ;
+        } else {
+            parent = rb_parent(succ);
+            parent->left = child;
+            if (child) {
+                set_parent(child, parent);
+            }
+            succ->right = node->right;
+            set_parent(node->right, succ);
+        }
+        succ->left = node->left;
+        set_parent(node->left, succ);
+        change_child(node, succ, rb_parent(node), root);
+        succ->parent_color = node->parent_color;
+    }
+    if (removed == RB_BLACK) {
+        erase_color(child, parent, root);
+    }
+}
+
+void rb_replace_node(struct rb_node *victim, struct rb_node *node,
+                     struct rb_root *root)
+{
+    *node = *victim;
+    if (victim->left) {
+        set_parent(victim->left, node);
+    }
+    if (victim->right) {
+        set_parent(victim->right, node);
+    }
+    change_child(victim, node, rb_parent(victim), root);
+}
+
+struct rb_node *rb_first(const struct rb_root *root)
+{
+    struct rb_node *node = root->node;
+
+    if (node) {
+        while (node->left) {
+            node = node->left;
+        }
+    }
+    return node;
+}
+
+struct rb_node *rb_last(const struct rb_root *root)
+{
+    struct rb_node *node = root->node;
+
+    if (node) {
+        while (node->right) {
+            node = node->right;
+        }
+    }
+    return node;
+}
+
+struct rb_node *rb_next(const struct rb_node *node)
+{
+    struct rb_node *parent;
+
+    if (node->right) {
+        node = node->right;
+        while (node->left) {
+            node = node->left;
+        }
+        return (struct rb_node *)node;
+    }
+    while ((parent = rb_parent(node)) != NULL && node == parent->right) {
+        node = parent;
+    }
+    return parent;
+}
+
+struct rb_node *rb_prev(const struct rb_node *node)
+{
+    struct rb_node *parent;
+
+    if (node->left) {
+        node = node->left;
+        while (node->right) {
+            node = node->right;
+        }
+        return (struct rb_node *)node;
+    }
+    while ((parent = rb_parent(node)) != NULL && node == parent->left) {
+        node = parent;
+    }
+    return parent;
+}
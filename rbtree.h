@@ -0,0 +1,157 @@
+/**********************************************************************
+ * Intrusive red-black tree
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * A red-black tree in the style of the Linux kernel's rbtree. A struct
+ * rb_node is embedded in each element, and holds the parent pointer
+ * with the colour in its low bit, so a node costs three words and the
+ * tree never allocates.
+ *
+ * The tree does not know how elements are ordered. To insert, the
+ * caller walks down from the root comparing keys itself, which lets the
+ * comparison be inlined and lets the caller spot duplicates on the way;
+ * rb_link_node then hangs the node where the walk ended, and
+ * rb_insert_color rebalances. rb_add and rb_find do the walk with a
+ * comparison function, for callers happy with an indirect call per
+ * level.
+ *
+ * Usage:
+ *      struct rb_node **link = &root.node, *parent = NULL;
+ *
+ *      while (*link) {
+ *          parent = *link;
+ *          if (key < rb_entry(parent, struct conn, node)->key) {
+ *              link = &parent->left;
+ *          } else {
+ *              link = &parent->right;
+ *          }
+ *      }
+ *      rb_link_node(&conn->node, parent, link);
+ *      rb_insert_color(&conn->node, &root);
+ *
+ *      for (n = rb_first(&root); n != NULL; n = rb_next(n)) {
+ *          c = rb_entry(n, struct conn, node);
+ *          ...
+ *      }
+ *      rb_erase(&conn->node, &root);
+ *********************************************************************/
+
+#ifndef __RBTREE_H
+#define __RBTREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cdecl.h"
+#include "compiler.h"
+
+__CDECL_BEGIN
+
+struct rb_node {
+    uintptr_t parent_color;     /* Parent, with bit 0 set if black */
+    struct rb_node *left;
+    struct rb_node *right;
+};
+
+struct rb_root {
+    struct rb_node *node;
+};
+
+#define RB_ROOT                         { NULL }
+
+/* The element containing the node ptr */
+#define rb_entry(ptr, type, member)     __CONTAINER_OF(ptr, type, member)
+
+static inline int rb_empty_root(const struct rb_root *root)
+{
+    return root->node == NULL;
+}
+
+static inline struct rb_node *rb_parent(const struct rb_node *node)
+{
+    return (struct rb_node *)(node->parent_color & ~(uintptr_t)3);
+}
+
+/*
+ * Hang node, red and childless, from parent at link, which is the
+ * parent's left or right pointer (or root->node for an empty tree).
+ * rb_insert_color must be called next.
+ */
+static inline void rb_link_node(struct rb_node *node, struct rb_node *parent,
+                                struct rb_node **link)
+{
+    node->parent_color = (uintptr_t)parent;
+    node->left = node->right = NULL;
+    *link = node;
+}
+
+/* Rebalance the tree after rb_link_node */
+void rb_insert_color(struct rb_node *node, struct rb_root *root);
+
+/* Take node out of the tree */
+void rb_erase(struct rb_node *node, struct rb_root *root);
+
+/* Put node in the place of victim, which must have the same key */
+void rb_replace_node(struct rb_node *victim, struct rb_node *node,
+                     struct rb_root *root);
+
+/* The first and last nodes in order, or NULL if the tree is empty */
+struct rb_node *rb_first(const struct rb_root *root);
+struct rb_node *rb_last(const struct rb_root *root);
+
+/* The node after or before node in order, or NULL if there is none */
+struct rb_node *rb_next(const struct rb_node *node);
+struct rb_node *rb_prev(const struct rb_node *node);
+
+/*
+ * Insert node, after any nodes with an equal key, where less tells
+ * whether a sorts before b.
+ */
+static inline void rb_add(struct rb_node *node, struct rb_root *root,
+                          int (*less)(const struct rb_node *a,
+                                      const struct rb_node *b))
+{
+    struct rb_node **link = &root->node, *parent = NULL;
+
+    while (*link) {
+        parent = *link;
+        if (less(node, parent)) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+        }
+    }
+    rb_link_node(node, parent, link);
+    rb_insert_color(node, root);
+}
+
+/*
+ * Find the first node matching key, or NULL, where cmp returns less
+ * than, equal to or greater than zero as key sorts before, with or
+ * after node.
+ */
+static inline struct rb_node *rb_find(const void *key,
+                                      const struct rb_root *root,
+                                      int (*cmp)(const void *key,
+                                                 const struct rb_node *node))
+{
+    struct rb_node *node = root->node, *match = NULL;
+    int c;
+
+    while (node) {
+        c = cmp(key, node);
+        if (c <= 0) {
+            if (c == 0) {
+                match = node;
+            }
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return match;
+}
+
+__CDECL_END
+
+#endif /* !defined __RBTREE_H */
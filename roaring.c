@@ -0,0 +1,1611 @@
+/**********************************************************************
+ * Roaring bitmaps
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Containers are kept sorted by key in two parallel arrays, so that the
+ * keys can be searched without touching the containers. An empty
+ * container is never kept. Each container is an array of at most
+ * ARRAY_MAX values, a bitmap, or a list of runs; arrays and bitmaps
+ * trade places as the cardinality crosses ARRAY_MAX, which is the point
+ * where the two take the same space.
+ *
+ * Binary operations build their result in a new bitmap and only replace
+ * the destination when everything has been allocated, which is what
+ * lets the destination be one of the operands. Where a bitmap is
+ * involved, the operands are combined into a fresh 8 KiB bitmap, which
+ * is turned into an array if the result turns out to be small enough.
+ *********************************************************************/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitset.h"
+#include "compiler.h"
+#include "roaring.h"
+
+#define ARRAY_MAX       4096
+#define BITMAP_WORDS    1024
+#define RUNS_MAX        32768
+
+enum { ARRAY, BITMAP, RUN };
+
+/* The values from start to last inclusive */
+struct run {
+    uint16_t start;
+    uint16_t last;
+};
+
+struct roaring_container {
+    union {
+        uint16_t *array;
+        uint64_t *bitmap;
+        struct run *runs;
+        void *mem;
+    } u;
+    uint32_t n;                 /* Values in an array, or runs */
+    uint32_t cap;               /* Allocated values or runs */
+    uint32_t card;              /* Values in the container */
+    int type;
+};
+
+/**********************************************************************
+ * Searching and growing
+ *********************************************************************/
+/* Index of the first of a[0..n) that is not less than v */
+static size_t lower_bound(const uint16_t *a, size_t n, uint32_t v)
+{
+    size_t lo = 0, half;
+
+    while (n > 0) {
+        half = n / 2;
+        if (a[lo + half] < v) {
+            lo += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return lo;
+}
+
+/* Index of the first of r[0..n) that ends at or after v */
+static size_t run_lower_bound(const struct run *r, size_t n, uint32_t v)
+{
+    size_t lo = 0, half;
+
+    while (n > 0) {
+        half = n / 2;
+        if (r[lo + half].last < v) {
+            lo += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return lo;
+}
+
+/* Make room for n values or runs of elem bytes, of which there are max */
+static int grow(struct roaring_container *c, size_t n, size_t elem,
+                size_t max)
+{
+    size_t cap;
+    void *p;
+
+    if (n <= c->cap) {
+        return 0;
+    }
+    cap = c->cap ? 2 * (size_t)c->cap : 4;
+    if (cap < n) {
+        cap = n;
+    }
+    if (cap > max) {
+        cap = max;
+    }
+    p = realloc(c->u.mem, cap * elem);
+    if (p == NULL) {
+        return -1;
+    }
+    c->u.mem = p;
+    c->cap = (uint32_t)cap;
+    return 0;
+}
+
+#define array_grow(c, n)    grow(c, n, sizeof(uint16_t), ARRAY_MAX)
+#define runs_grow(c, n)     grow(c, n, sizeof(struct run), RUNS_MAX)
+
+/**********************************************************************
+ * Bitmap words
+ *********************************************************************/
+static inline void bit_set(uint64_t *w, uint32_t v)
+{
+    w[v / 64] |= 1ULL << (v % 64);
+}
+
+static inline void bit_clear(uint64_t *w, uint32_t v)
+{
+    w[v / 64] &= ~(1ULL << (v % 64));
+}
+
+static inline int bit_test(const uint64_t *w, uint32_t v)
+{
+    return (int)((w[v / 64] >> (v % 64)) & 1);
+}
+
+/* Set (or clear) the bits from a to b inclusive */
+static void range_set(uint64_t *w, uint32_t a, uint32_t b, int set)
+{
+    uint32_t i = a / 64, j = b / 64, k;
+    uint64_t first = ~0ULL << (a % 64), last = ~0ULL >> (63 - b % 64);
+
+    if (i == j) {
+        first &= last;
+    }
+    w[i] = set ? w[i] | first : w[i] & ~first;
+    if (i == j) {
+        return;
+    }
+    for (k = i + 1; k < j; k++) {
+        w[k] = set ? ~0ULL : 0;
+    }
+    w[j] = set ? w[j] | last : w[j] & ~last;
+}
+
+/* Set bits from a to b inclusive */
+static size_t range_count(const uint64_t *w, uint32_t a, uint32_t b)
+{
+    uint32_t i = a / 64, j = b / 64;
+    uint64_t first = ~0ULL << (a % 64), last = ~0ULL >> (63 - b % 64);
+
+    if (i == j) {
+        return (size_t)__builtin_popcountll(w[i] & first & last);
+    }
+    return (size_t)__builtin_popcountll(w[i] & first) +
+           bitset_words_count(w + i + 1, j - i - 1) +
+           (size_t)__builtin_popcountll(w[j] & last);
+}
+
+/* Store the positions of the set bits of w[0..BITMAP_WORDS) in out */
+static uint32_t words_to_array(const uint64_t *w, uint16_t *out)
+{
+    uint32_t i, n = 0;
+    uint64_t x;
+
+    for (i = 0; i < BITMAP_WORDS; i++) {
+        for (x = w[i]; x != 0; x &= x - 1) {
+            out[n++] = (uint16_t)(i * 64 + (uint32_t)__builtin_ctzll(x));
+        }
+    }
+    return n;
+}
+
+/* Fill w with the values of c */
+static void to_words(const struct roaring_container *c, uint64_t *w)
+{
+    uint32_t i;
+
+    if (c->type == BITMAP) {
+        memcpy(w, c->u.bitmap, BITMAP_WORDS * sizeof(*w));
+        return;
+    }
+    memset(w, 0, BITMAP_WORDS * sizeof(*w));
+    for (i = 0; i < c->n; i++) {
+        if (c->type == ARRAY) {
+            bit_set(w, c->u.array[i]);
+        } else {
+            range_set(w, c->u.runs[i].start, c->u.runs[i].last, 1);
+        }
+    }
+}
+
+/**********************************************************************
+ * Containers
+ *********************************************************************/
+static void cont_free(struct roaring_container *c)
+{
+    free(c->u.mem);
+    c->u.mem = NULL;
+}
+
+static int cont_copy(struct roaring_container *dst,
+                     const struct roaring_container *src)
+{
+    size_t bytes;
+
+    if (src->type == BITMAP) {
+        bytes = BITMAP_WORDS * sizeof(uint64_t);
+    } else if (src->type == ARRAY) {
+        bytes = src->n * sizeof(uint16_t);
+    } else {
+        bytes = src->n * sizeof(struct run);
+    }
+    *dst = *src;
+    dst->u.mem = malloc(bytes);
+    if (dst->u.mem == NULL) {
+        return -1;
+    }
+    memcpy(dst->u.mem, src->u.mem, bytes);
+    dst->cap = src->n;
+    return 0;
+}
+
+/*
+ * Make c hold the values set in w, which was allocated with malloc and
+ * is either taken over by c or freed.
+ */
+static int cont_from_words(struct roaring_container *c, uint64_t *w)
+{
+    c->card = (uint32_t)bitset_words_count(w, BITMAP_WORDS);
+    c->u.mem = NULL;
+    c->n = 0;
+    c->cap = 0;
+    c->type = ARRAY;
+    if (c->card > ARRAY_MAX) {
+        c->u.bitmap = w;
+        c->type = BITMAP;
+        return 0;
+    }
+    if (c->card > 0) {
+        c->u.array = malloc(c->card * sizeof(uint16_t));
+        if (c->u.array == NULL) {
+            free(w);
+            return -1;
+        }
+        c->n = c->cap = words_to_array(w, c->u.array);
+    }
+    free(w);
+    return 0;
+}
+
+static int array_to_bitmap(struct roaring_container *c)
+{
+    uint64_t *w = malloc(BITMAP_WORDS * sizeof(*w));
+
+    if (w == NULL) {
+        return -1;
+    }
+    to_words(c, w);
+    cont_free(c);
+    c->u.bitmap = w;
+    c->type = BITMAP;
+    c->n = 0;
+    c->cap = 0;
+    return 0;
+}
+
+static int bitmap_to_array(struct roaring_container *c)
+{
+    uint16_t *a = malloc(c->card * sizeof(*a));
+
+    if (a == NULL) {
+        return -1;
+    }
+    words_to_array(c->u.bitmap, a);
+    cont_free(c);
+    c->u.array = a;
+    c->type = ARRAY;
+    c->n = c->cap = c->card;
+    return 0;
+}
+
+static uint32_t count_runs(const struct roaring_container *c)
+{
+    uint64_t w, carry = 0;
+    uint32_t i, n = 0;
+
+    if (c->type == RUN) {
+        return c->n;
+    }
+    if (c->type == ARRAY) {
+        for (i = 0; i < c->n; i++) {
+            n += i == 0 || c->u.array[i] != c->u.array[i - 1] + 1;
+        }
+        return n;
+    }
+
+    /* A run starts at each set bit whose lower neighbour is clear */
+    for (i = 0; i < BITMAP_WORDS; i++) {
+        w = c->u.bitmap[i];
+        n += (uint32_t)__builtin_popcountll(w & ~((w << 1) | carry));
+        carry = w >> 63;
+    }
+    return n;
+}
+
+static int to_runs(struct roaring_container *c)
+{
+    uint32_t n = count_runs(c), i, k = 0, v;
+    struct run *r = malloc(n * sizeof(*r));
+
+    if (r == NULL) {
+        return -1;
+    }
+    if (c->type == ARRAY) {
+        for (i = 0; i < c->n; i++) {
+            v = c->u.array[i];
+            if (k > 0 && r[k - 1].last + 1U == v) {
+                r[k - 1].last = (uint16_t)v;
+            } else {
+                r[k].start = r[k].last = (uint16_t)v;
+                k++;
+            }
+        }
+    } else {
+        for (v = 0; v < 65536; v++) {
+            if (!bit_test(c->u.bitmap, v)) {
+                /* Skip clear words whole */
+                if (c->u.bitmap[v / 64] == 0) {
+                    v |= 63;
+                }
+                continue;
+            }
+            if (k > 0 && r[k - 1].last + 1U == v) {
+                r[k - 1].last = (uint16_t)v;
+            } else {
+                r[k].start = r[k].last = (uint16_t)v;
+                k++;
+            }
+        }
+    }
+    cont_free(c);
+    c->u.runs = r;
+    c->type = RUN;
+    c->n = c->cap = n;
+    return 0;
+}
+
+/* Convert runs to an array or a bitmap, whichever suits the cardinality */
+static int from_runs(struct roaring_container *c)
+{
+    uint64_t *w = malloc(BITMAP_WORDS * sizeof(*w));
+
+    if (w == NULL) {
+        return -1;
+    }
+    to_words(c, w);
+    cont_free(c);
+    return cont_from_words(c, w);
+}
+
+/* Serialized size of a container in each form */
+static size_t runs_size(uint32_t runs)
+{
+    return 2 + 4 * (size_t)runs;
+}
+
+static size_t plain_size(uint32_t card)
+{
+    return card <= ARRAY_MAX ? 2 * (size_t)card : 8192;
+}
+
+static int cont_contains(const struct roaring_container *c, uint32_t v)
+{
+    size_t i;
+
+    if (c->type == ARRAY) {
+        i = lower_bound(c->u.array, c->n, v);
+        return i < c->n && c->u.array[i] == v;
+    }
+    if (c->type == BITMAP) {
+        return bit_test(c->u.bitmap, v);
+    }
+    i = run_lower_bound(c->u.runs, c->n, v);
+    return i < c->n && c->u.runs[i].start <= v;
+}
+
+/* Add v, returning 1 if it was added, 0 if present, or -1 */
+static int cont_add(struct roaring_container *c, uint32_t v)
+{
+    struct run *r;
+    size_t i;
+
+    switch (c->type) {
+    case ARRAY:
+        /* Sorted input appends */
+        i = c->n;
+        if (i > 0 && c->u.array[i - 1] >= v) {
+            i = lower_bound(c->u.array, c->n, v);
+            if (c->u.array[i] == v) {
+                return 0;
+            }
+        }
+        if (c->n == ARRAY_MAX) {
+            if (array_to_bitmap(c)) {
+                return -1;
+            }
+            return cont_add(c, v);
+        }
+        if (array_grow(c, c->n + 1)) {
+            return -1;
+        }
+        memmove(c->u.array + i + 1, c->u.array + i,
+                (c->n - i) * sizeof(uint16_t));
+        c->u.array[i] = (uint16_t)v;
+        c->n++;
+        break;
+
+    case BITMAP:
+        if (bit_test(c->u.bitmap, v)) {
+            return 0;
+        }
+        bit_set(c->u.bitmap, v);
+        break;
+
+    case RUN:
+        i = run_lower_bound(c->u.runs, c->n, v);
+        r = c->u.runs;
+        if (i < c->n && r[i].start <= v) {
+            return 0;
+        }
+        if (i > 0 && r[i - 1].last + 1U == v) {
+            /* Extend the run before, and join it to the one after */
+            if (i < c->n && r[i].start == v + 1) {
+                r[i - 1].last = r[i].last;
+                memmove(r + i, r + i + 1, (c->n - i - 1) * sizeof(*r));
+                c->n--;
+            } else {
+                r[i - 1].last = (uint16_t)v;
+            }
+        } else if (i < c->n && r[i].start == v + 1) {
+            r[i].start = (uint16_t)v;
+        } else {
+            if (runs_grow(c, c->n + 1)) {
+                return -1;
+            }
+            r = c->u.runs;
+            memmove(r + i + 1, r + i, (c->n - i) * sizeof(*r));
+            r[i].start = r[i].last = (uint16_t)v;
+            c->n++;
+        }
+        break;
+    }
+    c->card++;
+    return 1;
+}
+
+/* Remove v, returning 1 if it was removed, 0 if absent, or -1 */
+static int cont_remove(struct roaring_container *c, uint32_t v)
+{
+    struct run *r;
+    size_t i;
+
+    switch (c->type) {
+    case ARRAY:
+        i = lower_bound(c->u.array, c->n, v);
+        if (i == c->n || c->u.array[i] != v) {
+            return 0;
+        }
+        memmove(c->u.array + i, c->u.array + i + 1,
+                (c->n - i - 1) * sizeof(uint16_t));
+        c->n--;
+        break;
+
+    case BITMAP:
+        if (!bit_test(c->u.bitmap, v)) {
+            return 0;
+        }
+        bit_clear(c->u.bitmap, v);
+        if (c->card - 1 <= ARRAY_MAX) {
+            /* If this fails, the bitmap is still correct, only larger */
+            c->card--;
+            bitmap_to_array(c);
+            return 1;
+        }
+        break;
+
+    case RUN:
+        i = run_lower_bound(c->u.runs, c->n, v);
+        r = c->u.runs;
+        if (i == c->n || r[i].start > v) {
+            return 0;
+        }
+        if (r[i].start == r[i].last) {
+            memmove(r + i, r + i + 1, (c->n - i - 1) * sizeof(*r));
+            c->n--;
+        } else if (r[i].start == v) {
+            r[i].start++;
+        } else if (r[i].last == v) {
+            r[i].last--;
+        } else {
+            /* Split the run around v */
+            if (runs_grow(c, c->n + 1)) {
+                return -1;
+            }
+            r = c->u.runs;
+            memmove(r + i + 1, r + i, (c->n - i) * sizeof(*r));
+            r[i].last = (uint16_t)(v - 1);
+            r[i + 1].start = (uint16_t)(v + 1);
+            c->n++;
+        }
+        break;
+    }
+    c->card--;
+    return 1;
+}
+
+/* Add the values from a to b inclusive to a run container */
+static int runs_add_range(struct roaring_container *c, uint32_t a,
+                          uint32_t b)
+{
+    struct run *r = c->u.runs;
+    size_t i, j;
+    uint32_t card = 0;
+
+    /* Runs i to j - 1 overlap or touch the new one */
+    i = run_lower_bound(r, c->n, a > 0 ? a - 1 : 0);
+    for (j = i; j < c->n && r[j].start <= b + 1; j++) {
+    }
+
+    if (i == j) {
+        if (runs_grow(c, c->n + 1)) {
+            return -1;
+        }
+        r = c->u.runs;
+        memmove(r + i + 1, r + i, (c->n - i) * sizeof(*r));
+        r[i].start = (uint16_t)a;
+        r[i].last = (uint16_t)b;
+        c->n++;
+    } else {
+        if (r[i].start > a) {
+            r[i].start = (uint16_t)a;
+        }
+        r[i].last = (uint16_t)(r[j - 1].last > b ? r[j - 1].last : b);
+        memmove(r + i + 1, r + j, (c->n - j) * sizeof(*r));
+        c->n -= (uint32_t)(j - i - 1);
+    }
+
+    for (i = 0; i < c->n; i++) {
+        card += r[i].last - r[i].start + 1U;
+    }
+    c->card = card;
+    return 0;
+}
+
+static int cont_add_range(struct roaring_container *c, uint32_t a,
+                          uint32_t b)
+{
+    if (c->card == 0) {
+        /* A new container */
+        if (runs_grow(c, 1)) {
+            return -1;
+        }
+        c->type = RUN;
+        c->u.runs[0].start = (uint16_t)a;
+        c->u.runs[0].last = (uint16_t)b;
+        c->n = 1;
+        c->card = b - a + 1;
+        return 0;
+    }
+    if (c->type == BITMAP) {
+        range_set(c->u.bitmap, a, b, 1);
+        c->card = (uint32_t)bitset_words_count(c->u.bitmap, BITMAP_WORDS);
+        return 0;
+    }
+    if ((c->type == ARRAY && to_runs(c)) || runs_add_range(c, a, b)) {
+        return -1;
+    }
+
+    /* Adding to scattered values may leave more runs than are worth it */
+    if (runs_size(c->n) > plain_size(c->card)) {
+        from_runs(c);
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Container operations
+ *
+ * Each writes its result to out, which need not be initialized, and
+ * returns 0 or -1. An empty result has a cardinality of 0 and holds no
+ * memory.
+ *********************************************************************/
+static void cont_empty(struct roaring_container *c)
+{
+    memset(c, 0, sizeof(*c));
+    c->type = ARRAY;
+}
+
+/* Take an array result of n values, freeing it if it is empty */
+static void array_result(struct roaring_container *out, uint16_t *a,
+                         uint32_t n)
+{
+    cont_empty(out);
+    if (n == 0) {
+        free(a);
+        return;
+    }
+    out->u.array = a;
+    out->n = out->cap = out->card = n;
+}
+
+/*
+ * Intersect sorted arrays, storing the result in out unless it is NULL,
+ * and return its length. When one array is much shorter, each of its
+ * values is looked for in the other with steps that double in size, so
+ * that the cost depends mostly on the shorter array.
+ */
+static uint32_t intersect(const uint16_t *a, size_t na, const uint16_t *b,
+                          size_t nb, uint16_t *out)
+{
+    const uint16_t *t;
+    size_t i = 0, j = 0, step;
+    uint32_t n = 0;
+
+    if (na > nb) {
+        t = a, a = b, b = t;
+        step = na, na = nb, nb = step;
+    }
+
+    if (na * 32 < nb) {
+        for (i = 0; i < na && j < nb; i++) {
+            for (step = 1; j + step < nb && b[j + step] < a[i]; step *= 2) {
+            }
+            j += lower_bound(b + j, (j + step < nb ? step + 1 : nb - j),
+                             a[i]);
+            if (j < nb && b[j] == a[i]) {
+                if (out) {
+                    out[n] = a[i];
+                }
+                n++;
+            }
+        }
+        return n;
+    }
+
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) {
+            i++;
+        } else if (a[i] > b[j]) {
+            j++;
+        } else {
+            if (out) {
+                out[n] = a[i];
+            }
+            n++;
+            i++;
+            j++;
+        }
+    }
+    return n;
+}
+
+/*
+ * Values of the array a that are (keep = 1) or are not (keep = 0) in c,
+ * which is a bitmap or runs.
+ */
+static uint32_t filter(const uint16_t *a, size_t na,
+                       const struct roaring_container *c, int keep,
+                       uint16_t *out)
+{
+    const struct run *r = c->u.runs;
+    size_t i, j = 0;
+    uint32_t n = 0;
+    int in;
+
+    for (i = 0; i < na; i++) {
+        if (c->type == BITMAP) {
+            in = bit_test(c->u.bitmap, a[i]);
+        } else if (c->type == ARRAY) {
+            while (j < c->n && c->u.array[j] < a[i]) {
+                j++;
+            }
+            in = j < c->n && c->u.array[j] == a[i];
+        } else {
+            while (j < c->n && r[j].last < a[i]) {
+                j++;
+            }
+            in = j < c->n && r[j].start <= a[i];
+        }
+        if (in == keep) {
+            if (out) {
+                out[n] = a[i];
+            }
+            n++;
+        }
+    }
+    return n;
+}
+
+/* Order a pair of operands of a symmetric operation by type */
+#define ORDER(a, b)                                                     \
+    do {                                                                \
+        if ((a)->type > (b)->type) {                                    \
+            const struct roaring_container *__t = (a);                  \
+            (a) = (b);                                                  \
+            (b) = __t;                                                  \
+        }                                                               \
+    } while (0)
+
+/* Apply the values of c to the bitmap w, setting or clearing them */
+static void apply(uint64_t *w, const struct roaring_container *c, int set)
+{
+    uint32_t i;
+
+    if (c->type == BITMAP) {
+        if (set) {
+            bitset_words_or(w, c->u.bitmap, BITMAP_WORDS);
+        } else {
+            bitset_words_andnot(w, c->u.bitmap, BITMAP_WORDS);
+        }
+        return;
+    }
+    for (i = 0; i < c->n; i++) {
+        if (c->type == RUN) {
+            range_set(w, c->u.runs[i].start, c->u.runs[i].last, set);
+        } else if (set) {
+            bit_set(w, c->u.array[i]);
+        } else {
+            bit_clear(w, c->u.array[i]);
+        }
+    }
+}
+
+/* Keep only the bits of w inside the runs of c */
+static void mask_runs(uint64_t *w, const struct roaring_container *c)
+{
+    uint32_t i, from = 0;
+
+    for (i = 0; i < c->n; i++) {
+        if (c->u.runs[i].start > from) {
+            range_set(w, from, c->u.runs[i].start - 1U, 0);
+        }
+        from = c->u.runs[i].last + 1U;
+    }
+    if (from < 65536) {
+        range_set(w, from, 65535, 0);
+    }
+}
+
+/* Intersect or join runs, giving runs */
+static int runs_op(const struct roaring_container *a,
+                   const struct roaring_container *b, int join,
+                   struct roaring_container *out)
+{
+    const struct run *ra = a->u.runs, *rb = b->u.runs, *next;
+    size_t i = 0, j = 0;
+    uint32_t n = 0, card = 0, lo, hi;
+    struct run *r;
+
+    cont_empty(out);
+    r = malloc((a->n + b->n) * sizeof(*r));
+    if (r == NULL) {
+        return -1;
+    }
+
+    while (i < a->n || j < b->n) {
+        if (!join && (i == a->n || j == b->n)) {
+            break;
+        }
+        if (join) {
+            /* Take runs in order of start, merging those that touch */
+            if (j == b->n || (i < a->n && ra[i].start <= rb[j].start)) {
+                next = &ra[i++];
+            } else {
+                next = &rb[j++];
+            }
+            if (n > 0 && next->start <= r[n - 1].last + 1U) {
+                if (next->last > r[n - 1].last) {
+                    card += next->last - r[n - 1].last;
+                    r[n - 1].last = next->last;
+                }
+            } else {
+                r[n++] = *next;
+                card += next->last - next->start + 1U;
+            }
+            continue;
+        }
+        lo = ra[i].start > rb[j].start ? ra[i].start : rb[j].start;
+        hi = ra[i].last < rb[j].last ? ra[i].last : rb[j].last;
+        if (lo <= hi) {
+            r[n].start = (uint16_t)lo;
+            r[n].last = (uint16_t)hi;
+            n++;
+            card += hi - lo + 1;
+        }
+        if (ra[i].last < rb[j].last) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+
+    if (n == 0) {
+        free(r);
+        return 0;
+    }
+    out->u.runs = r;
+    out->type = RUN;
+    out->n = out->cap = n;
+    out->card = card;
+    return 0;
+}
+
+static int cont_and(const struct roaring_container *a,
+                    const struct roaring_container *b,
+                    struct roaring_container *out)
+{
+    uint16_t *r;
+    uint64_t *w;
+    uint32_t n;
+
+    ORDER(a, b);
+    if (a->type == RUN) {
+        return runs_op(a, b, 0, out);
+    }
+
+    if (a->type == ARRAY) {
+        r = malloc(a->n * sizeof(*r));
+        if (r == NULL) {
+            return -1;
+        }
+        if (b->type == ARRAY) {
+            n = intersect(a->u.array, a->n, b->u.array, b->n, r);
+        } else {
+            n = filter(a->u.array, a->n, b, 1, r);
+        }
+        array_result(out, r, n);
+        return 0;
+    }
+
+    /* A bitmap, and a bitmap or runs */
+    w = malloc(BITMAP_WORDS * sizeof(*w));
+    if (w == NULL) {
+        return -1;
+    }
+    memcpy(w, a->u.bitmap, BITMAP_WORDS * sizeof(*w));
+    if (b->type == BITMAP) {
+        bitset_words_and(w, b->u.bitmap, BITMAP_WORDS);
+    } else {
+        mask_runs(w, b);
+    }
+    return cont_from_words(out, w);
+}
+
+static uint32_t cont_and_card(const struct roaring_container *a,
+                              const struct roaring_container *b)
+{
+    uint32_t i, j, lo, hi, card = 0;
+
+    ORDER(a, b);
+    if (a->type == ARRAY) {
+        if (b->type == ARRAY) {
+            return intersect(a->u.array, a->n, b->u.array, b->n, NULL);
+        }
+        return filter(a->u.array, a->n, b, 1, NULL);
+    }
+    if (a->type == BITMAP && b->type == BITMAP) {
+        return (uint32_t)bitset_words_and_count(a->u.bitmap, b->u.bitmap,
+                                                BITMAP_WORDS);
+    }
+    if (a->type == BITMAP) {
+        for (i = 0; i < b->n; i++) {
+            card += (uint32_t)range_count(a->u.bitmap, b->u.runs[i].start,
+                                          b->u.runs[i].last);
+        }
+        return card;
+    }
+    for (i = 0, j = 0; i < a->n && j < b->n;) {
+        lo = a->u.runs[i].start > b->u.runs[j].start ?
+             a->u.runs[i].start : b->u.runs[j].start;
+        hi = a->u.runs[i].last < b->u.runs[j].last ?
+             a->u.runs[i].last : b->u.runs[j].last;
+        if (lo <= hi) {
+            card += hi - lo + 1;
+        }
+        if (a->u.runs[i].last < b->u.runs[j].last) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    return card;
+}
+
+static int cont_or(const struct roaring_container *a,
+                   const struct roaring_container *b,
+                   struct roaring_container *out)
+{
+    size_t i = 0, j = 0;
+    uint32_t n = 0;
+    uint16_t *r;
+    uint64_t *w;
+
+    ORDER(a, b);
+    if (a->card == 65536) {
+        return cont_copy(out, a);
+    }
+    if (b->card == 65536) {
+        return cont_copy(out, b);
+    }
+    if (a->type == RUN) {
+        return runs_op(a, b, 1, out);
+    }
+
+    if (b->type == ARRAY && a->n + b->n <= ARRAY_MAX) {
+        r = malloc((a->n + b->n) * sizeof(*r));
+        if (r == NULL) {
+            return -1;
+        }
+        while (i < a->n || j < b->n) {
+            if (j == b->n || (i < a->n && a->u.array[i] < b->u.array[j])) {
+                r[n++] = a->u.array[i++];
+            } else if (i == a->n || b->u.array[j] < a->u.array[i]) {
+                r[n++] = b->u.array[j++];
+            } else {
+                r[n++] = a->u.array[i++];
+                j++;
+            }
+        }
+        array_result(out, r, n);
+        return 0;
+    }
+
+    /* Start from the container that needs less work to add */
+    w = malloc(BITMAP_WORDS * sizeof(*w));
+    if (w == NULL) {
+        return -1;
+    }
+    if (a->type == BITMAP || b->type != BITMAP) {
+        to_words(a, w);
+        apply(w, b, 1);
+    } else {
+        to_words(b, w);
+        apply(w, a, 1);
+    }
+    return cont_from_words(out, w);
+}
+
+/* Values of a that are not in b */
+static int cont_andnot(const struct roaring_container *a,
+                       const struct roaring_container *b,
+                       struct roaring_container *out)
+{
+    uint16_t *r;
+    uint64_t *w;
+
+    if (a->type == ARRAY) {
+        r = malloc(a->n * sizeof(*r));
+        if (r == NULL) {
+            return -1;
+        }
+        array_result(out, r, filter(a->u.array, a->n, b, 0, r));
+        return 0;
+    }
+
+    w = malloc(BITMAP_WORDS * sizeof(*w));
+    if (w == NULL) {
+        return -1;
+    }
+    to_words(a, w);
+    apply(w, b, 0);
+    return cont_from_words(out, w);
+}
+
+/**********************************************************************
+ * Bitmaps
+ *********************************************************************/
+void roaring_init(struct roaring *r)
+{
+    r->keys = NULL;
+    r->containers = NULL;
+    r->size = 0;
+    r->cap = 0;
+}
+
+void roaring_clear(struct roaring *r)
+{
+    size_t i;
+
+    for (i = 0; i < r->size; i++) {
+        cont_free(&r->containers[i]);
+    }
+    r->size = 0;
+}
+
+void roaring_destroy(struct roaring *r)
+{
+    roaring_clear(r);
+    free(r->keys);
+    free(r->containers);
+    roaring_init(r);
+}
+
+static int reserve(struct roaring *r, size_t n)
+{
+    size_t cap = r->cap ? r->cap : 4;
+    struct roaring_container *c;
+    uint16_t *k;
+
+    if (n <= r->cap) {
+        return 0;
+    }
+    while (cap < n) {
+        cap *= 2;
+    }
+    k = realloc(r->keys, cap * sizeof(*k));
+    if (k == NULL) {
+        return -1;
+    }
+    r->keys = k;
+    c = realloc(r->containers, cap * sizeof(*c));
+    if (c == NULL) {
+        return -1;
+    }
+    r->containers = c;
+    r->cap = cap;
+    return 0;
+}
+
+/* Index of the container for key, or where it would go */
+static size_t find(const struct roaring *r, uint32_t key, int *found)
+{
+    size_t i;
+
+    /* Sorted input goes to the last container, or after it */
+    if (r->size > 0 && r->keys[r->size - 1] <= key) {
+        i = r->size - 1;
+        *found = r->keys[i] == key;
+        return *found ? i : r->size;
+    }
+    i = lower_bound(r->keys, r->size, key);
+    *found = i < r->size && r->keys[i] == key;
+    return i;
+}
+
+/* The container for key, created empty if need be, or NULL */
+static struct roaring_container *get(struct roaring *r, uint32_t key,
+                                     size_t *index)
+{
+    int found;
+    size_t i = find(r, key, &found);
+
+    if (!found) {
+        if (reserve(r, r->size + 1)) {
+            return NULL;
+        }
+        memmove(r->keys + i + 1, r->keys + i,
+                (r->size - i) * sizeof(*r->keys));
+        memmove(r->containers + i + 1, r->containers + i,
+                (r->size - i) * sizeof(*r->containers));
+        r->keys[i] = (uint16_t)key;
+        cont_empty(&r->containers[i]);
+        r->size++;
+    }
+    *index = i;
+    return &r->containers[i];
+}
+
+/* Drop the container at i if it is empty */
+static void prune(struct roaring *r, size_t i)
+{
+    if (r->containers[i].card > 0) {
+        return;
+    }
+    cont_free(&r->containers[i]);
+    memmove(r->keys + i, r->keys + i + 1,
+            (r->size - i - 1) * sizeof(*r->keys));
+    memmove(r->containers + i, r->containers + i + 1,
+            (r->size - i - 1) * sizeof(*r->containers));
+    r->size--;
+}
+
+int roaring_add(struct roaring *r, uint32_t v)
+{
+    struct roaring_container *c;
+    size_t i;
+    int rc;
+
+    c = get(r, v >> 16, &i);
+    if (c == NULL) {
+        return -1;
+    }
+    rc = cont_add(c, v & 0xffff);
+    if (rc < 0) {
+        prune(r, i);
+        return -1;
+    }
+    return 0;
+}
+
+int roaring_add_many(struct roaring *r, const uint32_t *v, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (roaring_add(r, v[i])) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int roaring_add_range(struct roaring *r, uint32_t first, uint32_t last)
+{
+    struct roaring_container *c;
+    uint32_t key, a, b;
+    size_t i;
+
+    if (first > last) {
+        return 0;
+    }
+    for (key = first >> 16; key <= last >> 16; key++) {
+        a = key == first >> 16 ? first & 0xffff : 0;
+        b = key == last >> 16 ? last & 0xffff : 0xffff;
+        c = get(r, key, &i);
+        if (c == NULL) {
+            return -1;
+        }
+        if (cont_add_range(c, a, b)) {
+            prune(r, i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int roaring_remove(struct roaring *r, uint32_t v)
+{
+    int found, rc;
+    size_t i = find(r, v >> 16, &found);
+
+    if (!found) {
+        return 0;
+    }
+    rc = cont_remove(&r->containers[i], v & 0xffff);
+    prune(r, i);
+    return rc;
+}
+
+int roaring_contains(const struct roaring *r, uint32_t v)
+{
+    int found;
+    size_t i = find(r, v >> 16, &found);
+
+    return found && cont_contains(&r->containers[i], v & 0xffff);
+}
+
+uint64_t roaring_cardinality(const struct roaring *r)
+{
+    uint64_t card = 0;
+    size_t i;
+
+    for (i = 0; i < r->size; i++) {
+        card += r->containers[i].card;
+    }
+    return card;
+}
+
+size_t roaring_to_array(const struct roaring *r, uint32_t *out)
+{
+    const struct roaring_container *c;
+    uint32_t high, j, v;
+    size_t i, n = 0;
+    uint64_t x;
+
+    for (i = 0; i < r->size; i++) {
+        c = &r->containers[i];
+        high = (uint32_t)r->keys[i] << 16;
+        if (c->type == ARRAY) {
+            for (j = 0; j < c->n; j++) {
+                out[n++] = high | c->u.array[j];
+            }
+        } else if (c->type == BITMAP) {
+            for (j = 0; j < BITMAP_WORDS; j++) {
+                for (x = c->u.bitmap[j]; x != 0; x &= x - 1) {
+                    out[n++] = high | (j * 64 +
+                                       (uint32_t)__builtin_ctzll(x));
+                }
+            }
+        } else {
+            for (j = 0; j < c->n; j++) {
+                for (v = c->u.runs[j].start; v <= c->u.runs[j].last; v++) {
+                    out[n++] = high | v;
+                }
+            }
+        }
+    }
+    return n;
+}
+
+enum { OP_AND, OP_OR, OP_ANDNOT };
+
+static int binary_op(struct roaring *dst, const struct roaring *a,
+                     const struct roaring *b, int op)
+{
+    struct roaring t;
+    struct roaring_container out;
+    size_t i = 0, j = 0;
+    uint32_t ka, kb, key;
+    int rc;
+
+    roaring_init(&t);
+    if (reserve(&t, op == OP_OR ? a->size + b->size : a->size)) {
+        roaring_destroy(&t);
+        return -1;
+    }
+
+    while (i < a->size || (op == OP_OR && j < b->size)) {
+        ka = i < a->size ? a->keys[i] : 0x10000;
+        kb = j < b->size ? b->keys[j] : 0x10000;
+        if (ka == kb) {
+            key = ka;
+            if (op == OP_AND) {
+                rc = cont_and(&a->containers[i++], &b->containers[j++], &out);
+            } else if (op == OP_OR) {
+                rc = cont_or(&a->containers[i++], &b->containers[j++], &out);
+            } else {
+                rc = cont_andnot(&a->containers[i++], &b->containers[j++],
+                                 &out);
+            }
+        } else if (ka < kb) {
+            key = ka;
+            if (op == OP_AND) {
+                i++;
+                continue;
+            }
+            rc = cont_copy(&out, &a->containers[i++]);
+        } else {
+            key = kb;
+            if (op != OP_OR) {
+                j++;
+                continue;
+            }
+            rc = cont_copy(&out, &b->containers[j++]);
+        }
+        if (rc) {
+            roaring_destroy(&t);
+            return -1;
+        }
+        if (out.card > 0) {
+            t.keys[t.size] = (uint16_t)key;
+            t.containers[t.size++] = out;
+        }
+    }
+
+    roaring_destroy(dst);
+    *dst = t;
+    return 0;
+}
+
+int roaring_and(struct roaring *dst, const struct roaring *a,
+                const struct roaring *b)
+{
+    return binary_op(dst, a, b, OP_AND);
+}
+
+int roaring_or(struct roaring *dst, const struct roaring *a,
+               const struct roaring *b)
+{
+    return binary_op(dst, a, b, OP_OR);
+}
+
+int roaring_andnot(struct roaring *dst, const struct roaring *a,
+                   const struct roaring *b)
+{
+    return binary_op(dst, a, b, OP_ANDNOT);
+}
+
+uint64_t roaring_and_cardinality(const struct roaring *a,
+                                 const struct roaring *b)
+{
+    uint64_t card = 0;
+    size_t i = 0, j = 0;
+
+    while (i < a->size && j < b->size) {
+        if (a->keys[i] < b->keys[j]) {
+            i++;
+        } else if (a->keys[i] > b->keys[j]) {
+            j++;
+        } else {
+            card += cont_and_card(&a->containers[i++], &b->containers[j++]);
+        }
+    }
+    return card;
+}
+
+int roaring_run_optimize(struct roaring *r)
+{
+    struct roaring_container *c;
+    size_t i;
+    int rc;
+
+    for (i = 0; i < r->size; i++) {
+        c = &r->containers[i];
+        if (c->type == RUN) {
+            rc = plain_size(c->card) < runs_size(c->n) ? from_runs(c) : 0;
+        } else {
+            rc = runs_size(count_runs(c)) < plain_size(c->card) ?
+                 to_runs(c) : 0;
+        }
+        if (rc) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Serialization
+ *
+ * A 32-bit cookie, which also holds the number of containers if there
+ * are runs, followed by a bitmap of which containers are runs, or
+ * otherwise by the number of containers. Then the key and cardinality
+ * minus one of each container, as 16-bit values, and, unless there are
+ * runs and fewer than NO_OFFSET_THRESHOLD containers, the offset of each
+ * container from the start. Then the containers: arrays of 16-bit
+ * values, bitmaps of 1024 64-bit words, and runs as a 16-bit count and
+ * a start and length minus one for each. Everything is little endian.
+ *********************************************************************/
+#define SERIAL_COOKIE_NO_RUNS   12346
+#define SERIAL_COOKIE           12347
+#define NO_OFFSET_THRESHOLD     4
+
+static unsigned char *put16(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    return p + 2;
+}
+
+static unsigned char *put32(unsigned char *p, uint32_t v)
+{
+    return put16(put16(p, v & 0xffff), v >> 16);
+}
+
+static uint32_t get16(const unsigned char *p)
+{
+    return p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+    return get16(p) | (get16(p + 2) << 16);
+}
+
+static int has_runs(const struct roaring *r)
+{
+    size_t i;
+
+    for (i = 0; i < r->size; i++) {
+        if (r->containers[i].type == RUN) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static size_t header_size(const struct roaring *r, int runs)
+{
+    size_t n = runs ? 4 + (r->size + 7) / 8 : 8;
+
+    n += 4 * r->size;
+    if (!runs || r->size >= NO_OFFSET_THRESHOLD) {
+        n += 4 * r->size;
+    }
+    return n;
+}
+
+static size_t cont_serialized_size(const struct roaring_container *c)
+{
+    return c->type == RUN ? runs_size(c->n) : plain_size(c->card);
+}
+
+size_t roaring_serialized_size(const struct roaring *r)
+{
+    size_t i, n = header_size(r, has_runs(r));
+
+    for (i = 0; i < r->size; i++) {
+        n += cont_serialized_size(&r->containers[i]);
+    }
+    return n;
+}
+
+size_t roaring_serialize(const struct roaring *r, void *buf)
+{
+    const struct roaring_container *c;
+    unsigned char *start = buf, *p = buf;
+    int runs = has_runs(r);
+    size_t i, j, offset;
+    uint64_t x;
+
+    if (runs) {
+        p = put32(p, SERIAL_COOKIE | (uint32_t)((r->size - 1) << 16));
+        memset(p, 0, (r->size + 7) / 8);
+        for (i = 0; i < r->size; i++) {
+            if (r->containers[i].type == RUN) {
+                p[i / 8] |= (unsigned char)(1 << (i % 8));
+            }
+        }
+        p += (r->size + 7) / 8;
+    } else {
+        p = put32(p, SERIAL_COOKIE_NO_RUNS);
+        p = put32(p, (uint32_t)r->size);
+    }
+    for (i = 0; i < r->size; i++) {
+        p = put16(p, r->keys[i]);
+        p = put16(p, r->containers[i].card - 1);
+    }
+    if (!runs || r->size >= NO_OFFSET_THRESHOLD) {
+        offset = header_size(r, runs);
+        for (i = 0; i < r->size; i++) {
+            p = put32(p, (uint32_t)offset);
+            offset += cont_serialized_size(&r->containers[i]);
+        }
+    }
+
+    for (i = 0; i < r->size; i++) {
+        c = &r->containers[i];
+        if (c->type == RUN) {
+            p = put16(p, c->n);
+            for (j = 0; j < c->n; j++) {
+                p = put16(p, c->u.runs[j].start);
+                p = put16(p, (uint32_t)(c->u.runs[j].last -
+                                        c->u.runs[j].start));
+            }
+        } else if (c->type == ARRAY) {
+            for (j = 0; j < c->n; j++) {
+                p = put16(p, c->u.array[j]);
+            }
+        } else if (c->card > ARRAY_MAX) {
+            for (j = 0; j < BITMAP_WORDS; j++) {
+                p = put32(p, (uint32_t)c->u.bitmap[j]);
+                p = put32(p, (uint32_t)(c->u.bitmap[j] >> 32));
+            }
+        } else {
+            /* A bitmap that could not be made an array when it shrank */
+            for (j = 0; j < BITMAP_WORDS; j++) {
+                for (x = c->u.bitmap[j]; x != 0; x &= x - 1) {
+                    p = put16(p, (uint32_t)j * 64 +
+                                 (uint32_t)__builtin_ctzll(x));
+                }
+            }
+        }
+    }
+    return (size_t)(p - start);
+}
+
+/*
+ * Read one container of the given cardinality from p[0..end), returning
+ * the end of it, or NULL with errno set to EINVAL or ENOMEM.
+ */
+static const unsigned char *read_container(struct roaring_container *c,
+                                           const unsigned char *p,
+                                           const unsigned char *end,
+                                           int run, uint32_t card)
+{
+    uint32_t i, n, start, last, total = 0;
+
+    if (run) {
+        if (end - p < 2) {
+            goto einval;
+        }
+        n = get16(p);
+        p += 2;
+        if (n > RUNS_MAX || (size_t)(end - p) < 4 * (size_t)n) {
+            goto einval;
+        }
+        if (runs_grow(c, n)) {
+            return NULL;
+        }
+        c->type = RUN;
+        for (i = 0; i < n; i++, p += 4) {
+            start = get16(p);
+            last = start + get16(p + 2);
+            if (last > 0xffff || (i > 0 && start <= c->u.runs[i - 1].last)) {
+                goto einval;
+            }
+            c->u.runs[i].start = (uint16_t)start;
+            c->u.runs[i].last = (uint16_t)last;
+            c->n++;
+            total += last - start + 1;
+        }
+    } else if (card <= ARRAY_MAX) {
+        if ((size_t)(end - p) < 2 * (size_t)card) {
+            goto einval;
+        }
+        if (array_grow(c, card)) {
+            return NULL;
+        }
+        for (i = 0; i < card; i++, p += 2) {
+            c->u.array[i] = (uint16_t)get16(p);
+            if (i > 0 && c->u.array[i] <= c->u.array[i - 1]) {
+                goto einval;
+            }
+            c->n++;
+        }
+        total = card;
+    } else {
+        if (end - p < 8192) {
+            goto einval;
+        }
+        c->u.bitmap = malloc(BITMAP_WORDS * sizeof(uint64_t));
+        if (c->u.bitmap == NULL) {
+            return NULL;
+        }
+        c->type = BITMAP;
+        for (i = 0; i < BITMAP_WORDS; i++, p += 8) {
+            c->u.bitmap[i] = get32(p) | ((uint64_t)get32(p + 4) << 32);
+        }
+        total = (uint32_t)bitset_words_count(c->u.bitmap, BITMAP_WORDS);
+    }
+
+    c->card = total;
+    if (total == card) {
+        return p;
+    }
+
+einval:
+    errno = EINVAL;
+    return NULL;
+}
+
+ssize_t roaring_deserialize(struct roaring *r, const void *buf, size_t len)
+{
+    const unsigned char *start = buf, *p = buf, *end = p + len;
+    const unsigned char *runflags = NULL, *header;
+    struct roaring t;
+    uint32_t cookie;
+    size_t n, i;
+    int run;
+
+    if (len < 4) {
+        goto einval;
+    }
+    cookie = get32(p);
+    p += 4;
+    if ((cookie & 0xffff) == SERIAL_COOKIE) {
+        n = (cookie >> 16) + 1;
+        runflags = p;
+        if ((size_t)(end - p) < (n + 7) / 8) {
+            goto einval;
+        }
+        p += (n + 7) / 8;
+    } else if (cookie == SERIAL_COOKIE_NO_RUNS && len >= 8) {
+        n = get32(p);
+        p += 4;
+    } else {
+        goto einval;
+    }
+    if (n > 65536 || (size_t)(end - p) < 4 * n) {
+        goto einval;
+    }
+    header = p;
+    p += 4 * n;
+    if (runflags == NULL || n >= NO_OFFSET_THRESHOLD) {
+        if ((size_t)(end - p) < 4 * n) {
+            goto einval;
+        }
+        p += 4 * n;
+    }
+
+    roaring_init(&t);
+    if (reserve(&t, n)) {
+        roaring_destroy(&t);
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        t.keys[i] = (uint16_t)get16(header + 4 * i);
+        cont_empty(&t.containers[i]);
+        t.size++;
+        if (i > 0 && t.keys[i] <= t.keys[i - 1]) {
+            roaring_destroy(&t);
+            goto einval;
+        }
+        run = runflags != NULL && ((runflags[i / 8] >> (i % 8)) & 1);
+        p = read_container(&t.containers[i], p, end, run,
+                           get16(header + 4 * i + 2) + 1);
+        if (p == NULL) {
+            roaring_destroy(&t);
+            return -1;
+        }
+    }
+
+    roaring_destroy(r);
+    *r = t;
+    return p - start;
+
+einval:
+    errno = EINVAL;
+    return -1;
+}
@@ -0,0 +1,197 @@
+/**********************************************************************
+ * Roaring bitmaps
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * A compressed set of 32-bit integers, after S. Chambi, D. Lemire, O.
+ * Kaser and R. Godin, "Better bitmap performance with Roaring bitmaps"
+ * (2016). Values are split on their high 16 bits into containers, each
+ * holding the low 16 bits of up to 65536 values in whichever of three
+ * forms suits them:
+ *
+ *      array       A sorted array of up to 4096 values
+ *      bitmap      A 65536 bit bitmap, for more than 4096 values
+ *      run         Sorted runs of consecutive values
+ *
+ * Sets are kept as arrays and bitmaps as values are added, and run
+ * containers come from roaring_add_range, or from roaring_run_optimize
+ * where they are smaller. Set operations work a container at a time:
+ * bitmaps are combined with the vector kernels of bitset.h, arrays are
+ * merged, or searched by doubling steps when one is much shorter than
+ * the other, and the result takes the form that fits its cardinality.
+ *
+ * The serialized form is the portable format shared by the Java, Go and
+ * C implementations (github.com/RoaringBitmap/RoaringFormatSpec), so
+ * bitmaps can be exchanged with them.
+ *
+ * Usage:
+ *      struct roaring a, b;
+ *
+ *      roaring_init(&a);
+ *      roaring_init(&b);
+ *      roaring_add_many(&a, postings_a, na);
+ *      roaring_add_many(&b, postings_b, nb);
+ *      roaring_and(&a, &a, &b);
+ *      n = roaring_to_array(&a, out);
+ *      roaring_destroy(&a);
+ *      roaring_destroy(&b);
+ *
+ * C++ code can use lub::roaring, defined at the end of this file.
+ *********************************************************************/
+
+#ifndef __ROARING_H
+#define __ROARING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+struct roaring_container;
+
+struct roaring {
+    uint16_t *keys;             /* High 16 bits of each container's values */
+    struct roaring_container *containers;
+    size_t size;                /* Containers in use */
+    size_t cap;
+};
+
+/* Initialize an empty bitmap. No memory is allocated until the first add */
+void roaring_init(struct roaring *r);
+
+/* Release all memory held by the bitmap */
+void roaring_destroy(struct roaring *r);
+
+/* Remove all values */
+void roaring_clear(struct roaring *r);
+
+/* Add v. Returns 0, or -1 with errno set to ENOMEM */
+int roaring_add(struct roaring *r, uint32_t v);
+
+/* Add n values, in any order, though sorted input is fastest */
+int roaring_add_many(struct roaring *r, const uint32_t *v, size_t n);
+
+/* Add every value from first to last inclusive, as runs */
+int roaring_add_range(struct roaring *r, uint32_t first, uint32_t last);
+
+/*
+ * Remove v. Returns 1 if it was present, 0 if it was not, or -1 with
+ * errno set to ENOMEM if a run had to be split and there was no memory.
+ */
+int roaring_remove(struct roaring *r, uint32_t v);
+
+int roaring_contains(const struct roaring *r, uint32_t v);
+
+/* Number of values in the bitmap */
+uint64_t roaring_cardinality(const struct roaring *r);
+
+/* Store the values in increasing order; out needs room for all of them */
+size_t roaring_to_array(const struct roaring *r, uint32_t *out);
+
+/*
+ * Set dst to the intersection, union, or difference (a without b) of a
+ * and b. dst must have been initialized, and its old contents are
+ * replaced; it may be a or b. Each returns 0, or -1 with errno set to
+ * ENOMEM, leaving dst unchanged.
+ */
+int roaring_and(struct roaring *dst, const struct roaring *a,
+                const struct roaring *b);
+int roaring_or(struct roaring *dst, const struct roaring *a,
+               const struct roaring *b);
+int roaring_andnot(struct roaring *dst, const struct roaring *a,
+                   const struct roaring *b);
+
+/* Size of the intersection of a and b, without building it */
+uint64_t roaring_and_cardinality(const struct roaring *a,
+                                 const struct roaring *b);
+
+/*
+ * Convert each container to runs if that makes it smaller, or from runs
+ * if it does not. Returns 0, or -1 with errno set to ENOMEM, in which
+ * case some containers may have been converted and others not.
+ */
+int roaring_run_optimize(struct roaring *r);
+
+/* Bytes needed by roaring_serialize */
+size_t roaring_serialized_size(const struct roaring *r);
+
+/* Write r in the portable format to buf, returning the bytes written */
+size_t roaring_serialize(const struct roaring *r, void *buf);
+
+/*
+ * Read a bitmap in the portable format from buf[0..len) into r, which
+ * must have been initialized, replacing its contents. Returns the bytes
+ * read, or -1 with errno set to EINVAL if the data is malformed or
+ * truncated, or to ENOMEM, leaving r unchanged.
+ */
+ssize_t roaring_deserialize(struct roaring *r, const void *buf, size_t len);
+
+__CDECL_END
+
+#ifdef __cplusplus
+#include <new>
+
+namespace lub {
+
+class roaring {
+    struct ::roaring r;
+
+    static void check(int rc)
+    {
+        if (rc < 0) {
+            throw std::bad_alloc();
+        }
+    }
+
+public:
+    roaring() { roaring_init(&r); }
+    ~roaring() { roaring_destroy(&r); }
+
+    roaring(const roaring &) = delete;
+    roaring &operator=(const roaring &) = delete;
+
+    void add(uint32_t v) { check(roaring_add(&r, v)); }
+    void add_range(uint32_t first, uint32_t last)
+    {
+        check(roaring_add_range(&r, first, last));
+    }
+    bool remove(uint32_t v)
+    {
+        int rc = roaring_remove(&r, v);
+
+        check(rc);
+        return rc != 0;
+    }
+
+    bool contains(uint32_t v) const { return roaring_contains(&r, v) != 0; }
+    uint64_t cardinality() const { return roaring_cardinality(&r); }
+    void run_optimize() { check(roaring_run_optimize(&r)); }
+
+    roaring &operator&=(const roaring &o)
+    {
+        check(roaring_and(&r, &r, &o.r));
+        return *this;
+    }
+
+    roaring &operator|=(const roaring &o)
+    {
+        check(roaring_or(&r, &r, &o.r));
+        return *this;
+    }
+
+    roaring &operator-=(const roaring &o)
+    {
+        check(roaring_andnot(&r, &r, &o.r));
+        return *this;
+    }
+
+    struct ::roaring *get() { return &r; }
+    const struct ::roaring *get() const { return &r; }
+};
+
+} /* namespace lub */
+#endif /* __cplusplus */
+
+#endif /* !defined __ROARING_H */
@@ -0,0 +1,220 @@
+/**********************************************************************
+ * Single producer, single consumer ring buffer
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * A lock free ring for passing fixed size elements from exactly one
+ * producer thread to exactly one consumer thread. The head index is
+ * written only by the producer and the tail only by the consumer, and
+ * each lives on its own cache line. Each side also keeps a cached copy
+ * of the other side's index, and only reloads it (taking a cache miss)
+ * when the cached value says the ring is full or empty.
+ *
+ * Elements are copied in and out of the ring, so a ring of pointers
+ * uses elem_size = sizeof(void *). The burst functions move as many
+ * elements as possible, up to n; the bulk functions move all n or
+ * nothing. All return the number of elements moved.
+ *
+ * The index updates use the GCC/Clang __atomic builtins, which follow
+ * the C11 memory model and also work when included from C++.
+ *
+ * Usage:
+ *      struct spsc_ring r;
+ *      spsc_ring_init(&r, 1024, sizeof(struct pkt *));
+ *      Producer:   spsc_ring_enqueue_burst(&r, pkts, npkts);
+ *      Consumer:   n = spsc_ring_dequeue_burst(&r, pkts, 32);
+ *********************************************************************/
+
+#ifndef __SPSC_RING_H
+#define __SPSC_RING_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "cdecl.h"
+#include "compiler.h"
+
+__CDECL_BEGIN
+
+struct spsc_ring {
+    /* Read only after init */
+    char *buf;
+    size_t mask;
+    size_t elem_size;
+
+    /* Producer */
+    size_t head __CACHELINE_ALIGNED;
+    size_t tail_cache;
+
+    /* Consumer */
+    size_t tail __CACHELINE_ALIGNED;
+    size_t head_cache;
+} __CACHELINE_ALIGNED;
+
+/*
+ * Initialize a ring holding at least count elements of elem_size bytes.
+ * count is rounded up to a power of 2. Returns 0 on success, or -1 with
+ * errno set on failure.
+ */
+static inline int spsc_ring_init(struct spsc_ring *r, size_t count,
+                                 size_t elem_size)
+{
+    size_t cap = 1;
+
+    if (count == 0 || elem_size == 0 || count > ((size_t)-1 >> 1)) {
+        errno = EINVAL;
+        return -1;
+    }
+    while (cap < count) {
+        cap <<= 1;
+    }
+    if (cap > (size_t)-1 / elem_size) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(r, 0, sizeof(*r));
+    r->buf = (char *)malloc(cap * elem_size);
+    if (r->buf == NULL) {
+        return -1;
+    }
+    r->mask = cap - 1;
+    r->elem_size = elem_size;
+    return 0;
+}
+
+static inline void spsc_ring_destroy(struct spsc_ring *r)
+{
+    free(r->buf);
+    r->buf = NULL;
+}
+
+static inline size_t spsc_ring_capacity(const struct spsc_ring *r)
+{
+    return r->mask + 1;
+}
+
+/* Number of elements in the ring. Only a snapshot if called concurrently */
+static inline size_t spsc_ring_count(const struct spsc_ring *r)
+{
+    size_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+    return head - tail;
+}
+
+/* Copy n elements between the ring (starting at index idx) and objs */
+static inline void __spsc_ring_copy_in(struct spsc_ring *r, size_t idx,
+                                       const void *objs, size_t n)
+{
+    size_t off = idx & r->mask;
+    size_t first = r->mask + 1 - off;
+
+    if (first > n) {
+        first = n;
+    }
+    memcpy(r->buf + off * r->elem_size, objs, first * r->elem_size);
+    memcpy(r->buf, (const char *)objs + first * r->elem_size,
+           (n - first) * r->elem_size);
+}
+
+static inline void __spsc_ring_copy_out(struct spsc_ring *r, size_t idx,
+                                        void *objs, size_t n)
+{
+    size_t off = idx & r->mask;
+    size_t first = r->mask + 1 - off;
+
+    if (first > n) {
+        first = n;
+    }
+    memcpy(objs, r->buf + off * r->elem_size, first * r->elem_size);
+    memcpy((char *)objs + first * r->elem_size, r->buf,
+           (n - first) * r->elem_size);
+}
+
+static inline size_t __spsc_ring_enqueue(struct spsc_ring *r,
+                                         const void *objs, size_t n,
+                                         int all)
+{
+    size_t head = r->head;
+    size_t cap = r->mask + 1;
+    size_t space = cap - (head - r->tail_cache);
+
+    if (__UNLIKELY(space < n)) {
+        r->tail_cache = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        space = cap - (head - r->tail_cache);
+        if (space < n) {
+            if (all || space == 0) {
+                return 0;
+            }
+            n = space;
+        }
+    }
+
+    __spsc_ring_copy_in(r, head, objs, n);
+    __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+static inline size_t __spsc_ring_dequeue(struct spsc_ring *r, void *objs,
+                                         size_t n, int all)
+{
+    size_t tail = r->tail;
+    size_t avail = r->head_cache - tail;
+
+    if (__UNLIKELY(avail < n)) {
+        r->head_cache = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        avail = r->head_cache - tail;
+        if (avail < n) {
+            if (all || avail == 0) {
+                return 0;
+            }
+            n = avail;
+        }
+    }
+
+    __spsc_ring_copy_out(r, tail, objs, n);
+    __atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+/* Producer side */
+static inline size_t spsc_ring_enqueue(struct spsc_ring *r, const void *obj)
+{
+    return __spsc_ring_enqueue(r, obj, 1, 1);
+}
+
+static inline size_t spsc_ring_enqueue_burst(struct spsc_ring *r,
+                                             const void *objs, size_t n)
+{
+    return __spsc_ring_enqueue(r, objs, n, 0);
+}
+
+static inline size_t spsc_ring_enqueue_bulk(struct spsc_ring *r,
+                                            const void *objs, size_t n)
+{
+    return __spsc_ring_enqueue(r, objs, n, 1);
+}
+
+/* Consumer side */
+static inline size_t spsc_ring_dequeue(struct spsc_ring *r, void *obj)
+{
+    return __spsc_ring_dequeue(r, obj, 1, 1);
+}
+
+static inline size_t spsc_ring_dequeue_burst(struct spsc_ring *r,
+                                             void *objs, size_t n)
+{
+    return __spsc_ring_dequeue(r, objs, n, 0);
+}
+
+static inline size_t spsc_ring_dequeue_bulk(struct spsc_ring *r,
+                                            void *objs, size_t n)
+{
+    return __spsc_ring_dequeue(r, objs, n, 1);
+}
+
+__CDECL_END
+
+#endif /* !defined __SPSC_RING_H */
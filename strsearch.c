@@ -0,0 +1,495 @@
+/**********************************************************************
+ * SIMD byte search
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Each kernel compares a whole vector of the input against the target
+ * bytes and reduces the result to a bitmask, whose lowest set bit gives
+ * the position of the first match. The AVX2 kernels are compiled with
+ * a target attribute, so this file does not need -mavx2, and are only
+ * selected by the cpu_features.h dispatcher if the CPU supports them.
+ *
+ * memmem uses the approach described by Wojciech Mula in "SIMD-friendly
+ * algorithms for substring searching": compare one vector against the
+ * first byte of the needle and a second, offset vector against the last
+ * byte, and only run memcmp at positions where both match.
+ *
+ * count accumulates the 0/-1 compare results in byte lanes, folding
+ * them into 64-bit lanes with a sum of absolute differences before the
+ * byte lanes can overflow.
+ *********************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include "compiler.h"
+#include "cpu_features.h"
+#include "strsearch.h"
+
+#if defined(__x86_64__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#define HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/**********************************************************************
+ * Scalar
+ *********************************************************************/
+static void *memchr2_scalar(const void *s, int c1, int c2, size_t n)
+{
+    const unsigned char *p = s;
+    unsigned char b1 = (unsigned char)c1;
+    unsigned char b2 = (unsigned char)c2;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (p[i] == b1 || p[i] == b2) {
+            return (void *)(p + i);
+        }
+    }
+    return NULL;
+}
+
+static void *memchr3_scalar(const void *s, int c1, int c2, int c3, size_t n)
+{
+    const unsigned char *p = s;
+    unsigned char b1 = (unsigned char)c1;
+    unsigned char b2 = (unsigned char)c2;
+    unsigned char b3 = (unsigned char)c3;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (p[i] == b1 || p[i] == b2 || p[i] == b3) {
+            return (void *)(p + i);
+        }
+    }
+    return NULL;
+}
+
+/* Search starting at position i, for when the vector loop runs out */
+static void *memmem_scalar_from(const unsigned char *h, size_t hlen,
+                                const unsigned char *n, size_t nlen,
+                                size_t i)
+{
+    const unsigned char *p;
+
+    while (i + nlen <= hlen) {
+        p = memchr(h + i, n[0], hlen - nlen + 1 - i);
+        if (p == NULL) {
+            return NULL;
+        }
+        if (memcmp(p + 1, n + 1, nlen - 1) == 0) {
+            return (void *)p;
+        }
+        i = (size_t)(p - h) + 1;
+    }
+    return NULL;
+}
+
+static void *memmem_scalar(const void *h, size_t hlen, const void *n,
+                           size_t nlen)
+{
+    return memmem_scalar_from(h, hlen, n, nlen, 0);
+}
+
+static size_t count_scalar(const void *s, int c, size_t n)
+{
+    const unsigned char *p = s;
+    unsigned char b = (unsigned char)c;
+    size_t count = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        count += p[i] == b;
+    }
+    return count;
+}
+
+#ifdef HAVE_X86
+/**********************************************************************
+ * SSE2
+ *********************************************************************/
+static void *memchr2_sse2(const void *s, int c1, int c2, size_t n)
+{
+    const unsigned char *p = s;
+    const unsigned char *end = p + n;
+    __m128i v1 = _mm_set1_epi8((char)c1);
+    __m128i v2 = _mm_set1_epi8((char)c2);
+    __m128i x;
+    unsigned int mask;
+
+    for (; end - p >= 16; p += 16) {
+        x = _mm_loadu_si128((const __m128i *)p);
+        mask = (unsigned int)_mm_movemask_epi8(
+                    _mm_or_si128(_mm_cmpeq_epi8(x, v1), _mm_cmpeq_epi8(x, v2)));
+        if (mask) {
+            return (void *)(p + __builtin_ctz(mask));
+        }
+    }
+    return memchr2_scalar(p, c1, c2, (size_t)(end - p));
+}
+
+static void *memchr3_sse2(const void *s, int c1, int c2, int c3, size_t n)
+{
+    const unsigned char *p = s;
+    const unsigned char *end = p + n;
+    __m128i v1 = _mm_set1_epi8((char)c1);
+    __m128i v2 = _mm_set1_epi8((char)c2);
+    __m128i v3 = _mm_set1_epi8((char)c3);
+    __m128i x, m;
+    unsigned int mask;
+
+    for (; end - p >= 16; p += 16) {
+        x = _mm_loadu_si128((const __m128i *)p);
+        m = _mm_or_si128(_mm_cmpeq_epi8(x, v1), _mm_cmpeq_epi8(x, v2));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, v3));
+        mask = (unsigned int)_mm_movemask_epi8(m);
+        if (mask) {
+            return (void *)(p + __builtin_ctz(mask));
+        }
+    }
+    return memchr3_scalar(p, c1, c2, c3, (size_t)(end - p));
+}
+
+static void *memmem_sse2(const void *hs, size_t hlen, const void *ns,
+                         size_t nlen)
+{
+    const unsigned char *h = hs;
+    const unsigned char *n = ns;
+    __m128i first = _mm_set1_epi8((char)n[0]);
+    __m128i last = _mm_set1_epi8((char)n[nlen - 1]);
+    __m128i bf, bl;
+    unsigned int mask;
+    size_t i, j;
+
+    for (i = 0; i + nlen - 1 + 16 <= hlen; i += 16) {
+        bf = _mm_loadu_si128((const __m128i *)(h + i));
+        bl = _mm_loadu_si128((const __m128i *)(h + i + nlen - 1));
+        mask = (unsigned int)_mm_movemask_epi8(
+                    _mm_and_si128(_mm_cmpeq_epi8(bf, first),
+                                  _mm_cmpeq_epi8(bl, last)));
+        while (mask) {
+            j = (size_t)__builtin_ctz(mask);
+            if (memcmp(h + i + j + 1, n + 1, nlen - 2) == 0) {
+                return (void *)(h + i + j);
+            }
+            mask &= mask - 1;
+        }
+    }
+    return memmem_scalar_from(h, hlen, n, nlen, i);
+}
+
+static size_t count_sse2(const void *s, int c, size_t n)
+{
+    const unsigned char *p = s;
+    const unsigned char *end = p + n;
+    __m128i v = _mm_set1_epi8((char)c);
+    __m128i zero = _mm_setzero_si128();
+    __m128i total = _mm_setzero_si128();
+    __m128i acc;
+    size_t count;
+    int k;
+
+    while (end - p >= 16) {
+        acc = _mm_setzero_si128();
+        for (k = 0; k < 255 && end - p >= 16; k++, p += 16) {
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(
+                            _mm_loadu_si128((const __m128i *)p), v));
+        }
+        total = _mm_add_epi64(total, _mm_sad_epu8(acc, zero));
+    }
+
+    count = (size_t)_mm_cvtsi128_si64(total) +
+            (size_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(total, total));
+    return count + count_scalar(p, c, (size_t)(end - p));
+}
+
+/**********************************************************************
+ * AVX2
+ *********************************************************************/
+#define AVX2 __attribute__((target("avx2")))
+
+static AVX2 void *memchr2_avx2(const void *s, int c1, int c2, size_t n)
+{
+    const unsigned char *p = s;
+    const unsigned char *end = p + n;
+    __m256i v1 = _mm256_set1_epi8((char)c1);
+    __m256i v2 = _mm256_set1_epi8((char)c2);
+    __m256i m0, m1, m2, m3, x;
+    uint64_t lo, hi;
+
+#define MATCH2(off) \
+    (x = _mm256_loadu_si256((const __m256i *)(p + (off))), \
+     _mm256_or_si256(_mm256_cmpeq_epi8(x, v1), _mm256_cmpeq_epi8(x, v2)))
+
+    /* Four vectors per iteration, only locating the match once found */
+    for (; end - p >= 128; p += 128) {
+        m0 = MATCH2(0);
+        m1 = MATCH2(32);
+        m2 = MATCH2(64);
+        m3 = MATCH2(96);
+        x = _mm256_or_si256(_mm256_or_si256(m0, m1), _mm256_or_si256(m2, m3));
+        if (_mm256_movemask_epi8(x)) {
+            lo = (uint32_t)_mm256_movemask_epi8(m0) |
+                 ((uint64_t)(uint32_t)_mm256_movemask_epi8(m1) << 32);
+            if (lo) {
+                return (void *)(p + __builtin_ctzll(lo));
+            }
+            hi = (uint32_t)_mm256_movemask_epi8(m2) |
+                 ((uint64_t)(uint32_t)_mm256_movemask_epi8(m3) << 32);
+            return (void *)(p + 64 + __builtin_ctzll(hi));
+        }
+    }
+
+    for (; end - p >= 32; p += 32) {
+        m0 = MATCH2(0);
+        if (_mm256_movemask_epi8(m0)) {
+            return (void *)(p + __builtin_ctz(
+                                (unsigned int)_mm256_movemask_epi8(m0)));
+        }
+    }
+#undef MATCH2
+
+    return memchr2_sse2(p, c1, c2, (size_t)(end - p));
+}
+
+static AVX2 void *memchr3_avx2(const void *s, int c1, int c2, int c3,
+                               size_t n)
+{
+    const unsigned char *p = s;
+    const unsigned char *end = p + n;
+    __m256i v1 = _mm256_set1_epi8((char)c1);
+    __m256i v2 = _mm256_set1_epi8((char)c2);
+    __m256i v3 = _mm256_set1_epi8((char)c3);
+    __m256i x, m;
+    unsigned int mask;
+
+    for (; end - p >= 32; p += 32) {
+        x = _mm256_loadu_si256((const __m256i *)p);
+        m = _mm256_or_si256(_mm256_cmpeq_epi8(x, v1),
+                            _mm256_cmpeq_epi8(x, v2));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, v3));
+        mask = (unsigned int)_mm256_movemask_epi8(m);
+        if (mask) {
+            return (void *)(p + __builtin_ctz(mask));
+        }
+    }
+    return memchr3_sse2(p, c1, c2, c3, (size_t)(end - p));
+}
+
+static AVX2 void *memmem_avx2(const void *hs, size_t hlen, const void *ns,
+                              size_t nlen)
+{
+    const unsigned char *h = hs;
+    const unsigned char *n = ns;
+    __m256i first = _mm256_set1_epi8((char)n[0]);
+    __m256i last = _mm256_set1_epi8((char)n[nlen - 1]);
+    __m256i bf, bl;
+    unsigned int mask;
+    size_t i, j;
+
+    for (i = 0; i + nlen - 1 + 32 <= hlen; i += 32) {
+        bf = _mm256_loadu_si256((const __m256i *)(h + i));
+        bl = _mm256_loadu_si256((const __m256i *)(h + i + nlen - 1));
+        mask = (unsigned int)_mm256_movemask_epi8(
+                    _mm256_and_si256(_mm256_cmpeq_epi8(bf, first),
+                                     _mm256_cmpeq_epi8(bl, last)));
+        while (mask) {
+            j = (size_t)__builtin_ctz(mask);
+            if (memcmp(h + i + j + 1, n + 1, nlen - 2) == 0) {
+                return (void *)(h + i + j);
+            }
+            mask &= mask - 1;
+        }
+    }
+    return memmem_scalar_from(h, hlen, n, nlen, i);
+}
+
+static AVX2 size_t count_avx2(const void *s, int c, size_t n)
+{
+    const unsigned char *p = s;
+    const unsigned char *end = p + n;
+    __m256i v = _mm256_set1_epi8((char)c);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i total = _mm256_setzero_si256();
+    __m256i acc;
+    __m128i sum;
+    size_t count;
+    int k;
+
+    while (end - p >= 32) {
+        acc = _mm256_setzero_si256();
+        for (k = 0; k < 255 && end - p >= 32; k++, p += 32) {
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(
+                            _mm256_loadu_si256((const __m256i *)p), v));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(acc, zero));
+    }
+
+    sum = _mm_add_epi64(_mm256_castsi256_si128(total),
+                        _mm256_extracti128_si256(total, 1));
+    count = (size_t)_mm_cvtsi128_si64(sum) +
+            (size_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(sum, sum));
+    return count + count_sse2(p, c, (size_t)(end - p));
+}
+#endif /* HAVE_X86 */
+
+#ifdef HAVE_NEON
+/**********************************************************************
+ * NEON
+ *
+ * NEON has no movemask. Narrowing the 16 byte compare result by 4 bits
+ * gives a 64-bit mask with a nibble per byte, which serves the same
+ * purpose with the bit positions scaled by 4.
+ *********************************************************************/
+static inline uint64_t neon_mask(uint8x16_t cmp)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(
+                vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4)), 0);
+}
+
+static void *memchr2_neon(const void *s, int c1, int c2, size_t n)
+{
+    const unsigned char *p = s;
+    const unsigned char *end = p + n;
+    uint8x16_t v1 = vdupq_n_u8((uint8_t)c1);
+    uint8x16_t v2 = vdupq_n_u8((uint8_t)c2);
+    uint8x16_t x;
+    uint64_t mask;
+
+    for (; end - p >= 16; p += 16) {
+        x = vld1q_u8(p);
+        mask = neon_mask(vorrq_u8(vceqq_u8(x, v1), vceqq_u8(x, v2)));
+        if (mask) {
+            return (void *)(p + (__builtin_ctzll(mask) >> 2));
+        }
+    }
+    return memchr2_scalar(p, c1, c2, (size_t)(end - p));
+}
+
+static void *memchr3_neon(const void *s, int c1, int c2, int c3, size_t n)
+{
+    const unsigned char *p = s;
+    const unsigned char *end = p + n;
+    uint8x16_t v1 = vdupq_n_u8((uint8_t)c1);
+    uint8x16_t v2 = vdupq_n_u8((uint8_t)c2);
+    uint8x16_t v3 = vdupq_n_u8((uint8_t)c3);
+    uint8x16_t x, m;
+    uint64_t mask;
+
+    for (; end - p >= 16; p += 16) {
+        x = vld1q_u8(p);
+        m = vorrq_u8(vceqq_u8(x, v1), vceqq_u8(x, v2));
+        mask = neon_mask(vorrq_u8(m, vceqq_u8(x, v3)));
+        if (mask) {
+            return (void *)(p + (__builtin_ctzll(mask) >> 2));
+        }
+    }
+    return memchr3_scalar(p, c1, c2, c3, (size_t)(end - p));
+}
+
+static void *memmem_neon(const void *hs, size_t hlen, const void *ns,
+                         size_t nlen)
+{
+    const unsigned char *h = hs;
+    const unsigned char *n = ns;
+    uint8x16_t first = vdupq_n_u8(n[0]);
+    uint8x16_t last = vdupq_n_u8(n[nlen - 1]);
+    uint64_t mask;
+    size_t i, j;
+
+    for (i = 0; i + nlen - 1 + 16 <= hlen; i += 16) {
+        mask = neon_mask(vandq_u8(vceqq_u8(vld1q_u8(h + i), first),
+                                  vceqq_u8(vld1q_u8(h + i + nlen - 1), last)));
+        while (mask) {
+            j = (size_t)(__builtin_ctzll(mask) >> 2);
+            if (memcmp(h + i + j + 1, n + 1, nlen - 2) == 0) {
+                return (void *)(h + i + j);
+            }
+            mask &= ~(0xFULL << (j * 4));
+        }
+    }
+    return memmem_scalar_from(h, hlen, n, nlen, i);
+}
+
+static size_t count_neon(const void *s, int c, size_t n)
+{
+    const unsigned char *p = s;
+    const unsigned char *end = p + n;
+    uint8x16_t v = vdupq_n_u8((uint8_t)c);
+    uint64x2_t total = vdupq_n_u64(0);
+    uint8x16_t acc;
+    int k;
+
+    while (end - p >= 16) {
+        acc = vdupq_n_u8(0);
+        for (k = 0; k < 255 && end - p >= 16; k++, p += 16) {
+            acc = vsubq_u8(acc, vceqq_u8(vld1q_u8(p), v));
+        }
+        total = vpadalq_u32(total, vpaddlq_u16(vpaddlq_u8(acc)));
+    }
+
+    return (size_t)(vgetq_lane_u64(total, 0) + vgetq_lane_u64(total, 1)) +
+           count_scalar(p, c, (size_t)(end - p));
+}
+#endif /* HAVE_NEON */
+
+/**********************************************************************
+ * Dispatch
+ *********************************************************************/
+#if defined(HAVE_X86)
+#define VARIANTS(fn)                                \
+    __CPU_VARIANT(CPU_FEATURE_AVX2, fn##_avx2),     \
+    __CPU_VARIANT(CPU_FEATURE_SSE2, fn##_sse2),     \
+    __CPU_VARIANT(0, fn##_scalar)
+#elif defined(HAVE_NEON)
+#define VARIANTS(fn)                                \
+    __CPU_VARIANT(CPU_FEATURE_NEON, fn##_neon),     \
+    __CPU_VARIANT(0, fn##_scalar)
+#else
+#define VARIANTS(fn)                                \
+    __CPU_VARIANT(0, fn##_scalar)
+#endif
+
+__CPU_DISPATCH(void *, strsearch_memchr2,
+               (const void *s, int c1, int c2, size_t n),
+               (s, c1, c2, n), VARIANTS(memchr2))
+
+__CPU_DISPATCH(void *, strsearch_memchr3,
+               (const void *s, int c1, int c2, int c3, size_t n),
+               (s, c1, c2, c3, n), VARIANTS(memchr3))
+
+__CPU_DISPATCH_STATIC(void *, memmem_dispatch,
+                      (const void *h, size_t hlen, const void *n,
+                       size_t nlen),
+                      (h, hlen, n, nlen), VARIANTS(memmem))
+
+__CPU_DISPATCH(size_t, strsearch_count, (const void *s, int c, size_t n),
+               (s, c, n), VARIANTS(count))
+
+/**********************************************************************
+ * Public API
+ *********************************************************************/
+void *strsearch_memmem(const void *haystack, size_t hlen,
+                       const void *needle, size_t nlen)
+{
+    if (nlen == 0) {
+        return (void *)haystack;
+    }
+    if (nlen > hlen) {
+        return NULL;
+    }
+    if (nlen == 1) {
+        return memchr(haystack, *(const unsigned char *)needle, hlen);
+    }
+    return memmem_dispatch(haystack, hlen, needle, nlen);
+}
+
+const char *strsearch_impl(void)
+{
+    const char *name = __CPU_SELECTED(strsearch_count)->name;
+
+    /* Variants are named <function>_<impl> */
+    return strrchr(name, '_') + 1;
+}
@@ -0,0 +1,47 @@
+/**********************************************************************
+ * SIMD byte search
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Vectorized versions of the searches that dominate line and field
+ * splitting: finding the first of two or three bytes, finding a
+ * substring, and counting occurrences of a byte. Kernels are provided
+ * for AVX2 and SSE2 on x86, and NEON on ARM, with a portable scalar
+ * fallback. The best kernel for the running CPU is selected on the
+ * first call.
+ *
+ * All functions take explicit lengths and do not stop at NUL bytes.
+ *********************************************************************/
+
+#ifndef __STRSEARCH_H
+#define __STRSEARCH_H
+
+#include <stddef.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+/* Return a pointer to the first byte in s[0..n) equal to c1 or c2 */
+void *strsearch_memchr2(const void *s, int c1, int c2, size_t n);
+
+/* Return a pointer to the first byte in s[0..n) equal to c1, c2 or c3 */
+void *strsearch_memchr3(const void *s, int c1, int c2, int c3, size_t n);
+
+/* Return a pointer to the first occurrence of needle in haystack */
+void *strsearch_memmem(const void *haystack, size_t hlen,
+                       const void *needle, size_t nlen);
+
+/* Count the bytes in s[0..n) equal to c */
+size_t strsearch_count(const void *s, int c, size_t n);
+
+static inline size_t strsearch_count_lines(const void *s, size_t n)
+{
+    return strsearch_count(s, '\n', n);
+}
+
+/* Name of the kernel set in use, e.g. "avx2" */
+const char *strsearch_impl(void);
+
+__CDECL_END
+
+#endif /* !defined __STRSEARCH_H */
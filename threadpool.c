@@ -0,0 +1,689 @@
+/**********************************************************************
+ * Work stealing thread pool
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * The deques follow Le, Pop, Cohen and Zappa Nardelli, "Correct and
+ * Efficient Work-Stealing for Weak Memory Models", PPoPP 2013. Arrays
+ * replaced when a deque grows are kept until the pool is destroyed,
+ * since a thief may still be reading from them.
+ *
+ * Tasks are allocated from a struct pool, and submissions from threads
+ * outside the pool go through a struct mpmc_queue.
+ *
+ * Sleeping uses an epoch counter under the pool lock. A thread about to
+ * park registers itself in sleepers, samples the epoch, and looks for
+ * work one last time. Anything that makes work available (or finishes
+ * a group of tasks) bumps the epoch and signals, but only if it sees a
+ * registered sleeper.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "compiler.h"
+#include "mpmc_queue.h"
+#include "pool.h"
+#include "threadpool.h"
+
+/* Capacity of the queue for tasks submitted from outside the pool */
+#define INJECT_QUEUE_SIZE       1024
+
+/* Initial number of slots in each worker's deque */
+#define DEQUE_INITIAL_SIZE      256
+
+/* Failed searches for work before an idle worker parks */
+#define SPIN_ROUNDS             64
+
+/* Automatic grain size aims for this many chunks per worker */
+#define CHUNKS_PER_WORKER       8
+
+struct group {
+    size_t pending;
+    size_t waiting;             /* Pending tasks blocked in group_wait */
+};
+
+struct range {
+    threadpool_range_fn fn;
+    void *arg;
+    size_t grain;
+};
+
+struct task {
+    void (*run)(struct threadpool *tp, struct task *t);
+    struct group *group;
+    union {
+        struct {
+            threadpool_fn fn;
+            void *arg;
+        } call;
+        struct {
+            const struct range *r;
+            size_t begin;
+            size_t end;
+        } range;
+    } u;
+};
+
+struct deque_array {
+    size_t size;
+    struct deque_array *retired;
+    struct task *buf[];
+};
+
+struct deque {
+    ptrdiff_t top __CACHELINE_ALIGNED;
+    ptrdiff_t bottom __CACHELINE_ALIGNED;
+    struct deque_array *array;
+    struct deque_array *retired;
+};
+
+struct worker {
+    struct deque dq;
+    struct threadpool *tp;
+    pthread_t thread;
+    uint64_t rng;
+} __CACHELINE_ALIGNED;
+
+struct threadpool {
+    struct worker *workers;
+    unsigned int nworkers;
+    struct mpmc_queue inject;
+    struct pool tasks;
+    struct group root;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    unsigned int sleepers;
+    unsigned int epoch;
+    int shutdown;
+};
+
+/* Worker running on this thread, if any */
+static __thread struct worker *current;
+
+/* Group of the task running on this thread, if any */
+static __thread struct group *running;
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static inline uint64_t xorshift(uint64_t *state)
+{
+    uint64_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/**********************************************************************
+ * Chase-Lev deque
+ *********************************************************************/
+static struct deque_array *array_new(size_t size)
+{
+    struct deque_array *a;
+
+    a = malloc(sizeof(*a) + size * sizeof(a->buf[0]));
+    if (a) {
+        a->size = size;
+        a->retired = NULL;
+    }
+    return a;
+}
+
+static int deque_init(struct deque *d)
+{
+    d->top = 0;
+    d->bottom = 0;
+    d->retired = NULL;
+    d->array = array_new(DEQUE_INITIAL_SIZE);
+    return d->array ? 0 : -1;
+}
+
+static void deque_destroy(struct deque *d)
+{
+    struct deque_array *a, *next;
+
+    free(d->array);
+    for (a = d->retired; a; a = next) {
+        next = a->retired;
+        free(a);
+    }
+}
+
+static struct deque_array *deque_grow(struct deque *d, struct deque_array *a,
+                                      ptrdiff_t top, ptrdiff_t bottom)
+{
+    struct deque_array *n = array_new(a->size * 2);
+    ptrdiff_t i;
+
+    if (n == NULL) {
+        return NULL;
+    }
+
+    for (i = top; i < bottom; i++) {
+        n->buf[(size_t)i & (n->size - 1)] = a->buf[(size_t)i & (a->size - 1)];
+    }
+
+    a->retired = d->retired;
+    d->retired = a;
+    __atomic_store_n(&d->array, n, __ATOMIC_RELEASE);
+    return n;
+}
+
+/* Owner only */
+static int deque_push(struct deque *d, struct task *t)
+{
+    ptrdiff_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    ptrdiff_t top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    struct deque_array *a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+
+    if (__UNLIKELY(b - top > (ptrdiff_t)a->size - 1)) {
+        a = deque_grow(d, a, top, b);
+        if (a == NULL) {
+            return -1;
+        }
+    }
+
+    __atomic_store_n(&a->buf[(size_t)b & (a->size - 1)], t, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Owner only, pops the most recently pushed task */
+static struct task *deque_take(struct deque *d)
+{
+    ptrdiff_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    struct deque_array *a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+    struct task *t = NULL;
+    ptrdiff_t top;
+
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+    if (top <= b) {
+        t = __atomic_load_n(&a->buf[(size_t)b & (a->size - 1)],
+                            __ATOMIC_RELAXED);
+        if (top == b) {
+            /* Last element, race against thieves for it */
+            if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+                                             __ATOMIC_SEQ_CST,
+                                             __ATOMIC_RELAXED)) {
+                t = NULL;
+            }
+            __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+
+    return t;
+}
+
+/* Any thread, takes the oldest task. Returns NULL if empty or contended */
+static struct task *deque_steal(struct deque *d)
+{
+    ptrdiff_t top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    ptrdiff_t b;
+    struct deque_array *a;
+    struct task *t;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (top >= b) {
+        return NULL;
+    }
+
+    a = __atomic_load_n(&d->array, __ATOMIC_ACQUIRE);
+    t = __atomic_load_n(&a->buf[(size_t)top & (a->size - 1)],
+                        __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return t;
+}
+
+/**********************************************************************
+ * Scheduling
+ *********************************************************************/
+static inline struct worker *worker_of(struct threadpool *tp)
+{
+    struct worker *w = current;
+
+    return (w && w->tp == tp) ? w : NULL;
+}
+
+static void wake_up(struct threadpool *tp, int all)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&tp->sleepers, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&tp->lock);
+    __atomic_store_n(&tp->epoch, tp->epoch + 1, __ATOMIC_RELEASE);
+    if (all) {
+        pthread_cond_broadcast(&tp->wake);
+    } else {
+        pthread_cond_signal(&tp->wake);
+    }
+    pthread_mutex_unlock(&tp->lock);
+}
+
+/* Make t available to the pool. Returns -1 if it could not be queued */
+static int spawn(struct threadpool *tp, struct task *t)
+{
+    struct worker *w = worker_of(tp);
+
+    if (w) {
+        if (deque_push(&w->dq, t)) {
+            return -1;
+        }
+    } else if (!mpmc_queue_enqueue_wait(&tp->inject, &t)) {
+        return -1;
+    }
+
+    wake_up(tp, 0);
+    return 0;
+}
+
+static struct task *find_work(struct threadpool *tp, struct worker *w,
+                              uint64_t *rng)
+{
+    struct task *t;
+    unsigned int i, n, start;
+
+    if (w) {
+        t = deque_take(&w->dq);
+        if (t) {
+            return t;
+        }
+    }
+
+    if (mpmc_queue_try_dequeue(&tp->inject, &t)) {
+        return t;
+    }
+
+    n = tp->nworkers;
+    start = (unsigned int)(xorshift(rng) % n);
+    for (i = 0; i < n; i++) {
+        struct worker *victim = &tp->workers[(start + i) % n];
+
+        if (victim == w) {
+            continue;
+        }
+        t = deque_steal(&victim->dq);
+        if (t) {
+            return t;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Whether a thread waiting for g can go on. One that is running a task
+ * of g goes on once every pending task is, like itself, blocked waiting
+ * for the group. pending is read first: it never drops below waiting,
+ * so if the later read of waiting matches, that was true at some point.
+ * Any other thread waits for the group to empty.
+ */
+static inline int group_done(struct group *g)
+{
+    size_t pending = __atomic_load_n(&g->pending, __ATOMIC_SEQ_CST);
+
+    if (running != g) {
+        return pending == 0;
+    }
+    return pending == __atomic_load_n(&g->waiting, __ATOMIC_SEQ_CST);
+}
+
+static void run_task(struct threadpool *tp, struct task *t)
+{
+    struct group *g = t->group, *outer = running;
+    size_t left;
+
+    running = g;
+    t->run(tp, t);
+    running = outer;
+    pool_free(&tp->tasks, t);
+
+    left = __atomic_sub_fetch(&g->pending, 1, __ATOMIC_SEQ_CST);
+    if (left == __atomic_load_n(&g->waiting, __ATOMIC_SEQ_CST)) {
+        wake_up(tp, 1);
+    }
+}
+
+/*
+ * Sleep until there may be new work, the pool is shut down, or g (if
+ * not NULL) completes. Runs a task instead if one turns up while getting
+ * ready to sleep.
+ */
+static void park(struct threadpool *tp, struct worker *w, uint64_t *rng,
+                 struct group *g)
+{
+    struct task *t;
+    unsigned int epoch;
+
+    __atomic_fetch_add(&tp->sleepers, 1, __ATOMIC_SEQ_CST);
+    epoch = __atomic_load_n(&tp->epoch, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    t = find_work(tp, w, rng);
+    if (t) {
+        __atomic_fetch_sub(&tp->sleepers, 1, __ATOMIC_RELAXED);
+        run_task(tp, t);
+        return;
+    }
+
+    pthread_mutex_lock(&tp->lock);
+    while (epoch == tp->epoch && !tp->shutdown &&
+           !(g && group_done(g))) {
+        pthread_cond_wait(&tp->wake, &tp->lock);
+    }
+    pthread_mutex_unlock(&tp->lock);
+
+    __atomic_fetch_sub(&tp->sleepers, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Wait for g to complete, running other tasks in the meantime. A task
+ * of g waiting for it counts itself as waiting rather than pending, so
+ * that it does not wait for itself; its arrival may complete the group
+ * for other waiters, who are woken.
+ */
+static void group_wait(struct threadpool *tp, struct group *g)
+{
+    struct worker *w = worker_of(tp);
+    uint64_t seed = (uintptr_t)g | 1;
+    uint64_t *rng = w ? &w->rng : &seed;
+    struct task *t;
+    unsigned int spins = 0;
+    int inside = running == g;
+
+    if (inside) {
+        __atomic_add_fetch(&g->waiting, 1, __ATOMIC_SEQ_CST);
+        if (group_done(g)) {
+            wake_up(tp, 1);
+        }
+    }
+
+    while (!group_done(g)) {
+        t = find_work(tp, w, rng);
+        if (t) {
+            run_task(tp, t);
+            spins = 0;
+        } else if (++spins < SPIN_ROUNDS) {
+            cpu_relax();
+        } else {
+            park(tp, w, rng, g);
+            spins = 0;
+        }
+    }
+
+    if (inside) {
+        __atomic_sub_fetch(&g->waiting, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    struct threadpool *tp = w->tp;
+    struct task *t;
+    unsigned int spins = 0;
+
+    current = w;
+
+    while (!__atomic_load_n(&tp->shutdown, __ATOMIC_ACQUIRE)) {
+        t = find_work(tp, w, &w->rng);
+        if (t) {
+            run_task(tp, t);
+            spins = 0;
+        } else if (++spins < SPIN_ROUNDS) {
+            cpu_relax();
+        } else {
+            park(tp, w, &w->rng, NULL);
+            spins = 0;
+        }
+    }
+
+    current = NULL;
+    return NULL;
+}
+
+/**********************************************************************
+ * Public API
+ *********************************************************************/
+static void shutdown_workers(struct threadpool *tp, unsigned int started)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&tp->lock);
+    __atomic_store_n(&tp->shutdown, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&tp->wake);
+    pthread_mutex_unlock(&tp->lock);
+
+    for (i = 0; i < started; i++) {
+        pthread_join(tp->workers[i].thread, NULL);
+    }
+}
+
+static void free_pool(struct threadpool *tp, unsigned int ndeques)
+{
+    unsigned int i;
+
+    for (i = 0; i < ndeques; i++) {
+        deque_destroy(&tp->workers[i].dq);
+    }
+    free(tp->workers);
+    pool_destroy(&tp->tasks);
+    mpmc_queue_destroy(&tp->inject);
+    pthread_cond_destroy(&tp->wake);
+    pthread_mutex_destroy(&tp->lock);
+    free(tp);
+}
+
+struct threadpool *threadpool_create(unsigned int nthreads)
+{
+    struct threadpool *tp;
+    unsigned int i;
+    void *mem;
+    int rc;
+
+    if (nthreads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+        nthreads = n > 0 ? (unsigned int)n : 1;
+    }
+
+    tp = calloc(1, sizeof(*tp));
+    if (tp == NULL) {
+        return NULL;
+    }
+
+    if (mpmc_queue_init(&tp->inject, INJECT_QUEUE_SIZE,
+                        sizeof(struct task *))) {
+        free(tp);
+        return NULL;
+    }
+    if (pool_init(&tp->tasks, sizeof(struct task), 0)) {
+        mpmc_queue_destroy(&tp->inject);
+        free(tp);
+        return NULL;
+    }
+    pthread_mutex_init(&tp->lock, NULL);
+    pthread_cond_init(&tp->wake, NULL);
+
+    rc = posix_memalign(&mem, __CACHELINE_SIZE,
+                        nthreads * sizeof(struct worker));
+    if (rc) {
+        free_pool(tp, 0);
+        errno = rc;
+        return NULL;
+    }
+    memset(mem, 0, nthreads * sizeof(struct worker));
+    tp->workers = mem;
+    tp->nworkers = nthreads;
+
+    for (i = 0; i < nthreads; i++) {
+        struct worker *w = &tp->workers[i];
+
+        if (deque_init(&w->dq)) {
+            free_pool(tp, i);
+            errno = ENOMEM;
+            return NULL;
+        }
+        w->tp = tp;
+        w->rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        rc = pthread_create(&tp->workers[i].thread, NULL, worker_main,
+                            &tp->workers[i]);
+        if (rc) {
+            shutdown_workers(tp, i);
+            free_pool(tp, nthreads);
+            errno = rc;
+            return NULL;
+        }
+    }
+
+    return tp;
+}
+
+void threadpool_destroy(struct threadpool *tp)
+{
+    threadpool_wait(tp);
+    shutdown_workers(tp, tp->nworkers);
+    free_pool(tp, tp->nworkers);
+}
+
+unsigned int threadpool_size(const struct threadpool *tp)
+{
+    return tp->nworkers;
+}
+
+static void call_task(struct threadpool *tp, struct task *t)
+{
+    (void)tp;
+    t->u.call.fn(t->u.call.arg);
+}
+
+int threadpool_submit(struct threadpool *tp, threadpool_fn fn, void *arg)
+{
+    struct task *t = pool_alloc(&tp->tasks);
+
+    if (t == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    t->run = call_task;
+    t->group = &tp->root;
+    t->u.call.fn = fn;
+    t->u.call.arg = arg;
+    __atomic_fetch_add(&tp->root.pending, 1, __ATOMIC_RELAXED);
+
+    if (spawn(tp, t)) {
+        /* Nowhere to queue it, so run it here */
+        run_task(tp, t);
+    }
+    return 0;
+}
+
+void threadpool_wait(struct threadpool *tp)
+{
+    group_wait(tp, &tp->root);
+}
+
+static void range_task(struct threadpool *tp, struct task *t);
+
+/*
+ * Split [begin, end) in half until it is no larger than the grain,
+ * leaving the upper halves for other workers, then run the rest.
+ */
+static void run_range(struct threadpool *tp, struct group *g,
+                      const struct range *r, size_t begin, size_t end)
+{
+    struct task *t;
+    size_t mid;
+
+    while (end - begin > r->grain) {
+        t = pool_alloc(&tp->tasks);
+        if (t == NULL) {
+            break;
+        }
+
+        mid = begin + (end - begin) / 2;
+        t->run = range_task;
+        t->group = g;
+        t->u.range.r = r;
+        t->u.range.begin = mid;
+        t->u.range.end = end;
+        __atomic_fetch_add(&g->pending, 1, __ATOMIC_RELAXED);
+
+        if (spawn(tp, t)) {
+            __atomic_fetch_sub(&g->pending, 1, __ATOMIC_RELAXED);
+            pool_free(&tp->tasks, t);
+            break;
+        }
+        end = mid;
+    }
+
+    r->fn(begin, end, r->arg);
+}
+
+static void range_task(struct threadpool *tp, struct task *t)
+{
+    run_range(tp, t->group, t->u.range.r, t->u.range.begin, t->u.range.end);
+}
+
+void threadpool_parallel_for(struct threadpool *tp, size_t begin, size_t end,
+                             size_t grain, threadpool_range_fn fn, void *arg)
+{
+    struct group g = { 0 };
+    struct range r;
+    size_t n;
+
+    if (begin >= end) {
+        return;
+    }
+
+    n = end - begin;
+    if (grain == 0) {
+        grain = n / ((size_t)tp->nworkers * CHUNKS_PER_WORKER);
+        if (grain == 0) {
+            grain = 1;
+        }
+    }
+
+    if (n <= grain) {
+        fn(begin, end, arg);
+        return;
+    }
+
+    r.fn = fn;
+    r.arg = arg;
+    r.grain = grain;
+    run_range(tp, &g, &r, begin, end);
+    group_wait(tp, &g);
+}
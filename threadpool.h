@@ -0,0 +1,147 @@
+/**********************************************************************
+ * Work stealing thread pool
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Each worker thread owns a Chase-Lev deque. Tasks submitted from a
+ * worker are pushed onto the bottom of its own deque and popped from
+ * there in LIFO order, while idle workers steal from the top of a
+ * randomly chosen victim's deque. Tasks submitted from outside the pool
+ * go through a shared injection queue. Workers that find nothing to do
+ * spin briefly, then park until new work is submitted.
+ *
+ * threadpool_parallel_for splits an index range recursively, pushing
+ * the upper half of each split for other workers to steal, until the
+ * pieces are no larger than the grain size. Passing a grain of 0 picks
+ * one based on the range and the number of workers.
+ *
+ * Tasks must not block waiting for other tasks, except through
+ * threadpool_wait and threadpool_parallel_for, which run pending tasks
+ * while they wait.
+ *
+ * C++ code can use lub::threadpool, defined at the end of this file,
+ * which accepts lambdas.
+ *********************************************************************/
+
+#ifndef __THREADPOOL_H
+#define __THREADPOOL_H
+
+#include <stddef.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+struct threadpool;
+
+typedef void (*threadpool_fn)(void *arg);
+typedef void (*threadpool_range_fn)(size_t begin, size_t end, void *arg);
+
+/*
+ * Create a pool with nthreads workers, or one per online CPU if
+ * nthreads is 0. Returns NULL with errno set on failure.
+ */
+struct threadpool *threadpool_create(unsigned int nthreads);
+
+/* Wait for all submitted tasks to complete, then stop the workers */
+void threadpool_destroy(struct threadpool *tp);
+
+/* Number of worker threads */
+unsigned int threadpool_size(const struct threadpool *tp);
+
+/* Queue fn(arg) to run on the pool. Returns 0, or -1 if out of memory */
+int threadpool_submit(struct threadpool *tp, threadpool_fn fn, void *arg);
+
+/*
+ * Wait for all tasks queued by threadpool_submit to complete. Called
+ * from such a task, it does not wait for that task, nor for others
+ * that are themselves blocked in threadpool_wait.
+ */
+void threadpool_wait(struct threadpool *tp);
+
+/*
+ * Call fn over [begin, end), split into chunks of at most grain indices
+ * (0 to choose automatically), and wait for all of them to complete.
+ * If memory for a split cannot be allocated, the unsplit chunk is run
+ * as is, so this never fails.
+ */
+void threadpool_parallel_for(struct threadpool *tp, size_t begin, size_t end,
+                             size_t grain, threadpool_range_fn fn, void *arg);
+
+__CDECL_END
+
+#ifdef __cplusplus
+#include <exception>
+#include <functional>
+#include <new>
+#include <system_error>
+#include <cerrno>
+
+namespace lub {
+
+/*
+ * Lambda friendly wrapper for struct threadpool. Exceptions must not
+ * escape from the callables, since they run on C frames; an escaping
+ * exception terminates the program.
+ */
+class threadpool {
+    struct ::threadpool *tp;
+
+    static void call(void *arg) noexcept
+    {
+        std::function<void()> *fn = static_cast<std::function<void()> *>(arg);
+
+        (*fn)();
+        delete fn;
+    }
+
+    template <typename F>
+    static void call_range(size_t begin, size_t end, void *arg) noexcept
+    {
+        F &fn = *static_cast<F *>(arg);
+
+        for (size_t i = begin; i < end; i++) {
+            fn(i);
+        }
+    }
+
+public:
+    explicit threadpool(unsigned int nthreads = 0)
+        : tp(threadpool_create(nthreads))
+    {
+        if (tp == nullptr) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "threadpool_create");
+        }
+    }
+
+    ~threadpool() { threadpool_destroy(tp); }
+
+    threadpool(const threadpool &) = delete;
+    threadpool &operator=(const threadpool &) = delete;
+
+    unsigned int size() const { return threadpool_size(tp); }
+
+    void submit(std::function<void()> fn)
+    {
+        std::function<void()> *p = new std::function<void()>(std::move(fn));
+
+        if (threadpool_submit(tp, call, p)) {
+            delete p;
+            throw std::bad_alloc();
+        }
+    }
+
+    void wait() { threadpool_wait(tp); }
+
+    /* Call fn(i) for every i in [begin, end) */
+    template <typename F>
+    void parallel_for(size_t begin, size_t end, F fn, size_t grain = 0)
+    {
+        threadpool_parallel_for(tp, begin, end, grain, call_range<F>, &fn);
+    }
+};
+
+} /* namespace lub */
+#endif /* __cplusplus */
+
+#endif /* !defined __THREADPOOL_H */
@@ -0,0 +1,219 @@
+/**********************************************************************
+ * Hierarchical timing wheel
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Follows Varghese and Lauck, "Hashed and Hierarchical Timing Wheels"
+ * (1987). A timer due in d ticks goes in the level whose slots are just
+ * wide enough to hold d, in the slot its expiry time falls in. When the
+ * wheel reaches the start of a slot above level 0, the timers in that
+ * slot are inserted again, and so move down a level or more; those in a
+ * level 0 slot are due when the wheel reaches it. A bitmap per level
+ * marks the slots in use, so the next tick that needs attention is
+ * found with a few bit scans.
+ *********************************************************************/
+
+#include <string.h>
+#include "timer_wheel.h"
+
+#define WHEEL_BITS      TIMER_WHEEL_BITS
+#define WHEEL_SIZE      TIMER_WHEEL_SIZE
+#define WHEEL_LEVELS    TIMER_WHEEL_LEVELS
+#define WHEEL_RANGE     (1ULL << (WHEEL_BITS * WHEEL_LEVELS))
+
+/* The list outside the wheel, for timers whose functions are being run */
+#define EXPIRED         (WHEEL_LEVELS * WHEEL_SIZE)
+
+static void wheel_link(struct timer_wheel *w, struct timer_wheel_node *t,
+                       int slot)
+{
+    t->slot = slot;
+    t->prev = NULL;
+    t->next = w->slots[slot];
+    if (t->next) {
+        t->next->prev = t;
+    }
+    w->slots[slot] = t;
+    if (slot < EXPIRED) {
+        w->occupied[slot / WHEEL_SIZE] |= 1ULL << (slot % WHEEL_SIZE);
+    }
+}
+
+static void wheel_unlink(struct timer_wheel *w, struct timer_wheel_node *t)
+{
+    int slot = t->slot;
+
+    if (t->prev) {
+        t->prev->next = t->next;
+    } else {
+        w->slots[slot] = t->next;
+    }
+    if (t->next) {
+        t->next->prev = t->prev;
+    }
+    if (w->slots[slot] == NULL && slot < EXPIRED) {
+        w->occupied[slot / WHEEL_SIZE] &= ~(1ULL << (slot % WHEEL_SIZE));
+    }
+    t->next = t->prev = NULL;
+    t->slot = -1;
+}
+
+static void wheel_insert(struct timer_wheel *w, struct timer_wheel_node *t)
+{
+    uint64_t expires, delta;
+    int level = 0;
+
+    if (t->expires < w->tick) {
+        t->expires = w->tick;
+    }
+    expires = t->expires;
+    delta = expires - w->tick;
+
+    /* Too far out for the wheel: park it in the last level for now */
+    if (delta >= WHEEL_RANGE) {
+        delta = WHEEL_RANGE - 1;
+        expires = w->tick + delta;
+    }
+    if (delta >= WHEEL_SIZE) {
+        level = (63 - __builtin_clzll(delta)) / WHEEL_BITS;
+    }
+    wheel_link(w, t, level * WHEEL_SIZE +
+               (int)((expires >> (level * WHEEL_BITS)) & (WHEEL_SIZE - 1)));
+}
+
+/*
+ * Process the slots reached at w->tick, then move on a tick. Returns the
+ * timers that are due, taken out of the wheel but with their slot left
+ * for the caller to set.
+ */
+static struct timer_wheel_node *wheel_tick(struct timer_wheel *w)
+{
+    struct timer_wheel_node *t, *next;
+    uint64_t tick = w->tick;
+    int level, slot;
+
+    /* Push timers in higher level slots starting here down */
+    for (level = WHEEL_LEVELS - 1; level > 0; level--) {
+        if (tick & ((1ULL << (level * WHEEL_BITS)) - 1)) {
+            continue;
+        }
+        slot = level * WHEEL_SIZE +
+               (int)((tick >> (level * WHEEL_BITS)) & (WHEEL_SIZE - 1));
+        t = w->slots[slot];
+        w->slots[slot] = NULL;
+        w->occupied[level] &= ~(1ULL << (slot % WHEEL_SIZE));
+        for (; t != NULL; t = next) {
+            next = t->next;
+            wheel_insert(w, t);
+        }
+    }
+
+    slot = (int)(tick & (WHEEL_SIZE - 1));
+    t = w->slots[slot];
+    w->slots[slot] = NULL;
+    w->occupied[0] &= ~(1ULL << slot);
+    w->tick = tick + 1;
+    return t;
+}
+
+void timer_wheel_init(struct timer_wheel *w, uint64_t now)
+{
+    memset(w, 0, sizeof(*w));
+    w->tick = now;
+}
+
+void timer_wheel_add(struct timer_wheel *w, struct timer_wheel_node *t,
+                     uint64_t expires)
+{
+    if (t->slot >= 0) {
+        wheel_unlink(w, t);
+    }
+    t->expires = expires;
+    wheel_insert(w, t);
+}
+
+void timer_wheel_cancel(struct timer_wheel *w, struct timer_wheel_node *t)
+{
+    if (t->slot >= 0) {
+        wheel_unlink(w, t);
+    }
+}
+
+uint64_t timer_wheel_next(const struct timer_wheel *w)
+{
+    uint64_t next = UINT64_MAX, block, occupied, t;
+    unsigned int level, shift, pos;
+
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        occupied = w->occupied[level];
+        if (occupied == 0) {
+            continue;
+        }
+
+        /* Slots are reached at the start of each block of their size */
+        shift = level * WHEEL_BITS;
+        block = (w->tick + (1ULL << shift) - 1) >> shift;
+        pos = (unsigned int)(block % WHEEL_SIZE);
+        if (pos != 0) {
+            occupied = (occupied >> pos) | (occupied << (WHEEL_SIZE - pos));
+        }
+        t = (block + (uint64_t)__builtin_ctzll(occupied)) << shift;
+        if (t < next) {
+            next = t;
+        }
+    }
+    return next;
+}
+
+size_t timer_wheel_advance(struct timer_wheel *w, uint64_t now)
+{
+    struct timer_wheel_node *t;
+    uint64_t next;
+    size_t count = 0;
+
+    while ((next = timer_wheel_next(w)) <= now) {
+        w->tick = next;
+
+        /*
+         * Move the due timers to their own list before calling them,
+         * since a function can add or cancel any timer, and a timer
+         * added for 64 ticks from now would land in the slot just
+         * emptied.
+         */
+        t = wheel_tick(w);
+        w->slots[EXPIRED] = t;
+        for (; t != NULL; t = t->next) {
+            t->slot = EXPIRED;
+        }
+        while ((t = w->slots[EXPIRED]) != NULL) {
+            wheel_unlink(w, t);
+            t->fn(t, t->arg);
+            count++;
+        }
+    }
+    if (w->tick <= now) {
+        w->tick = now + 1;
+    }
+    return count;
+}
+
+struct timer_wheel_node *timer_wheel_expire(struct timer_wheel *w,
+                                            uint64_t now)
+{
+    struct timer_wheel_node *head = NULL, **tail = &head, *t;
+    uint64_t next;
+
+    while ((next = timer_wheel_next(w)) <= now) {
+        w->tick = next;
+        t = wheel_tick(w);
+        *tail = t;
+        for (; t != NULL; t = t->next) {
+            t->slot = -1;
+            tail = &t->next;
+        }
+    }
+    if (w->tick <= now) {
+        w->tick = now + 1;
+    }
+    return head;
+}
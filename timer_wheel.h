@@ -0,0 +1,138 @@
+/**********************************************************************
+ * Hierarchical timing wheel
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Timers for very large numbers of timeouts, such as the idle and
+ * retransmit timers of every connection a server holds. Adding and
+ * cancelling a timer are a list insert and removal, however many timers
+ * are pending, where a binary heap takes log(n) steps, each likely a
+ * cache miss. The timers are embedded in the structures they time out,
+ * so the wheel never allocates.
+ *
+ * Time is counted in ticks of whatever length the caller likes, and the
+ * wheel is moved on by timer_wheel_advance, which calls the functions of
+ * every timer that has come due, or by timer_wheel_expire, which hands
+ * them all back at once as a list, for the caller to work through in a
+ * batch. Timers are kept to the tick: one due at tick 1000 fires when
+ * the wheel is moved on to 1000 and not before. Ticks where nothing is
+ * due are skipped rather than stepped through, so advancing over a long
+ * idle stretch costs no more than over a short one.
+ *
+ * There are four levels of 64 slots, so timers up to 2^24 ticks out
+ * (4.6 hours of 1 ms ticks) are placed directly; those further out are
+ * placed as far out as the wheel reaches, and placed again from there.
+ *
+ * A wheel is not thread safe.
+ *
+ * Usage:
+ *      static void on_idle(struct timer_wheel_node *t, void *arg)
+ *      {
+ *          struct conn *conn = arg;
+ *          ...
+ *      }
+ *
+ *      timer_wheel_init(&w, now_ms());
+ *      timer_wheel_node_init(&conn->idle, on_idle, conn);
+ *      timer_wheel_add(&w, &conn->idle, now_ms() + 30000);
+ *      ...
+ *      timer_wheel_advance(&w, now_ms());
+ *********************************************************************/
+
+#ifndef __TIMER_WHEEL_H
+#define __TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+#define TIMER_WHEEL_BITS    6
+#define TIMER_WHEEL_SIZE    (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS  4
+
+struct timer_wheel_node;
+
+typedef void (*timer_wheel_fn)(struct timer_wheel_node *t, void *arg);
+
+/*
+ * A timer, to be embedded in the structure it times out. Apart from
+ * next, which links the list returned by timer_wheel_expire, its fields
+ * are private to the wheel.
+ */
+struct timer_wheel_node {
+    struct timer_wheel_node *next;
+    struct timer_wheel_node *prev;
+    uint64_t expires;           /* Tick at which it fires */
+    timer_wheel_fn fn;
+    void *arg;
+    int slot;                   /* Slot in the wheel, or -1 if not pending */
+};
+
+struct timer_wheel {
+    uint64_t tick;              /* Ticks before this have been processed */
+    uint64_t occupied[TIMER_WHEEL_LEVELS];  /* Bitmaps of slots in use */
+
+    /* One more list, for timers whose functions are being called */
+    struct timer_wheel_node *slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SIZE +
+                                   1];
+};
+
+/* Initialize an empty wheel, with now as the current tick */
+void timer_wheel_init(struct timer_wheel *w, uint64_t now);
+
+static inline void timer_wheel_node_init(struct timer_wheel_node *t,
+                                         timer_wheel_fn fn, void *arg)
+{
+    t->next = t->prev = NULL;
+    t->expires = 0;
+    t->fn = fn;
+    t->arg = arg;
+    t->slot = -1;
+}
+
+/*
+ * Have the timer fire at tick expires, or at the next tick processed if
+ * that has passed. A pending timer is moved to the new time.
+ */
+void timer_wheel_add(struct timer_wheel *w, struct timer_wheel_node *t,
+                     uint64_t expires);
+
+/* Cancel the timer if it is pending */
+void timer_wheel_cancel(struct timer_wheel *w, struct timer_wheel_node *t);
+
+static inline int timer_wheel_pending(const struct timer_wheel_node *t)
+{
+    return t->slot >= 0;
+}
+
+/*
+ * The first tick at which the wheel has work to do, or UINT64_MAX if no
+ * timers are pending. No timer fires before it, though none need fire
+ * at it either, when it is only a point where timers move down a level.
+ * Useful for working out how long to sleep.
+ */
+uint64_t timer_wheel_next(const struct timer_wheel *w);
+
+/*
+ * Move the wheel on to tick now, calling the function of each timer due
+ * by then, in order of expiry. The functions may add and cancel any
+ * timers, including the one firing. Returns the number of functions
+ * called.
+ */
+size_t timer_wheel_advance(struct timer_wheel *w, uint64_t now);
+
+/*
+ * Move the wheel on to tick now like timer_wheel_advance, but rather
+ * than calling their functions, return the timers due by then as a list
+ * linked through next, in order of expiry, or NULL if there are none.
+ * They are no longer pending; next must be read before a timer is added
+ * again. Must not be called from a timer function.
+ */
+struct timer_wheel_node *timer_wheel_expire(struct timer_wheel *w,
+                                            uint64_t now);
+
+__CDECL_END
+
+#endif /* !defined __TIMER_WHEEL_H */
@@ -0,0 +1,319 @@
+/**********************************************************************
+ * Low overhead event tracing
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Rings are never freed. When a thread exits, its ring is marked as
+ * such and handed to the next thread that starts tracing, so programs
+ * that keep creating threads use no more rings than they have threads
+ * alive at once. Events carry the id of the thread that recorded them,
+ * so a reused ring's older events are still attributed correctly.
+ *
+ * The dumper reads rings while their owners may be writing to them,
+ * seqlock style: it copies the events, then reads the ring's head again
+ * and discards the slots that could have been overwritten meanwhile.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "outbuf.h"
+#include "trace.h"
+
+#if (TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) != 0
+#error "TRACE_RING_EVENTS must be a power of 2"
+#endif
+
+__thread struct trace_ring *__trace_ring;
+int __trace_enabled = 1;
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring *rings;
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+/* Clock reading at the first attach, the origin of dumped timestamps */
+static uint64_t epoch_ticks;
+static uint64_t epoch_ns;
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t current_tid(void)
+{
+#ifdef SYS_gettid
+    return (uint32_t)syscall(SYS_gettid);
+#else
+    static uint32_t next_tid;
+
+    return __atomic_add_fetch(&next_tid, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+/* Thread exit, rings_lock is not held */
+static void ring_release(void *arg)
+{
+    struct trace_ring *r = arg;
+
+    __trace_ring = NULL;
+    pthread_mutex_lock(&rings_lock);
+    r->exited = 1;
+    pthread_mutex_unlock(&rings_lock);
+}
+
+static void ring_setup(void)
+{
+    pthread_key_create(&ring_key, ring_release);
+    epoch_ns = mono_ns();
+    epoch_ticks = __trace_clock();
+}
+
+struct trace_ring *__trace_attach(void)
+{
+    struct trace_ring *r;
+    void *mem;
+
+    pthread_once(&ring_once, ring_setup);
+
+    pthread_mutex_lock(&rings_lock);
+    for (r = rings; r; r = r->next) {
+        if (r->exited) {
+            break;
+        }
+    }
+
+    if (r == NULL) {
+        if (posix_memalign(&mem, __CACHELINE_SIZE, sizeof(*r))) {
+            pthread_mutex_unlock(&rings_lock);
+            return NULL;
+        }
+        r = mem;
+        r->head = 0;
+        r->next = rings;
+        rings = r;
+    }
+
+    r->tid = current_tid();
+    r->exited = 0;
+    r->name[0] = '\0';
+    pthread_mutex_unlock(&rings_lock);
+
+    /* If this fails the ring is simply never reused */
+    pthread_setspecific(ring_key, r);
+    __trace_ring = r;
+    return r;
+}
+
+void trace_set_enabled(int enabled)
+{
+    __atomic_store_n(&__trace_enabled, enabled != 0, __ATOMIC_RELAXED);
+}
+
+void trace_set_thread_name(const char *name)
+{
+    struct trace_ring *r = __trace_ring;
+
+    if (r == NULL) {
+        r = __trace_attach();
+        if (r == NULL) {
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&rings_lock);
+    strncpy(r->name, name, sizeof(r->name) - 1);
+    r->name[sizeof(r->name) - 1] = '\0';
+    pthread_mutex_unlock(&rings_lock);
+}
+
+/**********************************************************************
+ * Dumping
+ *********************************************************************/
+
+/* Clock ticks per nanosecond */
+static double clock_rate(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t t0 = epoch_ticks, n0 = epoch_ns;
+    uint64_t t1, n1;
+
+    /* Measure against the epoch, over at least 10ms */
+    do {
+        n1 = mono_ns();
+        t1 = __trace_clock();
+    } while (n1 - n0 < 10000000);
+    return (double)(t1 - t0) / (double)(n1 - n0);
+#elif defined(__aarch64__)
+    uint64_t freq;
+
+    __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(freq));
+    return (double)freq / 1e9;
+#else
+    return 1.0;
+#endif
+}
+
+/*
+ * Copy the events that are still in r into buf, oldest first, and
+ * return how many there are.
+ */
+static size_t ring_snapshot(struct trace_ring *r, struct trace_event *buf)
+{
+    const size_t mask = TRACE_RING_EVENTS - 1;
+    uint64_t head, first, valid;
+    size_t i, n;
+
+    head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    n = head < TRACE_RING_EVENTS ? (size_t)head : TRACE_RING_EVENTS;
+    first = head - n;
+
+    for (i = 0; i < n; i++) {
+        struct trace_event *e = &r->events[(first + i) & mask];
+
+        buf[i].ts = __atomic_load_n(&e->ts, __ATOMIC_RELAXED);
+        buf[i].name = __atomic_load_n(&e->name, __ATOMIC_RELAXED);
+        buf[i].value = __atomic_load_n(&e->value, __ATOMIC_RELAXED);
+        buf[i].tid = __atomic_load_n(&e->tid, __ATOMIC_RELAXED);
+        buf[i].phase = __atomic_load_n(&e->phase, __ATOMIC_RELAXED);
+    }
+
+    /*
+     * The owner may have recorded events up to head, and be writing the
+     * next one, so anything older than that ring's worth may be torn.
+     */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    head = __atomic_load_n(&r->head, __ATOMIC_RELAXED) + 1;
+    valid = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+    if (valid > first) {
+        if (valid - first >= n) {
+            return 0;
+        }
+        memmove(buf, buf + (valid - first),
+                (n - (size_t)(valid - first)) * sizeof(*buf));
+        n -= (size_t)(valid - first);
+    }
+    return n;
+}
+
+/* Write s as a JSON string */
+static int put_string(struct outbuf *ob, const char *s)
+{
+    int rc = outbuf_putc(ob, '"');
+
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+
+        if (c == '"' || c == '\\') {
+            rc |= outbuf_putc(ob, '\\');
+            rc |= outbuf_putc(ob, (char)c);
+        } else if (c < 0x20) {
+            rc |= outbuf_printf(ob, "\\u%04x", c);
+        } else {
+            rc |= outbuf_putc(ob, (char)c);
+        }
+    }
+    return rc | outbuf_putc(ob, '"');
+}
+
+static int put_event(struct outbuf *ob, const struct trace_event *e,
+                     int pid, double us)
+{
+    int rc = outbuf_puts(ob, "{\"name\":");
+
+    rc |= put_string(ob, e->name ? e->name : "");
+    rc |= outbuf_printf(ob, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u",
+                        (char)e->phase, us, pid, e->tid);
+    if (e->phase == TRACE_PHASE_INSTANT) {
+        rc |= outbuf_puts(ob, ",\"s\":\"t\"");
+    } else if (e->phase == TRACE_PHASE_COUNTER) {
+        rc |= outbuf_printf(ob, ",\"args\":{\"value\":%lld}",
+                            (long long)e->value);
+    }
+    return rc | outbuf_putc(ob, '}');
+}
+
+int trace_dump(int fd)
+{
+    struct trace_event *buf;
+    struct trace_ring *r;
+    struct outbuf ob;
+    double rate;
+    size_t i, n;
+    const char *sep = "\n";
+    int pid = (int)getpid();
+    int rc;
+    int err;
+
+    buf = malloc(TRACE_RING_EVENTS * sizeof(*buf));
+    if (buf == NULL) {
+        return -1;
+    }
+
+    pthread_once(&ring_once, ring_setup);
+    rate = clock_rate();
+
+    outbuf_init(&ob, fd, 0);
+    rc = outbuf_puts(&ob, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    pthread_mutex_lock(&rings_lock);
+    for (r = rings; r && rc == 0; r = r->next) {
+        if (r->name[0]) {
+            rc |= outbuf_puts(&ob, sep);
+            rc |= outbuf_printf(&ob, "{\"name\":\"thread_name\","
+                                "\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+                                "\"args\":{\"name\":", pid, r->tid);
+            rc |= put_string(&ob, r->name);
+            rc |= outbuf_puts(&ob, "}}");
+            sep = ",\n";
+        }
+
+        n = ring_snapshot(r, buf);
+        for (i = 0; i < n && rc == 0; i++) {
+            double us = ((double)buf[i].ts - (double)epoch_ticks) / rate / 1e3;
+
+            rc |= outbuf_puts(&ob, sep);
+            rc |= put_event(&ob, &buf[i], pid, us);
+            sep = ",\n";
+        }
+    }
+    pthread_mutex_unlock(&rings_lock);
+
+    rc |= outbuf_puts(&ob, "\n]}\n");
+    rc |= outbuf_flush(&ob);
+
+    err = errno;
+    outbuf_destroy(&ob);
+    free(buf);
+    errno = err;
+    return rc ? -1 : 0;
+}
+
+int trace_dump_file(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int rc, err;
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    rc = trace_dump(fd);
+    err = errno;
+    if (close(fd) && rc == 0) {
+        return -1;
+    }
+    errno = err;
+    return rc;
+}
@@ -0,0 +1,184 @@
+/**********************************************************************
+ * Low overhead event tracing
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * TRACE_BEGIN and TRACE_END record timestamped events into a ring
+ * buffer owned by the calling thread, so recording an event takes no
+ * locks and touches no shared cache lines. Each ring keeps the most
+ * recent TRACE_RING_EVENTS events of its thread, overwriting the oldest
+ * ones, which makes it suitable for leaving enabled as a flight
+ * recorder. trace_dump writes the contents of every ring in the Chrome
+ * trace event format, which can be loaded into chrome://tracing or
+ * Perfetto.
+ *
+ * Timestamps come from the TSC on x86 and the virtual counter on
+ * AArch64, and are converted to wall time when dumping. Elsewhere they
+ * come from CLOCK_MONOTONIC.
+ *
+ * Event names must be string literals, or otherwise stay valid until
+ * the last dump, since only the pointer is recorded.
+ *
+ * Defining TRACE_DISABLE before including this file turns all the
+ * TRACE_* macros into no-ops, without evaluating their arguments. The
+ * rings are shared by all code in the process, C and C++ alike.
+ *
+ * Usage:
+ *      TRACE_BEGIN("parse");
+ *      ...
+ *      TRACE_END("parse");
+ *      trace_dump_file("trace.json");
+ *********************************************************************/
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cdecl.h"
+#include "compiler.h"
+
+#if !defined(__x86_64__) && !defined(__i386__) && !defined(__aarch64__)
+#include <time.h>
+#endif
+
+__CDECL_BEGIN
+
+/* Events kept per thread, must be a power of 2 */
+#ifndef TRACE_RING_EVENTS
+#define TRACE_RING_EVENTS   16384
+#endif
+
+/* Event types, as Chrome trace phases */
+#define TRACE_PHASE_BEGIN   'B'
+#define TRACE_PHASE_END     'E'
+#define TRACE_PHASE_INSTANT 'i'
+#define TRACE_PHASE_COUNTER 'C'
+
+struct trace_event {
+    uint64_t ts;                /* Raw clock value */
+    const char *name;
+    int64_t value;              /* Counter value */
+    uint32_t tid;               /* Thread that recorded the event */
+    uint32_t phase;             /* TRACE_PHASE_* */
+};
+
+struct trace_ring {
+    uint64_t head;              /* Number of events ever recorded */
+    uint32_t tid;
+    int exited;                 /* Owner has exited, ring can be reused */
+    struct trace_ring *next;    /* All rings, newest first */
+    char name[32];              /* Thread name, if set */
+    struct trace_event events[TRACE_RING_EVENTS] __CACHELINE_ALIGNED;
+};
+
+/* Calling thread's ring, or NULL before its first event */
+extern __thread struct trace_ring *__trace_ring;
+extern int __trace_enabled;
+
+/* Set up a ring for the calling thread. Returns NULL if out of memory */
+struct trace_ring *__trace_attach(void);
+
+/* Raw timestamp, converted to time by trace_dump */
+static __ALWAYS_INLINE uint64_t __trace_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t t;
+
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static __ALWAYS_INLINE void __trace_event(const char *name, uint32_t phase,
+                                          int64_t value)
+{
+    struct trace_ring *r = __trace_ring;
+    struct trace_event *e;
+    uint64_t head;
+
+    if (__UNLIKELY(!__atomic_load_n(&__trace_enabled, __ATOMIC_RELAXED))) {
+        return;
+    }
+    if (__UNLIKELY(r == NULL)) {
+        r = __trace_attach();
+        if (r == NULL) {
+            return;
+        }
+    }
+
+    /*
+     * Only this thread writes the ring. The fence keeps the slot writes
+     * from becoming visible before the previous event was published, so
+     * a concurrent trace_dump can tell which slots it may have read
+     * while they were being overwritten.
+     */
+    head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    e = &r->events[head & (TRACE_RING_EVENTS - 1)];
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&e->ts, __trace_clock(), __ATOMIC_RELAXED);
+    __atomic_store_n(&e->name, name, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->value, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->tid, r->tid, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->phase, phase, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#ifndef TRACE_DISABLE
+#define TRACE_BEGIN(name)   __trace_event((name), TRACE_PHASE_BEGIN, 0)
+#define TRACE_END(name)     __trace_event((name), TRACE_PHASE_END, 0)
+#define TRACE_INSTANT(name) __trace_event((name), TRACE_PHASE_INSTANT, 0)
+#define TRACE_COUNTER(name, value) \
+    __trace_event((name), TRACE_PHASE_COUNTER, (int64_t)(value))
+#else
+#define TRACE_BEGIN(name)           ((void)0)
+#define TRACE_END(name)             ((void)0)
+#define TRACE_INSTANT(name)         ((void)0)
+#define TRACE_COUNTER(name, value)  ((void)0)
+#endif
+
+/* Turn recording on or off at run time. It starts out on */
+void trace_set_enabled(int enabled);
+
+/* Name the calling thread in dumps. The name is truncated to 31 bytes */
+void trace_set_thread_name(const char *name);
+
+/*
+ * Write all recorded events to fd as Chrome trace JSON. Events recorded
+ * while the dump runs may be left out, and so may the oldest events of
+ * threads that overwrite them meanwhile. Returns 0, or -1 with errno set.
+ */
+int trace_dump(int fd);
+
+/* As trace_dump, creating or truncating the file at path */
+int trace_dump_file(const char *path);
+
+__CDECL_END
+
+#ifdef __cplusplus
+
+namespace lub {
+
+/* Records a begin event now and the matching end event at scope exit */
+class trace_scope {
+    const char *name;
+
+public:
+    explicit trace_scope(const char *n) : name(n) { TRACE_BEGIN(name); }
+    ~trace_scope() { TRACE_END(name); }
+
+    trace_scope(const trace_scope &) = delete;
+    trace_scope &operator=(const trace_scope &) = delete;
+};
+
+} /* namespace lub */
+#endif /* __cplusplus */
+
+#endif /* !defined __TRACE_H */
@@ -0,0 +1,887 @@
+/**********************************************************************
+ * Asynchronous I/O with io_uring
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Each request is a small record from a struct pool, holding the
+ * callback, whose address is the user data of its submission queue
+ * entry. Entries are written straight into the shared ring and the tail
+ * is published after each, but io_uring_enter is only called to submit
+ * them in a batch, or when the ring is full.
+ *
+ * The thread pool backend keeps queued requests on a list until they
+ * are submitted, then runs each as a threadpool task. Finished requests
+ * go on a completed list under a lock, and the waiting thread is woken
+ * through a condition variable and an eventfd, for uring_fd.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "compiler.h"
+#include "pool.h"
+#include "threadpool.h"
+#include "uring.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+/* Multishot requests and cancelling by descriptor need 6.0 headers */
+#if defined(IORING_ASYNC_CANCEL_FD) && defined(__NR_io_uring_setup)
+#define HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+/* Threads for the thread pool backend, which spend most time blocked */
+#define FALLBACK_THREADS    16
+
+enum { OP_READ, OP_WRITE, OP_FSYNC, OP_FDATASYNC };
+
+struct request {
+    uring_fn fn;
+    void *arg;
+
+    /* Thread pool backend only */
+    struct request *next;
+    struct uring *u;
+    void *buf;
+    size_t len;
+    uint64_t offset;
+    int fd;
+    int op;
+    int res;
+};
+
+struct uring {
+    int fd;                     /* Ring, or eventfd for the thread pool */
+    int threads;
+    unsigned int pending;
+    struct pool requests;
+
+#ifdef HAVE_IO_URING
+    /* Submission queue */
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int to_submit;
+    struct io_uring_sqe *sqes;
+
+    /* Completion queue */
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *ring;
+    size_t ring_size;
+    size_t sqes_size;
+
+    /* Registered file index plus one for each descriptor, or 0 */
+    unsigned int *files;
+    size_t nfiles;
+
+    /* Provided buffers for multishot recv */
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    char *bufs;
+    size_t buf_size;
+    unsigned int buf_count;
+    uint16_t buf_tail;
+#endif
+
+    /* Thread pool backend */
+    struct threadpool *tp;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct request *queued;
+    struct request **queued_tail;
+    struct request *completed;
+    struct request **completed_tail;
+    unsigned int ncompleted;
+};
+
+static struct request *request_new(struct uring *u, uring_fn fn, void *arg)
+{
+    struct request *r = pool_alloc(&u->requests);
+
+    if (r == NULL) {
+        return NULL;
+    }
+    r->fn = fn;
+    r->arg = arg;
+    u->pending++;
+    return r;
+}
+
+static void request_done(struct uring *u, struct request *r)
+{
+    pool_free(&u->requests, r);
+    u->pending--;
+}
+
+/**********************************************************************
+ * Thread pool backend
+ *********************************************************************/
+static void threads_run(void *arg)
+{
+    struct request *r = arg;
+    struct uring *u = r->u;
+    uint64_t one = 1;
+    ssize_t rc;
+
+    switch (r->op) {
+    case OP_READ:
+        rc = pread(r->fd, r->buf, r->len, (off_t)r->offset);
+        break;
+    case OP_WRITE:
+        rc = pwrite(r->fd, r->buf, r->len, (off_t)r->offset);
+        break;
+    case OP_FSYNC:
+        rc = fsync(r->fd);
+        break;
+    default:
+        rc = fdatasync(r->fd);
+        break;
+    }
+    r->res = rc < 0 ? -errno : (int)rc;
+
+    pthread_mutex_lock(&u->lock);
+    r->next = NULL;
+    *u->completed_tail = r;
+    u->completed_tail = &r->next;
+    u->ncompleted++;
+    pthread_cond_signal(&u->cond);
+    pthread_mutex_unlock(&u->lock);
+
+    while (write(u->fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+static int threads_queue(struct uring *u, int op, int fd, void *buf,
+                         size_t len, uint64_t offset, uring_fn fn,
+                         void *arg)
+{
+    struct request *r = request_new(u, fn, arg);
+
+    if (r == NULL) {
+        return -1;
+    }
+    r->u = u;
+    r->op = op;
+    r->fd = fd;
+    r->buf = buf;
+    r->len = len;
+    r->offset = offset;
+    r->next = NULL;
+    *u->queued_tail = r;
+    u->queued_tail = &r->next;
+    return 0;
+}
+
+static int threads_submit(struct uring *u)
+{
+    struct request *r;
+
+    /* Unlink r first: once submitted, its next field is the worker's */
+    while ((r = u->queued) != NULL) {
+        u->queued = r->next;
+        if (threadpool_submit(u->tp, threads_run, r)) {
+            u->queued = r;
+            return -1;
+        }
+        if (u->queued == NULL) {
+            u->queued_tail = &u->queued;
+        }
+    }
+    return 0;
+}
+
+static int threads_wait(struct uring *u, unsigned int min)
+{
+    struct request *r, *next;
+    unsigned int inflight;
+    uint64_t count;
+    int n = 0;
+
+    if (threads_submit(u)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&u->lock);
+    inflight = u->pending;
+    if (min > inflight) {
+        min = inflight;
+    }
+    while (u->ncompleted < min) {
+        pthread_cond_wait(&u->cond, &u->lock);
+    }
+    r = u->completed;
+    u->completed = NULL;
+    u->completed_tail = &u->completed;
+    u->ncompleted = 0;
+    pthread_mutex_unlock(&u->lock);
+
+    /* EAGAIN just means the workers have not written it yet */
+    while (read(u->fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+    }
+
+    for (; r != NULL; r = next) {
+        next = r->next;
+        r->fn(u, r->res, NULL, 0, r->arg);
+        request_done(u, r);
+        n++;
+    }
+    return n;
+}
+
+static int threads_create(struct uring *u)
+{
+    u->threads = 1;
+    u->queued_tail = &u->queued;
+    u->completed_tail = &u->completed;
+    u->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (u->fd < 0) {
+        return -1;
+    }
+    u->tp = threadpool_create(FALLBACK_THREADS);
+    if (u->tp == NULL) {
+        close(u->fd);
+        return -1;
+    }
+    pthread_mutex_init(&u->lock, NULL);
+    pthread_cond_init(&u->cond, NULL);
+    return 0;
+}
+
+/**********************************************************************
+ * io_uring backend
+ *********************************************************************/
+#ifdef HAVE_IO_URING
+static int ring_enter(struct uring *u, unsigned int wait)
+{
+    long rc;
+
+    for (;;) {
+        rc = syscall(__NR_io_uring_enter, u->fd, u->to_submit, wait,
+                     wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (rc >= 0) {
+            u->to_submit -= (unsigned int)rc;
+            return 0;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+/* A cleared entry at the tail of the submission queue, or NULL */
+static struct io_uring_sqe *ring_sqe(struct uring *u)
+{
+    unsigned int tail = *u->sq_tail;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >=
+        u->sq_entries) {
+        if (ring_enter(u, 0) ||
+            tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >=
+            u->sq_entries) {
+            errno = EBUSY;
+            return NULL;
+        }
+    }
+    sqe = &u->sqes[tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+/* Publish the entry from ring_sqe */
+static void ring_push(struct uring *u)
+{
+    __atomic_store_n(u->sq_tail, *u->sq_tail + 1, __ATOMIC_RELEASE);
+    u->to_submit++;
+}
+
+static void ring_set_fd(struct uring *u, struct io_uring_sqe *sqe, int fd)
+{
+    if (fd >= 0 && (size_t)fd < u->nfiles && u->files[fd] != 0) {
+        sqe->fd = (int)u->files[fd] - 1;
+        sqe->flags |= IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = fd;
+    }
+}
+
+/* Queue a request, leaving the entry to be filled in by the caller */
+static struct io_uring_sqe *ring_queue(struct uring *u, int opcode, int fd,
+                                       uring_fn fn, void *arg)
+{
+    struct io_uring_sqe *sqe = ring_sqe(u);
+    struct request *r;
+
+    if (sqe == NULL) {
+        return NULL;
+    }
+    r = request_new(u, fn, arg);
+    if (r == NULL) {
+        return NULL;
+    }
+    sqe->opcode = (uint8_t)opcode;
+    ring_set_fd(u, sqe, fd);
+    sqe->user_data = (uint64_t)(uintptr_t)r;
+    return sqe;
+}
+
+static int ring_wait(struct uring *u, unsigned int min)
+{
+    struct io_uring_cqe *cqe;
+    struct request *r;
+    unsigned int head, flags, bid;
+    void *buf;
+    int n = 0, res;
+
+    if (min > u->pending) {
+        min = u->pending;
+    }
+    for (;;) {
+        head = *u->cq_head;
+        if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+            if ((unsigned int)n >= min && u->to_submit == 0) {
+                return n;
+            }
+            if (ring_enter(u, (unsigned int)n < min ? min - n : 0)) {
+                return -1;
+            }
+            continue;
+        }
+
+        /*
+         * Consume the entry before calling back, since the callback may
+         * wait on the ring itself.
+         */
+        cqe = &u->cqes[head & u->cq_mask];
+        r = (struct request *)(uintptr_t)cqe->user_data;
+        res = cqe->res;
+        flags = cqe->flags;
+        __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+        if (r == NULL) {
+            /* A cancellation, which has no callback */
+            continue;
+        }
+
+        buf = NULL;
+        if (flags & IORING_CQE_F_BUFFER) {
+            bid = flags >> IORING_CQE_BUFFER_SHIFT;
+            buf = u->bufs + (size_t)bid * u->buf_size;
+        }
+        r->fn(u, res, buf, (flags & IORING_CQE_F_MORE) ? URING_MORE : 0,
+              r->arg);
+        if (!(flags & IORING_CQE_F_MORE)) {
+            request_done(u, r);
+        }
+        n++;
+    }
+}
+
+static void ring_unmap(struct uring *u)
+{
+    if (u->ring) {
+        munmap(u->ring, u->ring_size);
+    }
+    if (u->sqes) {
+        munmap(u->sqes, u->sqes_size);
+    }
+}
+
+/* Returns 0, or -1 with errno set */
+static int ring_create(struct uring *u, unsigned int entries)
+{
+    struct io_uring_params p;
+    size_t sq_size, cq_size;
+    unsigned int i, *array;
+    char *ring;
+
+    /*
+     * No IORING_SETUP_COOP_TASKRUN: completions it defers are not posted
+     * while the thread sleeps in epoll_wait on uring_fd.
+     */
+    memset(&p, 0, sizeof(p));
+    u->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (u->fd < 0) {
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(u->fd);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    u->ring = ring == MAP_FAILED ? NULL : ring;
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+    }
+    if (u->ring == NULL || u->sqes == NULL) {
+        int err = errno;
+
+        ring_unmap(u);
+        close(u->fd);
+        errno = err;
+        return -1;
+    }
+
+    u->sq_head = (unsigned int *)(ring + p.sq_off.head);
+    u->sq_tail = (unsigned int *)(ring + p.sq_off.tail);
+    u->sq_mask = *(unsigned int *)(ring + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    u->cq_head = (unsigned int *)(ring + p.cq_off.head);
+    u->cq_tail = (unsigned int *)(ring + p.cq_off.tail);
+    u->cq_mask = *(unsigned int *)(ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+
+    /* Entries are used in order, so the index array never changes */
+    array = (unsigned int *)(ring + p.sq_off.array);
+    for (i = 0; i < p.sq_entries; i++) {
+        array[i] = i;
+    }
+    return 0;
+}
+
+static int ring_register(struct uring *u, unsigned int opcode,
+                         const void *arg, unsigned int n)
+{
+    return (int)syscall(__NR_io_uring_register, u->fd, opcode, arg, n);
+}
+#endif /* HAVE_IO_URING */
+
+/**********************************************************************
+ * Interface
+ *********************************************************************/
+struct uring *uring_create(unsigned int entries, unsigned int flags)
+{
+    struct uring *u = calloc(1, sizeof(*u));
+    int rc = -1;
+
+    if (u == NULL) {
+        return NULL;
+    }
+    if (pool_init(&u->requests, sizeof(struct request), 0)) {
+        free(u);
+        return NULL;
+    }
+
+#ifdef HAVE_IO_URING
+    if (!(flags & URING_THREADS)) {
+        rc = ring_create(u, entries ? entries : 1);
+        if (rc && errno != ENOSYS && errno != EPERM && errno != EACCES) {
+            goto error;
+        }
+    }
+#else
+    (void)entries;
+    (void)flags;
+#endif
+    if (rc && threads_create(u)) {
+        goto error;
+    }
+    return u;
+
+error:
+    {
+        int err = errno;
+
+        pool_destroy(&u->requests);
+        free(u);
+        errno = err;
+    }
+    return NULL;
+}
+
+void uring_destroy(struct uring *u)
+{
+    if (u == NULL) {
+        return;
+    }
+    if (u->threads) {
+        /* Queued requests were never started; drop them */
+        threadpool_destroy(u->tp);
+        pthread_cond_destroy(&u->cond);
+        pthread_mutex_destroy(&u->lock);
+    }
+#ifdef HAVE_IO_URING
+    else {
+        ring_unmap(u);
+        if (u->buf_ring) {
+            munmap(u->buf_ring, u->buf_ring_size);
+        }
+        free(u->bufs);
+        free(u->files);
+    }
+#endif
+    close(u->fd);
+    pool_destroy(&u->requests);
+    free(u);
+}
+
+const char *uring_backend(const struct uring *u)
+{
+    return u->threads ? "threads" : "io_uring";
+}
+
+int uring_fd(const struct uring *u)
+{
+    return u->fd;
+}
+
+unsigned int uring_pending(const struct uring *u)
+{
+    return u->pending;
+}
+
+static int rw(struct uring *u, int op, int fd, void *buf, size_t len,
+              uint64_t offset, int index, uring_fn fn, void *arg)
+{
+#ifdef HAVE_IO_URING
+    struct io_uring_sqe *sqe;
+    int opcode;
+#endif
+
+    /* The ring takes a 32-bit length; ask for less, as read(2) may give */
+    if (len > UINT32_MAX) {
+        len = UINT32_MAX;
+    }
+#ifdef HAVE_IO_URING
+    if (!u->threads) {
+        if (op == OP_READ) {
+            opcode = index >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        } else if (op == OP_WRITE) {
+            opcode = index >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        } else {
+            opcode = IORING_OP_FSYNC;
+        }
+        sqe = ring_queue(u, opcode, fd, fn, arg);
+        if (sqe == NULL) {
+            return -1;
+        }
+        sqe->addr = (uint64_t)(uintptr_t)buf;
+        sqe->len = (uint32_t)len;
+        sqe->off = offset;
+        if (index >= 0) {
+            sqe->buf_index = (uint16_t)index;
+        }
+        if (op == OP_FDATASYNC) {
+            sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        }
+        ring_push(u);
+        return 0;
+    }
+#else
+    (void)index;
+#endif
+    return threads_queue(u, op, fd, buf, len, offset, fn, arg);
+}
+
+int uring_read(struct uring *u, int fd, void *buf, size_t len,
+               uint64_t offset, uring_fn fn, void *arg)
+{
+    return rw(u, OP_READ, fd, buf, len, offset, -1, fn, arg);
+}
+
+int uring_write(struct uring *u, int fd, const void *buf, size_t len,
+                uint64_t offset, uring_fn fn, void *arg)
+{
+    return rw(u, OP_WRITE, fd, (void *)buf, len, offset, -1, fn, arg);
+}
+
+int uring_fsync(struct uring *u, int fd, int datasync, uring_fn fn,
+                void *arg)
+{
+    return rw(u, datasync ? OP_FDATASYNC : OP_FSYNC, fd, NULL, 0, 0, -1, fn,
+              arg);
+}
+
+int uring_read_fixed(struct uring *u, int fd, void *buf, size_t len,
+                     uint64_t offset, unsigned int index, uring_fn fn,
+                     void *arg)
+{
+    return rw(u, OP_READ, fd, buf, len, offset, (int)index, fn, arg);
+}
+
+int uring_write_fixed(struct uring *u, int fd, const void *buf, size_t len,
+                      uint64_t offset, unsigned int index, uring_fn fn,
+                      void *arg)
+{
+    return rw(u, OP_WRITE, fd, (void *)buf, len, offset, (int)index, fn,
+              arg);
+}
+
+int uring_accept_multishot(struct uring *u, int fd, uring_fn fn, void *arg)
+{
+#ifdef HAVE_IO_URING
+    struct io_uring_sqe *sqe;
+
+    if (!u->threads) {
+        sqe = ring_queue(u, IORING_OP_ACCEPT, fd, fn, arg);
+        if (sqe == NULL) {
+            return -1;
+        }
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        ring_push(u);
+        return 0;
+    }
+#else
+    (void)fd;
+    (void)fn;
+    (void)arg;
+#endif
+    (void)u;
+    errno = ENOSYS;
+    return -1;
+}
+
+int uring_recv_multishot(struct uring *u, int fd, uring_fn fn, void *arg)
+{
+#ifdef HAVE_IO_URING
+    struct io_uring_sqe *sqe;
+
+    if (!u->threads) {
+        if (u->buf_ring == NULL) {
+            errno = EINVAL;
+            return -1;
+        }
+        sqe = ring_queue(u, IORING_OP_RECV, fd, fn, arg);
+        if (sqe == NULL) {
+            return -1;
+        }
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0;
+        ring_push(u);
+        return 0;
+    }
+#else
+    (void)fd;
+    (void)fn;
+    (void)arg;
+#endif
+    (void)u;
+    errno = ENOSYS;
+    return -1;
+}
+
+int uring_cancel_fd(struct uring *u, int fd)
+{
+#ifdef HAVE_IO_URING
+    struct io_uring_sqe *sqe;
+
+    if (!u->threads) {
+        sqe = ring_sqe(u);
+        if (sqe == NULL) {
+            return -1;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        ring_set_fd(u, sqe, fd);
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        if (sqe->flags & IOSQE_FIXED_FILE) {
+            /* The fixed file is named by the cancel flags instead */
+            sqe->flags &= (uint8_t)~IOSQE_FIXED_FILE;
+            sqe->cancel_flags |= IORING_ASYNC_CANCEL_FD_FIXED;
+        }
+        ring_push(u);
+        return 0;
+    }
+#else
+    (void)fd;
+#endif
+    (void)u;
+    errno = ENOSYS;
+    return -1;
+}
+
+int uring_submit(struct uring *u)
+{
+#ifdef HAVE_IO_URING
+    if (!u->threads) {
+        return u->to_submit ? ring_enter(u, 0) : 0;
+    }
+#endif
+    return threads_submit(u);
+}
+
+int uring_wait(struct uring *u, unsigned int min)
+{
+#ifdef HAVE_IO_URING
+    if (!u->threads) {
+        return ring_wait(u, min);
+    }
+#endif
+    return threads_wait(u, min);
+}
+
+int uring_register_buffers(struct uring *u, const struct iovec *iov,
+                           unsigned int n)
+{
+#ifdef HAVE_IO_URING
+    if (!u->threads) {
+        /* Fails with ENXIO if there were none */
+        ring_register(u, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        if (n == 0) {
+            return 0;
+        }
+        return ring_register(u, IORING_REGISTER_BUFFERS, iov, n) < 0 ? -1 : 0;
+    }
+#else
+    (void)iov;
+    (void)n;
+#endif
+    (void)u;
+    return 0;
+}
+
+int uring_register_files(struct uring *u, const int *fds, unsigned int n)
+{
+#ifdef HAVE_IO_URING
+    unsigned int *files = NULL;
+    size_t nfiles = 0;
+    unsigned int i;
+
+    if (u->threads) {
+        return 0;
+    }
+    for (i = 0; i < n; i++) {
+        if (fds[i] >= 0 && (size_t)fds[i] >= nfiles) {
+            nfiles = (size_t)fds[i] + 1;
+        }
+    }
+    if (nfiles > 0) {
+        files = calloc(nfiles, sizeof(*files));
+        if (files == NULL) {
+            return -1;
+        }
+    }
+
+    ring_register(u, IORING_UNREGISTER_FILES, NULL, 0);
+    free(u->files);
+    u->files = NULL;
+    u->nfiles = 0;
+    if (n == 0) {
+        free(files);
+        return 0;
+    }
+    if (ring_register(u, IORING_REGISTER_FILES, fds, n) < 0) {
+        free(files);
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        if (fds[i] >= 0) {
+            files[fds[i]] = i + 1;
+        }
+    }
+    u->files = files;
+    u->nfiles = nfiles;
+#else
+    (void)u;
+    (void)fds;
+    (void)n;
+#endif
+    return 0;
+}
+
+int uring_provide_buffers(struct uring *u, unsigned int count, size_t size)
+{
+#ifdef HAVE_IO_URING
+    struct io_uring_buf_reg reg;
+    unsigned int i;
+
+    if (u->threads) {
+        errno = ENOSYS;
+        return -1;
+    }
+    if (count == 0 || count > 32768 || (count & (count - 1)) ||
+        size == 0 || size > UINT32_MAX || u->buf_ring != NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    u->buf_ring_size = count * sizeof(struct io_uring_buf);
+    u->buf_ring = mmap(NULL, u->buf_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->buf_ring == MAP_FAILED) {
+        u->buf_ring = NULL;
+        return -1;
+    }
+    u->bufs = malloc(count * size);
+    if (u->bufs == NULL) {
+        goto error;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)u->buf_ring;
+    reg.ring_entries = count;
+    reg.bgid = 0;
+    if (ring_register(u, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        goto error;
+    }
+
+    u->buf_size = size;
+    u->buf_count = count;
+    u->buf_tail = 0;
+    for (i = 0; i < count; i++) {
+        uring_buffer_release(u, u->bufs + (size_t)i * size);
+    }
+    return 0;
+
+error:
+    {
+        int err = errno;
+
+        free(u->bufs);
+        u->bufs = NULL;
+        munmap(u->buf_ring, u->buf_ring_size);
+        u->buf_ring = NULL;
+        errno = err;
+    }
+    return -1;
+#else
+    (void)u;
+    (void)count;
+    (void)size;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+void uring_buffer_release(struct uring *u, void *buf)
+{
+#ifdef HAVE_IO_URING
+    struct io_uring_buf *b;
+    size_t bid = (size_t)((char *)buf - u->bufs) / u->buf_size;
+
+    b = &u->buf_ring->bufs[u->buf_tail & (u->buf_count - 1)];
+    b->addr = (uint64_t)(uintptr_t)buf;
+    b->len = (uint32_t)u->buf_size;
+    b->bid = (uint16_t)bid;
+    u->buf_tail++;
+    __atomic_store_n(&u->buf_ring->tail, u->buf_tail, __ATOMIC_RELEASE);
+#else
+    (void)u;
+    (void)buf;
+#endif
+}
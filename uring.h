@@ -0,0 +1,294 @@
+/**********************************************************************
+ * Asynchronous I/O with io_uring
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * Requests are queued with one call each and handed to the kernel in
+ * batches, by uring_submit or uring_wait, so that a thousand reads cost
+ * one system call rather than a thousand. Each request carries a
+ * callback, which uring_wait (or uring_poll) calls on the thread that
+ * waits, with the result of the operation: a byte count or descriptor,
+ * or a negated errno value.
+ *
+ * The ring is driven with the raw system calls, so there is no
+ * dependency on liburing. Where io_uring is not available (old kernels,
+ * or disabled by seccomp or sysctl), reads, writes and syncs are run
+ * with pread, pwrite and fsync on a thread pool instead, with the same
+ * batching and callbacks. The socket operations (multishot accept and
+ * recv) need io_uring, and fail with ENOSYS without it; uring_backend
+ * tells which is in use.
+ *
+ * Registered files are used automatically: once a descriptor has been
+ * registered with uring_register_files, requests naming it use the
+ * registered file, which saves a file table lookup per request. The
+ * files must be unregistered before they are closed, or a descriptor
+ * reusing the number would be taken for the old file.
+ * Registered buffers have their own read and write calls, which save
+ * mapping the pages of the buffer for every request.
+ *
+ * A uring is not thread safe; each thread doing I/O should have its own.
+ *
+ * Usage:
+ *      static void done(struct uring *u, int res, void *buf,
+ *                       unsigned int flags, void *arg)
+ *      {
+ *          if (res < 0) {
+ *              ... -res is the errno value ...
+ *          }
+ *      }
+ *
+ *      u = uring_create(256, 0);
+ *      for (i = 0; i < n; i++) {
+ *          uring_read(u, fd, bufs[i], 4096, offsets[i], done, &ctx[i]);
+ *      }
+ *      while (uring_pending(u) > 0) {
+ *          uring_wait(u, 1);
+ *      }
+ *      uring_destroy(u);
+ *
+ * C++ code can use lub::uring, defined at the end of this file.
+ *********************************************************************/
+
+#ifndef __URING_H
+#define __URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+struct uring;
+
+/* uring_create flags */
+#define URING_THREADS       0x1     /* Use the thread pool backend */
+
+/* Completion flags */
+#define URING_MORE          0x1     /* A multishot request will go on */
+
+/*
+ * Completion callback. res is the result of the operation, or -errno.
+ * buf is the provided buffer holding the data of a multishot recv, which
+ * must be given back with uring_buffer_release, and NULL otherwise.
+ */
+typedef void (*uring_fn)(struct uring *u, int res, void *buf,
+                         unsigned int flags, void *arg);
+
+/*
+ * Create a ring of at least entries submission slots (rounded up to a
+ * power of two). Returns NULL with errno set on failure.
+ */
+struct uring *uring_create(unsigned int entries, unsigned int flags);
+
+/*
+ * Free the ring. Requests still in flight are cancelled without their
+ * callbacks being called, except on the thread pool backend, where they
+ * are waited for first.
+ */
+void uring_destroy(struct uring *u);
+
+/* "io_uring" or "threads" */
+const char *uring_backend(const struct uring *u);
+
+/*
+ * A descriptor that becomes readable when completions are waiting, for
+ * watching in an event loop that then calls uring_poll.
+ */
+int uring_fd(const struct uring *u);
+
+/*
+ * Queue a request. Each returns 0, or -1 with errno set to ENOMEM, or to
+ * EBUSY if the submission queue is full and could not be flushed. The
+ * callback is called once with the result, unless noted otherwise.
+ *
+ * Reads and writes move at most UINT32_MAX bytes, the most a ring entry
+ * holds; a longer request completes short, with either backend.
+ */
+int uring_read(struct uring *u, int fd, void *buf, size_t len,
+               uint64_t offset, uring_fn fn, void *arg);
+int uring_write(struct uring *u, int fd, const void *buf, size_t len,
+                uint64_t offset, uring_fn fn, void *arg);
+
+/* fsync, or fdatasync if datasync is nonzero */
+int uring_fsync(struct uring *u, int fd, int datasync, uring_fn fn,
+                void *arg);
+
+/* Reads and writes within registered buffer index */
+int uring_read_fixed(struct uring *u, int fd, void *buf, size_t len,
+                     uint64_t offset, unsigned int index, uring_fn fn,
+                     void *arg);
+int uring_write_fixed(struct uring *u, int fd, const void *buf, size_t len,
+                      uint64_t offset, unsigned int index, uring_fn fn,
+                      void *arg);
+
+/*
+ * Accept connections on a listening socket until an error occurs or the
+ * request is cancelled. The callback is called with each new descriptor
+ * (opened close-on-exec), with URING_MORE set while accepting goes on.
+ */
+int uring_accept_multishot(struct uring *u, int fd, uring_fn fn, void *arg);
+
+/*
+ * Receive from a socket into buffers taken from those set up with
+ * uring_provide_buffers, until end of file, an error, or cancellation.
+ * Each callback gets the byte count and the buffer. Running out of
+ * buffers ends the request with -ENOBUFS; it can then be started again.
+ */
+int uring_recv_multishot(struct uring *u, int fd, uring_fn fn, void *arg);
+
+/* Cancel every request on fd. Their callbacks get -ECANCELED */
+int uring_cancel_fd(struct uring *u, int fd);
+
+/*
+ * Hand every queued request to the kernel (or the thread pool). Returns
+ * 0, or -1 with errno set.
+ */
+int uring_submit(struct uring *u);
+
+/*
+ * Submit queued requests, wait until at least min have completed (or
+ * all that are in flight, if fewer), then call the callbacks of every
+ * completed request. Returns the number of callbacks called, or -1 with
+ * errno set.
+ */
+int uring_wait(struct uring *u, unsigned int min);
+
+/* uring_wait(u, 0): call the callbacks of completed requests, if any */
+static inline int uring_poll(struct uring *u)
+{
+    return uring_wait(u, 0);
+}
+
+/* Requests queued or in flight, counting multishot requests as one */
+unsigned int uring_pending(const struct uring *u);
+
+/*
+ * Register buffers for uring_read_fixed and uring_write_fixed, or files
+ * used in place of their descriptors, replacing any registered before.
+ * n of 0 unregisters. Returns 0, or -1 with errno set. The thread pool
+ * backend accepts both and ignores them.
+ */
+int uring_register_buffers(struct uring *u, const struct iovec *iov,
+                           unsigned int n);
+int uring_register_files(struct uring *u, const int *fds, unsigned int n);
+
+/*
+ * Set up count (a power of two up to 32768) buffers of size bytes for
+ * uring_recv_multishot. Returns 0, or -1 with errno set.
+ */
+int uring_provide_buffers(struct uring *u, unsigned int count, size_t size);
+
+/* Give a buffer from a multishot recv back to the kernel */
+void uring_buffer_release(struct uring *u, void *buf);
+
+__CDECL_END
+
+#ifdef __cplusplus
+#include <cerrno>
+#include <functional>
+#include <new>
+#include <system_error>
+
+namespace lub {
+
+/*
+ * Lambda friendly wrapper for struct uring, for reads, writes and syncs.
+ * Exceptions must not escape from the callbacks.
+ */
+class uring {
+public:
+    typedef std::function<void(int res)> handler;
+
+private:
+    struct ::uring *u;
+
+    static void call(struct ::uring *, int res, void *, unsigned int,
+                     void *arg) noexcept
+    {
+        handler *fn = static_cast<handler *>(arg);
+
+        (*fn)(res);
+        delete fn;
+    }
+
+    static int check(int rc, const char *what)
+    {
+        if (rc < 0) {
+            if (errno == ENOMEM) {
+                throw std::bad_alloc();
+            }
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+        return rc;
+    }
+
+    template <typename F>
+    void queue(F start, handler fn, const char *what)
+    {
+        handler *p = new handler(std::move(fn));
+        int rc = start(p);
+
+        if (rc < 0) {
+            int err = errno;
+
+            delete p;
+            errno = err;
+            check(rc, what);
+        }
+    }
+
+public:
+    explicit uring(unsigned int entries = 256, unsigned int flags = 0)
+        : u(uring_create(entries, flags))
+    {
+        if (u == nullptr) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "uring_create");
+        }
+    }
+
+    ~uring() { uring_destroy(u); }
+
+    uring(const uring &) = delete;
+    uring &operator=(const uring &) = delete;
+
+    void read(int fd, void *buf, size_t len, uint64_t offset, handler fn)
+    {
+        queue([&](handler *p) {
+            return uring_read(u, fd, buf, len, offset, call, p);
+        }, std::move(fn), "uring_read");
+    }
+
+    void write(int fd, const void *buf, size_t len, uint64_t offset,
+               handler fn)
+    {
+        queue([&](handler *p) {
+            return uring_write(u, fd, buf, len, offset, call, p);
+        }, std::move(fn), "uring_write");
+    }
+
+    void fsync(int fd, bool datasync, handler fn)
+    {
+        queue([&](handler *p) {
+            return uring_fsync(u, fd, datasync, call, p);
+        }, std::move(fn), "uring_fsync");
+    }
+
+    void submit() { check(uring_submit(u), "uring_submit"); }
+
+    int wait(unsigned int min = 1)
+    {
+        return check(uring_wait(u, min), "uring_wait");
+    }
+
+    int poll() { return check(uring_poll(u), "uring_poll"); }
+    unsigned int pending() const { return uring_pending(u); }
+    const char *backend() const { return uring_backend(u); }
+    struct ::uring *get() { return u; }
+};
+
+} /* namespace lub */
+#endif /* __cplusplus */
+
+#endif /* !defined __URING_H */
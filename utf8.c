@@ -0,0 +1,732 @@
+/**********************************************************************
+ * UTF-8 validation and transcoding
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * The vector validators look at every byte together with the three
+ * before it. Almost every error is visible in the first two bytes of a
+ * sequence, so the high nibble of the previous byte, its low nibble and
+ * the high nibble of the current byte are each looked up in a 16 entry
+ * table of error classes with a byte shuffle, and the three results are
+ * ANDed: a bit that survives is an error that all three nibbles agree
+ * on. The one thing two bytes cannot tell is whether a continuation
+ * byte is the third or fourth of a sequence, which is checked by
+ * looking two and three bytes back for a 3 or 4 byte lead.
+ *
+ * Blocks that are all ASCII skip the lookups, but still have to check
+ * that the block before did not end in the middle of a sequence. The
+ * tail of the input is copied into a zero filled block, whose padding
+ * then shows up a sequence cut short at the end like any other.
+ *
+ * The transcoders copy runs of ASCII a vector at a time and decode or
+ * encode everything else one character at a time.
+ *********************************************************************/
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include "compiler.h"
+#include "cpu_features.h"
+#include "utf8.h"
+
+#if defined(__x86_64__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+/* The table lookups need the AArch64 forms of TBL */
+#define HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/**********************************************************************
+ * Scalar
+ *********************************************************************/
+#define ASCII_MASK  0x8080808080808080ULL
+
+/* Decode one character, returning its length or 0 if malformed */
+static inline size_t decode(const unsigned char *p, size_t avail,
+                            uint32_t *cp)
+{
+    unsigned char c = p[0];
+    uint32_t v;
+
+    if (c < 0x80) {
+        *cp = c;
+        return 1;
+    }
+
+    /* Continuation bytes, and leads that could only be overlong */
+    if (c < 0xc2) {
+        return 0;
+    }
+
+    if (c < 0xe0) {
+        if (avail < 2 || (p[1] & 0xc0) != 0x80) {
+            return 0;
+        }
+        *cp = ((uint32_t)(c & 0x1f) << 6) | (p[1] & 0x3f);
+        return 2;
+    }
+
+    if (c < 0xf0) {
+        if (avail < 3 || (p[1] & 0xc0) != 0x80 || (p[2] & 0xc0) != 0x80) {
+            return 0;
+        }
+        v = ((uint32_t)(c & 0x0f) << 12) | ((uint32_t)(p[1] & 0x3f) << 6) |
+            (p[2] & 0x3f);
+        if (v < 0x800 || (v >= 0xd800 && v <= 0xdfff)) {
+            return 0;
+        }
+        *cp = v;
+        return 3;
+    }
+
+    if (c < 0xf5) {
+        if (avail < 4 || (p[1] & 0xc0) != 0x80 || (p[2] & 0xc0) != 0x80 ||
+            (p[3] & 0xc0) != 0x80) {
+            return 0;
+        }
+        v = ((uint32_t)(c & 0x07) << 18) | ((uint32_t)(p[1] & 0x3f) << 12) |
+            ((uint32_t)(p[2] & 0x3f) << 6) | (p[3] & 0x3f);
+        if (v < 0x10000 || v > 0x10ffff) {
+            return 0;
+        }
+        *cp = v;
+        return 4;
+    }
+
+    return 0;
+}
+
+/* Encode a valid code point, returning the number of bytes written */
+static inline size_t encode(uint32_t cp, unsigned char *out)
+{
+    if (cp < 0x80) {
+        out[0] = (unsigned char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (unsigned char)(0xc0 | (cp >> 6));
+        out[1] = (unsigned char)(0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (unsigned char)(0xe0 | (cp >> 12));
+        out[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (unsigned char)(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (unsigned char)(0xf0 | (cp >> 18));
+    out[1] = (unsigned char)(0x80 | ((cp >> 12) & 0x3f));
+    out[2] = (unsigned char)(0x80 | ((cp >> 6) & 0x3f));
+    out[3] = (unsigned char)(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+static int validate_scalar(const void *s, size_t len)
+{
+    const unsigned char *p = s;
+    const unsigned char *end = p + len;
+    uint64_t v;
+    uint32_t cp;
+    size_t n;
+
+    while (p < end) {
+        if (end - p >= 8) {
+            memcpy(&v, p, 8);
+            if ((v & ASCII_MASK) == 0) {
+                p += 8;
+                continue;
+            }
+        }
+        n = decode(p, (size_t)(end - p), &cp);
+        if (n == 0) {
+            return 0;
+        }
+        p += n;
+    }
+    return 1;
+}
+
+/**********************************************************************
+ * Lookup tables
+ *
+ * Each bit is a class of error, set in an entry if a byte pair with
+ * that nibble could be an instance of it.
+ *********************************************************************/
+#define TOO_SHORT       (1 << 0)    /* 11______ 0_______, 11______ 11______ */
+#define TOO_LONG        (1 << 1)    /* 0_______ 10______ */
+#define OVERLONG_3      (1 << 2)    /* 11100000 100_____ */
+#define TOO_LARGE       (1 << 3)    /* 11110100 1001____, 11110101+ 10______ */
+#define SURROGATE       (1 << 4)    /* 11101101 101_____ */
+#define OVERLONG_2      (1 << 5)    /* 1100000_ 10______ */
+#define TOO_LARGE_1000  (1 << 6)    /* 11110101+ 1000____ */
+#define OVERLONG_4      (1 << 6)    /* 11110000 1000____ */
+#define TWO_CONTS       (1 << 7)    /* 10______ 10______ */
+#define CARRY           (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+#if defined(HAVE_X86) || defined(HAVE_NEON)
+/* Indexed by the high nibble of the first byte */
+static const uint8_t byte1_high[16] __ALIGNED(16) = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+/* Indexed by the low nibble of the first byte */
+static const uint8_t byte1_low[16] __ALIGNED(16) = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+/* Indexed by the high nibble of the second byte */
+static const uint8_t byte2_high[16] __ALIGNED(16) = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+        OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+/*
+ * Subtracted with saturation from the last bytes of a block, leaving a
+ * non-zero byte wherever a sequence starts that the block cannot hold
+ */
+static const uint8_t incomplete_max[32] __ALIGNED(32) = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xef, 0xdf, 0xbf,
+};
+#endif
+
+#ifdef HAVE_X86
+/**********************************************************************
+ * SSSE3
+ *********************************************************************/
+#define SSSE3 __attribute__((target("ssse3")))
+
+/* Baseline SSE2, for want of SSE4.1's ptest */
+static inline int sse2_is_zero(__m128i v)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) ==
+           0xffff;
+}
+
+static SSSE3 inline __m128i check_ssse3(__m128i input, __m128i prev)
+{
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+    __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+    __m128i b1h, b1l, b2h, special, must23;
+
+    b1h = _mm_shuffle_epi8(_mm_load_si128((const __m128i *)byte1_high),
+                           _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    b1l = _mm_shuffle_epi8(_mm_load_si128((const __m128i *)byte1_low),
+                           _mm_and_si128(prev1, nibble));
+    b2h = _mm_shuffle_epi8(_mm_load_si128((const __m128i *)byte2_high),
+                           _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    special = _mm_and_si128(_mm_and_si128(b1h, b1l), b2h);
+
+    /* Only 111_____ two back or 1111____ three back reach 0x80 */
+    must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(0x60)),
+                          _mm_subs_epu8(prev3, _mm_set1_epi8(0x70)));
+    must23 = _mm_and_si128(must23, _mm_set1_epi8((char)0x80));
+    return _mm_xor_si128(must23, special);
+}
+
+static SSSE3 int validate_ssse3(const void *s, size_t len)
+{
+    const unsigned char *p = s;
+    const unsigned char *end = p + len;
+    const __m128i max = _mm_load_si128((const __m128i *)(incomplete_max + 16));
+    __m128i error = _mm_setzero_si128();
+    __m128i incomplete = _mm_setzero_si128();
+    __m128i prev = _mm_setzero_si128();
+    __m128i input;
+    unsigned char tail[16];
+
+    for (; end - p >= 16; p += 16) {
+        input = _mm_loadu_si128((const __m128i *)p);
+        if (_mm_movemask_epi8(input) == 0) {
+            error = _mm_or_si128(error, incomplete);
+            incomplete = _mm_setzero_si128();
+        } else {
+            error = _mm_or_si128(error, check_ssse3(input, prev));
+            incomplete = _mm_subs_epu8(input, max);
+        }
+        prev = input;
+    }
+
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, p, (size_t)(end - p));
+    input = _mm_loadu_si128((const __m128i *)tail);
+    error = _mm_or_si128(error, check_ssse3(input, prev));
+
+    return sse2_is_zero(error);
+}
+
+/**********************************************************************
+ * AVX2
+ *********************************************************************/
+#define AVX2 __attribute__((target("avx2")))
+
+static AVX2 inline __m256i check_avx2(__m256i input, __m256i prev)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    __m256i carry = _mm256_permute2x128_si256(prev, input, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input, carry, 15);
+    __m256i prev2 = _mm256_alignr_epi8(input, carry, 14);
+    __m256i prev3 = _mm256_alignr_epi8(input, carry, 13);
+    __m256i b1h, b1l, b2h, special, must23;
+
+    b1h = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+                _mm_load_si128((const __m128i *)byte1_high)),
+            _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    b1l = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+                _mm_load_si128((const __m128i *)byte1_low)),
+            _mm256_and_si256(prev1, nibble));
+    b2h = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+                _mm_load_si128((const __m128i *)byte2_high)),
+            _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    special = _mm256_and_si256(_mm256_and_si256(b1h, b1l), b2h);
+
+    must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(0x60)),
+                             _mm256_subs_epu8(prev3, _mm256_set1_epi8(0x70)));
+    must23 = _mm256_and_si256(must23, _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must23, special);
+}
+
+static AVX2 int validate_avx2(const void *s, size_t len)
+{
+    const unsigned char *p = s;
+    const unsigned char *end = p + len;
+    const __m256i max = _mm256_load_si256((const __m256i *)incomplete_max);
+    __m256i error = _mm256_setzero_si256();
+    __m256i incomplete = _mm256_setzero_si256();
+    __m256i prev = _mm256_setzero_si256();
+    __m256i in0, in1;
+    unsigned char tail[32];
+
+    /* Two vectors per iteration, so ASCII text is tested 64 bytes at once */
+    for (; end - p >= 64; p += 64) {
+        in0 = _mm256_loadu_si256((const __m256i *)p);
+        in1 = _mm256_loadu_si256((const __m256i *)(p + 32));
+        if (_mm256_movemask_epi8(_mm256_or_si256(in0, in1)) == 0) {
+            error = _mm256_or_si256(error, incomplete);
+            incomplete = _mm256_setzero_si256();
+        } else {
+            error = _mm256_or_si256(error, check_avx2(in0, prev));
+            error = _mm256_or_si256(error, check_avx2(in1, in0));
+            incomplete = _mm256_subs_epu8(in1, max);
+        }
+        prev = in1;
+    }
+
+    if (end - p >= 32) {
+        in0 = _mm256_loadu_si256((const __m256i *)p);
+        error = _mm256_or_si256(error, check_avx2(in0, prev));
+        prev = in0;
+        p += 32;
+    }
+
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, p, (size_t)(end - p));
+    in0 = _mm256_loadu_si256((const __m256i *)tail);
+    error = _mm256_or_si256(error, check_avx2(in0, prev));
+
+    return _mm256_testz_si256(error, error);
+}
+#endif /* HAVE_X86 */
+
+#ifdef HAVE_NEON
+/**********************************************************************
+ * NEON
+ *********************************************************************/
+static inline uint8x16_t check_neon(uint8x16_t input, uint8x16_t prev)
+{
+    const uint8x16_t nibble = vdupq_n_u8(0x0f);
+    uint8x16_t prev1 = vextq_u8(prev, input, 15);
+    uint8x16_t prev2 = vextq_u8(prev, input, 14);
+    uint8x16_t prev3 = vextq_u8(prev, input, 13);
+    uint8x16_t b1h, b1l, b2h, special, must23;
+
+    b1h = vqtbl1q_u8(vld1q_u8(byte1_high), vshrq_n_u8(prev1, 4));
+    b1l = vqtbl1q_u8(vld1q_u8(byte1_low), vandq_u8(prev1, nibble));
+    b2h = vqtbl1q_u8(vld1q_u8(byte2_high), vshrq_n_u8(input, 4));
+    special = vandq_u8(vandq_u8(b1h, b1l), b2h);
+
+    must23 = vorrq_u8(vqsubq_u8(prev2, vdupq_n_u8(0x60)),
+                      vqsubq_u8(prev3, vdupq_n_u8(0x70)));
+    must23 = vandq_u8(must23, vdupq_n_u8(0x80));
+    return veorq_u8(must23, special);
+}
+
+static int validate_neon(const void *s, size_t len)
+{
+    const unsigned char *p = s;
+    const unsigned char *end = p + len;
+    const uint8x16_t max = vld1q_u8(incomplete_max + 16);
+    uint8x16_t error = vdupq_n_u8(0);
+    uint8x16_t incomplete = vdupq_n_u8(0);
+    uint8x16_t prev = vdupq_n_u8(0);
+    uint8x16_t input;
+    unsigned char tail[16];
+
+    for (; end - p >= 16; p += 16) {
+        input = vld1q_u8(p);
+        if (vmaxvq_u8(input) < 0x80) {
+            error = vorrq_u8(error, incomplete);
+            incomplete = vdupq_n_u8(0);
+        } else {
+            error = vorrq_u8(error, check_neon(input, prev));
+            incomplete = vqsubq_u8(input, max);
+        }
+        prev = input;
+    }
+
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, p, (size_t)(end - p));
+    input = vld1q_u8(tail);
+    error = vorrq_u8(error, check_neon(input, prev));
+
+    return vmaxvq_u8(error) == 0;
+}
+#endif /* HAVE_NEON */
+
+/**********************************************************************
+ * Dispatch
+ *********************************************************************/
+#if defined(HAVE_X86)
+#define VARIANTS(fn)                                \
+    __CPU_VARIANT(CPU_FEATURE_AVX2, fn##_avx2),     \
+    __CPU_VARIANT(CPU_FEATURE_SSSE3, fn##_ssse3),   \
+    __CPU_VARIANT(0, fn##_scalar)
+#elif defined(HAVE_NEON)
+#define VARIANTS(fn)                                \
+    __CPU_VARIANT(CPU_FEATURE_NEON, fn##_neon),     \
+    __CPU_VARIANT(0, fn##_scalar)
+#else
+#define VARIANTS(fn)                                \
+    __CPU_VARIANT(0, fn##_scalar)
+#endif
+
+__CPU_DISPATCH(int, utf8_validate, (const void *s, size_t len), (s, len),
+               VARIANTS(validate))
+
+const char *utf8_impl(void)
+{
+    const char *name = __CPU_SELECTED(utf8_validate)->name;
+
+    /* Variants are named <function>_<impl> */
+    return strrchr(name, '_') + 1;
+}
+
+/**********************************************************************
+ * ASCII runs
+ *
+ * Each returns the length of the run of ASCII at the start of s, having
+ * converted it to out. The vector loops are baseline SSE2 and NEON.
+ *********************************************************************/
+static size_t ascii_to_utf16(const unsigned char *s, size_t len,
+                             uint16_t *out)
+{
+    size_t i = 0;
+
+#if defined(HAVE_X86)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v;
+
+    for (; i + 16 <= len; i += 16) {
+        v = _mm_loadu_si128((const __m128i *)(s + i));
+        if (_mm_movemask_epi8(v)) {
+            break;
+        }
+        _mm_storeu_si128((__m128i *)(out + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i *)(out + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#elif defined(HAVE_NEON)
+    uint8x16_t v;
+
+    for (; i + 16 <= len; i += 16) {
+        v = vld1q_u8(s + i);
+        if (vmaxvq_u8(v) >= 0x80) {
+            break;
+        }
+        vst1q_u16(out + i, vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(out + i + 8, vmovl_high_u8(v));
+    }
+#endif
+
+    for (; i < len && s[i] < 0x80; i++) {
+        out[i] = s[i];
+    }
+    return i;
+}
+
+static size_t ascii_to_utf32(const unsigned char *s, size_t len,
+                             uint32_t *out)
+{
+    size_t i = 0;
+
+#if defined(HAVE_X86)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v, lo, hi;
+
+    for (; i + 16 <= len; i += 16) {
+        v = _mm_loadu_si128((const __m128i *)(s + i));
+        if (_mm_movemask_epi8(v)) {
+            break;
+        }
+        lo = _mm_unpacklo_epi8(v, zero);
+        hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *)(out + i + 4), _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *)(out + i + 8), _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128((__m128i *)(out + i + 12),
+                         _mm_unpackhi_epi16(hi, zero));
+    }
+#elif defined(HAVE_NEON)
+    uint8x16_t v;
+    uint16x8_t lo, hi;
+
+    for (; i + 16 <= len; i += 16) {
+        v = vld1q_u8(s + i);
+        if (vmaxvq_u8(v) >= 0x80) {
+            break;
+        }
+        lo = vmovl_u8(vget_low_u8(v));
+        hi = vmovl_high_u8(v);
+        vst1q_u32(out + i, vmovl_u16(vget_low_u16(lo)));
+        vst1q_u32(out + i + 4, vmovl_high_u16(lo));
+        vst1q_u32(out + i + 8, vmovl_u16(vget_low_u16(hi)));
+        vst1q_u32(out + i + 12, vmovl_high_u16(hi));
+    }
+#endif
+
+    for (; i < len && s[i] < 0x80; i++) {
+        out[i] = s[i];
+    }
+    return i;
+}
+
+static size_t utf16_to_ascii(const uint16_t *s, size_t len,
+                             unsigned char *out)
+{
+    size_t i = 0;
+
+#if defined(HAVE_X86)
+    const __m128i high = _mm_set1_epi16((short)0xff80);
+    __m128i lo, hi;
+
+    for (; i + 16 <= len; i += 16) {
+        lo = _mm_loadu_si128((const __m128i *)(s + i));
+        hi = _mm_loadu_si128((const __m128i *)(s + i + 8));
+        if (!sse2_is_zero(_mm_and_si128(_mm_or_si128(lo, hi), high))) {
+            break;
+        }
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(HAVE_NEON)
+    uint16x8_t lo, hi;
+
+    for (; i + 16 <= len; i += 16) {
+        lo = vld1q_u16(s + i);
+        hi = vld1q_u16(s + i + 8);
+        if (vmaxvq_u16(vorrq_u16(lo, hi)) >= 0x80) {
+            break;
+        }
+        vst1q_u8(out + i, vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+    }
+#endif
+
+    for (; i < len && s[i] < 0x80; i++) {
+        out[i] = (unsigned char)s[i];
+    }
+    return i;
+}
+
+static size_t utf32_to_ascii(const uint32_t *s, size_t len,
+                             unsigned char *out)
+{
+    size_t i = 0;
+
+#if defined(HAVE_X86)
+    const __m128i high = _mm_set1_epi32((int)0xffffff80);
+    __m128i a, b, c, d;
+
+    for (; i + 16 <= len; i += 16) {
+        a = _mm_loadu_si128((const __m128i *)(s + i));
+        b = _mm_loadu_si128((const __m128i *)(s + i + 4));
+        c = _mm_loadu_si128((const __m128i *)(s + i + 8));
+        d = _mm_loadu_si128((const __m128i *)(s + i + 12));
+        if (!sse2_is_zero(_mm_and_si128(
+                _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)), high))) {
+            break;
+        }
+        /* Values are below 0x80, so the signed saturating packs are exact */
+        _mm_storeu_si128((__m128i *)(out + i),
+                         _mm_packus_epi16(_mm_packs_epi32(a, b),
+                                          _mm_packs_epi32(c, d)));
+    }
+#elif defined(HAVE_NEON)
+    uint32x4_t a, b, c, d;
+
+    for (; i + 16 <= len; i += 16) {
+        a = vld1q_u32(s + i);
+        b = vld1q_u32(s + i + 4);
+        c = vld1q_u32(s + i + 8);
+        d = vld1q_u32(s + i + 12);
+        if (vmaxvq_u32(vorrq_u32(vorrq_u32(a, b), vorrq_u32(c, d))) >= 0x80) {
+            break;
+        }
+        vst1q_u8(out + i,
+                 vcombine_u8(vmovn_u16(vcombine_u16(vmovn_u32(a),
+                                                    vmovn_u32(b))),
+                             vmovn_u16(vcombine_u16(vmovn_u32(c),
+                                                    vmovn_u32(d)))));
+    }
+#endif
+
+    for (; i < len && s[i] < 0x80; i++) {
+        out[i] = (unsigned char)s[i];
+    }
+    return i;
+}
+
+/**********************************************************************
+ * Transcoding
+ *********************************************************************/
+ssize_t utf8_to_utf16(const char *s, size_t len, uint16_t *out)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    const unsigned char *end = p + len;
+    uint16_t *o = out;
+    uint32_t cp;
+    size_t n;
+
+    while (p < end) {
+        if (*p < 0x80) {
+            n = ascii_to_utf16(p, (size_t)(end - p), o);
+            p += n;
+            o += n;
+            continue;
+        }
+
+        n = decode(p, (size_t)(end - p), &cp);
+        if (n == 0) {
+            errno = EILSEQ;
+            return -1;
+        }
+        p += n;
+
+        if (cp < 0x10000) {
+            *o++ = (uint16_t)cp;
+        } else {
+            cp -= 0x10000;
+            *o++ = (uint16_t)(0xd800 | (cp >> 10));
+            *o++ = (uint16_t)(0xdc00 | (cp & 0x3ff));
+        }
+    }
+    return o - out;
+}
+
+ssize_t utf8_to_utf32(const char *s, size_t len, uint32_t *out)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    const unsigned char *end = p + len;
+    uint32_t *o = out;
+    size_t n;
+
+    while (p < end) {
+        if (*p < 0x80) {
+            n = ascii_to_utf32(p, (size_t)(end - p), o);
+            p += n;
+            o += n;
+            continue;
+        }
+
+        n = decode(p, (size_t)(end - p), o);
+        if (n == 0) {
+            errno = EILSEQ;
+            return -1;
+        }
+        p += n;
+        o++;
+    }
+    return o - out;
+}
+
+ssize_t utf16_to_utf8(const uint16_t *s, size_t len, char *out)
+{
+    unsigned char *o = (unsigned char *)out;
+    uint32_t cp;
+    size_t i = 0;
+    size_t n;
+
+    while (i < len) {
+        if (s[i] < 0x80) {
+            n = utf16_to_ascii(s + i, len - i, o);
+            i += n;
+            o += n;
+            continue;
+        }
+
+        cp = s[i++];
+        if (cp >= 0xd800 && cp <= 0xdfff) {
+            /* A high surrogate must be followed by a low one */
+            if (cp >= 0xdc00 || i == len || s[i] < 0xdc00 || s[i] > 0xdfff) {
+                errno = EILSEQ;
+                return -1;
+            }
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (s[i++] - 0xdc00);
+        }
+        o += encode(cp, o);
+    }
+    return o - (unsigned char *)out;
+}
+
+ssize_t utf32_to_utf8(const uint32_t *s, size_t len, char *out)
+{
+    unsigned char *o = (unsigned char *)out;
+    size_t i = 0;
+    size_t n;
+
+    while (i < len) {
+        if (s[i] < 0x80) {
+            n = utf32_to_ascii(s + i, len - i, o);
+            i += n;
+            o += n;
+            continue;
+        }
+
+        if (s[i] > 0x10ffff || (s[i] >= 0xd800 && s[i] <= 0xdfff)) {
+            errno = EILSEQ;
+            return -1;
+        }
+        o += encode(s[i++], o);
+    }
+    return o - (unsigned char *)out;
+}
@@ -0,0 +1,52 @@
+/**********************************************************************
+ * UTF-8 validation and transcoding
+ **********************************************************************
+ * Copyright (C) 2014 Nirenjan Krishnan (nirenjan@gmail.com)
+ *
+ * utf8_validate checks a buffer against the UTF-8 definition in the
+ * Unicode standard: no overlong forms, no surrogates, nothing above
+ * U+10FFFF and no truncated sequences. Kernels are provided for AVX2
+ * and SSSE3 on x86, and NEON on AArch64, using the lookup table method
+ * of J. Keiser and D. Lemire, "Validating UTF-8 In Less Than One
+ * Instruction Per Byte" (2021), with a portable scalar fallback. The
+ * best kernel for the running CPU is selected on the first call.
+ *
+ * The transcoders convert between UTF-8 and UTF-16 or UTF-32 in native
+ * byte order, copying runs of ASCII a vector at a time. They validate
+ * as they go, and fail with errno set to EILSEQ on malformed input,
+ * including unpaired surrogates in UTF-16. The output buffer must be
+ * large enough for the worst case, given with each function, and the
+ * number of code units written is returned.
+ *
+ * No function stops at NUL, which is a valid character.
+ *********************************************************************/
+
+#ifndef __UTF8_H
+#define __UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "cdecl.h"
+
+__CDECL_BEGIN
+
+/* Return 1 if s[0..len) is valid UTF-8, or 0 if not */
+int utf8_validate(const void *s, size_t len);
+
+/* out must have room for len units */
+ssize_t utf8_to_utf16(const char *s, size_t len, uint16_t *out);
+ssize_t utf8_to_utf32(const char *s, size_t len, uint32_t *out);
+
+/* out must have room for 3 * len bytes */
+ssize_t utf16_to_utf8(const uint16_t *s, size_t len, char *out);
+
+/* out must have room for 4 * len bytes */
+ssize_t utf32_to_utf8(const uint32_t *s, size_t len, char *out);
+
+/* Name of the validation kernel in use, e.g. "avx2" */
+const char *utf8_impl(void);
+
+__CDECL_END
+
+#endif /* !defined __UTF8_H */